@@ -1,7 +1,10 @@
 @pushd "%~dp0"
-@%VULKAN_SDK%\Bin32\glslangValidator.exe -V ..\src\shader.vert -o ..\src\vert.spv
-@%VULKAN_SDK%\Bin32\glslangValidator.exe -V ..\src\shader.frag -o ..\src\frag.spv
-@%VULKAN_SDK%\Bin32\glslangValidator.exe -V ..\src\line_shader.vert -o ..\src\line_vert.spv
-@%VULKAN_SDK%\Bin32\glslangValidator.exe -V ..\src\line_shader.frag -o ..\src\line_frag.spv
-@g++ -I%VULKAN_SDK%\Include -L%VULKAN_SDK%\Lib32 ..\src\maths.c ..\src\graphics.c ..\src\rng.c ..\src\main.c -o ..\bin\dungeon_gen.exe -lvulkan-1
+@%VULKAN_SDK%\Bin32\glslangValidator.exe -V --vn vert_spv ..\src\shader.vert -o ..\src\vert_spv.h
+@%VULKAN_SDK%\Bin32\glslangValidator.exe -V --vn frag_spv ..\src\shader.frag -o ..\src\frag_spv.h
+@%VULKAN_SDK%\Bin32\glslangValidator.exe -V --vn tile_vert_spv ..\src\tile_shader.vert -o ..\src\tile_vert_spv.h
+@%VULKAN_SDK%\Bin32\glslangValidator.exe -V --vn line_vert_spv ..\src\line_shader.vert -o ..\src\line_vert_spv.h
+@%VULKAN_SDK%\Bin32\glslangValidator.exe -V --vn line_frag_spv ..\src\line_shader.frag -o ..\src\line_frag_spv.h
+@%VULKAN_SDK%\Bin32\glslangValidator.exe -V --vn raster_tile_vert_spv ..\src\raster_tile_shader.vert -o ..\src\raster_tile_vert_spv.h
+@%VULKAN_SDK%\Bin32\glslangValidator.exe -V --vn tile_raster_comp_spv ..\src\tile_raster.comp -o ..\src\tile_raster_comp_spv.h
+@g++ -msse2 -mstackrealign -I%VULKAN_SDK%\Include -L%VULKAN_SDK%\Lib32 ..\src\maths.c ..\src\camera.c ..\src\tile_pyramid.c ..\src\graphics.c ..\src\rng.c ..\src\timer.c ..\src\dungeon.c ..\src\spatial.c ..\src\jobs.c ..\src\graph.c ..\src\bitgrid.c ..\src\validate.c ..\src\batch.c ..\src\mapped_file.c ..\src\dungeon_file.c ..\src\archive.c ..\src\codec.c ..\src\seed_file.c ..\src\cache.c ..\src\service.c ..\src\export.c ..\src\pipeline.c ..\src\dungeon_delta.c ..\src\dungeon_chunk.c ..\src\benchmark.c ..\src\main.c -o ..\bin\dungeon_gen.exe -lvulkan-1
 @popd
@@ -0,0 +1,195 @@
+#include "archive.h"
+
+void archive_path(char* path, const char* directory, const char* name)
+{
+	snprintf(path, ARCHIVE_PATH_SIZE, "%s/%s", directory, name);
+}
+
+void segment_path(char* path, const char* directory, uint32_t segment)
+{
+	snprintf(path, ARCHIVE_PATH_SIZE, "%s/segment_%05u.dat", directory, segment);
+}
+
+uint32_t seed_slot(uint64_t seed, uint32_t slot_count)
+{
+	return (uint32_t)((seed*0x9E3779B97F4A7C15ull) >> 32) & (slot_count - 1);
+}
+
+void append_entries(archive_entry** entries, int* count, int* capacity, const archive_entry* added, int added_count)
+{
+	if(*count + added_count > *capacity)
+	{
+		*capacity = max(*count + added_count, 2*(*capacity));
+		*entries = (archive_entry*)realloc(*entries, *capacity*sizeof(archive_entry));
+	}
+	memcpy(*entries + *count, added, added_count*sizeof(archive_entry));
+	*count += added_count;
+}
+
+bool open_archive(dungeon_archive* archive, const char* directory)
+{
+	*archive = {};
+	snprintf(archive->directory, ARCHIVE_PATH_SIZE, "%s", directory);
+	CreateDirectoryA(directory, NULL);
+	DWORD attributes = GetFileAttributesA(directory);
+	if(attributes == INVALID_FILE_ATTRIBUTES || !(attributes & FILE_ATTRIBUTE_DIRECTORY)) return false;
+	InitializeCriticalSection(&archive->entries_lock);
+
+	//Carry over what is already archived, new segments are numbered after the existing ones
+	archive_reader reader;
+	if(open_archive_reader(&reader, directory))
+	{
+		archive->segment_count = reader.header->segment_count;
+		for(uint32_t i = 0; i < reader.header->slot_count; i++)
+		{
+			if(reader.slots[i].size) append_entries(&archive->entries, &archive->entry_count, &archive->entry_capacity, &reader.slots[i], 1);
+		}
+		close_archive_reader(&reader);
+	}
+	return true;
+}
+
+bool close_archive(dungeon_archive* archive)
+{
+	uint32_t slot_count = 16;
+	while(slot_count < 2*(uint32_t)archive->entry_count) slot_count *= 2;
+	uint32_t size = sizeof(archive_index_header) + slot_count*sizeof(archive_entry);
+	char* index = (char*)calloc(size, 1);
+	archive_index_header* header = (archive_index_header*)index;
+	archive_entry* slots = (archive_entry*)(index + sizeof(archive_index_header));
+	header->magic = ARCHIVE_INDEX_MAGIC;
+	header->version = ARCHIVE_VERSION;
+	header->segment_count = archive->segment_count;
+	header->slot_count = slot_count;
+
+	//A seed archived again replaces its older entry
+	for(int i = 0; i < archive->entry_count; i++)
+	{
+		archive_entry* entry = &archive->entries[i];
+		uint32_t slot = seed_slot(entry->seed, slot_count);
+		while(slots[slot].size && slots[slot].seed != entry->seed) slot = (slot + 1) & (slot_count - 1);
+		header->entry_count += slots[slot].size == 0;
+		slots[slot] = *entry;
+	}
+
+	//Written beside the old index and swapped in, so readers never see half an index
+	char temporary_path[ARCHIVE_PATH_SIZE];
+	char index_path[ARCHIVE_PATH_SIZE];
+	archive_path(temporary_path, archive->directory, "index.tmp");
+	archive_path(index_path, archive->directory, "index.dat");
+	FILE* f = fopen(temporary_path, "wb");
+	bool written = f && fwrite(index, 1, size, f) == size;
+	if(f) written = (fclose(f) == 0) && written;
+	written = written && MoveFileExA(temporary_path, index_path, MOVEFILE_REPLACE_EXISTING);
+
+	free(index);
+	free(archive->entries);
+	DeleteCriticalSection(&archive->entries_lock);
+	*archive = {};
+	return written;
+}
+
+void open_archive_writer(archive_writer* writer, dungeon_archive* archive)
+{
+	*writer = {};
+	writer->archive = archive;
+}
+
+bool archive_dungeon(archive_writer* writer, dungeon* d, uint64_t seed, runtime_dungeon_config config)
+{
+	uint32_t size = dungeon_file_size(d);
+	if(size > writer->buffer_capacity)
+	{
+		writer->buffer_capacity = size;
+		writer->buffer = (char*)realloc(writer->buffer, size);
+	}
+	serialize_dungeon(d, seed, config, writer->buffer, size);
+
+	if(!writer->segment || writer->segment_size + size > ARCHIVE_SEGMENT_SIZE)
+	{
+		if(writer->segment) fclose(writer->segment);
+		char path[ARCHIVE_PATH_SIZE];
+		writer->segment_index = InterlockedIncrement(&writer->archive->segment_count) - 1;
+		writer->segment_size = 0;
+		segment_path(path, writer->archive->directory, writer->segment_index);
+		writer->segment = fopen(path, "wb");
+		if(!writer->segment) return false;
+	}
+	if(fwrite(writer->buffer, 1, size, writer->segment) != size)
+	{
+		//Part of the image may be in the segment, so nothing more goes after it and the next dungeon starts a new segment
+		fclose(writer->segment);
+		writer->segment = NULL;
+		return false;
+	}
+
+	archive_entry entry = {seed, writer->segment_index, writer->segment_size, size, 0};
+	append_entries(&writer->entries, &writer->entry_count, &writer->entry_capacity, &entry, 1);
+	writer->segment_size += size;
+	return true;
+}
+
+void close_archive_writer(archive_writer* writer)
+{
+	if(writer->segment) fclose(writer->segment);
+	dungeon_archive* archive = writer->archive;
+	EnterCriticalSection(&archive->entries_lock);
+	append_entries(&archive->entries, &archive->entry_count, &archive->entry_capacity, writer->entries, writer->entry_count);
+	LeaveCriticalSection(&archive->entries_lock);
+	free(writer->entries);
+	free(writer->buffer);
+	*writer = {};
+}
+
+bool open_archive_reader(archive_reader* reader, const char* directory)
+{
+	*reader = {};
+	char path[ARCHIVE_PATH_SIZE];
+	archive_path(path, directory, "index.dat");
+	if(!map_file(&reader->index, path)) return false;
+
+	const archive_index_header* header = (const archive_index_header*)reader->index.data;
+	bool valid = reader->index.size >= sizeof(archive_index_header) && header->magic == ARCHIVE_INDEX_MAGIC && header->version == ARCHIVE_VERSION;
+	valid = valid && header->slot_count && !(header->slot_count & (header->slot_count - 1));
+	valid = valid && (uint64_t)header->slot_count*sizeof(archive_entry) <= reader->index.size - sizeof(archive_index_header);
+	if(!valid)
+	{
+		unmap_file(&reader->index);
+		return false;
+	}
+	reader->header = header;
+	reader->slots = (const archive_entry*)((const char*)reader->index.data + sizeof(archive_index_header));
+
+	//Segments that failed to map are left empty and lookups into them fail
+	reader->segments = (mapped_file*)calloc(header->segment_count, sizeof(mapped_file));
+	for(uint32_t i = 0; i < header->segment_count; i++)
+	{
+		segment_path(path, directory, i);
+		map_file(&reader->segments[i], path);
+	}
+	return true;
+}
+
+void close_archive_reader(archive_reader* reader)
+{
+	for(uint32_t i = 0; i < reader->header->segment_count; i++) if(reader->segments[i].data) unmap_file(&reader->segments[i]);
+	free(reader->segments);
+	unmap_file(&reader->index);
+	*reader = {};
+}
+
+bool find_archived_dungeon(archive_reader* reader, uint64_t seed, dungeon_view* view)
+{
+	uint32_t mask = reader->header->slot_count - 1;
+	uint32_t slot = seed_slot(seed, reader->header->slot_count);
+	for(uint32_t probe = 0; probe < reader->header->slot_count && reader->slots[slot].size; probe++, slot = (slot + 1) & mask)
+	{
+		const archive_entry* entry = &reader->slots[slot];
+		if(entry->seed != seed) continue;
+		if(entry->segment >= reader->header->segment_count) return false;
+		mapped_file* segment = &reader->segments[entry->segment];
+		if(!segment->data || entry->offset > segment->size || entry->size > segment->size - entry->offset) return false;
+		return open_dungeon_view(view, (const char*)segment->data + entry->offset, entry->size);
+	}
+	return false;
+}
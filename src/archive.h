@@ -0,0 +1,84 @@
+#pragma once
+#include <windows.h>
+#include <stdio.h>
+#include "dungeon_file.h"
+
+#define ARCHIVE_INDEX_MAGIC 0x58444E49 //"INDX"
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_SEGMENT_SIZE (256u << 20) //Writers start a new segment rather than grow one past this
+#define ARCHIVE_PATH_SIZE 260
+
+//An archive is a directory of segment files holding dungeon file images back to back, and one index file
+//Each writer appends to segments of its own, so writers on different threads never share a file
+//The index is an open addressing hash table keyed by seed, rewritten whole when the archive is closed
+//Nothing archived since the archive was opened is indexed until then, a process that ends without close_archive() loses those dungeons
+//A failed write leaves its segment with a partial image at the end, which no entry points at
+
+struct archive_entry
+{
+	uint64_t seed;
+	uint32_t segment;
+	uint32_t offset; //Dungeon file image starts here in the segment, aligned to DUNGEON_FILE_ALIGNMENT
+	uint32_t size; //0 for empty slots
+	uint32_t reserved;
+};
+
+struct archive_index_header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t segment_count;
+	uint32_t entry_count;
+	uint32_t slot_count; //Power of two, slots follow the header
+	uint32_t reserved;
+};
+
+struct dungeon_archive
+{
+	char directory[ARCHIVE_PATH_SIZE];
+	volatile LONG segment_count;
+
+	//Entries from closed writers and from the index the archive was opened with
+	CRITICAL_SECTION entries_lock;
+	archive_entry* entries;
+	int entry_count;
+	int entry_capacity;
+};
+
+struct archive_writer
+{
+	dungeon_archive* archive;
+	FILE* segment;
+	uint32_t segment_index;
+	uint32_t segment_size;
+
+	archive_entry* entries;
+	int entry_count;
+	int entry_capacity;
+
+	char* buffer; //Scratch for serializing each dungeon
+	uint32_t buffer_capacity;
+};
+
+struct archive_reader
+{
+	mapped_file index;
+	const archive_index_header* header;
+	const archive_entry* slots;
+	mapped_file* segments;
+};
+
+//Creates the directory if needed, dungeons already in the archive stay in it
+bool open_archive(dungeon_archive*, const char* directory);
+//Writes the index, every writer must be closed first
+bool close_archive(dungeon_archive*);
+
+void open_archive_writer(archive_writer*, dungeon_archive*);
+//False if the dungeon wasn't written, the writer can carry on with the next one
+bool archive_dungeon(archive_writer*, dungeon*, uint64_t seed, runtime_dungeon_config);
+void close_archive_writer(archive_writer*);
+
+//Maps the index and every segment, lookups are then safe from any number of threads
+bool open_archive_reader(archive_reader*, const char* directory);
+void close_archive_reader(archive_reader*);
+bool find_archived_dungeon(archive_reader*, uint64_t seed, dungeon_view*);
@@ -0,0 +1,422 @@
+#include "batch.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define LANE_RNG_MULTIPLIER 1103515245u
+#define LANE_RNG_INCREMENT 12345u
+
+void seed_lane_rng(lane_rng* rng, const uint32_t* seeds, uint32_t stream)
+{
+	//Consecutive seeds would otherwise give lanes with correlated low bits
+	for(int lane = 0; lane < BATCH_LANES; lane++)
+	{
+		uint32_t mixed = seeds[lane] + 0x9E3779B9u*(stream + 1);
+		mixed = (mixed ^ (mixed >> 16))*0x85EBCA6Bu;
+		mixed = (mixed ^ (mixed >> 13))*0xC2B2AE35u;
+		rng->state[lane] = mixed ^ (mixed >> 16);
+	}
+}
+
+#ifdef __SSE2__
+//SSE2 has no 32 bit multiply, so the even and odd lanes are multiplied as 64 bit and interleaved back together
+__m128i multiply_lanes(__m128i a, __m128i b)
+{
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+__m128i select_lanes(__m128i mask, __m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+//lane_range() for four lanes
+__m128i range_lanes(__m128i values, __m128i min, __m128i max)
+{
+	__m128i range = _mm_sub_epi32(max, min);
+	range = _mm_and_si128(range, _mm_cmpgt_epi32(range, _mm_setzero_si128()));
+	return _mm_add_epi32(min, _mm_srli_epi32(multiply_lanes(values, range), 15));
+}
+#endif
+
+void next_lane_rng(lane_rng* rng, uint32_t* values)
+{
+#ifdef __SSE2__
+	__m128i multiplier = _mm_set1_epi32(LANE_RNG_MULTIPLIER);
+	__m128i increment = _mm_set1_epi32(LANE_RNG_INCREMENT);
+	__m128i mask = _mm_set1_epi32(0x7FFF);
+	for(int lane = 0; lane < BATCH_LANES; lane += 4)
+	{
+		__m128i state = _mm_loadu_si128((__m128i*)(rng->state + lane));
+		state = _mm_add_epi32(multiply_lanes(state, multiplier), increment);
+		_mm_storeu_si128((__m128i*)(rng->state + lane), state);
+		_mm_storeu_si128((__m128i*)(values + lane), _mm_and_si128(_mm_srli_epi32(state, 16), mask));
+	}
+#else
+	for(int lane = 0; lane < BATCH_LANES; lane++) values[lane] = next_lane_rng(rng, lane);
+#endif
+}
+
+uint32_t next_lane_rng(lane_rng* rng, int lane)
+{
+	rng->state[lane] = rng->state[lane]*LANE_RNG_MULTIPLIER + LANE_RNG_INCREMENT;
+	return (rng->state[lane] >> 16) & 0x7FFF;
+}
+
+//Maps a 15 bit value into [min, max) with a multiply instead of a divide, min if the range is empty
+int lane_range(uint32_t value, int min, int max)
+{
+	int range = (max > min) ? max - min : 0;
+	return min + (int)((value*(uint32_t)range) >> 15);
+}
+
+void create_dungeon_batch(dungeon_batch* batch, runtime_dungeon_config config)
+{
+	//Every partition is at least min_room+1 tiles across, which bounds how many leaves fit on the map
+	int max_leaves = (config.width/(config.min_room + 1) + 1)*(config.height/(config.min_room + 1) + 1);
+	int table_size = 2*max_leaves*BATCH_LANES;
+	*batch = {};
+	batch->config = config;
+	batch->node_capacity = 2*max_leaves;
+	int** fields[] = {&batch->min_xs, &batch->min_ys, &batch->max_xs, &batch->max_ys, &batch->levels, &batch->partition_directions, &batch->partition_positions, &batch->left_children,
+		&batch->room_min_xs, &batch->room_min_ys, &batch->room_max_xs, &batch->room_max_ys, &batch->room_indices};
+	for(int i = 0; i < (int)(sizeof(fields)/sizeof(fields[0])); i++) *fields[i] = (int*)calloc(table_size, sizeof(int));
+	batch->corridors = (tile_rect*)malloc(BATCH_LANES*batch->node_capacity*sizeof(tile_rect));
+	batch->tiles = (char*)malloc(BATCH_LANES*config.width*config.height);
+}
+
+void destroy_dungeon_batch(dungeon_batch* batch)
+{
+	int* fields[] = {batch->min_xs, batch->min_ys, batch->max_xs, batch->max_ys, batch->levels, batch->partition_directions, batch->partition_positions, batch->left_children,
+		batch->room_min_xs, batch->room_min_ys, batch->room_max_xs, batch->room_max_ys, batch->room_indices};
+	for(int i = 0; i < (int)(sizeof(fields)/sizeof(fields[0])); i++) free(fields[i]);
+	free(batch->corridors);
+	free(batch->tiles);
+	*batch = {};
+}
+
+char* batch_tiles(dungeon_batch* batch, int lane)
+{
+	return batch->tiles + lane*batch->config.width*batch->config.height;
+}
+
+tile_rect* batch_corridors(dungeon_batch* batch, int lane)
+{
+	return batch->corridors + lane*batch->node_capacity;
+}
+
+int most_nodes(dungeon_batch* batch)
+{
+	int nodes = 0;
+	for(int lane = 0; lane < BATCH_LANES; lane++) nodes = max(nodes, batch->node_counts[lane]);
+	return nodes;
+}
+
+//Breadth first, node n of every lane is decided together with selects rather than branches
+//Every lane draws the same number of values per node whether or not it splits, so a lane's draws for a node never depend on the other lanes
+//Each pass uses its own stream, since lanes still draw for nodes past their own last one
+void generate_batch_bsp(dungeon_batch* batch, const uint32_t* seeds)
+{
+	lane_rng rng;
+	seed_lane_rng(&rng, seeds, 0);
+	runtime_dungeon_config c = batch->config;
+	for(int lane = 0; lane < BATCH_LANES; lane++)
+	{
+		batch->node_counts[lane] = 1;
+		batch->min_xs[lane] = 0;
+		batch->min_ys[lane] = 0;
+		batch->max_xs[lane] = c.width - 1;
+		batch->max_ys[lane] = c.height - 1;
+		batch->levels[lane] = 0;
+	}
+
+	uint32_t leaf_draws[BATCH_LANES];
+	uint32_t direction_draws[BATCH_LANES];
+	uint32_t position_draws[BATCH_LANES];
+	int splits[BATCH_LANES];
+	for(int node = 0; node < most_nodes(batch); node++)
+	{
+		next_lane_rng(&rng, leaf_draws);
+		next_lane_rng(&rng, direction_draws);
+		next_lane_rng(&rng, position_draws);
+#ifdef __SSE2__
+		int split_mask = 0;
+		for(int lane = 0; lane < BATCH_LANES; lane += 4)
+		{
+			int i = node*BATCH_LANES + lane;
+			__m128i min_x = _mm_loadu_si128((__m128i*)(batch->min_xs + i));
+			__m128i min_y = _mm_loadu_si128((__m128i*)(batch->min_ys + i));
+			__m128i max_x = _mm_loadu_si128((__m128i*)(batch->max_xs + i));
+			__m128i max_y = _mm_loadu_si128((__m128i*)(batch->max_ys + i));
+			__m128i node_counts = _mm_loadu_si128((__m128i*)(batch->node_counts + lane));
+			__m128i min_partition = _mm_set1_epi32(c.min_partition);
+			__m128i width = _mm_sub_epi32(max_x, min_x);
+			__m128i height = _mm_sub_epi32(max_y, min_y);
+
+			__m128i divisible = _mm_or_si128(_mm_cmpgt_epi32(width, min_partition), _mm_cmpgt_epi32(height, min_partition));
+			__m128i leaf_draw = _mm_srli_epi32(multiply_lanes(_mm_loadu_si128((__m128i*)(leaf_draws + lane)), _mm_set1_epi32(c.leaf_odds)), 15);
+			__m128i keep_splitting = _mm_or_si128(_mm_cmpgt_epi32(leaf_draw, _mm_setzero_si128()), _mm_cmplt_epi32(_mm_loadu_si128((__m128i*)(batch->levels + i)), _mm_set1_epi32(c.min_depth)));
+			__m128i has_space = _mm_cmplt_epi32(node_counts, _mm_set1_epi32(batch->node_capacity - 1));
+			__m128i live = _mm_cmpgt_epi32(node_counts, _mm_set1_epi32(node));
+
+			__m128i vertical = _mm_cmpeq_epi32(_mm_and_si128(_mm_loadu_si128((__m128i*)(direction_draws + lane)), _mm_set1_epi32(1)), _mm_set1_epi32(VERTICAL));
+			vertical = _mm_xor_si128(vertical, _mm_cmplt_epi32(select_lanes(vertical, height, width), min_partition));
+			__m128i margin = _mm_set1_epi32(c.min_room + 2);
+			__m128i low = _mm_add_epi32(select_lanes(vertical, min_y, min_x), margin);
+			__m128i high = _mm_sub_epi32(select_lanes(vertical, max_y, max_x), margin);
+
+			__m128i split = _mm_and_si128(_mm_and_si128(live, divisible), _mm_and_si128(keep_splitting, has_space));
+			_mm_storeu_si128((__m128i*)(batch->partition_directions + i), select_lanes(split, _mm_and_si128(vertical, _mm_set1_epi32(VERTICAL)), _mm_set1_epi32(-1)));
+			_mm_storeu_si128((__m128i*)(batch->partition_positions + i), range_lanes(_mm_loadu_si128((__m128i*)(position_draws + lane)), low, high));
+			split_mask |= _mm_movemask_ps(_mm_castsi128_ps(split)) << lane;
+		}
+		for(int lane = 0; lane < BATCH_LANES; lane++) splits[lane] = (split_mask >> lane) & 1;
+#else
+		for(int lane = 0; lane < BATCH_LANES; lane++)
+		{
+			int i = node*BATCH_LANES + lane;
+			int width = batch->max_xs[i] - batch->min_xs[i];
+			int height = batch->max_ys[i] - batch->min_ys[i];
+			int divisible = (width > c.min_partition) | (height > c.min_partition);
+			int keep_splitting = (((leaf_draws[lane]*(uint32_t)c.leaf_odds) >> 15) != 0) | (batch->levels[i] < c.min_depth);
+			int has_space = batch->node_counts[lane] + 2 <= batch->node_capacity;
+			int live = node < batch->node_counts[lane];
+
+			int direction = direction_draws[lane] & 1;
+			direction ^= ((direction == HORIZONTAL) ? width : height) < c.min_partition;
+			int low = ((direction == HORIZONTAL) ? batch->min_xs[i] : batch->min_ys[i]) + c.min_room + 2;
+			int high = ((direction == HORIZONTAL) ? batch->max_xs[i] : batch->max_ys[i]) - c.min_room - 2;
+
+			splits[lane] = live & divisible & keep_splitting & has_space;
+			batch->partition_directions[i] = splits[lane] ? direction : -1;
+			batch->partition_positions[i] = lane_range(position_draws[lane], low, high);
+		}
+
+#endif
+
+		for(int lane = 0; lane < BATCH_LANES; lane++)
+		{
+			if(!splits[lane]) continue;
+			int i = node*BATCH_LANES + lane;
+			int left = batch->node_counts[lane];
+			batch->node_counts[lane] += 2;
+			batch->left_children[i] = left;
+			int l = left*BATCH_LANES + lane;
+			int r = l + BATCH_LANES;
+			batch->min_xs[l] = batch->min_xs[r] = batch->min_xs[i];
+			batch->min_ys[l] = batch->min_ys[r] = batch->min_ys[i];
+			batch->max_xs[l] = batch->max_xs[r] = batch->max_xs[i];
+			batch->max_ys[l] = batch->max_ys[r] = batch->max_ys[i];
+			batch->levels[l] = batch->levels[r] = batch->levels[i] + 1;
+
+			//Same split as generate_bsp_tree(), the left child is below x on a horizontal split and above y on a vertical one
+			int position = batch->partition_positions[i];
+			if(batch->partition_directions[i] == HORIZONTAL)
+			{
+				batch->max_xs[l] = position - 1;
+				batch->min_xs[r] = position;
+			}
+			else
+			{
+				batch->min_ys[l] = position;
+				batch->max_ys[r] = position - 1;
+			}
+		}
+	}
+}
+
+void generate_batch_rooms(dungeon_batch* batch, const uint32_t* seeds)
+{
+	lane_rng rng;
+	seed_lane_rng(&rng, seeds, 1);
+	int min_room = batch->config.min_room;
+	uint32_t draws[4][BATCH_LANES];
+	for(int lane = 0; lane < BATCH_LANES; lane++) batch->room_counts[lane] = 0;
+	for(int node = 0; node < most_nodes(batch); node++)
+	{
+		for(int d = 0; d < 4; d++) next_lane_rng(&rng, draws[d]);
+#ifdef __SSE2__
+		for(int lane = 0; lane < BATCH_LANES; lane += 4)
+		{
+			int i = node*BATCH_LANES + lane;
+			__m128i min_x = _mm_loadu_si128((__m128i*)(batch->min_xs + i));
+			__m128i min_y = _mm_loadu_si128((__m128i*)(batch->min_ys + i));
+			__m128i max_x = _mm_add_epi32(_mm_loadu_si128((__m128i*)(batch->max_xs + i)), _mm_set1_epi32(1));
+			__m128i max_y = _mm_add_epi32(_mm_loadu_si128((__m128i*)(batch->max_ys + i)), _mm_set1_epi32(1));
+			__m128i one = _mm_set1_epi32(1);
+			__m128i room_size = _mm_set1_epi32(min_room);
+			__m128i room_counts = _mm_loadu_si128((__m128i*)(batch->room_counts + lane));
+			__m128i live = _mm_cmpgt_epi32(_mm_loadu_si128((__m128i*)(batch->node_counts + lane)), _mm_set1_epi32(node));
+			__m128i leaf = _mm_and_si128(live, _mm_cmplt_epi32(_mm_loadu_si128((__m128i*)(batch->partition_directions + i)), _mm_setzero_si128()));
+
+			__m128i left_side = range_lanes(_mm_loadu_si128((__m128i*)(draws[0] + lane)), _mm_add_epi32(min_x, one), _mm_sub_epi32(max_x, room_size));
+			__m128i right_side = range_lanes(_mm_loadu_si128((__m128i*)(draws[1] + lane)), _mm_add_epi32(left_side, room_size), max_x);
+			__m128i bottom_side = range_lanes(_mm_loadu_si128((__m128i*)(draws[2] + lane)), _mm_add_epi32(min_y, one), _mm_sub_epi32(max_y, room_size));
+			__m128i top_side = range_lanes(_mm_loadu_si128((__m128i*)(draws[3] + lane)), _mm_add_epi32(bottom_side, room_size), max_y);
+			_mm_storeu_si128((__m128i*)(batch->room_min_xs + i), left_side);
+			_mm_storeu_si128((__m128i*)(batch->room_min_ys + i), bottom_side);
+			_mm_storeu_si128((__m128i*)(batch->room_max_xs + i), right_side);
+			_mm_storeu_si128((__m128i*)(batch->room_max_ys + i), top_side);
+			_mm_storeu_si128((__m128i*)(batch->room_indices + i), select_lanes(leaf, room_counts, _mm_set1_epi32(-1)));
+			_mm_storeu_si128((__m128i*)(batch->room_counts + lane), _mm_sub_epi32(room_counts, leaf));
+		}
+#else
+		for(int lane = 0; lane < BATCH_LANES; lane++)
+		{
+			int i = node*BATCH_LANES + lane;
+			int leaf = (node < batch->node_counts[lane]) & (batch->partition_directions[i] < 0);
+			int left_side = lane_range(draws[0][lane], batch->min_xs[i] + 1, batch->max_xs[i] - min_room + 1);
+			int right_side = lane_range(draws[1][lane], left_side + min_room, batch->max_xs[i] + 1);
+			int bottom_side = lane_range(draws[2][lane], batch->min_ys[i] + 1, batch->max_ys[i] - min_room + 1);
+			int top_side = lane_range(draws[3][lane], bottom_side + min_room, batch->max_ys[i] + 1);
+			batch->room_min_xs[i] = left_side;
+			batch->room_min_ys[i] = bottom_side;
+			batch->room_max_xs[i] = right_side;
+			batch->room_max_ys[i] = top_side;
+			batch->room_indices[i] = leaf ? batch->room_counts[lane] : -1;
+			batch->room_counts[lane] += leaf;
+		}
+#endif
+	}
+}
+
+void add_batch_corridor(dungeon_batch* batch, int lane, int min_x, int min_y, int max_x, int max_y)
+{
+	if(min_x >= max_x || min_y >= max_y) return;
+	batch_corridors(batch, lane)[batch->corridor_counts[lane]++] = tile_rect{min_x, min_y, max_x, max_y};
+}
+
+//Same hallway rules as generate_hallways(), on one lane's node table
+void generate_batch_hallway(dungeon_batch* batch, lane_rng* rng, int lane, int node, char* tiles)
+{
+	runtime_dungeon_config c = batch->config;
+	int* room_mins[2] = {batch->room_min_xs, batch->room_min_ys};
+	int* room_maxs[2] = {batch->room_max_xs, batch->room_max_ys};
+	int i = node*BATCH_LANES + lane;
+	int l = batch->left_children[i]*BATCH_LANES + lane;
+	int r = l + BATCH_LANES;
+
+	int direction = batch->partition_directions[i];
+	int bound_direction = 1 - direction;
+	int bound_max = min(room_maxs[bound_direction][l], room_maxs[bound_direction][r]);
+	int bound_min = max(room_mins[bound_direction][l], room_mins[bound_direction][r]);
+	int hallway_position = lane_range(next_lane_rng(rng, lane), bound_min, bound_max);
+
+	int position[2];
+	position[bound_direction] = hallway_position;
+	position[direction] = batch->partition_positions[i];
+	int x = position[0];
+	int y = position[1];
+	if(bound_max > bound_min)
+	{
+		if(direction == HORIZONTAL)
+		{
+			int forward = carve_until_floor(c, tiles, x, y, 1, 0);
+			int backward = carve_until_floor(c, tiles, x - 1, y, -1, 0);
+			add_batch_corridor(batch, lane, x - backward, y, x + forward, y + 1);
+		}
+		else
+		{
+			int forward = carve_until_floor(c, tiles, x, y, 0, 1);
+			int backward = carve_until_floor(c, tiles, x, y - 1, 0, -1);
+			add_batch_corridor(batch, lane, x, y - backward, x + 1, y + forward);
+		}
+	}
+	else
+	{
+		int position_1[2];
+		position_1[direction] = lane_range(next_lane_rng(rng, lane), room_mins[direction][r], room_maxs[direction][r]);
+		position_1[bound_direction] = hallway_position;
+		int x_1 = position_1[0];
+		int y_1 = position_1[1];
+		if(direction == HORIZONTAL)
+		{
+			int backward = carve_until_floor(c, tiles, x - 1, y, -1, 0);
+			for(int j = x; j <= x_1; ++j) tiles[y*c.width + j] = FLOOR;
+			int turn = carve_until_floor(c, tiles, x_1, y_1, 0, -1);
+			add_batch_corridor(batch, lane, x - backward, y, max(x, x_1 + 1), y + 1);
+			add_batch_corridor(batch, lane, x_1, y_1 - turn + 1, x_1 + 1, y_1 + 1);
+		}
+		else
+		{
+			int backward = carve_until_floor(c, tiles, x, y - 1, 0, -1);
+			for(int j = y; j <= y_1; ++j) tiles[j*c.width + x] = FLOOR;
+			int turn = carve_until_floor(c, tiles, x_1, y_1, -1, 0);
+			add_batch_corridor(batch, lane, x, y - backward, x + 1, max(y, y_1 + 1));
+			add_batch_corridor(batch, lane, x_1 - turn + 1, y_1, x_1 + 1, y_1 + 1);
+		}
+	}
+	batch->room_min_xs[i] = min(batch->room_min_xs[l], batch->room_min_xs[r]);
+	batch->room_min_ys[i] = min(batch->room_min_ys[l], batch->room_min_ys[r]);
+	batch->room_max_xs[i] = max(batch->room_max_xs[l], batch->room_max_xs[r]);
+	batch->room_max_ys[i] = max(batch->room_max_ys[l], batch->room_max_ys[r]);
+}
+
+void generate_dungeon_batch(dungeon_batch* batch, const uint32_t* seeds)
+{
+	generate_batch_bsp(batch, seeds);
+	generate_batch_rooms(batch, seeds);
+	lane_rng rng;
+	seed_lane_rng(&rng, seeds, 2);
+
+	//Carving depends on what has already been carved, so each lane's tiles and hallways are done on their own
+	int width = batch->config.width;
+	for(int lane = 0; lane < BATCH_LANES; lane++)
+	{
+		char* tiles = batch_tiles(batch, lane);
+		memset(tiles, WALL, width*batch->config.height);
+		for(int node = 0; node < batch->node_counts[lane]; node++)
+		{
+			int i = node*BATCH_LANES + lane;
+			if(batch->partition_directions[i] >= 0) continue;
+			for(int y = batch->room_min_ys[i]; y < batch->room_max_ys[i]; y++) memset(tiles + y*width + batch->room_min_xs[i], FLOOR, batch->room_max_xs[i] - batch->room_min_xs[i]);
+		}
+
+		//Children are numbered after their parents, so walking the table backwards connects children before parents
+		batch->corridor_counts[lane] = 0;
+		for(int node = batch->node_counts[lane] - 1; node >= 0; node--)
+		{
+			if(batch->partition_directions[node*BATCH_LANES + lane] >= 0) generate_batch_hallway(batch, &rng, lane, node, tiles);
+		}
+	}
+}
+
+bsp_node* batch_lane_node(dungeon_batch* batch, int lane, int node)
+{
+	int i = node*BATCH_LANES + lane;
+	bsp_node* tree = (bsp_node*)malloc(sizeof(bsp_node));
+	tree->bottom_left = vec2d{(float)batch->min_xs[i], (float)batch->min_ys[i]};
+	tree->top_right = vec2d{(float)batch->max_xs[i], (float)batch->max_ys[i]};
+	tree->room_bottom_left = vec2d{(float)batch->room_min_xs[i], (float)batch->room_min_ys[i]};
+	tree->room_top_right = vec2d{(float)batch->room_max_xs[i], (float)batch->room_max_ys[i]};
+	tree->partition_direction = batch->partition_directions[i];
+	tree->partition_position = batch->partition_positions[i];
+	tree->room_index = batch->room_indices[i];
+	tree->left_child = NULL;
+	tree->right_child = NULL;
+	if(tree->partition_direction >= 0)
+	{
+		tree->left_child = batch_lane_node(batch, lane, batch->left_children[i]);
+		tree->right_child = batch_lane_node(batch, lane, batch->left_children[i] + 1);
+	}
+	return tree;
+}
+
+void batch_lane_to_dungeon(dungeon_batch* batch, int lane, dungeon* d)
+{
+	d->tree = batch_lane_node(batch, lane, 0);
+	d->room_count = batch->room_counts[lane];
+	d->width = batch->config.width;
+	d->height = batch->config.height;
+	d->tiles = batch_tiles(batch, lane);
+	d->corridor_count = batch->corridor_counts[lane];
+	d->corridor_capacity = d->corridor_count;
+	d->corridors = (tile_rect*)malloc(d->corridor_capacity*sizeof(tile_rect));
+	memcpy(d->corridors, batch_corridors(batch, lane), d->corridor_count*sizeof(tile_rect));
+	//The batch does not record contacts, validate_dungeon() scans the tiles instead
+	d->contacts = NULL;
+	d->contact_count = 0;
+	d->contact_capacity = 0;
+}
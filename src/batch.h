@@ -0,0 +1,62 @@
+#pragma once
+#include <stdint.h>
+#include "generator.h"
+
+#define BATCH_LANES 8
+#define BATCH_GENERATOR_VERSION 1 //Bump whenever a change makes a seed generate a different batch dungeon
+
+//Independent 32 bit LCG per lane, all lanes advance together
+struct lane_rng
+{
+	uint32_t state[BATCH_LANES];
+};
+
+//Different streams from the same seeds are independent sequences
+void seed_lane_rng(lane_rng*, const uint32_t* seeds, uint32_t stream = 0);
+void next_lane_rng(lane_rng*, uint32_t* values); //15 bit value for every lane
+uint32_t next_lane_rng(lane_rng*, int lane); //Advances a single lane
+
+//Flat bsp tables for BATCH_LANES dungeons, each field is indexed [node*BATCH_LANES + lane]
+//Nodes are numbered breadth first, children are always numbered after their parent and the right child directly follows the left
+struct dungeon_batch
+{
+	runtime_dungeon_config config;
+	int node_capacity;
+	int node_counts[BATCH_LANES];
+	int room_counts[BATCH_LANES];
+
+	//Partition bounds, inclusive like bsp_node::bottom_left and bsp_node::top_right
+	int* min_xs;
+	int* min_ys;
+	int* max_xs;
+	int* max_ys;
+	int* levels;
+	int* partition_directions; //-1 for leaves
+	int* partition_positions;
+	int* left_children;
+
+	//Room bounds of leaves, and of all rooms below internal nodes once hallways are generated
+	int* room_min_xs;
+	int* room_min_ys;
+	int* room_max_xs;
+	int* room_max_ys;
+	int* room_indices;
+
+	tile_rect* corridors; //Indexed [lane*node_capacity + corridor], at most two per internal node so a lane never fills its share
+	int corridor_counts[BATCH_LANES];
+
+	char* tiles; //Indexed [lane*width*height + y*width + x]
+};
+
+void create_dungeon_batch(dungeon_batch*, runtime_dungeon_config);
+void destroy_dungeon_batch(dungeon_batch*);
+
+//Generates one dungeon per seed, BATCH_LANES seeds at a time
+//The lane rng makes this a different sequence to generate_dungeon(), a seed gives the same dungeon whichever batch or lane it is in
+void generate_dungeon_batch(dungeon_batch*, const uint32_t* seeds);
+
+char* batch_tiles(dungeon_batch*, int lane);
+tile_rect* batch_corridors(dungeon_batch*, int lane);
+
+//Builds a bsp tree for one lane so it can be used with everything that takes a dungeon, tiles point into the batch
+void batch_lane_to_dungeon(dungeon_batch*, int lane, dungeon*);
@@ -0,0 +1,1255 @@
+#include "benchmark.h"
+#include "spatial.h"
+#include "graph.h"
+#include "jobs.h"
+#include "validate.h"
+#include "generator.h"
+#include "batch.h"
+#include "dungeon_file.h"
+#include "archive.h"
+#include "codec.h"
+#include "seed_file.h"
+#include "service.h"
+#include "cache.h"
+#include "export.h"
+#include "pipeline.h"
+#include "dungeon_delta.h"
+#include "dungeon_chunk.h"
+#include "camera.h"
+#include "tile_pyramid.h"
+#include "timer.h"
+#include <malloc.h>
+
+#define BENCHMARK_QUERIES 1000000
+#define BENCHMARK_DUNGEONS 10000
+#define BENCHMARK_FILL_DUNGEONS 1000
+#define BENCHMARK_FILES 1000
+#define BENCHMARK_CODEC_MAPS 100
+#define BENCHMARK_CODEC_PASSES 20
+#define BENCHMARK_SERVICE_CLIENTS 32
+#define BENCHMARK_SERVICE_REQUESTS 500
+#define BENCHMARK_CACHE_SEEDS 4096
+#define BENCHMARK_CACHE_LOOKUPS 100000
+#define BENCHMARK_EXPORT_DUNGEONS 64
+#define BENCHMARK_EXPORTS 2000
+#define BENCHMARK_PIPELINE_DUNGEONS 50000
+#define BENCHMARK_DELTA_PAIRS 256
+#define BENCHMARK_DELTA_PASSES 20
+#define BENCHMARK_CHUNK_MAPS 10
+#define BENCHMARK_MATRICES 1024
+#define BENCHMARK_MATRIX_PASSES 1000
+#define BENCHMARK_TILE_TRANSFORMS (MAP_SIZE*MAP_SIZE) //One per tile drawn each frame
+#define BENCHMARK_PYRAMID_SIZE 8192
+#define BENCHMARK_PYRAMID_PASSES 10
+#define BENCHMARK_SCREEN_HEIGHT 1080
+#define BENCHMARK_JOB_RUNS 2000
+
+//Results are written here so the compiler can't discard the work being timed
+volatile int benchmark_sink;
+
+void report_benchmark(const char* name, timer* t, int operations)
+{
+	printf("%-36s %10.1f ns/op\n", name, time_elapsed_microsec(t)*1000.0/operations);
+}
+
+void benchmark_spatial_queries()
+{
+	dungeon* d = (dungeon*)malloc(sizeof(dungeon));
+	generate_dungeon(d);
+	spatial_index index;
+	build_spatial_index(&index, d);
+	printf("Spatial queries (%d rooms, %d corridors)\n", d->room_count, d->corridor_count);
+
+	int* xs = (int*)malloc(BENCHMARK_QUERIES*sizeof(int));
+	int* ys = (int*)malloc(BENCHMARK_QUERIES*sizeof(int));
+	int* results = (int*)malloc(BENCHMARK_QUERIES*sizeof(int));
+	int* results_y = (int*)malloc(BENCHMARK_QUERIES*sizeof(int));
+	bsp_node** rooms = (bsp_node**)malloc(BENCHMARK_QUERIES*sizeof(bsp_node*));
+	for(int i = 0; i < BENCHMARK_QUERIES; i++)
+	{
+		xs[i] = rng_range(0, MAP_SIZE);
+		ys[i] = rng_range(0, MAP_SIZE);
+	}
+
+	timer t;
+	int sink = 0;
+
+	start_timer(&t);
+	for(int i = 0; i < BENCHMARK_QUERIES; i++) sink += (find_room(d->tree, xs[i], ys[i]) != NULL);
+	end_timer(&t);
+	report_benchmark("bsp find_room", &t, BENCHMARK_QUERIES);
+
+	start_timer(&t);
+	find_rooms(d->tree, xs, ys, BENCHMARK_QUERIES, rooms);
+	end_timer(&t);
+	report_benchmark("bsp find_rooms (batch)", &t, BENCHMARK_QUERIES);
+
+	bsp_node* nearest_rooms[4];
+	int nearest_distances[4];
+	start_timer(&t);
+	for(int i = 0; i < BENCHMARK_QUERIES; i++) sink += find_nearest_rooms(d->tree, xs[i], ys[i], 4, nearest_rooms, nearest_distances);
+	end_timer(&t);
+	report_benchmark("bsp find_nearest_rooms k=4", &t, BENCHMARK_QUERIES);
+
+	start_timer(&t);
+	for(int i = 0; i < BENCHMARK_QUERIES; i++) sink += query_point(&index, xs[i], ys[i]);
+	end_timer(&t);
+	report_benchmark("index query_point", &t, BENCHMARK_QUERIES);
+
+	start_timer(&t);
+	query_points(&index, xs, ys, BENCHMARK_QUERIES, results);
+	end_timer(&t);
+	report_benchmark("index query_points (batch)", &t, BENCHMARK_QUERIES);
+
+	int rect_ids[64];
+	start_timer(&t);
+	for(int i = 0; i < BENCHMARK_QUERIES; i++) sink += query_rect(&index, tile_rect{xs[i] - 8, ys[i] - 8, xs[i] + 8, ys[i] + 8}, rect_ids, 64);
+	end_timer(&t);
+	report_benchmark("index query_rect 16x16", &t, BENCHMARK_QUERIES);
+
+	start_timer(&t);
+	for(int i = 0; i < BENCHMARK_QUERIES; i++) sink += query_nearest(&index, xs[i], ys[i], 4, rect_ids, nearest_distances);
+	end_timer(&t);
+	report_benchmark("index query_nearest k=4", &t, BENCHMARK_QUERIES);
+
+	start_timer(&t);
+	nearest_floor_tiles(&index, xs, ys, BENCHMARK_QUERIES, results, results_y);
+	end_timer(&t);
+	report_benchmark("index nearest_floor_tiles (batch)", &t, BENCHMARK_QUERIES);
+
+	benchmark_sink = sink + results[0] + results_y[0] + (rooms[0] != NULL);
+
+	free(rooms);
+	free(results_y);
+	free(results);
+	free(ys);
+	free(xs);
+	destroy_spatial_index(&index);
+	destroy_dungeon(d);
+	free(d);
+}
+
+void benchmark_room_graph()
+{
+	dungeon* d = (dungeon*)malloc(sizeof(dungeon));
+	generate_dungeon(d);
+	const char* tiles = &tile_map[0][0];
+	printf("Room graph and distance fields (%d rooms, %d threads)\n", d->room_count, processor_count());
+
+	timer t;
+	room_graph graph;
+	start_timer(&t);
+	build_room_graph(&graph, d, tiles, MAP_SIZE, MAP_SIZE);
+	end_timer(&t);
+	report_benchmark("build_room_graph", &t, 1);
+
+	room_distances distances;
+	start_timer(&t);
+	compute_room_distances(&distances, &graph, 1);
+	end_timer(&t);
+	report_benchmark("compute_room_distances 1 thread", &t, 1);
+	destroy_room_distances(&distances);
+
+	start_timer(&t);
+	compute_room_distances(&distances, &graph);
+	end_timer(&t);
+	report_benchmark("compute_room_distances all threads", &t, 1);
+
+	uint16_t* field = (uint16_t*)malloc(MAP_SIZE*MAP_SIZE*sizeof(uint16_t));
+	tile_rect* rooms = (tile_rect*)malloc(d->room_count*sizeof(tile_rect));
+	gather_room_rects(d->tree, rooms);
+	int source_x = rooms[0].min_x;
+	int source_y = rooms[0].min_y;
+	free(rooms);
+	start_timer(&t);
+	for(int i = 0; i < 1000; i++) compute_distance_field(field, tiles, MAP_SIZE, MAP_SIZE, &source_x, &source_y, 1);
+	end_timer(&t);
+	report_benchmark("compute_distance_field", &t, 1000);
+
+	start_timer(&t);
+	uint16_t* fields = compute_room_distance_fields(d, tiles, MAP_SIZE, MAP_SIZE, 1);
+	end_timer(&t);
+	report_benchmark("compute_room_distance_fields 1 thread", &t, 1);
+	free(fields);
+
+	start_timer(&t);
+	fields = compute_room_distance_fields(d, tiles, MAP_SIZE, MAP_SIZE);
+	end_timer(&t);
+	report_benchmark("compute_room_distance_fields all threads", &t, 1);
+
+	benchmark_sink = fields[0] + field[0] + room_distance(&distances, 0, d->room_count - 1);
+	free(fields);
+	free(field);
+	destroy_room_distances(&distances);
+	destroy_room_graph(&graph);
+	destroy_dungeon(d);
+	free(d);
+}
+
+//Generates the benchmark seeds, passing each dungeon to the validator if there is one
+int64_t time_validated_generation(const char* name, dungeon* d, connectivity_validator* validator, int* valid)
+{
+	*valid = 0;
+	timer t;
+	start_timer(&t);
+	for(int i = 0; i < BENCHMARK_DUNGEONS; i++)
+	{
+		seed_rng(i);
+		generate_dungeon(d);
+		*valid += validator ? validate_dungeon(validator, d, &tile_map[0][0]) : true;
+		destroy_dungeon(d);
+	}
+	end_timer(&t);
+	report_benchmark(name, &t, BENCHMARK_DUNGEONS);
+	return time_elapsed_microsec(&t);
+}
+
+//Times the same seeds with and without validation so the overhead is measured against generation
+void benchmark_validation()
+{
+	dungeon* d = (dungeon*)malloc(sizeof(dungeon));
+	connectivity_validator validator;
+	create_connectivity_validator(&validator, MAP_SIZE, MAP_SIZE);
+	printf("Connectivity validation (%d dungeons)\n", BENCHMARK_DUNGEONS);
+
+	int valid;
+	int64_t generation = time_validated_generation("generate_dungeon", d, NULL, &valid);
+	int64_t validated = time_validated_generation("generate_dungeon + validate_dungeon", d, &validator, &valid);
+	printf("Validation overhead = %.1f%%, %d/%d valid\n", (validated - generation)*100.0/generation, valid, BENCHMARK_DUNGEONS);
+
+	benchmark_sink = valid;
+	destroy_connectivity_validator(&validator);
+	free(d);
+}
+
+template<typename config>
+void benchmark_generator(const char* name, const config& c, char* tiles)
+{
+	dungeon* d = (dungeon*)malloc(sizeof(dungeon));
+	timer t;
+	start_timer(&t);
+	for(int i = 0; i < BENCHMARK_DUNGEONS; i++)
+	{
+		seed_rng(i);
+		generate_dungeon(d, tiles, c);
+		destroy_dungeon(d);
+	}
+	end_timer(&t);
+	report_benchmark(name, &t, BENCHMARK_DUNGEONS);
+	benchmark_sink = tiles[0];
+	free(d);
+}
+
+template<typename config>
+void benchmark_room_fill(const char* name, const config& c, tile_rect* rooms, int room_count)
+{
+	timer t;
+	start_timer(&t);
+	for(int i = 0; i < room_count; i++)
+	{
+		for(int y = rooms[i].min_y; y < rooms[i].max_y; y++) fill_row(c, &tile_map[0][0] + y*c.width + rooms[i].min_x, rooms[i].max_x - rooms[i].min_x, FLOOR);
+	}
+	end_timer(&t);
+	report_benchmark(name, &t, BENCHMARK_FILL_DUNGEONS);
+	benchmark_sink = tile_map[rooms[0].min_y][rooms[0].min_x];
+}
+
+//Just the room rows of the default configuration, the part of generation the fixed fill replaces memset in
+void benchmark_room_fills()
+{
+	dungeon* d = (dungeon*)malloc(sizeof(dungeon));
+	tile_rect* rooms = NULL;
+	int room_count = 0;
+	for(int i = 0; i < BENCHMARK_FILL_DUNGEONS; i++)
+	{
+		seed_rng(i);
+		generate_dungeon(d);
+		rooms = (tile_rect*)realloc(rooms, (room_count + d->room_count)*sizeof(tile_rect));
+		gather_room_rects(d->tree, rooms + room_count);
+		room_count += d->room_count;
+		destroy_dungeon(d);
+	}
+	printf("Room fills (%d dungeons, %d rooms)\n", BENCHMARK_FILL_DUNGEONS, room_count);
+	benchmark_room_fill("default 128x128 fixed rooms", default_dungeon_config(), rooms, room_count);
+	benchmark_room_fill("default 128x128 runtime rooms", make_runtime_config(default_dungeon_config()), rooms, room_count);
+	free(rooms);
+	free(d);
+}
+
+//Same seeds and parameters through each fixed configuration and its runtime equivalent
+void benchmark_generator_configs()
+{
+	char* tiles = (char*)malloc(large_dungeon_config::width*large_dungeon_config::height);
+	printf("Generator configurations (%d dungeons)\n", BENCHMARK_DUNGEONS);
+	benchmark_generator("small 64x64 fixed", small_dungeon_config(), tiles);
+	benchmark_generator("small 64x64 runtime", make_runtime_config(small_dungeon_config()), tiles);
+	benchmark_generator("default 128x128 fixed", default_dungeon_config(), tiles);
+	benchmark_generator("default 128x128 runtime", make_runtime_config(default_dungeon_config()), tiles);
+	benchmark_generator("large 256x256 fixed", large_dungeon_config(), tiles);
+	benchmark_generator("large 256x256 runtime", make_runtime_config(large_dungeon_config()), tiles);
+	free(tiles);
+}
+
+void benchmark_batch(const char* name, runtime_dungeon_config c)
+{
+	dungeon_batch batch;
+	create_dungeon_batch(&batch, c);
+	uint32_t seeds[BATCH_LANES];
+	timer t;
+	start_timer(&t);
+	for(int i = 0; i < BENCHMARK_DUNGEONS; i += BATCH_LANES)
+	{
+		for(int lane = 0; lane < BATCH_LANES; lane++) seeds[lane] = i + lane;
+		generate_dungeon_batch(&batch, seeds);
+	}
+	end_timer(&t);
+	report_benchmark(name, &t, BENCHMARK_DUNGEONS);
+	benchmark_sink = batch.room_counts[0];
+	destroy_dungeon_batch(&batch);
+}
+
+//Per dungeon time of the batch generator against the generate_dungeon() loops above
+void benchmark_batch_generation()
+{
+	printf("Batch generation (%d dungeons, %d lanes)\n", BENCHMARK_DUNGEONS, BATCH_LANES);
+	benchmark_batch("small 64x64 batch", make_runtime_config(small_dungeon_config()));
+	benchmark_batch("default 128x128 batch", make_runtime_config(default_dungeon_config()));
+}
+
+//Opens every file and reads one tile from each, against reading the whole file into memory
+void benchmark_dungeon_files()
+{
+	const char* directory = "benchmark_dungeons";
+	char path[256];
+	runtime_dungeon_config config = make_runtime_config(default_dungeon_config());
+	dungeon* d = (dungeon*)malloc(sizeof(dungeon));
+	CreateDirectoryA(directory, NULL);
+	for(int i = 0; i < BENCHMARK_FILES; i++)
+	{
+		seed_rng(i);
+		generate_dungeon(d);
+		sprintf(path, "%s/%d.dungeon", directory, i);
+		write_dungeon_file(path, d, i, config);
+		destroy_dungeon(d);
+	}
+	printf("Dungeon files (%d files)\n", BENCHMARK_FILES);
+
+	timer t;
+	int sink = 0;
+	start_timer(&t);
+	for(int i = 0; i < BENCHMARK_FILES; i++)
+	{
+		mapped_file mapped;
+		dungeon_view view;
+		sprintf(path, "%s/%d.dungeon", directory, i);
+		if(!load_dungeon_file(path, &mapped, &view)) continue;
+		sink += view.tiles[view.rooms[0].min_y*view.header->config.width + view.rooms[0].min_x];
+		unmap_file(&mapped);
+	}
+	end_timer(&t);
+	report_benchmark("load_dungeon_file (mapped)", &t, BENCHMARK_FILES);
+
+	start_timer(&t);
+	for(int i = 0; i < BENCHMARK_FILES; i++)
+	{
+		sprintf(path, "%s/%d.dungeon", directory, i);
+		FILE* f = fopen(path, "rb");
+		if(!f) continue;
+		fseek(f, 0, SEEK_END);
+		int size = ftell(f);
+		fseek(f, 0, SEEK_SET);
+		char* contents = (char*)malloc(size);
+		fread(contents, 1, size, f);
+		fclose(f);
+		dungeon_view view;
+		if(open_dungeon_view(&view, contents, size)) sink += view.tiles[view.rooms[0].min_y*view.header->config.width + view.rooms[0].min_x];
+		free(contents);
+	}
+	end_timer(&t);
+	report_benchmark("fread whole file", &t, BENCHMARK_FILES);
+
+	for(int i = 0; i < BENCHMARK_FILES; i++)
+	{
+		sprintf(path, "%s/%d.dungeon", directory, i);
+		DeleteFileA(path);
+	}
+	RemoveDirectoryA(directory);
+	benchmark_sink = sink;
+	free(d);
+}
+
+struct archive_job
+{
+	dungeon_archive* archive;
+	runtime_dungeon_config config;
+	int batches_per_job;
+};
+
+//Each job is one writer archiving its own range of seeds from the batch generator, which unlike generate_dungeon() is safe to run on several threads
+void archive_seeds(void* data, int index)
+{
+	archive_job* job = (archive_job*)data;
+	dungeon_batch batch;
+	create_dungeon_batch(&batch, job->config);
+	archive_writer writer;
+	open_archive_writer(&writer, job->archive);
+	dungeon* d = (dungeon*)malloc(sizeof(dungeon));
+	uint32_t seeds[BATCH_LANES];
+	for(int b = 0; b < job->batches_per_job; b++)
+	{
+		for(int lane = 0; lane < BATCH_LANES; lane++) seeds[lane] = (index*job->batches_per_job + b)*BATCH_LANES + lane;
+		generate_dungeon_batch(&batch, seeds);
+		for(int lane = 0; lane < BATCH_LANES; lane++)
+		{
+			batch_lane_to_dungeon(&batch, lane, d);
+			archive_dungeon(&writer, d, seeds[lane], job->config);
+			destroy_dungeon(d);
+		}
+	}
+	close_archive_writer(&writer);
+	free(d);
+	destroy_dungeon_batch(&batch);
+}
+
+void benchmark_archive()
+{
+	const char* directory = "benchmark_archive";
+	int jobs = processor_count();
+	archive_job job = {NULL, make_runtime_config(default_dungeon_config()), BENCHMARK_DUNGEONS/(jobs*BATCH_LANES)};
+	int dungeon_count = jobs*job.batches_per_job*BATCH_LANES;
+	printf("Dungeon archive (%d dungeons, %d writers)\n", dungeon_count, jobs);
+
+	timer t;
+	dungeon_archive archive;
+	job.archive = &archive;
+	start_timer(&t);
+	open_archive(&archive, directory);
+	parallel_for(jobs, archive_seeds, &job);
+	int segment_count = archive.segment_count;
+	close_archive(&archive);
+	end_timer(&t);
+	report_benchmark("generate and archive", &t, dungeon_count);
+
+	archive_reader reader;
+	start_timer(&t);
+	bool opened = open_archive_reader(&reader, directory);
+	end_timer(&t);
+	report_benchmark("open_archive_reader", &t, 1);
+
+	int sink = 0;
+	if(opened)
+	{
+		start_timer(&t);
+		for(int i = 0; i < BENCHMARK_QUERIES; i++)
+		{
+			dungeon_view view;
+			if(find_archived_dungeon(&reader, rng_range(0, dungeon_count), &view)) sink += view.tiles[view.rooms[0].min_y*view.header->config.width + view.rooms[0].min_x];
+		}
+		end_timer(&t);
+		report_benchmark("find_archived_dungeon", &t, BENCHMARK_QUERIES);
+		close_archive_reader(&reader);
+	}
+
+	char path[ARCHIVE_PATH_SIZE];
+	for(int i = 0; i < segment_count; i++)
+	{
+		snprintf(path, ARCHIVE_PATH_SIZE, "%s/segment_%05u.dat", directory, i);
+		DeleteFileA(path);
+	}
+	snprintf(path, ARCHIVE_PATH_SIZE, "%s/index.dat", directory);
+	DeleteFileA(path);
+	RemoveDirectoryA(directory);
+	benchmark_sink = sink;
+}
+
+//Raw tile bytes per second through each direction, over a set of maps generated up front
+template<typename config>
+void benchmark_codec(const char* name, const config& c)
+{
+	int map_size = c.width*c.height;
+	char* maps = (char*)malloc(BENCHMARK_CODEC_MAPS*map_size);
+	char* decoded = (char*)malloc(map_size);
+	int capacity = max_encoded_size(map_size) + TILE_CODEC_MAX_TOKEN;
+	uint8_t* encoded = (uint8_t*)malloc(BENCHMARK_CODEC_MAPS*capacity);
+	int* encoded_sizes = (int*)malloc(BENCHMARK_CODEC_MAPS*sizeof(int));
+	dungeon* d = (dungeon*)malloc(sizeof(dungeon));
+	for(int i = 0; i < BENCHMARK_CODEC_MAPS; i++)
+	{
+		seed_rng(i);
+		generate_dungeon(d, maps + i*map_size, c);
+		destroy_dungeon(d);
+	}
+
+	timer t;
+	int operations = BENCHMARK_CODEC_MAPS*BENCHMARK_CODEC_PASSES;
+	double megabytes = (double)operations*map_size/(1 << 20);
+	long encoded_total = 0;
+	start_timer(&t);
+	for(int pass = 0; pass < BENCHMARK_CODEC_PASSES; pass++)
+	{
+		for(int i = 0; i < BENCHMARK_CODEC_MAPS; i++) encoded_sizes[i] = compress_tiles(maps + i*map_size, c.width, c.height, encoded + i*capacity);
+	}
+	end_timer(&t);
+	for(int i = 0; i < BENCHMARK_CODEC_MAPS; i++) encoded_total += encoded_sizes[i];
+	printf("%s: %d bytes raw, %.1f bytes encoded, %.1fx\n", name, map_size, (double)encoded_total/BENCHMARK_CODEC_MAPS, (double)map_size*BENCHMARK_CODEC_MAPS/encoded_total);
+	report_benchmark("compress_tiles", &t, operations);
+	printf("%-36s %10.1f MB/s\n", "", megabytes*1000000.0/time_elapsed_microsec(&t));
+
+	int sink = 0;
+	start_timer(&t);
+	for(int pass = 0; pass < BENCHMARK_CODEC_PASSES; pass++)
+	{
+		for(int i = 0; i < BENCHMARK_CODEC_MAPS; i++)
+		{
+			sink += decompress_tiles(encoded + i*capacity, encoded_sizes[i], decoded, c.width, c.height);
+		}
+	}
+	end_timer(&t);
+	report_benchmark("decompress_tiles", &t, operations);
+	printf("%-36s %10.1f MB/s\n", "", megabytes*1000000.0/time_elapsed_microsec(&t));
+
+	//A row at a time into a buffer that only ever holds one row's output, as a network writer would
+	uint8_t* row_output = (uint8_t*)malloc(max_encoded_size(c.width) + TILE_CODEC_MAX_TOKEN);
+	start_timer(&t);
+	for(int pass = 0; pass < BENCHMARK_CODEC_PASSES; pass++)
+	{
+		for(int i = 0; i < BENCHMARK_CODEC_MAPS; i++)
+		{
+			tile_encoder encoder;
+			create_tile_encoder(&encoder, c.width);
+			for(int y = 0; y < c.height; y++) sink += encode_tiles(&encoder, maps + i*map_size + y*c.width, c.width, row_output);
+			sink += finish_tile_encoder(&encoder, row_output);
+			destroy_tile_encoder(&encoder);
+		}
+	}
+	end_timer(&t);
+	report_benchmark("encode_tiles by row", &t, operations);
+	benchmark_sink = sink;
+
+	free(row_output);
+	free(d);
+	free(encoded_sizes);
+	free(encoded);
+	free(decoded);
+	free(maps);
+}
+
+void benchmark_codecs()
+{
+	printf("Tile codec (%d maps, %d passes)\n", BENCHMARK_CODEC_MAPS, BENCHMARK_CODEC_PASSES);
+	benchmark_codec("small 64x64", small_dungeon_config());
+	benchmark_codec("default 128x128", default_dungeon_config());
+	benchmark_codec("large 256x256", large_dungeon_config());
+}
+
+//Time until a dungeon's tiles are usable, mapping a stored dungeon file against generating it again from a seed record
+//Mapped tiles are touched once per page so the page faults are counted
+template<typename config>
+void benchmark_regeneration(const char* name, const config& c)
+{
+	const char* directory = "benchmark_regeneration";
+	char path[256];
+	runtime_dungeon_config runtime = make_runtime_config(c);
+	int map_size = c.width*c.height;
+	char* tiles = (char*)malloc(map_size);
+	dungeon* d = (dungeon*)malloc(sizeof(dungeon));
+	CreateDirectoryA(directory, NULL);
+	for(int i = 0; i < BENCHMARK_FILES; i++)
+	{
+		seed_rng(i);
+		generate_dungeon(d, tiles, c);
+		sprintf(path, "%s/%d.dungeon", directory, i);
+		write_dungeon_file(path, d, i, runtime);
+		sprintf(path, "%s/%d.seed", directory, i);
+		write_dungeon_seed_file(path, i, runtime);
+		if(i == 0) printf("%s: %u byte dungeon file, %d byte seed record\n", name, dungeon_file_size(d), (int)sizeof(dungeon_seed_record));
+		destroy_dungeon(d);
+	}
+
+	timer t;
+	int sink = 0;
+	start_timer(&t);
+	for(int i = 0; i < BENCHMARK_FILES; i++)
+	{
+		mapped_file mapped;
+		dungeon_view view;
+		sprintf(path, "%s/%d.dungeon", directory, i);
+		if(!load_dungeon_file(path, &mapped, &view)) continue;
+		for(int j = 0; j < map_size; j += 4096) sink += view.tiles[j];
+		unmap_file(&mapped);
+	}
+	end_timer(&t);
+	report_benchmark("load_dungeon_file (mapped)", &t, BENCHMARK_FILES);
+
+	start_timer(&t);
+	for(int i = 0; i < BENCHMARK_FILES; i++)
+	{
+		dungeon_seed_record record;
+		sprintf(path, "%s/%d.seed", directory, i);
+		if(!read_dungeon_seed_file(path, &record) || !regenerate_dungeon(&record, d, tiles)) continue;
+		sink += tiles[0];
+		destroy_dungeon(d);
+	}
+	end_timer(&t);
+	report_benchmark("regenerate_dungeon (seed file)", &t, BENCHMARK_FILES);
+
+	for(int i = 0; i < BENCHMARK_FILES; i++)
+	{
+		sprintf(path, "%s/%d.dungeon", directory, i);
+		DeleteFileA(path);
+		sprintf(path, "%s/%d.seed", directory, i);
+		DeleteFileA(path);
+	}
+	RemoveDirectoryA(directory);
+	benchmark_sink = sink;
+	free(d);
+	free(tiles);
+}
+
+void benchmark_regeneration_sizes()
+{
+	printf("Regenerate against load (%d dungeons)\n", BENCHMARK_FILES);
+	benchmark_regeneration("small 64x64", small_dungeon_config());
+	benchmark_regeneration("default 128x128", default_dungeon_config());
+	benchmark_regeneration("large 256x256", large_dungeon_config());
+}
+
+//Each client stands in for a game server, asking for distinct seeds back to back so nothing comes from the cache
+void service_client_job(void* data, int index)
+{
+	dungeon_service* service = (dungeon_service*)data;
+	service_request request;
+	create_service_request(&request);
+	for(int i = 0; i < BENCHMARK_SERVICE_REQUESTS; i++)
+	{
+		request.seed = index*BENCHMARK_SERVICE_REQUESTS + i;
+		service_generate(service, &request);
+		free(request.blob);
+		request.blob = NULL;
+	}
+	destroy_service_request(&request);
+}
+
+void benchmark_service()
+{
+	dungeon_service* service = (dungeon_service*)malloc(sizeof(dungeon_service));
+	create_dungeon_service(service, make_runtime_config(default_dungeon_config()));
+	printf("Generation service (%d workers, %d clients, %d requests each)\n", service->worker_count, BENCHMARK_SERVICE_CLIENTS, BENCHMARK_SERVICE_REQUESTS);
+	timer t;
+	start_timer(&t);
+	parallel_for(BENCHMARK_SERVICE_CLIENTS, service_client_job, service, BENCHMARK_SERVICE_CLIENTS);
+	end_timer(&t);
+	report_benchmark("service_generate", &t, BENCHMARK_SERVICE_CLIENTS*BENCHMARK_SERVICE_REQUESTS);
+	service_stats stats;
+	get_service_stats(service, &stats);
+	print_service_stats(&stats);
+	destroy_dungeon_service(service);
+	free(service);
+}
+
+//Lookups skewed towards a few popular seeds, through a cache with room for about a quarter of them
+void benchmark_cache()
+{
+	runtime_dungeon_config config = make_runtime_config(default_dungeon_config());
+	dungeon* d = (dungeon*)malloc(sizeof(dungeon));
+	char* tiles = (char*)malloc(config.width*config.height);
+	uint32_t image_size = 0;
+	char* image = NULL;
+	dungeon_cache* cache = (dungeon_cache*)malloc(sizeof(dungeon_cache));
+	create_dungeon_cache(cache, 4u << 20);
+	printf("Dungeon cache (%d seeds, %d lookups)\n", BENCHMARK_CACHE_SEEDS, BENCHMARK_CACHE_LOOKUPS);
+
+	timer t;
+	int sink = 0;
+	uint32_t state = 1;
+	int64_t generate_time = 0;
+	int generated = 0;
+	start_timer(&t);
+	for(int i = 0; i < BENCHMARK_CACHE_LOOKUPS; i++)
+	{
+		//Squaring a uniform draw puts most lookups on low seeds
+		state = state*1103515245u + 12345u;
+		uint32_t draw = (state >> 16) % 1024;
+		uint32_t seed = draw*draw*BENCHMARK_CACHE_SEEDS/(1024*1024);
+		dungeon_cache_key key = make_cache_key(seed, config);
+		char* cached;
+		uint32_t size;
+		if(find_cached_dungeon(cache, &key, &cached, &size))
+		{
+			sink += cached[size/2];
+			free(cached);
+			continue;
+		}
+
+		//A miss generates the seed, as the service does
+		timer generate;
+		start_timer(&generate);
+		seed_rng(seed);
+		generate_dungeon(d, tiles, default_dungeon_config());
+		if(!image) image_size = dungeon_file_size(d);
+		if(!image) image = (char*)malloc(image_size);
+		serialize_dungeon(d, seed, config, image, image_size);
+		destroy_dungeon(d);
+		cache_dungeon(cache, &key, image, image_size);
+		end_timer(&generate);
+		generate_time += time_elapsed_microsec(&generate);
+		generated++;
+	}
+	end_timer(&t);
+	report_benchmark("lookup or generate", &t, BENCHMARK_CACHE_LOOKUPS);
+	if(generated) printf("%-36s %10.1f ns/op\n", "generate and cache (misses)", generate_time*1000.0/generated);
+	printf("%-36s %10.1f ns/op\n", "find_cached_dungeon (hits)", (time_elapsed_microsec(&t) - generate_time)*1000.0/(BENCHMARK_CACHE_LOOKUPS - generated));
+	cache_stats stats;
+	get_cache_stats(cache, &stats);
+	print_cache_stats(&stats);
+	benchmark_sink = sink;
+
+	destroy_dungeon_cache(cache);
+	free(cache);
+	free(image);
+	free(tiles);
+	free(d);
+}
+
+struct export_benchmark
+{
+	dungeon* dungeons;
+	export_format format;
+	const char* directory; //NULL only encodes
+	volatile LONG bytes;
+};
+
+void export_benchmark_job(void* data, int index)
+{
+	export_benchmark* benchmark = (export_benchmark*)data;
+	char path[256];
+	if(benchmark->directory) sprintf(path, "%s/%d.%s", benchmark->directory, index, export_extension(benchmark->format));
+	export_writer* writer = (export_writer*)malloc(sizeof(export_writer));
+	open_export_writer(writer, benchmark->directory ? path : NULL);
+	dungeon* d = &benchmark->dungeons[index % BENCHMARK_EXPORT_DUNGEONS];
+	switch(benchmark->format)
+	{
+		case EXPORT_PNG: export_png(writer, d); break;
+		case EXPORT_CSV: export_csv(writer, d); break;
+		case EXPORT_JSON: export_json(writer, d, index); break;
+		case EXPORT_TMX: export_tmx(writer, d); break;
+	}
+	close_export_writer(writer);
+	InterlockedExchangeAdd(&benchmark->bytes, (LONG)writer->written);
+	free(writer);
+}
+
+//Each format encoded into a discarding writer and then written to files, dungeons exported in parallel
+//Where the two take about as long the export is bound by the disk rather than by encoding
+void benchmark_exports()
+{
+	const char* directory = "benchmark_exports";
+	char path[256];
+	int map_size = default_dungeon_config::width*default_dungeon_config::height;
+	dungeon* dungeons = (dungeon*)malloc(BENCHMARK_EXPORT_DUNGEONS*sizeof(dungeon));
+	char* tiles = (char*)malloc(BENCHMARK_EXPORT_DUNGEONS*map_size);
+	for(int i = 0; i < BENCHMARK_EXPORT_DUNGEONS; i++)
+	{
+		seed_rng(i);
+		generate_dungeon(&dungeons[i], tiles + i*map_size, default_dungeon_config());
+	}
+	CreateDirectoryA(directory, NULL);
+	printf("Exports (%d dungeons, %d threads)\n", BENCHMARK_EXPORTS, processor_count());
+
+	export_format formats[] = {EXPORT_PNG, EXPORT_CSV, EXPORT_JSON, EXPORT_TMX};
+	for(int i = 0; i < 4; i++)
+	{
+		char name[64];
+		timer t;
+		export_benchmark benchmark = {dungeons, formats[i], NULL, 0};
+		start_timer(&t);
+		parallel_for(BENCHMARK_EXPORTS, export_benchmark_job, &benchmark);
+		end_timer(&t);
+		sprintf(name, "%s encode", export_extension(formats[i]));
+		report_benchmark(name, &t, BENCHMARK_EXPORTS);
+		printf("%-36s %10.1f MB/s, %ld bytes each\n", "", benchmark.bytes/(1024.0*1024.0)*1000000.0/time_elapsed_microsec(&t), benchmark.bytes/BENCHMARK_EXPORTS);
+
+		benchmark.directory = directory;
+		benchmark.bytes = 0;
+		start_timer(&t);
+		parallel_for(BENCHMARK_EXPORTS, export_benchmark_job, &benchmark);
+		end_timer(&t);
+		sprintf(name, "%s to files", export_extension(formats[i]));
+		report_benchmark(name, &t, BENCHMARK_EXPORTS);
+		printf("%-36s %10.1f MB/s\n", "", benchmark.bytes/(1024.0*1024.0)*1000000.0/time_elapsed_microsec(&t));
+		for(int j = 0; j < BENCHMARK_EXPORTS; j++)
+		{
+			sprintf(path, "%s/%d.%s", directory, j, export_extension(formats[i]));
+			DeleteFileA(path);
+		}
+	}
+	RemoveDirectoryA(directory);
+	for(int i = 0; i < BENCHMARK_EXPORT_DUNGEONS; i++) destroy_dungeon(&dungeons[i]);
+	free(tiles);
+	free(dungeons);
+}
+
+//One generator against every generator, the stats say which stage limits each run
+void benchmark_pipeline()
+{
+	const char* path = "benchmark_pipeline.dng";
+	runtime_dungeon_config config = make_runtime_config(default_dungeon_config());
+	int generator_counts[] = {1, 0};
+	for(int i = 0; i < 2; i++)
+	{
+		pipeline_stats stats;
+		run_dungeon_pipeline(path, config, 0, BENCHMARK_PIPELINE_DUNGEONS, generator_counts[i], &stats);
+		print_pipeline_stats(&stats);
+	}
+	DeleteFileA(path);
+}
+
+//Variants from nearby parameters, the same seeds through the batch generator with a different leaf_odds
+//Compared against sending each variant's image with only its tiles through the tile codec
+void benchmark_deltas()
+{
+	runtime_dungeon_config configs[2] = {make_runtime_config(default_dungeon_config()), make_runtime_config(default_dungeon_config())};
+	configs[1].leaf_odds = 4;
+	uint32_t capacity = 0;
+	char* images[2][BENCHMARK_DELTA_PAIRS];
+	dungeon_view views[2][BENCHMARK_DELTA_PAIRS];
+	for(int i = 0; i < 2; i++)
+	{
+		dungeon_batch batch;
+		create_dungeon_batch(&batch, configs[i]);
+		for(int pair = 0; pair < BENCHMARK_DELTA_PAIRS; pair += BATCH_LANES)
+		{
+			uint32_t seeds[BATCH_LANES];
+			for(int lane = 0; lane < BATCH_LANES; lane++) seeds[lane] = pair + lane;
+			generate_dungeon_batch(&batch, seeds);
+			for(int lane = 0; lane < BATCH_LANES; lane++)
+			{
+				uint32_t size = batch_lane_file_size(&batch, lane);
+				images[i][pair + lane] = (char*)malloc(size);
+				serialize_batch_lane(&batch, lane, seeds[lane], images[i][pair + lane], size);
+				open_dungeon_view(&views[i][pair + lane], images[i][pair + lane], size);
+				if(max_dungeon_delta_size(&views[i][pair + lane]) > capacity) capacity = max_dungeon_delta_size(&views[i][pair + lane]);
+			}
+		}
+		destroy_dungeon_batch(&batch);
+	}
+
+	char* deltas = (char*)malloc(BENCHMARK_DELTA_PAIRS*capacity);
+	uint32_t delta_sizes[BENCHMARK_DELTA_PAIRS];
+	char* image = (char*)malloc(capacity);
+	uint64_t image_bytes = 0;
+	uint64_t delta_bytes = 0;
+	uint64_t codec_bytes = 0;
+	timer t;
+	start_timer(&t);
+	for(int pass = 0; pass < BENCHMARK_DELTA_PASSES; pass++)
+	{
+		for(int i = 0; i < BENCHMARK_DELTA_PAIRS; i++) delta_sizes[i] = encode_dungeon_delta(&views[0][i], &views[1][i], deltas + i*capacity, capacity);
+	}
+	end_timer(&t);
+	printf("Dungeon deltas (%d pairs, leaf_odds %d against %d)\n", BENCHMARK_DELTA_PAIRS, configs[1].leaf_odds, configs[0].leaf_odds);
+	report_benchmark("encode_dungeon_delta", &t, BENCHMARK_DELTA_PAIRS*BENCHMARK_DELTA_PASSES);
+
+	int failed = 0;
+	start_timer(&t);
+	for(int pass = 0; pass < BENCHMARK_DELTA_PASSES; pass++)
+	{
+		for(int i = 0; i < BENCHMARK_DELTA_PAIRS; i++) failed += !apply_dungeon_delta(&views[0][i], deltas + i*capacity, delta_sizes[i], image, capacity);
+	}
+	end_timer(&t);
+	report_benchmark("apply_dungeon_delta", &t, BENCHMARK_DELTA_PAIRS*BENCHMARK_DELTA_PASSES);
+
+	for(int i = 0; i < BENCHMARK_DELTA_PAIRS; i++)
+	{
+		const dungeon_file_header* header = views[1][i].header;
+		image_bytes += header->file_size;
+		delta_bytes += delta_sizes[i];
+		codec_bytes += header->tile_offset + compress_tiles(views[1][i].tiles, header->config.width, header->config.height, (uint8_t*)image);
+	}
+	printf("Image %llu bytes, tiles through the codec %llu, delta %llu (%.1fx smaller than the image, %.1fx than the codec)", image_bytes/BENCHMARK_DELTA_PAIRS,
+		codec_bytes/BENCHMARK_DELTA_PAIRS, delta_bytes/BENCHMARK_DELTA_PAIRS, (double)image_bytes/delta_bytes, (double)codec_bytes/delta_bytes);
+	printf(failed ? ", %d failed\n\n" : "\n\n", failed);
+
+	for(int i = 0; i < BENCHMARK_DELTA_PAIRS; i++)
+	{
+		free(images[0][i]);
+		free(images[1][i]);
+	}
+	free(deltas);
+	free(image);
+}
+
+struct chunk_benchmark
+{
+	timer* first_chunk;
+	int chunks;
+	uint64_t bytes;
+};
+
+bool chunk_benchmark_sink(void* data, const void* chunk, uint32_t size)
+{
+	chunk_benchmark* benchmark = (chunk_benchmark*)data;
+	if(!benchmark->chunks++) end_timer(benchmark->first_chunk);
+	benchmark->bytes += size;
+	return true;
+}
+
+//Time from starting generation until the first chunk is ready, against until the whole image is serialized and its tiles compressed
+void benchmark_chunk_size(int size)
+{
+	runtime_dungeon_config config = make_runtime_config(default_dungeon_config());
+	config.width = config.height = size;
+	char* tiles = (char*)malloc(size*size);
+	char* image = NULL;
+	uint8_t* encoded = (uint8_t*)malloc(max_encoded_size(size*size) + TILE_CODEC_MAX_TOKEN);
+	dungeon* d = (dungeon*)malloc(sizeof(dungeon));
+	int64_t whole = 0;
+	int64_t first = 0;
+	int64_t streamed = 0;
+	uint64_t whole_bytes = 0;
+	chunk_benchmark benchmark = {};
+	for(int i = 0; i < BENCHMARK_CHUNK_MAPS; i++)
+	{
+		timer t;
+		start_timer(&t);
+		seed_rng(i);
+		generate_dungeon(d, tiles, config);
+		uint32_t image_size = dungeon_file_size(d);
+		image = (char*)realloc(image, image_size);
+		serialize_dungeon(d, i, config, image, image_size);
+		whole_bytes += ((dungeon_file_header*)image)->tile_offset + compress_tiles(d->tiles, size, size, encoded);
+		end_timer(&t);
+		whole += time_elapsed_microsec(&t);
+		destroy_dungeon(d);
+
+		timer first_chunk;
+		benchmark.first_chunk = &first_chunk;
+		benchmark.chunks = 0;
+		start_timer(&t);
+		first_chunk.start = t.start;
+		first_chunk.frequency = t.frequency;
+		seed_rng(i);
+		generate_dungeon(d, tiles, config);
+		stream_dungeon_chunks(d, i, DUNGEON_CHUNK_SIZE, size/2, size/2, chunk_benchmark_sink, &benchmark);
+		end_timer(&t);
+		first += time_elapsed_microsec(&first_chunk);
+		streamed += time_elapsed_microsec(&t);
+		destroy_dungeon(d);
+	}
+	printf("%dx%d: whole image %lldus, first chunk %lldus, every chunk %lldus\n", size, size, (long long)(whole/BENCHMARK_CHUNK_MAPS), (long long)(first/BENCHMARK_CHUNK_MAPS), (long long)(streamed/BENCHMARK_CHUNK_MAPS));
+	printf("%-36s %d chunks of %llu bytes in all, image with compressed tiles %llu bytes\n", "", benchmark.chunks, benchmark.bytes/BENCHMARK_CHUNK_MAPS, whole_bytes/BENCHMARK_CHUNK_MAPS);
+	free(d);
+	free(encoded);
+	free(image);
+	free(tiles);
+}
+
+void benchmark_chunks()
+{
+	printf("Chunked tile streams (%d maps each, %d tile chunks from the centre out)\n", BENCHMARK_CHUNK_MAPS, DUNGEON_CHUNK_SIZE);
+	benchmark_chunk_size(256);
+	benchmark_chunk_size(1024);
+	benchmark_chunk_size(4096);
+	printf("\n");
+}
+
+//The scalar versions maths.c had before its SIMD kernels, kept to benchmark against
+mat4 scalar_multiply(mat4 m_0, mat4 m_1)
+{
+	mat4 m_2 = {};
+	for(int col = 0; col < 4; col++)
+	{
+		for(int row = 0; row < 4; row++)
+		{
+			for(int i = 0; i < 4; i++) m_2[col][row] += m_0[i][row]*m_1[col][i];
+		}
+	}
+	return m_2;
+}
+
+mat4 scalar_identity()
+{
+	mat4 m;
+	for(int i = 0; i < 4; i++)
+	{
+		for(int j = 0; j < 4; j++) m[i][j] = (i == j) ? 1.0f : 0.0f;
+	}
+	return m;
+}
+
+mat4 scalar_translate(vec3d v)
+{
+	mat4 m = scalar_identity();
+	m[3].xyz = v;
+	return m;
+}
+
+void scalar_transform(mat4* m, const vec4d* in, vec4d* out, int count)
+{
+	for(int i = 0; i < count; i++)
+	{
+		vec4d v = in[i];
+		for(int row = 0; row < 4; row++) out[i][row] = (*m)[0][row]*v.x + (*m)[1][row]*v.y + (*m)[2][row]*v.z + (*m)[3][row]*v.w;
+	}
+}
+
+float matrix_checksum(mat4* matrices, int count)
+{
+	float sum = 0.0f;
+	for(int i = 0; i < count; i++) sum += matrices[i][0][0] + matrices[i][3][3];
+	return sum;
+}
+
+void benchmark_maths()
+{
+	mat4* matrices = (mat4*)_aligned_malloc(BENCHMARK_MATRICES*sizeof(mat4), alignof(mat4));
+	mat4* products = (mat4*)_aligned_malloc(BENCHMARK_MATRICES*sizeof(mat4), alignof(mat4));
+	vec4d* vectors = (vec4d*)_aligned_malloc(BENCHMARK_TILE_TRANSFORMS*sizeof(vec4d), alignof(vec4d));
+	vec3d* positions = (vec3d*)malloc(BENCHMARK_TILE_TRANSFORMS*sizeof(vec3d));
+	vec4d* transformed = (vec4d*)_aligned_malloc(BENCHMARK_TILE_TRANSFORMS*sizeof(vec4d), alignof(vec4d));
+	for(int i = 0; i < BENCHMARK_MATRICES; i++) matrices[i] = rotate_about_axis(vec3d{0.0f, 0.0f, 1.0f}, i*0.01f)*scale(1.0f + i*0.001f);
+	for(int i = 0; i < BENCHMARK_TILE_TRANSFORMS; i++)
+	{
+		positions[i] = vec3d{(float)(i % MAP_SIZE), (float)(i / MAP_SIZE), 0.0f};
+		vectors[i] = vec4d{positions[i].x, positions[i].y, 0.0f, 1.0f};
+	}
+	mat4 projection = orthographic_projection(0.0f, 128.0f, 0.0f, 128.0f, -1.0f, 1.0f);
+	printf("Maths kernels\n");
+
+	timer t;
+	start_timer(&t);
+	for(int pass = 0; pass < BENCHMARK_MATRIX_PASSES; pass++)
+	{
+		for(int i = 0; i < BENCHMARK_MATRICES; i++) products[i] = scalar_multiply(matrices[i], matrices[(i + pass) % BENCHMARK_MATRICES]);
+	}
+	end_timer(&t);
+	report_benchmark("mat4 multiply (scalar)", &t, BENCHMARK_MATRICES*BENCHMARK_MATRIX_PASSES);
+	float scalar_sum = matrix_checksum(products, BENCHMARK_MATRICES);
+	start_timer(&t);
+	for(int pass = 0; pass < BENCHMARK_MATRIX_PASSES; pass++)
+	{
+		for(int i = 0; i < BENCHMARK_MATRICES; i++) products[i] = matrices[i]*matrices[(i + pass) % BENCHMARK_MATRICES];
+	}
+	end_timer(&t);
+	report_benchmark("mat4 multiply", &t, BENCHMARK_MATRICES*BENCHMARK_MATRIX_PASSES);
+	if(fabsf(scalar_sum - matrix_checksum(products, BENCHMARK_MATRICES)) > 0.01f) printf("mat4 multiply results differ\n");
+
+	//Each tile's model matrix, as the render loop builds them
+	start_timer(&t);
+	for(int i = 0; i < BENCHMARK_TILE_TRANSFORMS; i++) products[i % BENCHMARK_MATRICES] = scalar_translate(positions[i]);
+	end_timer(&t);
+	benchmark_sink = (int)matrix_checksum(products, BENCHMARK_MATRICES);
+	report_benchmark("translate per tile (scalar)", &t, BENCHMARK_TILE_TRANSFORMS);
+	start_timer(&t);
+	for(int i = 0; i < BENCHMARK_TILE_TRANSFORMS; i++) products[i % BENCHMARK_MATRICES] = translate(positions[i]);
+	end_timer(&t);
+	benchmark_sink = (int)matrix_checksum(products, BENCHMARK_MATRICES);
+	report_benchmark("translate per tile", &t, BENCHMARK_TILE_TRANSFORMS);
+
+	start_timer(&t);
+	for(int pass = 0; pass < 100; pass++) scalar_transform(&projection, vectors, transformed, BENCHMARK_TILE_TRANSFORMS);
+	end_timer(&t);
+	float scalar_x = transformed[BENCHMARK_TILE_TRANSFORMS - 1].x;
+	report_benchmark("transform tile positions (scalar)", &t, BENCHMARK_TILE_TRANSFORMS*100);
+	start_timer(&t);
+	for(int pass = 0; pass < 100; pass++) transform_vectors(&projection, vectors, transformed, BENCHMARK_TILE_TRANSFORMS);
+	end_timer(&t);
+	report_benchmark("transform_vectors", &t, BENCHMARK_TILE_TRANSFORMS*100);
+	if(transformed[BENCHMARK_TILE_TRANSFORMS - 1].x != scalar_x) printf("transform results differ\n");
+	start_timer(&t);
+	for(int pass = 0; pass < 100; pass++) transform_positions(&projection, positions, transformed, BENCHMARK_TILE_TRANSFORMS);
+	end_timer(&t);
+	report_benchmark("transform_positions", &t, BENCHMARK_TILE_TRANSFORMS*100);
+	printf("\n");
+
+	_aligned_free(matrices);
+	_aligned_free(products);
+	_aligned_free(vectors);
+	free(positions);
+	_aligned_free(transformed);
+}
+
+//Every tile's transform for one frame, per tile as the render loop used to build them and as one batch
+void benchmark_tile_batch_size(int size, int passes)
+{
+	runtime_dungeon_config config = make_runtime_config(default_dungeon_config());
+	config.width = config.height = size;
+	char* tiles = (char*)malloc(size*size);
+	vec2d* offsets = (vec2d*)malloc(size*size*sizeof(vec2d));
+	mat4* models = (mat4*)_aligned_malloc(BENCHMARK_MATRICES*sizeof(mat4), alignof(mat4));
+	dungeon* d = (dungeon*)malloc(sizeof(dungeon));
+	seed_rng(size);
+	generate_dungeon(d, tiles, config);
+	destroy_dungeon(d);
+	int tile_count = size*size;
+	char label[64];
+
+	timer t;
+	start_timer(&t);
+	for(int pass = 0; pass < passes; pass++)
+	{
+		for(int y = 0; y < size; y++)
+		{
+			for(int x = 0; x < size; x++) models[(y*size + x) % BENCHMARK_MATRICES] = translate(vec3d{(float)x, (float)y, 0.0f});
+		}
+	}
+	end_timer(&t);
+	benchmark_sink = (int)matrix_checksum(models, BENCHMARK_MATRICES);
+	snprintf(label, sizeof(label), "%d: translate per tile", size);
+	report_benchmark(label, &t, tile_count*passes);
+
+	tile_batch batch;
+	start_timer(&t);
+	for(int pass = 0; pass < passes; pass++) batch_tile_offsets(tiles, size, size, offsets, &batch, 1);
+	end_timer(&t);
+	snprintf(label, sizeof(label), "%d: batch_tile_offsets", size);
+	report_benchmark(label, &t, tile_count*passes);
+	start_timer(&t);
+	for(int pass = 0; pass < passes; pass++) batch_tile_offsets(tiles, size, size, offsets, &batch);
+	end_timer(&t);
+	snprintf(label, sizeof(label), "%d: batch_tile_offsets, %d threads", size, processor_count());
+	report_benchmark(label, &t, tile_count*passes);
+
+	//What the render loop submits, the tiles under a camera showing MAP_SIZE tiles from the middle of the map
+	camera view = make_camera(vec2d{0.5f*size, 0.5f*size}, (float)MAP_SIZE, 1.0f);
+	start_timer(&t);
+	for(int pass = 0; pass < passes; pass++)
+	{
+		tile_rect visible = visible_tiles(&view, size, size);
+		batch_tile_rect_offsets(tiles, size, visible.min_x, visible.min_y, visible.max_x, visible.max_y, offsets, &batch);
+	}
+	end_timer(&t);
+	snprintf(label, sizeof(label), "%d: frame culled to the camera", size);
+	report_benchmark(label, &t, passes);
+	batch_tile_offsets(tiles, size, size, offsets, &batch);
+
+	//Each type's range must hold exactly that type's tiles
+	int batched = 0;
+	bool correct = true;
+	for(int type = 0; type < TILE_BATCH_MAX_TYPES; type++)
+	{
+		batched += batch.count[type];
+		for(int i = batch.first[type]; i < batch.first[type] + batch.count[type]; i++) correct = correct && tiles[(int)offsets[i].y*size + (int)offsets[i].x] == type;
+	}
+	if(!correct || batched != tile_count) printf("Tile batch is wrong\n");
+
+	free(tiles);
+	free(offsets);
+	_aligned_free(models);
+	free(d);
+}
+
+void benchmark_tile_batches()
+{
+	printf("Tile transforms per frame (square maps of each size)\n");
+	benchmark_tile_batch_size(MAP_SIZE, 1000);
+	benchmark_tile_batch_size(1024, 20);
+	benchmark_tile_batch_size(4096, 2);
+	printf("\n");
+}
+
+//Building the pyramid over a huge map, and a frame zoomed out to show all of it on a BENCHMARK_SCREEN_HEIGHT pixel screen with and without it
+void benchmark_pyramids()
+{
+	int size = BENCHMARK_PYRAMID_SIZE;
+	runtime_dungeon_config config = make_runtime_config(default_dungeon_config());
+	config.width = config.height = size;
+	char* tiles = (char*)malloc(size*size);
+	vec2d* offsets = (vec2d*)malloc(size*size*sizeof(vec2d));
+	dungeon* d = (dungeon*)malloc(sizeof(dungeon));
+	seed_rng(size);
+	generate_dungeon(d, tiles, config);
+	destroy_dungeon(d);
+	printf("Tile pyramid (%dx%d map)\n", size, size);
+
+	tile_pyramid pyramid;
+	create_tile_pyramid(&pyramid, tiles, size, size);
+	timer t;
+	start_timer(&t);
+	for(int pass = 0; pass < BENCHMARK_PYRAMID_PASSES; pass++) build_tile_pyramid(&pyramid, 1);
+	end_timer(&t);
+	printf("%-36s %10.2f ms\n", "build pyramid, 1 thread", time_elapsed_microsec(&t)/(1000.0*BENCHMARK_PYRAMID_PASSES));
+	start_timer(&t);
+	for(int pass = 0; pass < BENCHMARK_PYRAMID_PASSES; pass++) build_tile_pyramid(&pyramid);
+	end_timer(&t);
+	char label[64];
+	snprintf(label, sizeof(label), "build pyramid, %d threads", processor_count());
+	printf("%-36s %10.2f ms\n", label, time_elapsed_microsec(&t)/(1000.0*BENCHMARK_PYRAMID_PASSES));
+
+	camera view = make_camera(vec2d{0.5f*size, 0.5f*size}, (float)size, 1.0f);
+	tile_batch batch;
+	memset(offsets, 0, size*size*sizeof(vec2d)); //Fault the pages in before timing
+	start_timer(&t);
+	tile_rect visible = visible_tiles(&view, size, size);
+	batch_tile_rect_offsets(tiles, size, visible.min_x, visible.min_y, visible.max_x, visible.max_y, offsets, &batch);
+	end_timer(&t);
+	int instances = size*size;
+	printf("%-36s %10.2f ms %10d tiles\n", "whole map frame, every tile", time_elapsed_microsec(&t)/1000.0, instances);
+
+	start_timer(&t);
+	int level = pyramid_level_for(&pyramid, view.height/BENCHMARK_SCREEN_HEIGHT);
+	visible = pyramid_level_rect(visible_tiles(&view, size, size), level);
+	batch_tile_rect_offsets(pyramid.levels[level], pyramid.widths[level], visible.min_x, visible.min_y, visible.max_x, visible.max_y, offsets, &batch);
+	end_timer(&t);
+	instances = 0;
+	for(int type = 0; type < TILE_BATCH_MAX_TYPES; type++) instances += batch.count[type];
+	snprintf(label, sizeof(label), "whole map frame, level %d", level);
+	printf("%-36s %10.2f ms %10d tiles\n\n", label, time_elapsed_microsec(&t)/1000.0, instances);
+
+	destroy_tile_pyramid(&pyramid);
+	free(tiles);
+	free(offsets);
+	free(d);
+}
+
+void count_job(void* data, int index)
+{
+	InterlockedIncrement((volatile LONG*)data);
+}
+
+//Cost of one split of work across every processor, what frame by frame work like region recording pays on top of the work itself
+void benchmark_job_pool()
+{
+	int threads = processor_count();
+	volatile LONG counted = 0;
+	printf("Job dispatch (%d threads)\n", threads);
+	timer t;
+	start_timer(&t);
+	for(int run = 0; run < BENCHMARK_JOB_RUNS; run++) parallel_for(threads, count_job, (void*)&counted, threads);
+	end_timer(&t);
+	report_benchmark("parallel_for", &t, BENCHMARK_JOB_RUNS);
+
+	job_pool pool;
+	create_job_pool(&pool, threads);
+	start_timer(&t);
+	for(int run = 0; run < BENCHMARK_JOB_RUNS; run++) run_jobs(&pool, threads, count_job, (void*)&counted);
+	end_timer(&t);
+	destroy_job_pool(&pool);
+	report_benchmark("run_jobs", &t, BENCHMARK_JOB_RUNS);
+	if(counted != 2*BENCHMARK_JOB_RUNS*threads) printf("Jobs went missing\n");
+	printf("\n");
+}
+
+void run_benchmarks()
+{
+	benchmark_spatial_queries();
+	benchmark_room_graph();
+	benchmark_validation();
+	benchmark_generator_configs();
+	benchmark_room_fills();
+	benchmark_batch_generation();
+	benchmark_dungeon_files();
+	benchmark_archive();
+	benchmark_codecs();
+	benchmark_regeneration_sizes();
+	benchmark_service();
+	benchmark_cache();
+	benchmark_exports();
+	benchmark_pipeline();
+	benchmark_deltas();
+	benchmark_chunks();
+	benchmark_maths();
+	benchmark_tile_batches();
+	benchmark_pyramids();
+	benchmark_job_pool();
+}
@@ -0,0 +1,4 @@
+#pragma once
+
+//Runs with "-bench" on the command line, results are printed to stdout
+void run_benchmarks();
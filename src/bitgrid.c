@@ -0,0 +1,60 @@
+#include "bitgrid.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+void create_bitgrid(bitgrid* grid, int width, int height)
+{
+	grid->width = width;
+	grid->height = height;
+	grid->words_per_row = (width + 63)/64;
+	grid->words = (uint64_t*)calloc(grid->words_per_row*height, sizeof(uint64_t));
+}
+
+void destroy_bitgrid(bitgrid* grid)
+{
+	free(grid->words);
+	grid->words = NULL;
+}
+
+void clear_bitgrid(bitgrid* grid)
+{
+	memset(grid->words, 0, grid->words_per_row*grid->height*sizeof(uint64_t));
+}
+
+void set_bit(bitgrid* grid, int x, int y)
+{
+	grid->words[y*grid->words_per_row + x/64] |= (uint64_t)1 << (x%64);
+}
+
+bool get_bit(bitgrid* grid, int x, int y)
+{
+	return (grid->words[y*grid->words_per_row + x/64] >> (x%64)) & 1;
+}
+
+int count_bits(bitgrid* grid)
+{
+	int count = 0;
+	for(int i = 0; i < grid->words_per_row*grid->height; i++) count += __builtin_popcountll(grid->words[i]);
+	return count;
+}
+
+void bitgrid_from_tiles(bitgrid* grid, const char* tiles, char tile)
+{
+	clear_bitgrid(grid);
+	for(int y = 0; y < grid->height; y++)
+	{
+		const char* row = tiles + y*grid->width;
+		uint64_t* bits = grid->words + y*grid->words_per_row;
+		int x = 0;
+#ifdef __SSE2__
+		__m128i match = _mm_set1_epi8(tile);
+		for(; x + 16 <= grid->width; x += 16)
+		{
+			uint64_t matched = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(row + x)), match));
+			bits[x/64] |= matched << (x%64);
+		}
+#endif
+		for(; x < grid->width; x++) bits[x/64] |= (uint64_t)(row[x] == tile) << (x%64);
+	}
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+//One bit per tile, each row padded to a whole number of 64 bit words
+struct bitgrid
+{
+	int width;
+	int height;
+	int words_per_row;
+	uint64_t* words;
+};
+
+void create_bitgrid(bitgrid*, int width, int height);
+void destroy_bitgrid(bitgrid*);
+void clear_bitgrid(bitgrid*);
+
+void set_bit(bitgrid*, int x, int y);
+bool get_bit(bitgrid*, int x, int y);
+int count_bits(bitgrid*);
+
+//Sets the bit for every tile equal to tile, comparing 16 tiles at a time where SSE2 is available
+void bitgrid_from_tiles(bitgrid*, const char* tiles, char tile);
+
@@ -0,0 +1,226 @@
+#include "cache.h"
+
+dungeon_cache_key make_cache_key(uint64_t seed, runtime_dungeon_config config, uint32_t generator_version)
+{
+	dungeon_cache_key key;
+	memset(&key, 0, sizeof(key));
+	key.seed = seed;
+	key.config = config;
+	key.generator_version = generator_version;
+	return key;
+}
+
+uint32_t hash_cache_key(const dungeon_cache_key* key)
+{
+	const runtime_dungeon_config& c = key->config;
+	uint64_t hash = key->seed ^ ((uint64_t)key->generator_version << 48);
+	uint32_t fields[] = {(uint32_t)c.width, (uint32_t)c.height, (uint32_t)c.min_partition, (uint32_t)c.min_room, (uint32_t)c.leaf_odds, (uint32_t)c.min_depth};
+	for(int i = 0; i < 6; i++) hash = (hash ^ fields[i])*0x9E3779B97F4A7C15ull;
+	hash ^= hash >> 29;
+	return (uint32_t)(hash*0xBF58476D1CE4E5B9ull >> 32);
+}
+
+bool same_cache_key(const dungeon_cache_key* a, const dungeon_cache_key* b)
+{
+	const runtime_dungeon_config& c = a->config;
+	const runtime_dungeon_config& d = b->config;
+	return a->seed == b->seed && a->generator_version == b->generator_version && c.width == d.width && c.height == d.height &&
+		c.min_partition == d.min_partition && c.min_room == d.min_room && c.leaf_odds == d.leaf_odds && c.min_depth == d.min_depth;
+}
+
+uint32_t cache_entry_memory(cache_entry* entry)
+{
+	return sizeof(cache_entry) + entry->stored_size;
+}
+
+//Shards use the top bits of the hash and buckets the bottom bits
+cache_shard* key_shard(dungeon_cache* cache, uint32_t hash)
+{
+	return &cache->shards[hash >> 28 & (CACHE_SHARDS - 1)];
+}
+
+void create_dungeon_cache(dungeon_cache* cache, uint32_t memory_budget)
+{
+	memset(cache, 0, sizeof(dungeon_cache));
+	for(int i = 0; i < CACHE_SHARDS; i++)
+	{
+		cache_shard* shard = &cache->shards[i];
+		InitializeCriticalSection(&shard->lock);
+		shard->bucket_count = CACHE_MIN_BUCKETS;
+		shard->buckets = (cache_entry**)calloc(shard->bucket_count, sizeof(cache_entry*));
+		shard->memory_budget = memory_budget/CACHE_SHARDS;
+	}
+}
+
+void destroy_dungeon_cache(dungeon_cache* cache)
+{
+	for(int i = 0; i < CACHE_SHARDS; i++)
+	{
+		cache_shard* shard = &cache->shards[i];
+		for(cache_entry* entry = shard->newest; entry;)
+		{
+			cache_entry* older = entry->older;
+			free(entry);
+			entry = older;
+		}
+		free(shard->buckets);
+		DeleteCriticalSection(&shard->lock);
+	}
+	memset(cache, 0, sizeof(dungeon_cache));
+}
+
+//The functions below are called with the shard's lock held
+
+cache_entry** find_bucket_link(cache_shard* shard, const dungeon_cache_key* key, uint32_t hash)
+{
+	cache_entry** link = &shard->buckets[hash & (shard->bucket_count - 1)];
+	while(*link && ((*link)->hash != hash || !same_cache_key(&(*link)->key, key))) link = &(*link)->next_in_bucket;
+	return link;
+}
+
+void unlink_recency(cache_shard* shard, cache_entry* entry)
+{
+	if(entry->newer) entry->newer->older = entry->older;
+	else shard->newest = entry->older;
+	if(entry->older) entry->older->newer = entry->newer;
+	else shard->oldest = entry->newer;
+}
+
+void push_newest(cache_shard* shard, cache_entry* entry)
+{
+	entry->newer = NULL;
+	entry->older = shard->newest;
+	if(shard->newest) shard->newest->newer = entry;
+	else shard->oldest = entry;
+	shard->newest = entry;
+}
+
+void remove_cache_entry(cache_shard* shard, cache_entry* entry)
+{
+	cache_entry** link = find_bucket_link(shard, &entry->key, entry->hash);
+	*link = entry->next_in_bucket;
+	unlink_recency(shard, entry);
+	shard->entry_count--;
+	shard->memory_used -= cache_entry_memory(entry);
+	free(entry);
+}
+
+//Doubles the table once it averages more than one entry a bucket
+void grow_buckets(cache_shard* shard)
+{
+	uint32_t bucket_count = shard->bucket_count*2;
+	cache_entry** buckets = (cache_entry**)calloc(bucket_count, sizeof(cache_entry*));
+	for(uint32_t i = 0; i < shard->bucket_count; i++)
+	{
+		for(cache_entry* entry = shard->buckets[i]; entry;)
+		{
+			cache_entry* next = entry->next_in_bucket;
+			cache_entry** bucket = &buckets[entry->hash & (bucket_count - 1)];
+			entry->next_in_bucket = *bucket;
+			*bucket = entry;
+			entry = next;
+		}
+	}
+	free(shard->buckets);
+	shard->buckets = buckets;
+	shard->bucket_count = bucket_count;
+}
+
+bool find_cached_dungeon(dungeon_cache* cache, const dungeon_cache_key* key, char** image, uint32_t* size)
+{
+	uint32_t hash = hash_cache_key(key);
+	cache_shard* shard = key_shard(cache, hash);
+	EnterCriticalSection(&shard->lock);
+	cache_entry* entry = *find_bucket_link(shard, key, hash);
+	if(!entry)
+	{
+		shard->misses++;
+		LeaveCriticalSection(&shard->lock);
+		return false;
+	}
+	shard->hits++;
+	unlink_recency(shard, entry);
+	push_newest(shard, entry);
+
+	char* expanded = (char*)calloc(entry->image_size, 1);
+	memcpy(expanded, entry->data, entry->tile_offset);
+	const dungeon_file_header* header = (const dungeon_file_header*)expanded;
+	decompress_tiles((const uint8_t*)entry->data + entry->tile_offset, entry->stored_size - entry->tile_offset, expanded + entry->tile_offset, header->config.width, header->config.height);
+	*image = expanded;
+	*size = entry->image_size;
+	LeaveCriticalSection(&shard->lock);
+	return true;
+}
+
+void cache_dungeon(dungeon_cache* cache, const dungeon_cache_key* key, const char* image, uint32_t size)
+{
+	dungeon_view view;
+	if(!open_dungeon_view(&view, image, size)) return;
+	int width = view.header->config.width;
+	int height = view.header->config.height;
+	uint32_t tile_offset = view.header->tile_offset;
+
+	//Encoded before taking the lock, into an entry sized for the worst case and shrunk after
+	uint32_t capacity = tile_offset + max_encoded_size(width*height) + TILE_CODEC_MAX_TOKEN;
+	cache_entry* entry = (cache_entry*)malloc(sizeof(cache_entry) + capacity);
+	entry->key = *key;
+	entry->hash = hash_cache_key(key);
+	entry->image_size = view.header->file_size;
+	entry->tile_offset = tile_offset;
+	memcpy(entry->data, image, tile_offset);
+	entry->stored_size = tile_offset + compress_tiles(view.tiles, width, height, (uint8_t*)entry->data + tile_offset);
+	entry = (cache_entry*)realloc(entry, sizeof(cache_entry) + entry->stored_size);
+
+	cache_shard* shard = key_shard(cache, entry->hash);
+	uint32_t memory = cache_entry_memory(entry);
+	if(memory > shard->memory_budget)
+	{
+		free(entry);
+		return;
+	}
+
+	EnterCriticalSection(&shard->lock);
+	cache_entry* replaced = *find_bucket_link(shard, key, entry->hash);
+	if(replaced) remove_cache_entry(shard, replaced);
+	while(shard->memory_used + memory > shard->memory_budget)
+	{
+		remove_cache_entry(shard, shard->oldest);
+		shard->evictions++;
+	}
+	if(shard->entry_count >= shard->bucket_count) grow_buckets(shard);
+	cache_entry** bucket = &shard->buckets[entry->hash & (shard->bucket_count - 1)];
+	entry->next_in_bucket = *bucket;
+	*bucket = entry;
+	push_newest(shard, entry);
+	shard->entry_count++;
+	shard->memory_used += memory;
+	shard->insertions++;
+	LeaveCriticalSection(&shard->lock);
+}
+
+void get_cache_stats(dungeon_cache* cache, cache_stats* stats)
+{
+	memset(stats, 0, sizeof(cache_stats));
+	for(int i = 0; i < CACHE_SHARDS; i++)
+	{
+		cache_shard* shard = &cache->shards[i];
+		EnterCriticalSection(&shard->lock);
+		stats->hits += shard->hits;
+		stats->misses += shard->misses;
+		stats->insertions += shard->insertions;
+		stats->evictions += shard->evictions;
+		stats->entry_count += shard->entry_count;
+		stats->memory_used += shard->memory_used;
+		stats->memory_budget += shard->memory_budget;
+		for(cache_entry* entry = shard->newest; entry; entry = entry->older) stats->image_bytes += entry->image_size;
+		LeaveCriticalSection(&shard->lock);
+	}
+}
+
+void print_cache_stats(cache_stats* stats)
+{
+	printf("Dungeon cache\n");
+	printf("Hits = %u, misses = %u, insertions = %u, evictions = %u\n", stats->hits, stats->misses, stats->insertions, stats->evictions);
+	printf("Entries = %u, %u of %u bytes used", stats->entry_count, stats->memory_used, stats->memory_budget);
+	printf(" (%.1fx smaller than the images)\n\n", stats->memory_used ? (double)stats->image_bytes/stats->memory_used : 0.0);
+}
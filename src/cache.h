@@ -0,0 +1,80 @@
+#pragma once
+#include <windows.h>
+#include <stdint.h>
+#include "dungeon_file.h"
+#include "codec.h"
+
+#define CACHE_SHARDS 16 //Power of two
+#define CACHE_MIN_BUCKETS 64
+
+//Dungeon cache
+//Holds dungeon file images keyed by everything that decides what a seed generates, least recently used entries are evicted to stay within a memory budget
+//Entries are split across shards by key hash, each with its own lock, table and budget, so threads looking up different seeds rarely contend
+//An entry keeps the image's tables as they are and its tile grid through the tile codec, usually a fifth of the image or less
+
+struct dungeon_cache_key
+{
+	uint64_t seed;
+	runtime_dungeon_config config;
+	uint32_t generator_version; //Whichever generator the cache's owner uses, e.g. DUNGEON_GENERATOR_VERSION
+};
+
+struct cache_entry
+{
+	dungeon_cache_key key;
+	uint32_t hash;
+	uint32_t image_size; //Size of the image the entry expands back to
+	uint32_t tile_offset; //Bytes before this are stored as is, encoded tiles follow them
+	uint32_t stored_size;
+	cache_entry* next_in_bucket;
+	cache_entry* newer; //Recency list, most recent first
+	cache_entry* older;
+	char data[1];
+};
+
+struct cache_shard
+{
+	CRITICAL_SECTION lock;
+	cache_entry** buckets;
+	uint32_t bucket_count; //Power of two
+	uint32_t entry_count;
+	cache_entry* newest;
+	cache_entry* oldest;
+	uint32_t memory_used;
+	uint32_t memory_budget;
+
+	uint32_t hits;
+	uint32_t misses;
+	uint32_t insertions;
+	uint32_t evictions;
+};
+
+struct dungeon_cache
+{
+	cache_shard shards[CACHE_SHARDS];
+};
+
+struct cache_stats
+{
+	uint32_t hits;
+	uint32_t misses;
+	uint32_t insertions;
+	uint32_t evictions;
+	uint32_t entry_count;
+	uint32_t memory_used;
+	uint32_t memory_budget;
+	uint64_t image_bytes; //Total size of the cached images expanded, against memory_used
+};
+
+void create_dungeon_cache(dungeon_cache*, uint32_t memory_budget);
+void destroy_dungeon_cache(dungeon_cache*);
+
+dungeon_cache_key make_cache_key(uint64_t seed, runtime_dungeon_config, uint32_t generator_version = DUNGEON_GENERATOR_VERSION);
+
+//On a hit, image is malloced with the expanded dungeon file image and owned by the caller
+bool find_cached_dungeon(dungeon_cache*, const dungeon_cache_key*, char** image, uint32_t* size);
+//Stores a dungeon file image, replacing any entry with the same key, images that fail to open or outgrow a shard's budget are not cached
+void cache_dungeon(dungeon_cache*, const dungeon_cache_key*, const char* image, uint32_t size);
+
+void get_cache_stats(dungeon_cache*, cache_stats*);
+void print_cache_stats(cache_stats*);
@@ -0,0 +1,55 @@
+#include "camera.h"
+
+camera make_camera(vec2d centre, float height, float aspect)
+{
+	return camera{centre, height < CAMERA_MIN_HEIGHT ? CAMERA_MIN_HEIGHT : height, aspect};
+}
+
+void pan_camera(camera* c, vec2d offset)
+{
+	c->centre = c->centre + offset;
+}
+
+void zoom_camera(camera* c, float factor, vec2d anchor)
+{
+	float height = c->height*factor;
+	if(height < CAMERA_MIN_HEIGHT) height = CAMERA_MIN_HEIGHT;
+	//The anchor's distance from the centre scales with the view
+	float ratio = height/c->height;
+	c->centre.x = anchor.x + (c->centre.x - anchor.x)*ratio;
+	c->centre.y = anchor.y + (c->centre.y - anchor.y)*ratio;
+	c->height = height;
+}
+
+mat4 camera_view(camera* c)
+{
+	return translate(vec3d{-c->centre.x, -c->centre.y, 0.0f});
+}
+
+mat4 camera_projection(camera* c)
+{
+	float half_width = 0.5f*c->height*c->aspect;
+	float half_height = 0.5f*c->height;
+	return orthographic_projection(-half_width, half_width, -half_height, half_height, -1.0f, 1.0f);
+}
+
+view_bounds camera_bounds(camera* c)
+{
+	float half_width = 0.5f*c->height*c->aspect;
+	float half_height = 0.5f*c->height;
+	return view_bounds{c->centre.x - half_width, c->centre.y - half_height, c->centre.x + half_width, c->centre.y + half_height};
+}
+
+//Tile (x, y) covers [x, x + 1) so any tile the bounds touch is kept
+tile_rect visible_tiles(camera* c, int width, int height)
+{
+	view_bounds bounds = camera_bounds(c);
+	tile_rect rect;
+	rect.min_x = bounds.min_x <= 0.0f ? 0 : bounds.min_x >= width ? width : (int)bounds.min_x;
+	rect.min_y = bounds.min_y <= 0.0f ? 0 : bounds.min_y >= height ? height : (int)bounds.min_y;
+	rect.max_x = bounds.max_x <= 0.0f ? 0 : bounds.max_x >= width ? width : (int)ceilf(bounds.max_x);
+	rect.max_y = bounds.max_y <= 0.0f ? 0 : bounds.max_y >= height ? height : (int)ceilf(bounds.max_y);
+	rect.max_x = max(rect.min_x, rect.max_x);
+	rect.max_y = max(rect.min_y, rect.max_y);
+	return rect;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include "maths.h"
+#include "dungeon.h"
+
+#define CAMERA_MIN_HEIGHT 4.0f //Closest zoom, in tiles from the bottom of the view to the top
+
+//2D camera over the tile grid, everything in tile units
+//Its view matrix moves the centre to the origin and its projection scales the visible area to the screen
+struct camera
+{
+	vec2d centre; //Tile position at the middle of the view
+	float height; //Tiles visible from the bottom of the view to the top
+	float aspect; //Width of the view over its height
+};
+
+//Tile space area the camera sees
+struct view_bounds
+{
+	float min_x;
+	float min_y;
+	float max_x;
+	float max_y;
+};
+
+camera make_camera(vec2d centre, float height, float aspect);
+void pan_camera(camera*, vec2d offset);
+//Scales the visible height by factor, below 1 zooms in, keeping the tile space point anchor at the same place on screen
+void zoom_camera(camera*, float factor, vec2d anchor);
+
+mat4 camera_view(camera*);
+mat4 camera_projection(camera*);
+view_bounds camera_bounds(camera*);
+//Tiles of a width*height map that overlap the camera's view, straight from the bounds so its cost does not depend on the map
+//Empty (min == max) when the camera is off the map
+tile_rect visible_tiles(camera*, int width, int height);
@@ -0,0 +1,213 @@
+#include "codec.h"
+
+int max_encoded_size(int tile_count)
+{
+	//At most one run started before the call finishes as a long token, every other run costs at most 2 bytes a tile
+	return 2*tile_count + TILE_CODEC_MAX_TOKEN + 1;
+}
+
+void create_tile_encoder(tile_encoder* encoder, int width)
+{
+	encoder->width = width;
+	encoder->column = 0;
+	encoder->previous_row = (char*)calloc(width, 1);
+	encoder->run_delta = 0;
+	encoder->run_length = 0;
+}
+
+void destroy_tile_encoder(tile_encoder* encoder)
+{
+	free(encoder->previous_row);
+	encoder->previous_row = NULL;
+}
+
+int write_run(uint8_t* output, uint8_t delta, uint32_t length)
+{
+	int written = 0;
+	uint8_t kind = (delta < TILE_CODEC_LITERAL) ? delta : TILE_CODEC_LITERAL;
+	if(length <= TILE_CODEC_LONG_RUN)
+	{
+		output[written++] = (kind << 6) | (length - 1);
+	}
+	else
+	{
+		output[written++] = (kind << 6) | TILE_CODEC_LONG_RUN;
+		for(length -= TILE_CODEC_LONG_RUN + 1; length >= 0x80; length >>= 7) output[written++] = (length & 0x7F) | 0x80;
+		output[written++] = length;
+	}
+	if(kind == TILE_CODEC_LITERAL) output[written++] = delta;
+	return written;
+}
+
+//Number of leading tiles whose delta against the row above is delta, compared 8 at a time
+int match_length(const char* tiles, const char* above, int count, uint8_t delta)
+{
+	uint64_t repeated = 0x0101010101010101ull*delta;
+	int i = 0;
+	for(; i + 8 <= count; i += 8)
+	{
+		uint64_t a, b;
+		memcpy(&a, tiles + i, 8);
+		memcpy(&b, above + i, 8);
+		uint64_t mismatched = a ^ b ^ repeated;
+		if(mismatched) return i + __builtin_ctzll(mismatched)/8;
+	}
+	for(; i < count && (uint8_t)(tiles[i] ^ above[i]) == delta; i++);
+	return i;
+}
+
+int encode_tiles(tile_encoder* encoder, const char* tiles, int count, uint8_t* output)
+{
+	int written = 0;
+	for(int i = 0; i < count;)
+	{
+		//Work along the rest of the current row, the row above is updated once the segment is done
+		int segment = min(count - i, encoder->width - encoder->column);
+		const char* above = encoder->previous_row + encoder->column;
+		for(int j = 0; j < segment;)
+		{
+			int matched = match_length(tiles + i + j, above + j, segment - j, encoder->run_delta);
+			encoder->run_length += matched;
+			j += matched;
+			if(j == segment) break;
+			if(encoder->run_length) written += write_run(output + written, encoder->run_delta, encoder->run_length);
+			encoder->run_delta = tiles[i + j] ^ above[j];
+			encoder->run_length = 0;
+		}
+		memcpy(encoder->previous_row + encoder->column, tiles + i, segment);
+		encoder->column = (encoder->column + segment) % encoder->width;
+		i += segment;
+	}
+	return written;
+}
+
+int finish_tile_encoder(tile_encoder* encoder, uint8_t* output)
+{
+	int written = encoder->run_length ? write_run(output, encoder->run_delta, encoder->run_length) : 0;
+	encoder->run_length = 0;
+	return written;
+}
+
+void create_tile_decoder(tile_decoder* decoder, int width)
+{
+	*decoder = {};
+	decoder->width = width;
+	decoder->previous_row = (char*)calloc(width, 1);
+}
+
+void destroy_tile_decoder(tile_decoder* decoder)
+{
+	free(decoder->previous_row);
+	decoder->previous_row = NULL;
+}
+
+//Returns the size of the token at input, or 0 if it runs past the end of the input
+int read_run(const uint8_t* input, int input_size, uint8_t* delta, uint32_t* length)
+{
+	if(input_size < 1) return 0;
+	int read = 1;
+	uint8_t kind = input[0] >> 6;
+	uint32_t run_length = (input[0] & TILE_CODEC_LONG_RUN) + 1;
+	if(run_length > TILE_CODEC_LONG_RUN)
+	{
+		uint32_t extra = 0;
+		for(int shift = 0;; shift += 7)
+		{
+			if(read == input_size || shift > 28) return 0;
+			extra |= (uint32_t)(input[read] & 0x7F) << shift;
+			if(!(input[read++] & 0x80)) break;
+		}
+		run_length += extra;
+	}
+	uint8_t run_delta = kind;
+	if(kind == TILE_CODEC_LITERAL)
+	{
+		if(read == input_size) return 0;
+		run_delta = input[read++];
+	}
+	*delta = run_delta;
+	*length = run_length;
+	return read;
+}
+
+int decode_tiles(tile_decoder* decoder, const uint8_t* input, int input_size, int* consumed, char* tiles, int max_tiles)
+{
+	int read = 0;
+	int written = 0;
+	while(written < max_tiles)
+	{
+		if(!decoder->run_remaining)
+		{
+			//Finish a token split across calls before reading straight from the input
+			int token_size;
+			if(decoder->pending_size)
+			{
+				int copied = min(input_size - read, TILE_CODEC_MAX_TOKEN - decoder->pending_size);
+				memcpy(decoder->pending + decoder->pending_size, input + read, copied);
+				token_size = read_run(decoder->pending, decoder->pending_size + copied, &decoder->run_delta, &decoder->run_remaining);
+				if(!token_size)
+				{
+					decoder->pending_size += copied;
+					read += copied;
+					break;
+				}
+				read += token_size - decoder->pending_size;
+				decoder->pending_size = 0;
+			}
+			else
+			{
+				token_size = read_run(input + read, input_size - read, &decoder->run_delta, &decoder->run_remaining);
+				if(!token_size)
+				{
+					decoder->pending_size = input_size - read;
+					memcpy(decoder->pending, input + read, decoder->pending_size);
+					read = input_size;
+					break;
+				}
+				read += token_size;
+			}
+		}
+
+		//Zero runs repeat the row above, anything else is XORed onto it
+		while(decoder->run_remaining && written < max_tiles)
+		{
+			int segment = min(max_tiles - written, decoder->width - decoder->column);
+			if(decoder->run_remaining < (uint32_t)segment) segment = decoder->run_remaining;
+			char* above = decoder->previous_row + decoder->column;
+			if(decoder->run_delta == 0)
+			{
+				memcpy(tiles + written, above, segment);
+			}
+			else
+			{
+				for(int j = 0; j < segment; j++) above[j] = tiles[written + j] = above[j] ^ decoder->run_delta;
+			}
+			decoder->run_remaining -= segment;
+			decoder->column = (decoder->column + segment) % decoder->width;
+			written += segment;
+		}
+	}
+	*consumed = read;
+	return written;
+}
+
+int compress_tiles(const char* tiles, int width, int height, uint8_t* output)
+{
+	tile_encoder encoder;
+	create_tile_encoder(&encoder, width);
+	int written = encode_tiles(&encoder, tiles, width*height, output);
+	written += finish_tile_encoder(&encoder, output + written);
+	destroy_tile_encoder(&encoder);
+	return written;
+}
+
+bool decompress_tiles(const uint8_t* input, int input_size, char* tiles, int width, int height)
+{
+	tile_decoder decoder;
+	create_tile_decoder(&decoder, width);
+	int consumed;
+	int written = decode_tiles(&decoder, input, input_size, &consumed, tiles, width*height);
+	bool complete = written == width*height && consumed == input_size && !decoder.run_remaining && !decoder.pending_size;
+	destroy_tile_decoder(&decoder);
+	return complete;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "maths.h"
+
+//Tile grid codec
+//Each tile is XORed with the tile above it, so repeated rows become zero, then the row major stream of deltas is run length encoded
+//A token byte holds the run's delta in the top 2 bits and its length in the low 6:
+//	- Deltas 0-2 are stored directly, 3 means the delta is a byte following the token (and its length)
+//	- Lengths 1-63 are stored as length-1, 63 means the length is 64 plus a LEB128 varint following the token
+//Runs carry across rows and across calls, so both ends can work a few tiles at a time
+
+#define TILE_CODEC_LITERAL 3
+#define TILE_CODEC_LONG_RUN 63
+#define TILE_CODEC_MAX_TOKEN 7 //Token byte, 5 byte varint, literal byte
+
+struct tile_encoder
+{
+	int width;
+	int column;
+	char* previous_row;
+	uint8_t run_delta;
+	uint32_t run_length;
+};
+
+struct tile_decoder
+{
+	int width;
+	int column;
+	char* previous_row;
+	uint8_t run_delta;
+	uint32_t run_remaining;
+
+	//Start of a token split across input chunks
+	uint8_t pending[TILE_CODEC_MAX_TOKEN];
+	int pending_size;
+};
+
+//Output space encode_tiles() may need for count tiles
+int max_encoded_size(int tile_count);
+
+void create_tile_encoder(tile_encoder*, int width);
+void destroy_tile_encoder(tile_encoder*);
+//Encodes the next count tiles in row major order, returns the number of bytes written to output
+int encode_tiles(tile_encoder*, const char* tiles, int count, uint8_t* output);
+//Writes the last run, at most TILE_CODEC_MAX_TOKEN bytes
+int finish_tile_encoder(tile_encoder*, uint8_t* output);
+
+void create_tile_decoder(tile_decoder*, int width);
+void destroy_tile_decoder(tile_decoder*);
+//Decodes until the input is used up or max_tiles have been written, returns the number of tiles written
+//consumed is set to the number of input bytes used, input left over is passed again on the next call
+int decode_tiles(tile_decoder*, const uint8_t* input, int input_size, int* consumed, char* tiles, int max_tiles);
+
+//Whole grids in one call, compress_tiles() needs max_encoded_size(width*height) + TILE_CODEC_MAX_TOKEN bytes of output
+int compress_tiles(const char* tiles, int width, int height, uint8_t* output);
+bool decompress_tiles(const uint8_t* input, int input_size, char* tiles, int width, int height);
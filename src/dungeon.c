@@ -0,0 +1,81 @@
+#include "generator.h"
+
+char tile_map[MAP_SIZE][MAP_SIZE] = {};
+
+void destroy_bsp_tree(bsp_node* tree)
+{
+	if(tree->left_child) destroy_bsp_tree(tree->left_child);
+	if(tree->right_child) destroy_bsp_tree(tree->right_child);
+	free(tree);
+}
+
+void add_corridor(dungeon* d, int min_x, int min_y, int max_x, int max_y)
+{
+	if(min_x >= max_x || min_y >= max_y) return;
+	if(d->corridor_count == d->corridor_capacity)
+	{
+		d->corridor_capacity = max(2*d->corridor_capacity, 16);
+		d->corridors = (tile_rect*)realloc(d->corridors, d->corridor_capacity*sizeof(tile_rect));
+	}
+	d->corridors[d->corridor_count++] = tile_rect{min_x, min_y, max_x, max_y};
+}
+
+void reserve_contacts(dungeon* d, int count)
+{
+	if(d->contact_count + count <= d->contact_capacity) return;
+	d->contact_capacity = max(2*d->contact_capacity, d->contact_count + count);
+	d->contacts = (dungeon_contact*)realloc(d->contacts, d->contact_capacity*sizeof(dungeon_contact));
+}
+
+void generate_dungeon(dungeon* d)
+{
+	generate_dungeon(d, &tile_map[0][0], default_dungeon_config());
+}
+
+void destroy_dungeon(dungeon* d)
+{
+	destroy_bsp_tree(d->tree);
+	d->tree = NULL;
+	free(d->corridors);
+	d->corridors = NULL;
+	d->room_count = 0;
+	d->corridor_count = 0;
+	d->corridor_capacity = 0;
+	free(d->contacts);
+	d->contacts = NULL;
+	d->contact_count = 0;
+	d->contact_capacity = 0;
+}
+
+tile_rect room_rect(bsp_node* leaf)
+{
+	return tile_rect{(int)leaf->room_bottom_left.x, (int)leaf->room_bottom_left.y, (int)leaf->room_top_right.x, (int)leaf->room_top_right.y};
+}
+
+//Writes each leaf's room rect at its room index
+void gather_room_rects(bsp_node* node, tile_rect* rects)
+{
+	if(!node->left_child)
+	{
+		rects[node->room_index] = room_rect(node);
+		return;
+	}
+	gather_room_rects(node->left_child, rects);
+	gather_room_rects(node->right_child, rects);
+}
+
+int gather_floor_rects(dungeon* d, tile_rect* rects)
+{
+	gather_room_rects(d->tree, rects);
+	memcpy(rects + d->room_count, d->corridors, d->corridor_count*sizeof(tile_rect));
+	return d->room_count + d->corridor_count;
+}
+
+void rasterize_rects(const tile_rect* rects, int rect_count, int width, int height, char* tiles)
+{
+	memset(tiles, WALL, width*height);
+	for(int i = 0; i < rect_count; i++)
+	{
+		for(int y = rects[i].min_y; y < rects[i].max_y; y++) memset(tiles + y*width + rects[i].min_x, FLOOR, rects[i].max_x - rects[i].min_x);
+	}
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <stdlib.h>
+#include "maths.h"
+#include "rng.h"
+
+#define MIN_PARTITION 16
+#define MIN_ROOM 4
+
+#define HORIZONTAL 0
+#define VERTICAL 1
+
+#define WALL 0
+#define FLOOR 1
+#define PARTITION 2
+
+#define MAP_SIZE 128
+
+struct bsp_node
+{
+	vec2d top_right;
+	vec2d bottom_left;
+	vec2d room_top_right;
+	vec2d room_bottom_left;
+	int partition_direction;
+	int partition_position;
+	int room_index; //Index of the leaf's room in generation order, -1 for internal nodes
+	bsp_node* left_child;
+	bsp_node* right_child;
+};
+
+//Rectangle of tiles, min is inclusive and max is exclusive
+struct tile_rect
+{
+	int min_x;
+	int min_y;
+	int max_x;
+	int max_y;
+};
+
+//A corridor and a room or corridor it was carved next to or over, both as rect ids numbered like gather_floor_rects()
+struct dungeon_contact
+{
+	int corridor;
+	int rect;
+};
+
+struct dungeon
+{
+	bsp_node* tree;
+	int room_count;
+
+	//Tile grid the dungeon was generated into, row major, not owned by the dungeon
+	int width;
+	int height;
+	char* tiles;
+
+	//Straight hallway segments carved by generate_hallways(), grown by add_corridor() and freed by destroy_dungeon()
+	tile_rect* corridors;
+	int corridor_count;
+	int corridor_capacity;
+
+	//Every place generate_hallways() carved next to or over earlier floor, lets validate_dungeon() check connectivity without scanning the tiles
+	//NULL for dungeons that were not generated by generate_dungeon(), grown by reserve_contacts() and freed by destroy_dungeon()
+	dungeon_contact* contacts;
+	int contact_count;
+	int contact_capacity;
+};
+
+extern char tile_map[MAP_SIZE][MAP_SIZE];
+
+void destroy_bsp_tree(bsp_node*);
+void add_corridor(dungeon*, int min_x, int min_y, int max_x, int max_y);
+//Makes room for count more contacts, which generate_hallways() writes directly
+void reserve_contacts(dungeon*, int count);
+
+//Generates into tile_map with the default configuration, see generator.h for other configurations
+void generate_dungeon(dungeon*);
+void destroy_dungeon(dungeon*);
+
+tile_rect room_rect(bsp_node* leaf);
+void gather_room_rects(bsp_node*, tile_rect*);
+
+//A generated dungeon's floor is exactly its rooms and corridors, none are dropped, so its tiles can be rebuilt from the rects alone
+//Writes room_count + corridor_count rects, rooms first, and returns the count
+int gather_floor_rects(dungeon*, tile_rect* rects);
+//WALL everywhere but the rects, which are FLOOR, the CPU reference for rasterize_tiles() in graphics.h
+void rasterize_rects(const tile_rect* rects, int rect_count, int width, int height, char* tiles);
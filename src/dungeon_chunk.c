@@ -0,0 +1,115 @@
+#include "dungeon_chunk.h"
+
+int dungeon_chunk_count(int width, int height, int chunk_size)
+{
+	if(chunk_size <= 0) return 0;
+	return ((width + chunk_size - 1)/chunk_size)*((height + chunk_size - 1)/chunk_size);
+}
+
+tile_rect dungeon_chunk_rect(int width, int height, int chunk_size, int index)
+{
+	int columns = (width + chunk_size - 1)/chunk_size;
+	int x = (index % columns)*chunk_size;
+	int y = (index / columns)*chunk_size;
+	return tile_rect{x, y, min(x + chunk_size, width), min(y + chunk_size, height)};
+}
+
+//Squared distance from the focus to the nearest tile of the chunk, ties broken by index so the order is stable
+struct chunk_distance
+{
+	int64_t distance;
+	int index;
+};
+
+int compare_chunk_distances(const void* a, const void* b)
+{
+	const chunk_distance* x = (const chunk_distance*)a;
+	const chunk_distance* y = (const chunk_distance*)b;
+	if(x->distance != y->distance) return x->distance < y->distance ? -1 : 1;
+	return x->index - y->index;
+}
+
+void order_chunks_nearest(int width, int height, int chunk_size, int focus_x, int focus_y, int* order)
+{
+	int count = dungeon_chunk_count(width, height, chunk_size);
+	chunk_distance* distances = (chunk_distance*)malloc(count*sizeof(chunk_distance));
+	for(int i = 0; i < count; i++)
+	{
+		tile_rect rect = dungeon_chunk_rect(width, height, chunk_size, i);
+		int64_t dx = focus_x < rect.min_x ? rect.min_x - focus_x : focus_x >= rect.max_x ? focus_x - rect.max_x + 1 : 0;
+		int64_t dy = focus_y < rect.min_y ? rect.min_y - focus_y : focus_y >= rect.max_y ? focus_y - rect.max_y + 1 : 0;
+		distances[i] = chunk_distance{dx*dx + dy*dy, i};
+	}
+	qsort(distances, count, sizeof(chunk_distance), compare_chunk_distances);
+	for(int i = 0; i < count; i++) order[i] = distances[i].index;
+	free(distances);
+}
+
+uint32_t max_dungeon_chunk_size(int chunk_size)
+{
+	return sizeof(dungeon_chunk_header) + max_encoded_size(chunk_size*chunk_size) + TILE_CODEC_MAX_TOKEN;
+}
+
+//Rows are encoded straight from the map, the encoder's width is the chunk's so runs never cross into the next chunk
+uint32_t serialize_dungeon_chunk(dungeon* d, uint64_t seed, int chunk_size, int index, void* buffer, uint32_t capacity)
+{
+	if(chunk_size <= 0 || capacity < max_dungeon_chunk_size(chunk_size)) return 0;
+	int chunk_count = dungeon_chunk_count(d->width, d->height, chunk_size);
+	if(index < 0 || index >= chunk_count) return 0;
+	tile_rect rect = dungeon_chunk_rect(d->width, d->height, chunk_size, index);
+	int rect_width = rect.max_x - rect.min_x;
+	dungeon_chunk_header header = {DUNGEON_CHUNK_MAGIC, DUNGEON_CHUNK_VERSION, seed, (uint32_t)d->width, (uint32_t)d->height, (uint32_t)chunk_size, (uint32_t)index, (uint32_t)chunk_count, 0};
+
+	uint8_t* output = (uint8_t*)buffer + sizeof(dungeon_chunk_header);
+	tile_encoder encoder;
+	create_tile_encoder(&encoder, rect_width);
+	for(int y = rect.min_y; y < rect.max_y; y++) header.encoded_size += encode_tiles(&encoder, d->tiles + y*d->width + rect.min_x, rect_width, output + header.encoded_size);
+	header.encoded_size += finish_tile_encoder(&encoder, output + header.encoded_size);
+	destroy_tile_encoder(&encoder);
+	memcpy(buffer, &header, sizeof(header));
+	return sizeof(dungeon_chunk_header) + header.encoded_size;
+}
+
+bool read_dungeon_chunk(const void* chunk, uint32_t size, char* tiles, int width, int height)
+{
+	const dungeon_chunk_header* header = (const dungeon_chunk_header*)chunk;
+	if(size < sizeof(dungeon_chunk_header) || header->magic != DUNGEON_CHUNK_MAGIC || header->version != DUNGEON_CHUNK_VERSION) return false;
+	if(header->map_width != (uint32_t)width || header->map_height != (uint32_t)height || header->chunk_size == 0 || header->chunk_size > 0xFFFF) return false;
+	if(header->chunk_index >= (uint32_t)dungeon_chunk_count(width, height, header->chunk_size) || header->encoded_size > size - sizeof(dungeon_chunk_header)) return false;
+
+	tile_rect rect = dungeon_chunk_rect(width, height, header->chunk_size, header->chunk_index);
+	int rect_width = rect.max_x - rect.min_x;
+	const uint8_t* input = (const uint8_t*)chunk + sizeof(dungeon_chunk_header);
+	int used = 0;
+	bool complete = true;
+	tile_decoder decoder;
+	create_tile_decoder(&decoder, rect_width);
+	for(int y = rect.min_y; y < rect.max_y && complete; y++)
+	{
+		int consumed;
+		complete = decode_tiles(&decoder, input + used, header->encoded_size - used, &consumed, tiles + y*width + rect.min_x, rect_width) == rect_width;
+		used += consumed;
+	}
+	complete = complete && used == (int)header->encoded_size && !decoder.run_remaining && !decoder.pending_size;
+	destroy_tile_decoder(&decoder);
+	return complete;
+}
+
+bool stream_dungeon_chunks(dungeon* d, uint64_t seed, int chunk_size, int focus_x, int focus_y, chunk_sink sink, void* data)
+{
+	if(chunk_size <= 0) return false;
+	int count = dungeon_chunk_count(d->width, d->height, chunk_size);
+	int* order = (int*)malloc(count*sizeof(int));
+	uint32_t capacity = max_dungeon_chunk_size(chunk_size);
+	void* buffer = malloc(capacity);
+	order_chunks_nearest(d->width, d->height, chunk_size, focus_x, focus_y, order);
+	bool streamed = true;
+	for(int i = 0; i < count && streamed; i++)
+	{
+		uint32_t size = serialize_dungeon_chunk(d, seed, chunk_size, order[i], buffer, capacity);
+		streamed = sink(data, buffer, size);
+	}
+	free(buffer);
+	free(order);
+	return streamed;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <stdint.h>
+#include "dungeon.h"
+#include "codec.h"
+
+#define DUNGEON_CHUNK_MAGIC 0x4B484344 //"DCHK"
+#define DUNGEON_CHUNK_VERSION 1
+#define DUNGEON_CHUNK_SIZE 64
+
+//Chunked tile streams
+//A dungeon's tile grid is cut into chunk_size squares, numbered row major, chunks on the right and bottom edges are clipped to the map
+//Each chunk is a header and its tiles through the tile codec, and can be decoded without any other chunk
+//Chunks are sent nearest a focus tile first, so a client can draw around its view before the far side of a large map arrives
+//Hallways are carved after every room is placed and may cross any chunk, so chunks are only cut once the whole dungeon is generated
+struct dungeon_chunk_header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t seed;
+	uint32_t map_width;
+	uint32_t map_height;
+	uint32_t chunk_size;
+	uint32_t chunk_index; //Row major in the map's grid of chunks
+	uint32_t chunk_count;
+	uint32_t encoded_size; //Codec bytes following the header
+};
+
+//Called for each chunk in order, returning false stops the stream
+typedef bool (*chunk_sink)(void* data, const void* chunk, uint32_t size);
+
+//0 if chunk_size isn't positive
+int dungeon_chunk_count(int width, int height, int chunk_size);
+tile_rect dungeon_chunk_rect(int width, int height, int chunk_size, int index);
+//Fills order with every chunk index, nearest to the focus tile first
+void order_chunks_nearest(int width, int height, int chunk_size, int focus_x, int focus_y, int* order);
+
+//Space serialize_dungeon_chunk() may need for one chunk
+uint32_t max_dungeon_chunk_size(int chunk_size);
+//Returns the size of the chunk, or 0 if capacity is too small or index isn't one of the map's chunks
+uint32_t serialize_dungeon_chunk(dungeon*, uint64_t seed, int chunk_size, int index, void* buffer, uint32_t capacity);
+//Decodes a chunk into its place in tiles, which must be the chunk's map_width*map_height, false if the chunk is malformed or for another size of map
+bool read_dungeon_chunk(const void* chunk, uint32_t size, char* tiles, int width, int height);
+
+//Serializes every chunk nearest the focus first, handing each to sink as soon as it is encoded
+//False if sink stopped the stream or chunk_size isn't positive, in which case nothing is sent
+bool stream_dungeon_chunks(dungeon*, uint64_t seed, int chunk_size, int focus_x, int focus_y, chunk_sink, void* data);
@@ -0,0 +1,481 @@
+#include "dungeon_delta.h"
+
+struct delta_writer
+{
+	uint8_t* data;
+	uint32_t capacity;
+	uint32_t size;
+	bool failed;
+};
+
+struct delta_reader
+{
+	const uint8_t* data;
+	uint32_t size;
+	uint32_t position;
+	bool failed;
+};
+
+void write_delta(delta_writer* writer, const void* data, uint32_t size)
+{
+	if(writer->failed || size > writer->capacity - writer->size)
+	{
+		writer->failed = true;
+		return;
+	}
+	memcpy(writer->data + writer->size, data, size);
+	writer->size += size;
+}
+
+//Returns NULL once the reader has run out of data, every later read fails too
+const uint8_t* read_delta(delta_reader* reader, uint32_t size)
+{
+	if(reader->failed || size > reader->size - reader->position)
+	{
+		reader->failed = true;
+		return NULL;
+	}
+	const uint8_t* data = reader->data + reader->position;
+	reader->position += size;
+	return data;
+}
+
+bool is_leaf(const dungeon_file_node* node)
+{
+	return node->partition_direction < 0;
+}
+
+//Everything but room_index and left_child, which depend on the rest of the tree
+bool same_node(const dungeon_file_node* a, const dungeon_file_node* b)
+{
+	return a->min_x == b->min_x && a->min_y == b->min_y && a->max_x == b->max_x && a->max_y == b->max_y &&
+		!memcmp(&a->room, &b->room, sizeof(tile_rect)) && a->partition_direction == b->partition_direction && (is_leaf(a) || a->partition_position == b->partition_position);
+}
+
+//left_child is only followed once open_dungeon_view() has been checked against, so a malformed table ends the walk rather than reading past it
+bool has_children(const dungeon_view* view, int node)
+{
+	int left = view->nodes[node].left_child;
+	return !is_leaf(&view->nodes[node]) && left > node && (uint32_t)left + 1 < view->header->node_count;
+}
+
+bool same_subtree(const dungeon_view* base, int b, const dungeon_view* variant, int v)
+{
+	if(!same_node(&base->nodes[b], &variant->nodes[v])) return false;
+	if(is_leaf(&variant->nodes[v])) return true;
+	if(!has_children(base, b) || !has_children(variant, v)) return false;
+	int bl = base->nodes[b].left_child;
+	int vl = variant->nodes[v].left_child;
+	return same_subtree(base, bl, variant, vl) && same_subtree(base, bl + 1, variant, vl + 1);
+}
+
+//Node fields as the delta stores them, false if any does not fit 16 bits
+bool pack_delta_node(const dungeon_file_node* node, uint16_t* fields)
+{
+	if(node->partition_direction < -1 || node->partition_direction > VERTICAL) return false;
+	int32_t values[9] = {node->min_x, node->min_y, node->max_x, node->max_y, node->room.min_x, node->room.min_y, node->room.max_x, node->room.max_y, node->partition_position};
+	for(int i = 0; i < 9; i++)
+	{
+		if(values[i] < 0 || values[i] > 0xFFFF) return false;
+		fields[i] = (uint16_t)values[i];
+	}
+	return true;
+}
+
+void unpack_delta_node(const uint16_t* fields, dungeon_file_node* node)
+{
+	node->min_x = fields[0];
+	node->min_y = fields[1];
+	node->max_x = fields[2];
+	node->max_y = fields[3];
+	node->room = tile_rect{fields[4], fields[5], fields[6], fields[7]};
+}
+
+//Writes an op per variant node in breadth first order, pairing nodes as apply_delta_nodes() will
+void encode_delta_nodes(const dungeon_view* base, const dungeon_view* variant, delta_writer* writer)
+{
+	uint32_t count = variant->header->node_count;
+	if(!count)
+	{
+		writer->failed = true;
+		return;
+	}
+	int* pairs = (int*)malloc(count*sizeof(int)); //Base node paired with each variant node, -1 for none
+	bool* copied = (bool*)malloc(count*sizeof(bool)); //Inside a subtree already written as DELTA_SAME_SUBTREE
+	pairs[0] = base->header->node_count ? 0 : -1;
+	copied[0] = false;
+	uint32_t next_child = 1;
+	for(uint32_t v = 0; v < count && !writer->failed; v++)
+	{
+		const dungeon_file_node* node = &variant->nodes[v];
+		int b = pairs[v];
+		bool same = copied[v] || (b >= 0 && same_subtree(base, b, variant, v));
+		if(!copied[v])
+		{
+			uint16_t fields[9];
+			uint8_t op = same ? DELTA_SAME_SUBTREE : is_leaf(node) ? DELTA_LEAF : DELTA_SPLIT + node->partition_direction;
+			write_delta(writer, &op, 1);
+			if(!same && !pack_delta_node(node, fields)) writer->failed = true;
+			if(!same) write_delta(writer, fields, is_leaf(node) ? 8*sizeof(uint16_t) : 9*sizeof(uint16_t));
+		}
+		if(is_leaf(node)) continue;
+
+		//Applying numbers children in the order they are reached, so only tables laid out that way can be encoded
+		if(!has_children(variant, v) || (uint32_t)node->left_child != next_child)
+		{
+			writer->failed = true;
+			break;
+		}
+		next_child += 2;
+
+		//Children keep their base pairing when the partition is unchanged
+		int left = node->left_child;
+		bool paired = b >= 0 && has_children(base, b) && base->nodes[b].partition_direction == node->partition_direction && base->nodes[b].partition_position == node->partition_position;
+		pairs[left] = paired ? base->nodes[b].left_child : -1;
+		pairs[left + 1] = paired ? base->nodes[b].left_child + 1 : -1;
+		copied[left] = copied[left + 1] = same;
+	}
+	if(next_child != count) writer->failed = true;
+	free(pairs);
+	free(copied);
+}
+
+//Room indices are only stored when they are not the leaves' breadth first order, which the batch generator always gives
+bool breadth_first_rooms(const dungeon_view* view)
+{
+	int32_t room = 0;
+	for(uint32_t i = 0; i < view->header->node_count; i++)
+	{
+		if(is_leaf(&view->nodes[i]) && view->nodes[i].room_index != room++) return false;
+	}
+	return true;
+}
+
+//Returns the number of indices written, one per leaf
+uint32_t encode_delta_room_indices(const dungeon_view* variant, delta_writer* writer)
+{
+	uint32_t leaves = 0;
+	for(uint32_t i = 0; i < variant->header->node_count; i++)
+	{
+		if(!is_leaf(&variant->nodes[i])) continue;
+		write_delta(writer, &variant->nodes[i].room_index, sizeof(int32_t));
+		leaves++;
+	}
+	return leaves;
+}
+
+int find_base_corridor(const dungeon_view* base, const tile_rect* corridor, uint32_t start)
+{
+	uint32_t count = base->header->corridor_count;
+	if(start >= count) start = 0;
+	for(uint32_t i = 0; i < count; i++)
+	{
+		uint32_t j = (start + i) % count;
+		if(!memcmp(&base->corridors[j], corridor, sizeof(tile_rect))) return j;
+	}
+	return -1;
+}
+
+//Returns the number of runs, corridors usually move as whole runs when the hallways before them change
+uint32_t encode_delta_corridors(const dungeon_view* base, const dungeon_view* variant, delta_writer* writer)
+{
+	uint32_t runs = 0;
+	uint32_t count = variant->header->corridor_count;
+	uint32_t next_base = 0;
+	for(uint32_t i = 0; i < count;)
+	{
+		delta_corridor_run run = {find_base_corridor(base, &variant->corridors[i], next_base), 1};
+		if(run.base_start >= 0)
+		{
+			while(i + run.count < count && run.base_start + run.count < base->header->corridor_count &&
+				!memcmp(&base->corridors[run.base_start + run.count], &variant->corridors[i + run.count], sizeof(tile_rect))) run.count++;
+			next_base = run.base_start + run.count;
+			write_delta(writer, &run, sizeof(run));
+		}
+		else
+		{
+			while(i + run.count < count && find_base_corridor(base, &variant->corridors[i + run.count], next_base) < 0) run.count++;
+			write_delta(writer, &run, sizeof(run));
+			write_delta(writer, &variant->corridors[i], run.count*sizeof(tile_rect));
+		}
+		i += run.count;
+		runs++;
+	}
+	return runs;
+}
+
+bool tile_block_changed(const dungeon_view* base, const dungeon_view* variant, int min_x, int min_y, int max_x, int max_y)
+{
+	int width = variant->header->config.width;
+	for(int y = min_y; y < max_y; y++)
+	{
+		if(memcmp(base->tiles + y*width + min_x, variant->tiles + y*width + min_x, max_x - min_x)) return true;
+	}
+	return false;
+}
+
+//Gathers the rect's tiles and compresses them after the rect
+void encode_delta_tile_rect(const dungeon_view* variant, delta_tile_rect* rect, char* scratch, delta_writer* writer)
+{
+	int width = variant->header->config.width;
+	int rect_width = rect->max_x - rect->min_x;
+	int rect_height = rect->max_y - rect->min_y;
+	for(int y = 0; y < rect_height; y++) memcpy(scratch + y*rect_width, variant->tiles + (rect->min_y + y)*width + rect->min_x, rect_width);
+	uint32_t start = writer->size;
+	write_delta(writer, rect, sizeof(delta_tile_rect));
+	uint32_t bound = max_encoded_size(rect_width*rect_height) + TILE_CODEC_MAX_TOKEN;
+	if(writer->failed || bound > writer->capacity - writer->size)
+	{
+		writer->failed = true;
+		return;
+	}
+	rect->size = compress_tiles(scratch, rect_width, rect_height, writer->data + writer->size);
+	writer->size += rect->size;
+	memcpy(writer->data + start, rect, sizeof(delta_tile_rect));
+}
+
+//Returns the number of rects, a grid of a different size to the base is one rect of everything
+uint32_t encode_delta_tiles(const dungeon_view* base, const dungeon_view* variant, delta_writer* writer)
+{
+	int width = variant->header->config.width;
+	int height = variant->header->config.height;
+	bool same_size = base->header->config.width == width && base->header->config.height == height;
+	char* scratch = (char*)malloc(same_size ? width*DELTA_TILE_BLOCK : width*height);
+	uint32_t rects = 0;
+	if(!same_size)
+	{
+		delta_tile_rect rect = {0, 0, (uint16_t)width, (uint16_t)height, 0};
+		encode_delta_tile_rect(variant, &rect, scratch, writer);
+		rects++;
+	}
+	for(int y = 0; same_size && y < height; y += DELTA_TILE_BLOCK)
+	{
+		int max_y = min(y + DELTA_TILE_BLOCK, height);
+		for(int x = 0; x < width;)
+		{
+			int max_x = min(x + DELTA_TILE_BLOCK, width);
+			if(!tile_block_changed(base, variant, x, y, max_x, max_y))
+			{
+				x = max_x;
+				continue;
+			}
+			while(max_x < width && tile_block_changed(base, variant, max_x, y, min(max_x + DELTA_TILE_BLOCK, width), max_y)) max_x = min(max_x + DELTA_TILE_BLOCK, width);
+			delta_tile_rect rect = {(uint16_t)x, (uint16_t)y, (uint16_t)max_x, (uint16_t)max_y, 0};
+			encode_delta_tile_rect(variant, &rect, scratch, writer);
+			rects++;
+			x = max_x;
+		}
+	}
+	free(scratch);
+	return rects;
+}
+
+uint32_t max_dungeon_delta_size(const dungeon_view* variant)
+{
+	const dungeon_file_header* header = variant->header;
+	uint32_t tiles = header->config.width*header->config.height;
+	uint32_t blocks = ((header->config.width + DELTA_TILE_BLOCK - 1)/DELTA_TILE_BLOCK)*((header->config.height + DELTA_TILE_BLOCK - 1)/DELTA_TILE_BLOCK);
+	return sizeof(dungeon_delta_header) + header->node_count*(1 + 9*sizeof(uint16_t) + sizeof(int32_t)) +
+		header->corridor_count*(sizeof(delta_corridor_run) + sizeof(tile_rect)) +
+		2*tiles + blocks*(sizeof(delta_tile_rect) + 2*TILE_CODEC_MAX_TOKEN + 1);
+}
+
+uint32_t encode_dungeon_delta(const dungeon_view* base, const dungeon_view* variant, void* delta, uint32_t capacity)
+{
+	delta_writer writer = {(uint8_t*)delta, capacity, 0, false};
+	dungeon_delta_header header = {};
+	header.magic = DUNGEON_DELTA_MAGIC;
+	header.version = DUNGEON_DELTA_VERSION;
+	header.base_seed = base->header->seed;
+	header.base_file_size = base->header->file_size;
+	header.base_node_count = base->header->node_count;
+	header.variant = *variant->header;
+	if(breadth_first_rooms(variant)) header.flags |= DELTA_BREADTH_FIRST_ROOMS;
+	if(variant->header->config.width > 0xFFFF || variant->header->config.height > 0xFFFF) return 0;
+
+	//The header goes in last, once the section sizes are known
+	write_delta(&writer, &header, sizeof(header));
+	encode_delta_nodes(base, variant, &writer);
+	header.node_stream_size = writer.size - sizeof(header);
+	if(!(header.flags & DELTA_BREADTH_FIRST_ROOMS))
+	{
+		header.room_index_count = encode_delta_room_indices(variant, &writer);
+	}
+	header.corridor_run_count = encode_delta_corridors(base, variant, &writer);
+	header.tile_rect_count = encode_delta_tiles(base, variant, &writer);
+	if(writer.failed) return 0;
+	header.size = writer.size;
+	memcpy(delta, &header, sizeof(header));
+	return writer.size;
+}
+
+uint32_t dungeon_delta_image_size(const void* delta, uint32_t size)
+{
+	const dungeon_delta_header* header = (const dungeon_delta_header*)delta;
+	if(size < sizeof(dungeon_delta_header) || header->magic != DUNGEON_DELTA_MAGIC || header->version != DUNGEON_DELTA_VERSION || header->size > size || header->size < sizeof(dungeon_delta_header)) return 0;
+	return header->variant.file_size;
+}
+
+//Rebuilds the node table breadth first, the pairing and copy state of nodes not yet reached are kept in their own left_child and room_index fields
+bool apply_delta_nodes(const dungeon_view* base, const dungeon_delta_header* header, delta_reader* ops, delta_reader* room_indices, dungeon_file_node* nodes)
+{
+	uint32_t count = header->variant.node_count;
+	uint32_t next_child = 1;
+	int32_t next_room = 0;
+	if(!count) return false;
+	nodes[0].left_child = base->header->node_count ? 0 : -1;
+	nodes[0].room_index = 0;
+	for(uint32_t v = 0; v < count; v++)
+	{
+		if(v >= next_child) return false;
+		dungeon_file_node* node = &nodes[v];
+		int b = node->left_child;
+		bool copied = node->room_index;
+		if(!copied)
+		{
+			const uint8_t* op = read_delta(ops, 1);
+			if(!op || *op > DELTA_SPLIT + VERTICAL || (*op == DELTA_SAME_SUBTREE && b < 0)) return false;
+			copied = *op == DELTA_SAME_SUBTREE;
+			if(!copied)
+			{
+				uint16_t fields[9] = {};
+				const uint8_t* data = read_delta(ops, *op == DELTA_LEAF ? 8*sizeof(uint16_t) : 9*sizeof(uint16_t));
+				if(!data) return false;
+				memcpy(fields, data, *op == DELTA_LEAF ? 8*sizeof(uint16_t) : 9*sizeof(uint16_t));
+				unpack_delta_node(fields, node);
+				node->partition_direction = *op == DELTA_LEAF ? -1 : *op - DELTA_SPLIT;
+				node->partition_position = fields[8];
+			}
+		}
+		if(copied)
+		{
+			*node = base->nodes[b];
+			if(is_leaf(node)) node->partition_position = 0;
+			else if(!has_children(base, b)) return false;
+		}
+
+		if(is_leaf(node))
+		{
+			node->left_child = -1;
+			if(room_indices)
+			{
+				const uint8_t* index = read_delta(room_indices, sizeof(int32_t));
+				if(!index) return false;
+				memcpy(&node->room_index, index, sizeof(int32_t));
+			}
+			else node->room_index = next_room++;
+			continue;
+		}
+		node->room_index = -1;
+		if(next_child + 2 > count) return false;
+
+		//Children keep their base pairing when the partition is unchanged, as encode_delta_nodes() pairs them
+		bool paired = b >= 0 && has_children(base, b) && base->nodes[b].partition_direction == node->partition_direction && base->nodes[b].partition_position == node->partition_position;
+		node->left_child = next_child;
+		nodes[next_child].left_child = paired ? base->nodes[b].left_child : -1;
+		nodes[next_child + 1].left_child = paired ? base->nodes[b].left_child + 1 : -1;
+		nodes[next_child].room_index = nodes[next_child + 1].room_index = copied;
+		next_child += 2;
+	}
+	return next_child == count;
+}
+
+bool apply_delta_corridors(const dungeon_view* base, const dungeon_delta_header* header, delta_reader* reader, tile_rect* corridors)
+{
+	uint32_t count = 0;
+	for(uint32_t i = 0; i < header->corridor_run_count; i++)
+	{
+		const uint8_t* data = read_delta(reader, sizeof(delta_corridor_run));
+		if(!data) return false;
+		delta_corridor_run run;
+		memcpy(&run, data, sizeof(run));
+		if(run.count > header->variant.corridor_count - count) return false;
+		if(run.base_start >= 0)
+		{
+			if((uint64_t)run.base_start + run.count > base->header->corridor_count) return false;
+			memcpy(corridors + count, base->corridors + run.base_start, run.count*sizeof(tile_rect));
+		}
+		else
+		{
+			data = read_delta(reader, run.count*sizeof(tile_rect));
+			if(!data) return false;
+			memcpy(corridors + count, data, run.count*sizeof(tile_rect));
+		}
+		count += run.count;
+	}
+	return count == header->variant.corridor_count;
+}
+
+//Unchanged tiles come from the base, each rect is decoded a row at a time straight into the image
+bool apply_delta_tiles(const dungeon_view* base, const dungeon_delta_header* header, delta_reader* reader, char* tiles)
+{
+	int width = header->variant.config.width;
+	int height = header->variant.config.height;
+	if(base->header->config.width == width && base->header->config.height == height) memcpy(tiles, base->tiles, width*height);
+
+	for(uint32_t i = 0; i < header->tile_rect_count; i++)
+	{
+		const uint8_t* data = read_delta(reader, sizeof(delta_tile_rect));
+		if(!data) return false;
+		delta_tile_rect rect;
+		memcpy(&rect, data, sizeof(rect));
+		const uint8_t* input = read_delta(reader, rect.size);
+		if(!input || rect.min_x >= rect.max_x || rect.min_y >= rect.max_y || rect.max_x > width || rect.max_y > height) return false;
+
+		int rect_width = rect.max_x - rect.min_x;
+		int used = 0;
+		bool complete = true;
+		tile_decoder decoder;
+		create_tile_decoder(&decoder, rect_width);
+		for(int y = rect.min_y; y < rect.max_y && complete; y++)
+		{
+			char* row = tiles + y*width + rect.min_x;
+			int consumed;
+			complete = decode_tiles(&decoder, input + used, rect.size - used, &consumed, row, rect_width) == rect_width;
+			used += consumed;
+		}
+		complete = complete && used == (int)rect.size && !decoder.run_remaining && !decoder.pending_size;
+		destroy_tile_decoder(&decoder);
+		if(!complete) return false;
+	}
+	return true;
+}
+
+bool apply_dungeon_delta(const dungeon_view* base, const void* delta, uint32_t size, void* image, uint32_t capacity)
+{
+	const dungeon_delta_header* header = (const dungeon_delta_header*)delta;
+	uint32_t image_size = dungeon_delta_image_size(delta, size);
+	if(!image_size || image_size > capacity) return false;
+	if(header->base_seed != base->header->seed || header->base_file_size != base->header->file_size || header->base_node_count != base->header->node_count) return false;
+
+	//Once the variant header is in place the view checks every section fits before anything is written to them
+	//The nodes are only checked once they have all been written
+	char* file = (char*)image;
+	dungeon_view view;
+	memset(file, 0, image_size);
+	memcpy(file, &header->variant, sizeof(dungeon_file_header));
+	if(!open_dungeon_sections(&view, file, image_size)) return false;
+	dungeon_file_node* nodes = (dungeon_file_node*)view.nodes;
+	tile_rect* rooms = (tile_rect*)view.rooms;
+
+	const uint8_t* sections = (const uint8_t*)delta + sizeof(dungeon_delta_header);
+	uint32_t sections_size = header->size - sizeof(dungeon_delta_header);
+	if(header->node_stream_size > sections_size) return false;
+	delta_reader ops = {sections, header->node_stream_size, 0, false};
+	delta_reader rest = {sections + header->node_stream_size, sections_size - header->node_stream_size, 0, false};
+	bool breadth_first = header->flags & DELTA_BREADTH_FIRST_ROOMS;
+	if(!breadth_first && header->room_index_count > rest.size/sizeof(int32_t)) return false;
+	delta_reader room_indices = {rest.data, breadth_first ? 0 : header->room_index_count*(uint32_t)sizeof(int32_t), 0, false};
+	rest.position = room_indices.size;
+
+	if(!apply_delta_nodes(base, header, &ops, breadth_first ? NULL : &room_indices, nodes) || ops.position != ops.size) return false;
+	for(uint32_t i = 0; i < header->variant.node_count; i++)
+	{
+		if(!is_leaf(&nodes[i])) continue;
+		if(nodes[i].room_index < 0 || (uint32_t)nodes[i].room_index >= header->variant.room_count) return false;
+		rooms[nodes[i].room_index] = nodes[i].room;
+	}
+	if(!apply_delta_corridors(base, header, &rest, (tile_rect*)view.corridors)) return false;
+	if(!apply_delta_tiles(base, header, &rest, (char*)view.tiles)) return false;
+	return rest.position == rest.size && dungeon_nodes_valid(&view) && dungeon_rects_valid(&view);
+}
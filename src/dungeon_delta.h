@@ -0,0 +1,74 @@
+#pragma once
+#include <stdint.h>
+#include "dungeon_file.h"
+#include "codec.h"
+
+#define DUNGEON_DELTA_MAGIC 0x544C4444 //"DDLT"
+#define DUNGEON_DELTA_VERSION 1
+#define DELTA_TILE_BLOCK 16 //Tiles are compared in blocks this size, changed blocks next to each other in a row become one rect
+
+//Delta flags
+#define DELTA_BREADTH_FIRST_ROOMS 1 //Leaves are numbered in breadth first order, so no room indices are stored
+
+//Node ops
+#define DELTA_SAME_SUBTREE 0
+#define DELTA_LEAF 1
+#define DELTA_SPLIT 2 //DELTA_SPLIT + partition_direction
+
+//Dungeon deltas
+//A delta rebuilds a variant dungeon file image from a base image, storing only what differs between them
+//	- Nodes are visited breadth first, pairing each variant node with the base node at the same place in the tree
+//	- A subtree identical to its base subtree is one op byte, changed nodes are stored with 16 bit fields
+//	- A changed node with the same partition as its base node still pairs its children with the base node's children
+//	- Corridors are runs copied from the base table or stored as they are
+//	- Changed tiles are stored as rects of the variant's tiles, each compressed with the tile codec
+//	  The codec's own row XOR already does better on them than XORing against the base would
+//	- A variant of a different size to its base stores its whole grid as one rect
+//Applying a delta is a copy of the base plus the changed parts, nothing is generated
+struct dungeon_delta_header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size; //Whole delta, header included
+	uint32_t flags;
+
+	//Identify the base the delta was made against, applying it to any other base fails
+	uint64_t base_seed;
+	uint32_t base_file_size;
+	uint32_t base_node_count;
+
+	//Sections follow the header in this order
+	uint32_t node_stream_size;
+	uint32_t room_index_count; //int32_t room index per leaf in breadth first order, 0 with DELTA_BREADTH_FIRST_ROOMS
+	uint32_t corridor_run_count;
+	uint32_t tile_rect_count;
+
+	dungeon_file_header variant; //Header of the image the delta rebuilds
+};
+
+//A run of run.count corridors, copied from base_start onwards in the base table, or stored after the run when base_start is -1
+struct delta_corridor_run
+{
+	int32_t base_start;
+	uint32_t count;
+};
+
+//Followed by size bytes of codec output for the rect's (max_x - min_x)*(max_y - min_y) tiles
+struct delta_tile_rect
+{
+	uint16_t min_x;
+	uint16_t min_y;
+	uint16_t max_x; //Exclusive
+	uint16_t max_y;
+	uint32_t size;
+};
+
+//Space encode_dungeon_delta() may need for any base and this variant
+uint32_t max_dungeon_delta_size(const dungeon_view* variant);
+//Returns the size of the delta, or 0 if capacity is too small or the variant has fields that do not fit 16 bits
+uint32_t encode_dungeon_delta(const dungeon_view* base, const dungeon_view* variant, void* delta, uint32_t capacity);
+
+//Size of the image the delta rebuilds, 0 if the delta header is malformed
+uint32_t dungeon_delta_image_size(const void* delta, uint32_t size);
+//Writes the variant image into image, false if the delta is malformed, was made against a different base, or capacity is too small
+bool apply_dungeon_delta(const dungeon_view* base, const void* delta, uint32_t size, void* image, uint32_t capacity);
@@ -0,0 +1,226 @@
+#include "dungeon_file.h"
+
+uint32_t align_file_offset(uint32_t offset)
+{
+	return (offset + DUNGEON_FILE_ALIGNMENT - 1) & ~(uint32_t)(DUNGEON_FILE_ALIGNMENT - 1);
+}
+
+int count_bsp_nodes(bsp_node* node)
+{
+	if(!node->left_child) return 1;
+	return 1 + count_bsp_nodes(node->left_child) + count_bsp_nodes(node->right_child);
+}
+
+//Fills in the section offsets from the counts, returns the total file size
+uint32_t layout_dungeon_sections(dungeon_file_header* header, int width, int height)
+{
+	header->header_size = sizeof(dungeon_file_header);
+	header->node_offset = align_file_offset(sizeof(dungeon_file_header));
+	header->room_offset = align_file_offset(header->node_offset + header->node_count*sizeof(dungeon_file_node));
+	header->corridor_offset = align_file_offset(header->room_offset + header->room_count*sizeof(tile_rect));
+	header->tile_offset = align_file_offset(header->corridor_offset + header->corridor_count*sizeof(tile_rect));
+	header->file_size = align_file_offset(header->tile_offset + width*height);
+	return header->file_size;
+}
+
+uint32_t layout_dungeon_file(dungeon_file_header* header, dungeon* d)
+{
+	header->node_count = count_bsp_nodes(d->tree);
+	header->room_count = d->room_count;
+	header->corridor_count = d->corridor_count;
+	return layout_dungeon_sections(header, d->width, d->height);
+}
+
+uint32_t layout_batch_lane_file(dungeon_file_header* header, dungeon_batch* batch, int lane)
+{
+	header->node_count = batch->node_counts[lane];
+	header->room_count = batch->room_counts[lane];
+	header->corridor_count = batch->corridor_counts[lane];
+	return layout_dungeon_sections(header, batch->config.width, batch->config.height);
+}
+
+uint32_t dungeon_file_size(dungeon* d)
+{
+	dungeon_file_header header;
+	return layout_dungeon_file(&header, d);
+}
+
+uint32_t serialize_dungeon(dungeon* d, uint64_t seed, runtime_dungeon_config config, void* buffer, uint32_t capacity)
+{
+	dungeon_file_header header = {};
+	if(layout_dungeon_file(&header, d) > capacity) return 0;
+	header.magic = DUNGEON_FILE_MAGIC;
+	header.version = DUNGEON_FILE_VERSION;
+	header.seed = seed;
+	header.config = config;
+	header.config.width = d->width;
+	header.config.height = d->height;
+
+	char* file = (char*)buffer;
+	memset(file, 0, header.file_size);
+	memcpy(file, &header, sizeof(header));
+
+	//Breadth first, a node's position in the queue is its index in the table
+	dungeon_file_node* nodes = (dungeon_file_node*)(file + header.node_offset);
+	bsp_node** queue = (bsp_node**)malloc(header.node_count*sizeof(bsp_node*));
+	int queued = 1;
+	queue[0] = d->tree;
+	for(int i = 0; i < queued; i++)
+	{
+		bsp_node* node = queue[i];
+		nodes[i].min_x = (int)node->bottom_left.x;
+		nodes[i].min_y = (int)node->bottom_left.y;
+		nodes[i].max_x = (int)node->top_right.x;
+		nodes[i].max_y = (int)node->top_right.y;
+		nodes[i].room = room_rect(node);
+		nodes[i].partition_direction = node->partition_direction;
+		nodes[i].partition_position = node->left_child ? node->partition_position : 0;
+		nodes[i].room_index = node->room_index;
+		nodes[i].left_child = -1;
+		if(node->left_child)
+		{
+			nodes[i].left_child = queued;
+			queue[queued++] = node->left_child;
+			queue[queued++] = node->right_child;
+		}
+	}
+	free(queue);
+
+	gather_room_rects(d->tree, (tile_rect*)(file + header.room_offset));
+	memcpy(file + header.corridor_offset, d->corridors, header.corridor_count*sizeof(tile_rect));
+	memcpy(file + header.tile_offset, d->tiles, d->width*d->height);
+	return header.file_size;
+}
+
+uint32_t batch_lane_file_size(dungeon_batch* batch, int lane)
+{
+	dungeon_file_header header;
+	return layout_batch_lane_file(&header, batch, lane);
+}
+
+//The batch tables are already numbered breadth first with right children after left ones, so nodes copy across by index
+uint32_t serialize_batch_lane(dungeon_batch* batch, int lane, uint64_t seed, void* buffer, uint32_t capacity)
+{
+	dungeon_file_header header = {};
+	if(layout_batch_lane_file(&header, batch, lane) > capacity) return 0;
+	header.magic = DUNGEON_FILE_MAGIC;
+	header.version = DUNGEON_FILE_VERSION;
+	header.seed = seed;
+	header.config = batch->config;
+
+	char* file = (char*)buffer;
+	memset(file, 0, header.file_size);
+	memcpy(file, &header, sizeof(header));
+
+	dungeon_file_node* nodes = (dungeon_file_node*)(file + header.node_offset);
+	tile_rect* rooms = (tile_rect*)(file + header.room_offset);
+	for(uint32_t node = 0; node < header.node_count; node++)
+	{
+		int i = node*BATCH_LANES + lane;
+		bool leaf = batch->partition_directions[i] < 0;
+		nodes[node].min_x = batch->min_xs[i];
+		nodes[node].min_y = batch->min_ys[i];
+		nodes[node].max_x = batch->max_xs[i];
+		nodes[node].max_y = batch->max_ys[i];
+		nodes[node].room = tile_rect{batch->room_min_xs[i], batch->room_min_ys[i], batch->room_max_xs[i], batch->room_max_ys[i]};
+		nodes[node].partition_direction = batch->partition_directions[i];
+		nodes[node].partition_position = leaf ? 0 : batch->partition_positions[i];
+		nodes[node].room_index = batch->room_indices[i];
+		nodes[node].left_child = leaf ? -1 : batch->left_children[i];
+		if(leaf) rooms[batch->room_indices[i]] = nodes[node].room;
+	}
+
+	memcpy(file + header.corridor_offset, batch_corridors(batch, lane), header.corridor_count*sizeof(tile_rect));
+	memcpy(file + header.tile_offset, batch_tiles(batch, lane), batch->config.width*batch->config.height);
+	return header.file_size;
+}
+
+bool write_dungeon_file(const char* path, dungeon* d, uint64_t seed, runtime_dungeon_config config)
+{
+	uint32_t size = dungeon_file_size(d);
+	void* buffer = malloc(size);
+	serialize_dungeon(d, seed, config, buffer, size);
+
+	FILE* f = fopen(path, "wb");
+	bool written = f && fwrite(buffer, 1, size, f) == size;
+	if(f) written = (fclose(f) == 0) && written;
+	free(buffer);
+	return written;
+}
+
+//Whether count elements of element_size at offset lie inside a file of size bytes
+bool section_fits(uint32_t offset, uint32_t count, uint32_t element_size, uint32_t size)
+{
+	return offset % DUNGEON_FILE_ALIGNMENT == 0 && offset <= size && (uint64_t)count*element_size <= size - offset;
+}
+
+bool open_dungeon_sections(dungeon_view* view, const void* data, uint32_t size)
+{
+	*view = {};
+	const dungeon_file_header* header = (const dungeon_file_header*)data;
+	if(size < sizeof(dungeon_file_header)) return false;
+	if(header->magic != DUNGEON_FILE_MAGIC || header->version != DUNGEON_FILE_VERSION || header->header_size != sizeof(dungeon_file_header)) return false;
+	if(header->file_size > size || header->config.width <= 0 || header->config.height <= 0 || header->config.width > 0xFFFF || header->config.height > 0xFFFF) return false;
+
+	uint32_t file_size = header->file_size;
+	uint64_t tile_count = (uint64_t)header->config.width*(uint64_t)header->config.height;
+	if(!section_fits(header->node_offset, header->node_count, sizeof(dungeon_file_node), file_size)) return false;
+	if(!section_fits(header->room_offset, header->room_count, sizeof(tile_rect), file_size)) return false;
+	if(!section_fits(header->corridor_offset, header->corridor_count, sizeof(tile_rect), file_size)) return false;
+	if(tile_count > file_size || !section_fits(header->tile_offset, (uint32_t)tile_count, 1, file_size)) return false;
+
+	const char* file = (const char*)data;
+	view->header = header;
+	view->nodes = (const dungeon_file_node*)(file + header->node_offset);
+	view->rooms = (const tile_rect*)(file + header->room_offset);
+	view->corridors = (const tile_rect*)(file + header->corridor_offset);
+	view->tiles = file + header->tile_offset;
+	return true;
+}
+
+//Children come after their parent, which also keeps a walk down the tree from looping
+bool dungeon_nodes_valid(const dungeon_view* view)
+{
+	const dungeon_file_header* header = view->header;
+	for(uint32_t i = 0; i < header->node_count; i++)
+	{
+		const dungeon_file_node* node = &view->nodes[i];
+		if(node->left_child == -1)
+		{
+			if(node->room_index < 0 || (uint32_t)node->room_index >= header->room_count) return false;
+		}
+		else if(node->left_child <= (int64_t)i || (uint32_t)node->left_child >= header->node_count - 1 || node->room_index != -1) return false;
+	}
+	return true;
+}
+
+bool rect_in_map(tile_rect rect, int width, int height)
+{
+	return rect.min_x >= 0 && rect.min_y >= 0 && rect.min_x <= rect.max_x && rect.min_y <= rect.max_y && rect.max_x <= width && rect.max_y <= height;
+}
+
+bool dungeon_rects_valid(const dungeon_view* view)
+{
+	const dungeon_file_header* header = view->header;
+	int width = header->config.width;
+	int height = header->config.height;
+	for(uint32_t i = 0; i < header->room_count; i++) if(!rect_in_map(view->rooms[i], width, height)) return false;
+	for(uint32_t i = 0; i < header->corridor_count; i++) if(!rect_in_map(view->corridors[i], width, height)) return false;
+	for(uint32_t i = 0; i < header->node_count; i++) if(!rect_in_map(view->nodes[i].room, width, height)) return false;
+	return true;
+}
+
+bool open_dungeon_view(dungeon_view* view, const void* data, uint32_t size)
+{
+	if(open_dungeon_sections(view, data, size) && dungeon_nodes_valid(view) && dungeon_rects_valid(view)) return true;
+	*view = {};
+	return false;
+}
+
+bool load_dungeon_file(const char* path, mapped_file* mapped, dungeon_view* view)
+{
+	if(!map_file(mapped, path)) return false;
+	if(open_dungeon_view(view, mapped->data, mapped->size)) return true;
+	unmap_file(mapped);
+	return false;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <stdint.h>
+#include "generator.h"
+#include "batch.h"
+#include "mapped_file.h"
+
+#define DUNGEON_FILE_MAGIC 0x4E474E44 //"DNGN"
+#define DUNGEON_FILE_VERSION 1
+#define DUNGEON_FILE_ALIGNMENT 64 //Every section starts on a cache line
+
+//File layout: header, bsp node table, room table, corridor table, tile grid
+//Offsets are from the start of the file, all fields are little endian and used in place
+struct dungeon_file_header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t file_size;
+	uint32_t header_size;
+	uint64_t seed;
+	runtime_dungeon_config config;
+
+	uint32_t node_count;
+	uint32_t room_count;
+	uint32_t corridor_count;
+	uint32_t node_offset;
+	uint32_t room_offset; //tile_rect per room, indexed by room index
+	uint32_t corridor_offset; //tile_rect per corridor
+	uint32_t tile_offset; //config.width*config.height tiles, row major
+};
+
+//Flattened bsp_node, nodes are stored breadth first with the root first and the right child directly after the left
+struct dungeon_file_node
+{
+	int32_t min_x; //Partition bounds, inclusive like bsp_node::bottom_left and bsp_node::top_right
+	int32_t min_y;
+	int32_t max_x;
+	int32_t max_y;
+	tile_rect room; //The leaf's room, or the bounds of all rooms below an internal node
+	int32_t partition_direction; //-1 for leaves
+	int32_t partition_position;
+	int32_t room_index; //-1 for internal nodes
+	int32_t left_child; //-1 for leaves
+};
+
+//Pointers into a loaded file, nothing is copied
+struct dungeon_view
+{
+	const dungeon_file_header* header;
+	const dungeon_file_node* nodes;
+	const tile_rect* rooms;
+	const tile_rect* corridors;
+	const char* tiles;
+};
+
+uint32_t dungeon_file_size(dungeon*);
+
+//Writes the file image into buffer, returns the number of bytes written or 0 if capacity is too small
+uint32_t serialize_dungeon(dungeon*, uint64_t seed, runtime_dungeon_config, void* buffer, uint32_t capacity);
+//Same image as serialize_dungeon() after batch_lane_to_dungeon(), straight from the batch tables without building a tree
+uint32_t batch_lane_file_size(dungeon_batch*, int lane);
+uint32_t serialize_batch_lane(dungeon_batch*, int lane, uint64_t seed, void* buffer, uint32_t capacity);
+bool write_dungeon_file(const char* path, dungeon*, uint64_t seed, runtime_dungeon_config);
+
+//Checks the header and that every section lies inside the data, then points the view at it
+//Nothing in the sections is checked, for images still being written
+bool open_dungeon_sections(dungeon_view*, const void* data, uint32_t size);
+//Every node's child and room index is in range
+bool dungeon_nodes_valid(const dungeon_view*);
+//Every room, corridor and node room rect lies inside the header's map, so it can index the tiles without clipping
+bool dungeon_rects_valid(const dungeon_view*);
+//open_dungeon_sections(), dungeon_nodes_valid() and dungeon_rects_valid(), the view's nodes can then be followed and its rects used without further checks
+bool open_dungeon_view(dungeon_view*, const void* data, uint32_t size);
+
+//Maps the file and opens a view into it, the view is valid until the file is unmapped
+bool load_dungeon_file(const char* path, mapped_file*, dungeon_view*);
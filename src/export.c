@@ -0,0 +1,432 @@
+#include "export.h"
+#include <stdarg.h>
+#include <string.h>
+#include "jobs.h"
+
+bool open_export_writer(export_writer* writer, const char* path)
+{
+	writer->file = NULL;
+	writer->written = 0;
+	writer->used = 0;
+	writer->failed = false;
+	if(!path) return true;
+	writer->file = fopen(path, "wb");
+	writer->failed = !writer->file;
+	return !writer->failed;
+}
+
+void flush_export(export_writer* writer)
+{
+	if(writer->file && writer->used && fwrite(writer->buffer, 1, writer->used, writer->file) != writer->used) writer->failed = true;
+	writer->written += writer->used;
+	writer->used = 0;
+}
+
+bool close_export_writer(export_writer* writer)
+{
+	flush_export(writer);
+	if(writer->file && fclose(writer->file) != 0) writer->failed = true;
+	writer->file = NULL;
+	return !writer->failed;
+}
+
+void write_export(export_writer* writer, const void* data, uint32_t size)
+{
+	if(writer->used + size > EXPORT_BUFFER_SIZE) flush_export(writer);
+	if(size > EXPORT_BUFFER_SIZE)
+	{
+		if(writer->file && fwrite(data, 1, size, writer->file) != size) writer->failed = true;
+		writer->written += size;
+		return;
+	}
+	memcpy(writer->buffer + writer->used, data, size);
+	writer->used += size;
+}
+
+//Room in the buffer for size bytes, which must be at most EXPORT_BUFFER_SIZE, the caller adds what it used to writer->used
+char* reserve_export(export_writer* writer, uint32_t size)
+{
+	if(writer->used + size > EXPORT_BUFFER_SIZE) flush_export(writer);
+	return writer->buffer + writer->used;
+}
+
+void write_export_text(export_writer* writer, const char* format, ...)
+{
+	char text[1024];
+	va_list arguments;
+	va_start(arguments, format);
+	int length = vsnprintf(text, sizeof(text), format, arguments);
+	va_end(arguments);
+	write_export(writer, text, min(length, (int)sizeof(text) - 1));
+}
+
+int format_tile(char* text, uint32_t tile)
+{
+	if(tile < 10)
+	{
+		text[0] = '0' + tile;
+		return 1;
+	}
+	if(tile < 100)
+	{
+		text[0] = '0' + tile/10;
+		text[1] = '0' + tile%10;
+		return 2;
+	}
+	text[0] = '0' + tile/100;
+	text[1] = '0' + tile/10%10;
+	text[2] = '0' + tile%10;
+	return 3;
+}
+
+//One row of tiles as comma separated values, each tile offset by gid_offset
+void write_tile_row(export_writer* writer, const char* tiles, int width, int gid_offset)
+{
+	for(int x = 0; x < width; x += EXPORT_ROW_SEGMENT)
+	{
+		int count = min(EXPORT_ROW_SEGMENT, width - x);
+		char* text = reserve_export(writer, count*4);
+		int length = 0;
+		for(int i = 0; i < count; i++)
+		{
+			if(x + i) text[length++] = ',';
+			length += format_tile(text + length, (unsigned char)tiles[x + i] + gid_offset);
+		}
+		writer->used += length;
+	}
+}
+
+void export_csv(export_writer* writer, dungeon* d)
+{
+	for(int y = 0; y < d->height; y++)
+	{
+		write_tile_row(writer, d->tiles + y*d->width, d->width, 0);
+		write_export(writer, "\n", 1);
+	}
+}
+
+//Leaf rooms in left to right order, separated by commas
+void write_json_rooms(export_writer* writer, bsp_node* node, bool* first)
+{
+	if(node->left_child)
+	{
+		write_json_rooms(writer, node->left_child, first);
+		write_json_rooms(writer, node->right_child, first);
+		return;
+	}
+	tile_rect room = room_rect(node);
+	write_export_text(writer, "%s[%d,%d,%d,%d]", *first ? "" : ",", room.min_x, room.min_y, room.max_x, room.max_y);
+	*first = false;
+}
+
+void export_json(export_writer* writer, dungeon* d, uint64_t seed)
+{
+	write_export_text(writer, "{\"width\":%d,\"height\":%d,\"seed\":%llu,\n\"rooms\":[", d->width, d->height, (unsigned long long)seed);
+	bool first = true;
+	write_json_rooms(writer, d->tree, &first);
+	write_export_text(writer, "],\n\"corridors\":[");
+	for(int i = 0; i < d->corridor_count; i++)
+	{
+		tile_rect* c = &d->corridors[i];
+		write_export_text(writer, "%s[%d,%d,%d,%d]", i ? "," : "", c->min_x, c->min_y, c->max_x, c->max_y);
+	}
+	write_export_text(writer, "],\n\"tiles\":[\n");
+	for(int y = 0; y < d->height; y++)
+	{
+		write_export(writer, "[", 1);
+		write_tile_row(writer, d->tiles + y*d->width, d->width, 0);
+		write_export(writer, y + 1 < d->height ? "],\n" : "]\n", y + 1 < d->height ? 3 : 2);
+	}
+	write_export(writer, "]}\n", 3);
+}
+
+void write_tmx_rooms(export_writer* writer, bsp_node* node, int tile_size, int* object_id)
+{
+	if(node->left_child)
+	{
+		write_tmx_rooms(writer, node->left_child, tile_size, object_id);
+		write_tmx_rooms(writer, node->right_child, tile_size, object_id);
+		return;
+	}
+	tile_rect room = room_rect(node);
+	write_export_text(writer, "  <object id=\"%d\" name=\"room\" x=\"%d\" y=\"%d\" width=\"%d\" height=\"%d\"/>\n", (*object_id)++,
+			room.min_x*tile_size, room.min_y*tile_size, (room.max_x - room.min_x)*tile_size, (room.max_y - room.min_y)*tile_size);
+}
+
+void export_tmx(export_writer* writer, dungeon* d, int tile_size)
+{
+	write_export_text(writer, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+	write_export_text(writer, "<map version=\"1.10\" orientation=\"orthogonal\" renderorder=\"right-down\" width=\"%d\" height=\"%d\" tilewidth=\"%d\" tileheight=\"%d\" infinite=\"0\" nextlayerid=\"3\" nextobjectid=\"%d\">\n",
+			d->width, d->height, tile_size, tile_size, d->room_count + 1);
+	write_export_text(writer, " <tileset firstgid=\"1\" name=\"dungeon\" tilewidth=\"%d\" tileheight=\"%d\" tilecount=\"3\" columns=\"3\">\n", tile_size, tile_size);
+	write_export_text(writer, "  <image source=\"%s\" width=\"%d\" height=\"%d\"/>\n </tileset>\n", TMX_TILESET_IMAGE, 3*tile_size, tile_size);
+	write_export_text(writer, " <layer id=\"1\" name=\"tiles\" width=\"%d\" height=\"%d\">\n  <data encoding=\"csv\">\n", d->width, d->height);
+	for(int y = 0; y < d->height; y++)
+	{
+		write_tile_row(writer, d->tiles + y*d->width, d->width, 1);
+		write_export(writer, y + 1 < d->height ? ",\n" : "\n", y + 1 < d->height ? 2 : 1);
+	}
+	write_export_text(writer, "  </data>\n </layer>\n <objectgroup id=\"2\" name=\"rooms\">\n");
+	int object_id = 1;
+	write_tmx_rooms(writer, d->tree, tile_size, &object_id);
+	write_export_text(writer, " </objectgroup>\n</map>\n");
+}
+
+//PNG
+
+//Slice by 8 tables, entries[k][n] is the CRC of byte n followed by k zero bytes
+struct crc_table
+{
+	uint32_t entries[8][256];
+};
+
+crc_table make_crc_table()
+{
+	crc_table table;
+	for(uint32_t i = 0; i < 256; i++)
+	{
+		uint32_t c = i;
+		for(int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+		table.entries[0][i] = c;
+	}
+	for(uint32_t i = 0; i < 256; i++)
+	{
+		for(int k = 1; k < 8; k++) table.entries[k][i] = table.entries[0][table.entries[k - 1][i] & 0xFF] ^ (table.entries[k - 1][i] >> 8);
+	}
+	return table;
+}
+
+uint32_t update_crc(uint32_t crc, const uint8_t* data, uint32_t size)
+{
+	static const crc_table table = make_crc_table();
+	const uint32_t (*t)[256] = table.entries;
+	uint32_t i = 0;
+	for(; i + 8 <= size; i += 8)
+	{
+		uint32_t low, high;
+		memcpy(&low, data + i, 4);
+		memcpy(&high, data + i + 4, 4);
+		low ^= crc;
+		crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24] ^
+			t[3][high & 0xFF] ^ t[2][(high >> 8) & 0xFF] ^ t[1][(high >> 16) & 0xFF] ^ t[0][high >> 24];
+	}
+	for(; i < size; i++) crc = t[0][(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	return crc;
+}
+
+#define ADLER_BASE 65521
+#define ADLER_BLOCK 5552 //Most bytes that can be summed before the 32 bit sums could overflow
+
+uint32_t update_adler32(uint32_t adler, const uint8_t* data, uint32_t size)
+{
+	uint32_t a = adler & 0xFFFF;
+	uint32_t b = adler >> 16;
+	while(size)
+	{
+		uint32_t block = min(size, ADLER_BLOCK);
+		for(uint32_t i = 0; i < block; i++)
+		{
+			a += data[i];
+			b += a;
+		}
+		a %= ADLER_BASE;
+		b %= ADLER_BASE;
+		data += block;
+		size -= block;
+	}
+	return a | (b << 16);
+}
+
+//Checksum of two pieces of data joined, from each piece's checksum and the second piece's size
+uint32_t combine_adler32(uint32_t first, uint32_t second, uint32_t second_size)
+{
+	uint32_t remainder = second_size % ADLER_BASE;
+	uint32_t a = first & 0xFFFF;
+	uint32_t b = (uint32_t)((uint64_t)remainder*a % ADLER_BASE);
+	a += (second & 0xFFFF) + ADLER_BASE - 1;
+	b += (first >> 16) + (second >> 16) + ADLER_BASE - remainder;
+	if(a >= ADLER_BASE) a -= ADLER_BASE;
+	if(a >= ADLER_BASE) a -= ADLER_BASE;
+	if(b >= 2*ADLER_BASE) b -= 2*ADLER_BASE;
+	if(b >= ADLER_BASE) b -= ADLER_BASE;
+	return a | (b << 16);
+}
+
+void store_big_endian(uint8_t* data, uint32_t value)
+{
+	data[0] = value >> 24;
+	data[1] = value >> 16;
+	data[2] = value >> 8;
+	data[3] = value;
+}
+
+void write_png_chunk(export_writer* writer, const char* type, const uint8_t* data, uint32_t size)
+{
+	uint8_t header[8];
+	store_big_endian(header, size);
+	memcpy(header + 4, type, 4);
+	uint8_t crc[4];
+	store_big_endian(crc, update_crc(update_crc(0xFFFFFFFF, header + 4, 4), data, size) ^ 0xFFFFFFFF);
+	write_export(writer, header, 8);
+	if(size) write_export(writer, data, size);
+	write_export(writer, crc, 4);
+}
+
+struct png_encoding
+{
+	dungeon* d;
+	int scale;
+	int image_height;
+	uint32_t row_bytes; //Filter byte and 4 pixels a byte
+	int rows_per_chunk;
+	int first_chunk;
+
+	//One IDAT chunk per row chunk in flight
+	uint8_t* chunks;
+	uint32_t chunk_capacity;
+	uint32_t chunk_sizes[PNG_CHUNKS_IN_FLIGHT];
+	uint32_t raw_sizes[PNG_CHUNKS_IN_FLIGHT];
+	uint32_t adlers[PNG_CHUNKS_IN_FLIGHT];
+};
+
+void pack_png_row(uint8_t* row, const char* tiles, int width, int scale)
+{
+	row[0] = 0; //No filter
+	uint8_t* pixels = row + 1;
+	int image_width = width*scale;
+	if(scale == 1)
+	{
+		int x = 0;
+		for(; x + 4 <= width; x += 4) *pixels++ = (tiles[x] & 3) << 6 | (tiles[x + 1] & 3) << 4 | (tiles[x + 2] & 3) << 2 | (tiles[x + 3] & 3);
+		if(x < width)
+		{
+			uint8_t packed = 0;
+			for(int i = 0; x + i < width; i++) packed |= (tiles[x + i] & 3) << (6 - 2*i);
+			*pixels = packed;
+		}
+		return;
+	}
+	memset(pixels, 0, (image_width + 3)/4);
+	for(int x = 0; x < image_width; x++) pixels[x >> 2] |= (tiles[x/scale] & 3) << (6 - 2*(x & 3));
+}
+
+//Writes a whole IDAT chunk holding one stored deflate block of the chunk's rows, the zlib header goes in front of the first
+void encode_png_chunk(void* data, int index)
+{
+	png_encoding* png = (png_encoding*)data;
+	dungeon* d = png->d;
+	int chunk = png->first_chunk + index;
+	int first_row = chunk*png->rows_per_chunk;
+	int row_count = min(png->rows_per_chunk, png->image_height - first_row);
+	uint32_t raw_size = row_count*png->row_bytes;
+
+	uint8_t* out = png->chunks + index*png->chunk_capacity;
+	uint8_t* p = out + 8;
+	if(chunk == 0)
+	{
+		*p++ = 0x78;
+		*p++ = 0x01;
+	}
+	*p++ = 0; //Stored block, not the last
+	*p++ = raw_size & 0xFF;
+	*p++ = raw_size >> 8;
+	*p++ = ~raw_size & 0xFF;
+	*p++ = (~raw_size >> 8) & 0xFF;
+	uint8_t* raw = p;
+	for(int i = 0; i < row_count; i++, p += png->row_bytes)
+	{
+		int row = first_row + i;
+		if(i > 0 && row/png->scale == (row - 1)/png->scale) memcpy(p, p - png->row_bytes, png->row_bytes);
+		else pack_png_row(p, d->tiles + (row/png->scale)*d->width, d->width, png->scale);
+	}
+
+	uint32_t size = p - (out + 8);
+	store_big_endian(out, size);
+	memcpy(out + 4, "IDAT", 4);
+	store_big_endian(p, update_crc(0xFFFFFFFF, out + 4, size + 4) ^ 0xFFFFFFFF);
+	png->chunk_sizes[index] = size + 12;
+	png->raw_sizes[index] = raw_size;
+	png->adlers[index] = update_adler32(1, raw, raw_size);
+}
+
+void export_png(export_writer* writer, dungeon* d, int scale, int thread_count)
+{
+	png_encoding png = {};
+	png.d = d;
+	png.scale = max(scale, 1);
+	png.image_height = d->height*png.scale;
+	png.row_bytes = 1 + (d->width*png.scale + 3)/4;
+	if(png.row_bytes > PNG_MAX_BLOCK)
+	{
+		writer->failed = true;
+		return;
+	}
+	png.rows_per_chunk = min(PNG_MAX_BLOCK/png.row_bytes, png.image_height);
+	png.chunk_capacity = 12 + 2 + 5 + png.rows_per_chunk*png.row_bytes;
+	int chunk_count = (png.image_height + png.rows_per_chunk - 1)/png.rows_per_chunk;
+	png.chunks = (uint8_t*)malloc(min(chunk_count, PNG_CHUNKS_IN_FLIGHT)*png.chunk_capacity);
+
+	static const uint8_t signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+	write_export(writer, signature, sizeof(signature));
+	uint8_t header[13] = {};
+	store_big_endian(header, d->width*png.scale);
+	store_big_endian(header + 4, png.image_height);
+	header[8] = 2; //Bit depth
+	header[9] = 3; //Indexed colour
+	write_png_chunk(writer, "IHDR", header, sizeof(header));
+	//WALL, FLOOR, PARTITION, and red for anything else
+	static const uint8_t palette[] = {0, 0, 0, 255, 255, 255, 128, 128, 128, 255, 0, 0};
+	write_png_chunk(writer, "PLTE", palette, sizeof(palette));
+
+	uint32_t adler = 1;
+	for(int first = 0; first < chunk_count; first += PNG_CHUNKS_IN_FLIGHT)
+	{
+		int count = min(PNG_CHUNKS_IN_FLIGHT, chunk_count - first);
+		png.first_chunk = first;
+		parallel_for(count, encode_png_chunk, &png, thread_count);
+		for(int i = 0; i < count; i++)
+		{
+			write_export(writer, png.chunks + i*png.chunk_capacity, png.chunk_sizes[i]);
+			adler = combine_adler32(adler, png.adlers[i], png.raw_sizes[i]);
+		}
+	}
+	free(png.chunks);
+
+	//An empty last block ends the deflate stream, then the zlib checksum
+	uint8_t end[9] = {1, 0, 0, 0xFF, 0xFF};
+	store_big_endian(end + 5, adler);
+	write_png_chunk(writer, "IDAT", end, sizeof(end));
+	write_png_chunk(writer, "IEND", NULL, 0);
+}
+
+const char* export_extension(export_format format)
+{
+	switch(format)
+	{
+		case EXPORT_PNG: return "png";
+		case EXPORT_CSV: return "csv";
+		case EXPORT_JSON: return "json";
+		case EXPORT_TMX: return "tmx";
+	}
+	return "";
+}
+
+bool export_dungeon(const char* path, dungeon* d, uint64_t seed, export_format format)
+{
+	export_writer* writer = (export_writer*)malloc(sizeof(export_writer));
+	if(!open_export_writer(writer, path))
+	{
+		free(writer);
+		return false;
+	}
+	switch(format)
+	{
+		case EXPORT_PNG: export_png(writer, d); break;
+		case EXPORT_CSV: export_csv(writer, d); break;
+		case EXPORT_JSON: export_json(writer, d, seed); break;
+		case EXPORT_TMX: export_tmx(writer, d); break;
+	}
+	bool exported = close_export_writer(writer);
+	free(writer);
+	return exported;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include "dungeon.h"
+
+#define EXPORT_BUFFER_SIZE 65536
+#define EXPORT_ROW_SEGMENT 4096 //Tiles formatted per buffer reservation
+#define PNG_CHUNKS_IN_FLIGHT 8 //Row chunks encoded at once, each up to one stored deflate block
+#define PNG_MAX_BLOCK 65535
+#define TMX_TILESET_IMAGE "dungeon_tiles.png"
+
+//Exporters
+//Every format is written a row or a few rows at a time through one fixed size buffer, nothing the size of the whole image or document is built
+//PNG previews are 2 bit indexed images in stored (uncompressed) deflate blocks, the tile grid is already small and this keeps encoding at memory speed
+//Each PNG row chunk is its own IDAT chunk with its own CRC, and the zlib checksums of chunks are combined, so chunks can be encoded on separate threads
+
+enum export_format
+{
+	EXPORT_PNG,
+	EXPORT_CSV,
+	EXPORT_JSON,
+	EXPORT_TMX,
+};
+
+struct export_writer
+{
+	FILE* file; //NULL discards everything written, for timing the encoders alone
+	uint64_t written;
+	uint32_t used;
+	bool failed;
+	char buffer[EXPORT_BUFFER_SIZE];
+};
+
+bool open_export_writer(export_writer*, const char* path);
+//Flushes and closes, false if anything failed to write
+bool close_export_writer(export_writer*);
+void write_export(export_writer*, const void* data, uint32_t size);
+void write_export_text(export_writer*, const char* format, ...);
+
+//Tiles are written top row first, y down as they are stored
+//scale is pixels per tile, thread_count > 1 encodes row chunks in parallel
+void export_png(export_writer*, dungeon*, int scale = 1, int thread_count = 1);
+void export_csv(export_writer*, dungeon*);
+//Includes room and corridor rects from the bsp tree, rects are min inclusive and max exclusive
+void export_json(export_writer*, dungeon*, uint64_t seed);
+//Tile layer in CSV encoding with gids tile + 1, and an object layer of rooms in pixels
+//The tileset image is expected beside the map as TMX_TILESET_IMAGE, one tile_size tile per tile value
+void export_tmx(export_writer*, dungeon*, int tile_size = 16);
+
+bool export_dungeon(const char* path, dungeon*, uint64_t seed, export_format);
+const char* export_extension(export_format);
@@ -0,0 +1,413 @@
+#pragma once
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "dungeon.h"
+
+//Generator configurations
+//Fixed configurations make every parameter a compile time constant, so map strides, bounds checks and fills are resolved when the generator is instantiated
+//The runtime configuration holds the same parameters as plain fields, for tooling that needs to change them without rebuilding
+//Each leaf_odds is the 1 in n chance that a node below min_depth stops splitting
+
+//Stored with seed records, bump it whenever a change makes a seed generate a different dungeon
+//Draws come from the C runtime's rand(), so records are only portable between builds against the same runtime
+#define DUNGEON_GENERATOR_VERSION 1
+
+template<int map_width, int map_height, int partition_size, int room_size, int odds, int depth>
+struct fixed_dungeon_config
+{
+	static const int width = map_width;
+	static const int height = map_height;
+	static const int min_partition = partition_size;
+	static const int min_room = room_size;
+	static const int leaf_odds = odds;
+	static const int min_depth = depth;
+};
+
+typedef fixed_dungeon_config<MAP_SIZE, MAP_SIZE, MIN_PARTITION, MIN_ROOM, 5, 2> default_dungeon_config;
+typedef fixed_dungeon_config<64, 64, MIN_PARTITION, MIN_ROOM, 5, 2> small_dungeon_config;
+typedef fixed_dungeon_config<256, 256, MIN_PARTITION, MIN_ROOM, 5, 2> large_dungeon_config;
+
+struct runtime_dungeon_config
+{
+	int width;
+	int height;
+	int min_partition;
+	int min_room;
+	int leaf_odds;
+	int min_depth;
+};
+
+template<typename config>
+runtime_dungeon_config make_runtime_config(const config& c)
+{
+	return runtime_dungeon_config{c.width, c.height, c.min_partition, c.min_room, c.leaf_odds, c.min_depth};
+}
+
+//Room rows are filled differently for fixed and runtime configurations
+//A fixed width bounds a row to a known number of 16 byte blocks, so the fill is instantiated as straight line stores, the last one ending at the row's end
+//Rows under 16 tiles take two overlapping 8 or 4 byte stores
+//The runtime configuration calls memset, which has to work out the same thing from the count on every row
+#ifdef __SSE2__
+template<int block, int blocks>
+struct row_fill
+{
+	static void fill(char* row, int count, __m128i tiles)
+	{
+		if(16*block + 16 >= count)
+		{
+			_mm_storeu_si128((__m128i*)(row + count - 16), tiles);
+			return;
+		}
+		_mm_storeu_si128((__m128i*)(row + 16*block), tiles);
+		row_fill<block + 1, blocks>::fill(row, count, tiles);
+	}
+};
+
+template<int blocks>
+struct row_fill<blocks, blocks>
+{
+	static void fill(char*, int, __m128i) {}
+};
+#endif
+
+template<typename config>
+void fill_row(const config& c, char* row, int count, char tile)
+{
+#ifdef __SSE2__
+	if(count >= 16)
+	{
+		row_fill<0, (config::width + 15)/16>::fill(row, count, _mm_set1_epi8(tile));
+		return;
+	}
+#else
+	if(count >= 16)
+	{
+		memset(row, tile, count);
+		return;
+	}
+#endif
+	uint64_t tiles = 0x0101010101010101ull*(unsigned char)tile;
+	if(count >= 8)
+	{
+		memcpy(row, &tiles, 8);
+		memcpy(row + count - 8, &tiles, 8);
+	}
+	else if(count >= 4)
+	{
+		memcpy(row, &tiles, 4);
+		memcpy(row + count - 4, &tiles, 4);
+	}
+	else
+	{
+		for(int i = 0; i < count; i++) row[i] = tile;
+	}
+}
+
+inline void fill_row(const runtime_dungeon_config& c, char* row, int count, char tile)
+{
+	memset(row, tile, count);
+}
+
+inline void fill_rect_ids(int* row, int count, int rect_id)
+{
+#ifdef __SSE2__
+	if(count >= 4)
+	{
+		__m128i ids = _mm_set1_epi32(rect_id);
+		for(int i = 0; i < count - 4; i += 4) _mm_storeu_si128((__m128i*)(row + i), ids);
+		_mm_storeu_si128((__m128i*)(row + count - 4), ids);
+		return;
+	}
+#endif
+	for(int i = 0; i < count; i++) row[i] = rect_id;
+}
+
+//bsp tree:
+//	- At least min_depth levels deep
+
+template<typename config>
+bsp_node* generate_bsp_tree(const config& c, vec2d bottom_left, vec2d top_right, int level = 0)
+{
+	bsp_node* tree = (bsp_node*)malloc(sizeof(bsp_node));
+	tree->bottom_left = bottom_left;
+	tree->top_right = top_right;
+	tree->left_child = NULL;
+	tree->right_child = NULL;
+	tree->partition_direction = -1;
+	tree->room_index = -1;
+
+	vec2d dimensions = top_right - bottom_left;
+
+	if(dimensions[HORIZONTAL] > c.min_partition || dimensions[VERTICAL] > c.min_partition)
+	{
+		int should_partition = rng() % c.leaf_odds;
+		if(should_partition || level < c.min_depth)
+		{
+			//Choose direction of partition
+			int direction = rng() % 2;
+			if(dimensions[direction] < c.min_partition) direction = (direction+1)%2;
+
+			//Choose position of partition along direction
+			int min = bottom_left[direction] + c.min_room + 2;
+			int max = top_right[direction] - c.min_room - 2;
+			int partition_position = rng_range(min, max);
+
+			//Find bottom_left and top_right for left and right child nodes
+			//If direction is x (partition line is drawn parallel to y axis)
+			//	Left child bottom_left is same as current_bottom_left
+			//	Right child bottom_left is {partition_position, bottom_left.y}
+			//	Left child top_right is {partition_position - 1, top_right.y}
+			//	Right child top_right is same as current top_right
+			//If direction is y (partition line is drawn parallel to x axis)
+			//	Left child bottom left is {bottom_left.x, partition_position}
+			//	Right child bottom_left is same as current_bottom_left
+			//	Left child top_right is same as current top_right
+			//	Right child top_right is {top_right.x, partition_position - 1}
+			vec2d l_child_bottom_left = (direction == HORIZONTAL) ? bottom_left : vec2d{bottom_left.x, (float)partition_position};
+			vec2d l_child_top_right = (direction == HORIZONTAL) ? vec2d{(float)(partition_position - 1), top_right.y} : top_right;
+			vec2d r_child_bottom_left = (direction == HORIZONTAL) ? vec2d{(float)partition_position, bottom_left.y} : bottom_left;
+			vec2d r_child_top_right = (direction == HORIZONTAL) ? top_right : vec2d{top_right.x, (float)(partition_position - 1)};
+
+			tree->partition_position = partition_position;
+
+			//Create child nodes
+			tree->partition_direction = direction;
+			tree->left_child = generate_bsp_tree(c, l_child_bottom_left, l_child_top_right, level+1);
+			tree->right_child = generate_bsp_tree(c, r_child_bottom_left, r_child_top_right, level+1);
+		}
+	}
+	return tree;
+}
+
+//Carves floor tiles from (x, y) stepping by (dx, dy) until a non wall tile or the map edge is reached, returns the number of tiles carved
+template<typename config>
+int carve_until_floor(const config& c, char* tiles, int x, int y, int dx, int dy)
+{
+	int carved = 0;
+	for(; x >= 0 && x < c.width && y >= 0 && y < c.height && tiles[y*c.width + x] == WALL; x += dx, y += dy, ++carved) tiles[y*c.width + x] = FLOOR;
+	return carved;
+}
+
+//Bit i is set if tiles[i*step] is floor, for up to 64 tiles, row_tiles is how many tiles are left in the row from tiles
+inline uint64_t floor_bits(const char* tiles, int count, int step, int row_tiles)
+{
+	uint64_t bits = 0;
+	int i = 0;
+#ifdef __SSE2__
+	if(step == 1)
+	{
+		//Whole blocks of 16 are read while they stay in the row, the bits past count are masked off
+		for(; i < count && i + 16 <= row_tiles; i += 16) bits |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(tiles + i)), _mm_set1_epi8(FLOOR))) << i;
+		if(i >= count) return (count == 64) ? bits : bits & ((1ull << count) - 1);
+	}
+#endif
+	for(; i < count; i++) bits |= (uint64_t)(tiles[i*step] == FLOOR) << i;
+	return bits;
+}
+
+//Records a contact between the corridor just added and every run of floor along its sides and past its ends, then claims its tiles in rect_ids
+//A run of floor is 4-connected so one contact joins all of it, and the corridor's own tiles were floor from other rects only where carve_through() recorded it
+template<typename config>
+void touch_corridor(const config& c, dungeon* d, int* rect_ids)
+{
+	int corridor = d->room_count + d->corridor_count - 1;
+	tile_rect rect = d->corridors[d->corridor_count - 1];
+	bool horizontal = rect.max_y - rect.min_y == 1;
+	int first = rect.min_y*c.width + rect.min_x;
+	int length = horizontal ? rect.max_x - rect.min_x : rect.max_y - rect.min_y;
+	int step = horizontal ? 1 : c.width;
+	int side = horizontal ? c.width : 1;
+
+	//Both ends, and at most a run start for every other tile down each side plus one for each block of 64
+	reserve_contacts(d, 2*length + 4);
+	dungeon_contact* contacts = d->contacts;
+	int contact_count = d->contact_count;
+	if((horizontal ? rect.min_x : rect.min_y) > 0 && d->tiles[first - step] == FLOOR) contacts[contact_count++] = dungeon_contact{corridor, rect_ids[first - step]};
+	if((horizontal ? c.width - rect.max_x : c.height - rect.max_y) > 0 && d->tiles[first + length*step] == FLOOR) contacts[contact_count++] = dungeon_contact{corridor, rect_ids[first + length*step]};
+	for(int s = 0; s < 2; s++)
+	{
+		if(s == 0 && (horizontal ? rect.min_y : rect.min_x) == 0) continue;
+		if(s == 1 && (horizontal ? c.height - rect.max_y : c.width - rect.max_x) == 0) continue;
+		int row = (s == 0) ? first - side : first + side;
+		for(int i = 0; i < length; i += 64)
+		{
+			uint64_t floor = floor_bits(d->tiles + row + i*step, min(64, length - i), step, c.width - rect.min_x - i);
+			for(uint64_t run_starts = floor & ~(floor << 1); run_starts; run_starts &= run_starts - 1)
+			{
+				contacts[contact_count++] = dungeon_contact{corridor, rect_ids[row + (i + __builtin_ctzll(run_starts))*step]};
+			}
+		}
+	}
+	d->contact_count = contact_count;
+	for(int i = 0; i < length; i++) rect_ids[first + i*step] = corridor;
+}
+
+//add_corridor() for generate_hallways(), recording what the corridor touches if it was added
+template<typename config>
+void add_hallway_corridor(const config& c, dungeon* d, int* rect_ids, int min_x, int min_y, int max_x, int max_y)
+{
+	int corridor_count = d->corridor_count;
+	add_corridor(d, min_x, min_y, max_x, max_y);
+	if(d->corridor_count > corridor_count) touch_corridor(c, d, rect_ids);
+}
+
+//Carves count tiles from (x, y) whatever is there, each run of floor it crosses is touching the corridor being carved
+template<typename config>
+void carve_through(const config& c, dungeon* d, const int* rect_ids, int corridor, int x, int y, int count, int dx, int dy)
+{
+	if(count <= 0) return;
+	reserve_contacts(d, (count + 1)/2);
+	bool crossing = false;
+	for(int i = 0; i < count; i++, x += dx, y += dy)
+	{
+		bool floor = d->tiles[y*c.width + x] == FLOOR;
+		if(floor && !crossing) d->contacts[d->contact_count++] = dungeon_contact{corridor, rect_ids[y*c.width + x]};
+		crossing = floor;
+		d->tiles[y*c.width + x] = FLOOR;
+	}
+}
+
+//Recursively generates hallways connecting the given node's child nodes
+template<typename config>
+void generate_hallways(const config& c, dungeon* d, int* rect_ids, bsp_node* node)
+{
+	//Each hallway is 1 wide and n long
+	//Need to connect from one of the first child's outer floor tile to one of the second's outer floor tile
+	//Take bounding boxes containing all floor tiles of each child, rectangle (minx,miny) (maxx, maxy)
+	//Hallways generated should be single straight lines of floor tiles
+	//The partitions always have matching bounds and are adjacent, but within the bounds of each the rooms may not be aligned along the partition direction
+
+	//If bounds of both children can be connected by a single line across the partition direction
+	//Generate hallway at random position between overlapping bounds
+	//Else
+	//Either generate hallway connecting random position along bound of first partition in direction perpendicular to the partition direction, to random position along
+	//bound of second partition in the partition direction
+	//or generate hallway along fist partition bound in partition direction, connecting to random position along second bound in direction perpendicular to partition direction
+
+	//If node's children are not leaf nodes
+	//Generate hallways between child nodes
+	if(node->left_child && node->left_child->left_child) generate_hallways(c, d, rect_ids, node->left_child);
+	if(node->right_child && node->right_child->right_child) generate_hallways(c, d, rect_ids, node->right_child);
+
+	char* tiles = d->tiles;
+
+	//Get bounds of both children's floor tiles
+	vec2d left_child_room_bounds[2] = {node->left_child->room_bottom_left, node->left_child->room_top_right};
+	vec2d right_child_room_bounds[2] = {node->right_child->room_bottom_left, node->right_child->room_top_right};
+
+	int overlap;
+	int bound_direction = 1 - node->partition_direction;
+	int bound_max = min(left_child_room_bounds[1][bound_direction], right_child_room_bounds[1][bound_direction]);
+	int bound_min = max(left_child_room_bounds[0][bound_direction], right_child_room_bounds[0][bound_direction]);
+	int hallway_position = rng_range(bound_min, bound_max);
+	overlap = max(0, bound_max - bound_min);
+
+	vec2d hallway_center = {}; //Not literal center, just at hallway position along partition line
+	hallway_center[bound_direction] = (float)hallway_position;
+	hallway_center[1-bound_direction] = node->partition_position;
+	int x = (int)hallway_center.x;
+	int y = (int)hallway_center.y;
+	int corridor = d->room_count + d->corridor_count; //Rect id the next corridor will get
+	if(overlap > 0)
+	{
+
+		if(node->partition_direction == HORIZONTAL)
+		{
+			int forward = carve_until_floor(c, tiles, x, y, 1, 0);
+			int backward = carve_until_floor(c, tiles, x - 1, y, -1, 0);
+			add_hallway_corridor(c, d, rect_ids, x - backward, y, x + forward, y + 1);
+		}
+		else
+		{
+			int forward = carve_until_floor(c, tiles, x, y, 0, 1);
+			int backward = carve_until_floor(c, tiles, x, y - 1, 0, -1);
+			add_hallway_corridor(c, d, rect_ids, x, y - backward, x + 1, y + forward);
+		}
+	}
+	else
+	{
+		int hallway_position_1_max = (int)right_child_room_bounds[1][node->partition_direction]; //Oriented to different axis to position_0
+		int hallway_position_1_min = (int)right_child_room_bounds[0][node->partition_direction];
+
+		int hallway_position_1 = rng_range(hallway_position_1_min, hallway_position_1_max);
+
+		vec2d hallway_center_1 = {};
+		hallway_center_1[1-bound_direction] = hallway_position_1;
+		hallway_center_1[bound_direction] = hallway_center[bound_direction];
+		int x_1 = (int)hallway_center_1.x;
+		int y_1 = (int)hallway_center_1.y;
+		if(node->partition_direction == HORIZONTAL)
+		{
+			int backward = carve_until_floor(c, tiles, x - 1, y, -1, 0);
+			carve_through(c, d, rect_ids, corridor, x, y, x_1 - x + 1, 1, 0);
+			add_hallway_corridor(c, d, rect_ids, x - backward, y, max(x, x_1 + 1), y + 1);
+			int turn = carve_until_floor(c, tiles, x_1, y_1, 0, -1);
+			add_hallway_corridor(c, d, rect_ids, x_1, y_1 - turn + 1, x_1 + 1, y_1 + 1);
+		}
+		else
+		{
+			int backward = carve_until_floor(c, tiles, x, y - 1, 0, -1);
+			carve_through(c, d, rect_ids, corridor, x, y, y_1 - y + 1, 0, 1);
+			add_hallway_corridor(c, d, rect_ids, x, y - backward, x + 1, max(y, y_1 + 1));
+			int turn = carve_until_floor(c, tiles, x_1, y_1, -1, 0);
+			add_hallway_corridor(c, d, rect_ids, x_1 - turn + 1, y_1, x_1 + 1, y_1 + 1);
+		}
+	}
+	node->room_bottom_left = {(float)min(node->left_child->room_bottom_left.x, node->right_child->room_bottom_left.x), (float)min(node->left_child->room_bottom_left.y, node->right_child->room_bottom_left.y)};
+	node->room_top_right = {(float)max(node->left_child->room_top_right.x, node->right_child->room_top_right.x), (float)max(node->left_child->room_top_right.y, node->right_child->room_top_right.y)};
+}
+
+template<typename config>
+void generate_rooms(const config& c, dungeon* d, int* rect_ids, bsp_node* node)
+{
+	//If node is a leaf
+	if(!node->left_child && !node->right_child)
+	{
+		int left_side = rng_range(node->bottom_left.x+1, node->top_right.x-c.min_room+1);
+		int right_side = rng_range(left_side+c.min_room, node->top_right.x+1);
+		int bottom_side = rng_range(node->bottom_left.y+1, node->top_right.y-c.min_room+1);
+		int top_side = rng_range(bottom_side+c.min_room, node->top_right.y+1);
+		node->room_bottom_left = vec2d{(float)left_side, (float)bottom_side};
+		node->room_top_right = vec2d{(float)right_side, (float)top_side};
+		node->room_index = d->room_count++;
+		for(int i = bottom_side; i < top_side; i++)
+		{
+			fill_row(c, d->tiles + i*c.width + left_side, right_side - left_side, FLOOR);
+			fill_rect_ids(rect_ids + i*c.width + left_side, right_side - left_side, node->room_index);
+		}
+	}
+	else
+	{
+		generate_rooms(c, d, rect_ids, node->left_child);
+		generate_rooms(c, d, rect_ids, node->right_child);
+	}
+}
+
+//Generates into tiles, which must hold c.width*c.height tiles
+template<typename config>
+void generate_dungeon(dungeon* d, char* tiles, const config& c)
+{
+	d->width = c.width;
+	d->height = c.height;
+	d->tiles = tiles;
+	memset(tiles, WALL, c.width*c.height);
+	d->room_count = 0;
+	d->corridor_count = 0;
+	d->tree = generate_bsp_tree(c, vec2d{0.0f, 0.0f}, vec2d{c.width - 1.0f, c.height - 1.0f});
+	//Rect id of every floor tile, as numbered by gather_floor_rects(), so hallways can record what they touch
+	//Written as each tile becomes floor and only read for floor, so it is never cleared
+	int* rect_ids = (int*)malloc(c.width*c.height*sizeof(int));
+	generate_rooms(c, d, rect_ids, d->tree);
+
+	//A hallway per internal node and at most two corridors per hallway, so add_corridor() never has to grow this
+	d->corridor_capacity = 2*d->room_count;
+	d->corridors = (tile_rect*)malloc(d->corridor_capacity*sizeof(tile_rect));
+	d->contacts = NULL;
+	d->contact_count = 0;
+	d->contact_capacity = 0;
+	reserve_contacts(d, 4*d->room_count);
+	generate_hallways(c, d, rect_ids, d->tree);
+	free(rect_ids);
+}
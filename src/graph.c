@@ -0,0 +1,290 @@
+#include "graph.h"
+#include "jobs.h"
+
+#define CORRIDOR_TILE -1
+#define WALL_TILE -2
+
+//Labels every tile with the index of the room it belongs to, CORRIDOR_TILE for any other floor and WALL_TILE for the rest
+int* label_room_tiles(tile_rect* rooms, int room_count, const char* tiles, int width, int height)
+{
+	int* labels = (int*)malloc(width*height*sizeof(int));
+	for(int i = 0; i < width*height; i++) labels[i] = (tiles[i] == FLOOR) ? CORRIDOR_TILE : WALL_TILE;
+	for(int r = 0; r < room_count; r++)
+	{
+		for(int y = rooms[r].min_y; y < rooms[r].max_y; y++) for(int x = rooms[r].min_x; x < rooms[r].max_x; x++) labels[y*width + x] = r;
+	}
+	return labels;
+}
+
+//Breadth first search out of each room along corridor tiles, every other room it bumps into becomes an edge
+//Working from the carved tiles rather than the hallway scan keeps the graph right when a hallway runs into another corridor instead of a room
+void build_room_graph(room_graph* graph, dungeon* d, const char* tiles, int width, int height)
+{
+	int tile_count = width*height;
+	tile_rect* rooms = (tile_rect*)malloc(d->room_count*sizeof(tile_rect));
+	gather_room_rects(d->tree, rooms);
+	int* labels = label_room_tiles(rooms, d->room_count, tiles, width, height);
+	int* visited_by = (int*)calloc(tile_count, sizeof(int)); //Room index + 1 of the last search to visit the tile
+	int* steps = (int*)malloc(tile_count*sizeof(int));
+	int* queue = (int*)malloc(tile_count*sizeof(int));
+	int* lengths = (int*)malloc(d->room_count*sizeof(int));
+	int* reached = (int*)malloc(d->room_count*sizeof(int));
+	for(int r = 0; r < d->room_count; r++) lengths[r] = -1;
+
+	int edge_capacity = 4*d->room_count + 4;
+	graph->room_count = d->room_count;
+	graph->edge_count = 0;
+	graph->edge_starts = (int*)malloc((d->room_count + 1)*sizeof(int));
+	graph->edge_rooms = (int*)malloc(edge_capacity*sizeof(int));
+	graph->edge_lengths = (int*)malloc(edge_capacity*sizeof(int));
+
+	int neighbour_x[] = {1, -1, 0, 0};
+	int neighbour_y[] = {0, 0, 1, -1};
+	for(int r = 0; r < d->room_count; r++)
+	{
+		graph->edge_starts[r] = graph->edge_count;
+		int queue_start = 0;
+		int queue_end = 0;
+		int reached_count = 0;
+		for(int y = rooms[r].min_y; y < rooms[r].max_y; y++)
+		{
+			for(int x = rooms[r].min_x; x < rooms[r].max_x; x++)
+			{
+				int tile = y*width + x;
+				visited_by[tile] = r + 1;
+				steps[tile] = 0;
+				queue[queue_end++] = tile;
+			}
+		}
+
+		while(queue_start < queue_end)
+		{
+			int tile = queue[queue_start++];
+			int x = tile%width;
+			int y = tile/width;
+			for(int n = 0; n < 4; n++)
+			{
+				int nx = x + neighbour_x[n];
+				int ny = y + neighbour_y[n];
+				if(nx < 0 || nx >= width || ny < 0 || ny >= height) continue;
+				int neighbour = ny*width + nx;
+				int label = labels[neighbour];
+				if(label == WALL_TILE || visited_by[neighbour] == r + 1) continue;
+				if(label == CORRIDOR_TILE)
+				{
+					visited_by[neighbour] = r + 1;
+					steps[neighbour] = steps[tile] + 1;
+					queue[queue_end++] = neighbour;
+				}
+				else if(lengths[label] == -1)
+				{
+					//Tiles leave the queue in step order so the first contact is the shortest
+					lengths[label] = steps[tile];
+					reached[reached_count++] = label;
+				}
+			}
+		}
+
+		for(int i = 0; i < reached_count; i++)
+		{
+			if(graph->edge_count == edge_capacity)
+			{
+				edge_capacity *= 2;
+				graph->edge_rooms = (int*)realloc(graph->edge_rooms, edge_capacity*sizeof(int));
+				graph->edge_lengths = (int*)realloc(graph->edge_lengths, edge_capacity*sizeof(int));
+			}
+			graph->edge_rooms[graph->edge_count] = reached[i];
+			graph->edge_lengths[graph->edge_count] = lengths[reached[i]];
+			++graph->edge_count;
+			lengths[reached[i]] = -1;
+		}
+	}
+	graph->edge_starts[d->room_count] = graph->edge_count;
+
+	free(reached);
+	free(lengths);
+	free(queue);
+	free(steps);
+	free(visited_by);
+	free(labels);
+	free(rooms);
+}
+
+void destroy_room_graph(room_graph* graph)
+{
+	free(graph->edge_starts);
+	free(graph->edge_rooms);
+	free(graph->edge_lengths);
+	*graph = {};
+}
+
+void heap_push(int* keys, int* values, int* size, int key, int value)
+{
+	int i = (*size)++;
+	for(; i > 0 && keys[(i-1)/2] > key; i = (i-1)/2)
+	{
+		keys[i] = keys[(i-1)/2];
+		values[i] = values[(i-1)/2];
+	}
+	keys[i] = key;
+	values[i] = value;
+}
+
+void heap_pop(int* keys, int* values, int* size, int* key, int* value)
+{
+	*key = keys[0];
+	*value = values[0];
+	int last_key = keys[--*size];
+	int last_value = values[*size];
+	int i = 0;
+	for(int child = 1; child < *size; child = 2*i + 1)
+	{
+		if(child + 1 < *size && keys[child + 1] < keys[child]) ++child;
+		if(keys[child] >= last_key) break;
+		keys[i] = keys[child];
+		values[i] = values[child];
+		i = child;
+	}
+	keys[i] = last_key;
+	values[i] = last_value;
+}
+
+struct room_distance_job
+{
+	room_graph* graph;
+	room_distances* result;
+};
+
+//Dijkstra from a single source room, fills that room's row of the distance matrix
+void compute_distances_from_room(void* data, int source)
+{
+	room_distance_job* job = (room_distance_job*)data;
+	room_graph* graph = job->graph;
+	int* distances = job->result->distances + source*graph->room_count;
+	for(int r = 0; r < graph->room_count; r++) distances[r] = ROOM_UNREACHABLE;
+
+	//Every directed edge is relaxed at most once, so the heap never holds more than edge_count + 1 entries
+	int* heap_keys = (int*)malloc((graph->edge_count + 1)*sizeof(int));
+	int* heap_rooms = (int*)malloc((graph->edge_count + 1)*sizeof(int));
+	int heap_size = 0;
+	heap_push(heap_keys, heap_rooms, &heap_size, 0, source);
+	while(heap_size > 0)
+	{
+		int distance;
+		int room;
+		heap_pop(heap_keys, heap_rooms, &heap_size, &distance, &room);
+		if(distances[room] != ROOM_UNREACHABLE) continue;
+		distances[room] = distance;
+		for(int e = graph->edge_starts[room]; e < graph->edge_starts[room + 1]; e++)
+		{
+			int neighbour = graph->edge_rooms[e];
+			if(distances[neighbour] == ROOM_UNREACHABLE) heap_push(heap_keys, heap_rooms, &heap_size, distance + graph->edge_lengths[e], neighbour);
+		}
+	}
+	free(heap_rooms);
+	free(heap_keys);
+}
+
+void compute_room_distances(room_distances* result, room_graph* graph, int thread_count)
+{
+	result->room_count = graph->room_count;
+	result->distances = (int*)malloc(graph->room_count*graph->room_count*sizeof(int));
+	room_distance_job job = {graph, result};
+	parallel_for(graph->room_count, compute_distances_from_room, &job, thread_count);
+}
+
+void destroy_room_distances(room_distances* result)
+{
+	free(result->distances);
+	*result = {};
+}
+
+int room_distance(room_distances* result, int from_room, int to_room)
+{
+	return result->distances[from_room*result->room_count + to_room];
+}
+
+//Breadth first from every source at once, the queue holds tile indices in order of distance
+//A bitset wavefront was tried here but corridor heavy maps need hundreds of steps to cover a handful of tiles per step, which made it several times slower
+void compute_distance_field(uint16_t* distances, const char* tiles, int width, int height, const int* xs, const int* ys, int source_count, int* queue)
+{
+	memset(distances, 0xFF, width*height*sizeof(uint16_t));
+	int queue_start = 0;
+	int queue_end = 0;
+	for(int i = 0; i < source_count; i++)
+	{
+		int tile = ys[i]*width + xs[i];
+		if(tiles[tile] != FLOOR || distances[tile] == 0) continue;
+		distances[tile] = 0;
+		queue[queue_end++] = tile;
+	}
+
+	while(queue_start < queue_end)
+	{
+		int tile = queue[queue_start++];
+		int x = tile%width;
+		uint16_t distance = distances[tile] + (distances[tile] < TILE_UNREACHABLE - 1);
+		int neighbours[4] = {tile - width, tile + width, tile - 1, tile + 1};
+		bool in_bounds[4] = {tile >= width, tile + width < width*height, x > 0, x + 1 < width};
+		for(int n = 0; n < 4; n++)
+		{
+			if(!in_bounds[n]) continue;
+			int neighbour = neighbours[n];
+			if(tiles[neighbour] != FLOOR || distances[neighbour] != TILE_UNREACHABLE) continue;
+			distances[neighbour] = distance;
+			queue[queue_end++] = neighbour;
+		}
+	}
+}
+
+void compute_distance_field(uint16_t* distances, const char* tiles, int width, int height, const int* xs, const int* ys, int source_count)
+{
+	int* queue = (int*)malloc(width*height*sizeof(int));
+	compute_distance_field(distances, tiles, width, height, xs, ys, source_count, queue);
+	free(queue);
+}
+
+struct room_field_job
+{
+	const char* tiles;
+	int width;
+	int height;
+	tile_rect* rooms;
+	uint16_t* fields;
+};
+
+void compute_room_distance_field(void* data, int room)
+{
+	room_field_job* job = (room_field_job*)data;
+	tile_rect r = job->rooms[room];
+	int source_count = (r.max_x - r.min_x)*(r.max_y - r.min_y);
+	int* xs = (int*)malloc(source_count*sizeof(int));
+	int* ys = (int*)malloc(source_count*sizeof(int));
+	int* queue = (int*)malloc(job->width*job->height*sizeof(int));
+	int i = 0;
+	for(int y = r.min_y; y < r.max_y; y++)
+	{
+		for(int x = r.min_x; x < r.max_x; x++, i++)
+		{
+			xs[i] = x;
+			ys[i] = y;
+		}
+	}
+	compute_distance_field(job->fields + room*job->width*job->height, job->tiles, job->width, job->height, xs, ys, source_count, queue);
+	free(queue);
+	free(ys);
+	free(xs);
+}
+
+uint16_t* compute_room_distance_fields(dungeon* d, const char* tiles, int width, int height, int thread_count)
+{
+	tile_rect* rooms = (tile_rect*)malloc(d->room_count*sizeof(tile_rect));
+	gather_room_rects(d->tree, rooms);
+
+	uint16_t* fields = (uint16_t*)malloc(d->room_count*width*height*sizeof(uint16_t));
+	room_field_job job = {tiles, width, height, rooms, fields};
+	parallel_for(d->room_count, compute_room_distance_field, &job, thread_count);
+
+	free(rooms);
+	return fields;
+}
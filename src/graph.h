@@ -0,0 +1,39 @@
+#pragma once
+#include <string.h>
+#include "dungeon.h"
+
+#define ROOM_UNREACHABLE -1
+#define TILE_UNREACHABLE 0xFFFF
+
+//Rooms joined by corridors in compressed sparse row form
+//Edge lengths are the number of corridor tiles walked between the two rooms
+struct room_graph
+{
+	int room_count;
+	int edge_count;
+	int* edge_starts; //room_count+1 offsets into edge_rooms and edge_lengths
+	int* edge_rooms;
+	int* edge_lengths;
+};
+
+//Shortest corridor distance between every pair of rooms, ROOM_UNREACHABLE if there is no path
+struct room_distances
+{
+	int room_count;
+	int* distances; //room_count*room_count, row per source room
+};
+
+void build_room_graph(room_graph*, dungeon*, const char* tiles, int width, int height);
+void destroy_room_graph(room_graph*);
+
+void compute_room_distances(room_distances*, room_graph*, int thread_count = 0);
+void destroy_room_distances(room_distances*);
+int room_distance(room_distances*, int from_room, int to_room);
+
+//Steps from the nearest source to every floor tile, TILE_UNREACHABLE for walls and tiles with no path
+//queue needs room for width*height tile indices
+void compute_distance_field(uint16_t* distances, const char* tiles, int width, int height, const int* xs, const int* ys, int source_count, int* queue);
+void compute_distance_field(uint16_t* distances, const char* tiles, int width, int height, const int* xs, const int* ys, int source_count);
+
+//One width*height distance field per room, sourced from all of the room's tiles, stored room after room
+uint16_t* compute_room_distance_fields(dungeon*, const char* tiles, int width, int height, int thread_count = 0);
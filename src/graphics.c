@@ -1,4 +1,22 @@
 #include "graphics.h"
+#include "timer.h"
+#include <string.h>
+//SPIR-V compiled into the binary by build.bat (glslangValidator --vn), so startup reads no shader files
+#include "vert_spv.h"
+#include "frag_spv.h"
+#include "line_vert_spv.h"
+#include "line_frag_spv.h"
+#include "tile_vert_spv.h"
+#include "raster_tile_vert_spv.h"
+#include "tile_raster_comp_spv.h"
+
+struct shader_code
+{
+	const uint32_t* words;
+	size_t size; //Bytes
+};
+
+#define SHADER_CODE(words) shader_code{words, sizeof(words)}
 
 //NOTE: Instance extensions vs device extensions
 #define VK_ERROR_SURFACE_NOT_SUPPORTED 1000
@@ -285,6 +303,30 @@ VkResult create_logical_device(VkDevice* logical_device, uint32_t* graphics_queu
 	return result;
 }
 
+//FIFO is the only mode every surface supports
+bool present_mode_supported(vulkan_state* vulkan, VkPresentModeKHR present_mode)
+{
+	uint32_t mode_count;
+	vkGetPhysicalDeviceSurfacePresentModesKHR(vulkan->physical_device, vulkan->surface, &mode_count, NULL);
+	VkPresentModeKHR modes[16] = {};
+	if(mode_count > 16) mode_count = 16;
+	vkGetPhysicalDeviceSurfacePresentModesKHR(vulkan->physical_device, vulkan->surface, &mode_count, modes);
+	for(uint32_t i = 0; i < mode_count; i++) if(modes[i] == present_mode) return true;
+	return false;
+}
+
+const char* present_mode_name(VkPresentModeKHR present_mode)
+{
+	switch(present_mode)
+	{
+		case VK_PRESENT_MODE_IMMEDIATE_KHR: return "immediate";
+		case VK_PRESENT_MODE_MAILBOX_KHR: return "mailbox";
+		case VK_PRESENT_MODE_FIFO_KHR: return "fifo";
+		case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "fifo relaxed";
+		default: return "unknown";
+	}
+}
+
 bool swapchain_format_supported(VkPhysicalDevice physical_device, VkSurfaceKHR surface, VkFormat format)
 {
 	uint32_t format_count;
@@ -297,7 +339,7 @@ bool swapchain_format_supported(VkPhysicalDevice physical_device, VkSurfaceKHR s
 
 //NOTE: Should swapchain creation be dependent specifically on surface capabilities
 //Do I even need to make swapchain creation more generic? My requirements for it seem static
-VkResult create_swapchain(VkSwapchainKHR* swapchain, VkExtent2D swapchain_extent, uint32_t swapchain_image_count, VkPhysicalDevice device, VkDevice logical_device, VkSurfaceKHR surface, VkSurfaceTransformFlagBitsKHR pre_transform, VkFormat swapchain_image_format)
+VkResult create_swapchain(VkSwapchainKHR* swapchain, VkExtent2D swapchain_extent, uint32_t swapchain_image_count, VkPhysicalDevice device, VkDevice logical_device, VkSurfaceKHR surface, VkSurfaceTransformFlagBitsKHR pre_transform, VkFormat swapchain_image_format, VkPresentModeKHR present_mode)
 {
 	//CREATE SWAPCHAIN
 	VkSwapchainCreateInfoKHR swapchain_create_info = {};
@@ -312,7 +354,7 @@ VkResult create_swapchain(VkSwapchainKHR* swapchain, VkExtent2D swapchain_extent
 	swapchain_create_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	swapchain_create_info.preTransform = pre_transform;
 	swapchain_create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-	swapchain_create_info.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+	swapchain_create_info.presentMode = present_mode;
 	swapchain_create_info.clipped = VK_TRUE;
 	swapchain_create_info.oldSwapchain = VK_NULL_HANDLE;
 
@@ -425,30 +467,18 @@ VkResult create_command_buffers(VkCommandBuffer* command_buffers, VkDevice* logi
 	return result;
 }
 
-VkShaderModule create_shader_module(VkDevice logical_device, const char* path)
+VkShaderModule create_shader_module(VkDevice logical_device, shader_code code)
 {
-	FILE* f = fopen(path, "rb");
-	if(!f) printf("File I/O blows\n");
-	fseek(f, 0, SEEK_END);
-	int size = ftell(f);
-	fseek(f, 0, SEEK_SET);
-
-	char* file_contents = (char*)malloc(size+1);
-	fread(file_contents, 1, size, f);
-	fclose(f);
-	file_contents[size] = 0;
-	
 	VkShaderModuleCreateInfo shader_module_create_info = {};
 	shader_module_create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	shader_module_create_info.codeSize = size;
-	shader_module_create_info.pCode = (const uint32_t*)file_contents;
+	shader_module_create_info.codeSize = code.size;
+	shader_module_create_info.pCode = code.words;
 	
 	VkShaderModule shader_module;
 	if(vkCreateShaderModule(logical_device, &shader_module_create_info, NULL, &shader_module) != VK_SUCCESS)
 	{
 		printf("Shaders suck\n");
 	}
-	free(file_contents);
 	return shader_module;
 }
 
@@ -497,11 +527,12 @@ VkVertexInputAttributeDescription vertex_attribute(uint32_t binding, uint32_t lo
 	return vertex_attribute_description;
 }
 
-VkResult create_graphics_pipeline(VkPipeline* graphics_pipeline, VkDevice logical_device, VkExtent2D swapchain_extent, VkRenderPass render_pass, VkDescriptorSetLayout descriptor_set_layout, VkPipelineLayout pipeline_layout, VkPrimitiveTopology topology, VkVertexInputBindingDescription* vertex_binding_descriptions, uint32_t vertex_binding_description_count, VkVertexInputAttributeDescription* vertex_attributes, uint32_t vertex_attribute_count, const char* vertex_shader_path, const char* fragment_shader_path)
+//Viewport and scissor are dynamic, so pipelines don't depend on the swapchain extent and survive a resize
+VkResult create_graphics_pipeline(VkPipeline* graphics_pipeline, VkDevice logical_device, VkPipelineCache pipeline_cache, VkRenderPass render_pass, VkPipelineLayout pipeline_layout, VkPrimitiveTopology topology, VkVertexInputBindingDescription* vertex_binding_descriptions, uint32_t vertex_binding_description_count, VkVertexInputAttributeDescription* vertex_attributes, uint32_t vertex_attribute_count, shader_code vertex_shader, shader_code fragment_shader)
 {
 	//CREATE SHADER MODULES AND PIPELINE STAGES
-	VkShaderModule vertex_shader_module = create_shader_module(logical_device, vertex_shader_path);
-	VkShaderModule fragment_shader_module = create_shader_module(logical_device, fragment_shader_path);
+	VkShaderModule vertex_shader_module = create_shader_module(logical_device, vertex_shader);
+	VkShaderModule fragment_shader_module = create_shader_module(logical_device, fragment_shader);
 	VkPipelineShaderStageCreateInfo vertex_shader_stage_info = {};
 	vertex_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 	vertex_shader_stage_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
@@ -532,26 +563,17 @@ VkResult create_graphics_pipeline(VkPipeline* graphics_pipeline, VkDevice logica
 	input_assembly_info.topology = topology;
 	input_assembly_info.primitiveRestartEnable = VK_FALSE;
 	
-	//DESCRIBE VIEWPORT
-	VkViewport viewport = {};
-	viewport.x = 0.0f;
-	viewport.y = (float)swapchain_extent.height;
-	viewport.width = (float)swapchain_extent.width;
-	viewport.height = -(float)swapchain_extent.height;
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
-
-	VkRect2D scissor = {};
-	scissor.offset = {0, 0};
-	scissor.extent = swapchain_extent;
-
-	//CREATE VIEWPORT
+	//DESCRIBE VIEWPORT, SET EACH FRAME BY begin_frame()
 	VkPipelineViewportStateCreateInfo viewport_state_info = {};
 	viewport_state_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 	viewport_state_info.viewportCount = 1;
-	viewport_state_info.pViewports = &viewport;
 	viewport_state_info.scissorCount = 1;
-	viewport_state_info.pScissors = &scissor;
+
+	VkDynamicState dynamic_states[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+	VkPipelineDynamicStateCreateInfo dynamic_state_info = {};
+	dynamic_state_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamic_state_info.dynamicStateCount = 2;
+	dynamic_state_info.pDynamicStates = dynamic_states;
 
 	//DESCRIBE RASTERISER
 	VkPipelineRasterizationStateCreateInfo rasterizer = {};
@@ -594,11 +616,12 @@ VkResult create_graphics_pipeline(VkPipeline* graphics_pipeline, VkDevice logica
 	pipeline_info.pRasterizationState = &rasterizer;
 	pipeline_info.pMultisampleState = &multisample_info;
 	pipeline_info.pColorBlendState = &colour_blending_info;
+	pipeline_info.pDynamicState = &dynamic_state_info;
 	pipeline_info.layout = pipeline_layout;
 	pipeline_info.renderPass = render_pass;
 	pipeline_info.subpass = 0;
 
-	VkResult result = vkCreateGraphicsPipelines(logical_device, VK_NULL_HANDLE, 1, &pipeline_info, NULL, graphics_pipeline);
+	VkResult result = vkCreateGraphicsPipelines(logical_device, pipeline_cache, 1, &pipeline_info, NULL, graphics_pipeline);
 	if(result != VK_SUCCESS)
 	{
 		print_vulkan_error(result);
@@ -629,7 +652,7 @@ VkResult create_uniform_descriptor_pool(VkDescriptorPool* descriptor_pool, VkDev
 
 VkResult create_descriptor_sets(VkDescriptorSet* descriptor_sets, VkDevice* logical_device, VkDescriptorPool* descriptor_pool, VkBuffer* descriptor_set_buffers, VkDescriptorSetLayout descriptor_set_layout, int descriptor_set_count, int descriptor_set_buffer_range)
 {
-	VkDescriptorSetLayout descriptor_set_layouts[4] = {};
+	VkDescriptorSetLayout descriptor_set_layouts[MAX_FRAMES_COMPUTED_AT_ONCE] = {};
 	for(int i = 0; i < descriptor_set_count; i++) descriptor_set_layouts[i] = descriptor_set_layout;
 
 	VkDescriptorSetAllocateInfo descriptor_set_alloc_info = {};
@@ -843,18 +866,26 @@ uint32_t create_swapchain_dependent_components(vulkan_state* vulkan)
 		return 1;
 	}
 
-	vulkan->swapchain_image_count = 3;
+	//An image more than there are frames in flight, so a frame can be recorded while the others are queued or on screen
+	int image_count = max(surface_capabilities.minImageCount + 1, vulkan->frames_in_flight + 1);
+	if(surface_capabilities.maxImageCount) image_count = min(image_count, surface_capabilities.maxImageCount);
+	vulkan->swapchain_image_count = min(image_count, MAX_SWAPCHAIN_IMAGES);
 	vulkan->swapchain_extent = surface_capabilities.currentExtent;
 
 	//*CREATE SWAPCHAIN
-	VkResult vulkan_procedure_result = create_swapchain(&vulkan->swapchain, vulkan->swapchain_extent, vulkan->swapchain_image_count, vulkan->physical_device, vulkan->logical_device, vulkan->surface, surface_capabilities.currentTransform, swapchain_image_format);
+	VkResult vulkan_procedure_result = create_swapchain(&vulkan->swapchain, vulkan->swapchain_extent, vulkan->swapchain_image_count, vulkan->physical_device, vulkan->logical_device, vulkan->surface, surface_capabilities.currentTransform, swapchain_image_format, vulkan->present_mode);
 	if(vulkan_procedure_result != VK_SUCCESS) return 5;
 
 	//*CREATE SWAPCHAIN IMAGE VIEWS
-	VkImage swapchain_images[4] = {};
-	uint32_t swapchain_image_count;
-	vkGetSwapchainImagesKHR(vulkan->logical_device, vulkan->swapchain, &swapchain_image_count, NULL);
-	printf("Retrieved swapchain image count = %d\n", swapchain_image_count);
+	//The count asked for is a minimum, the driver may make more
+	VkImage swapchain_images[MAX_SWAPCHAIN_IMAGES] = {};
+	vkGetSwapchainImagesKHR(vulkan->logical_device, vulkan->swapchain, &vulkan->swapchain_image_count, NULL);
+	printf("Retrieved swapchain image count = %d\n", vulkan->swapchain_image_count);
+	if(vulkan->swapchain_image_count > MAX_SWAPCHAIN_IMAGES)
+	{
+		vulkan->swapchain_image_count = 0;
+		return 6;
+	}
 	vkGetSwapchainImagesKHR(vulkan->logical_device, vulkan->swapchain, &vulkan->swapchain_image_count, swapchain_images);
 	for(int i = 0; i < vulkan->swapchain_image_count; i++)
 	{
@@ -874,7 +905,154 @@ uint32_t create_swapchain_dependent_components(vulkan_state* vulkan)
 		if(vulkan_procedure_result != VK_SUCCESS) return 11;
 	}
 
-	//*CREATE GRAPHICS PIPELINE
+	return 0;
+}
+
+//Cache data starts with a header naming the device it was made on, data from another device or driver is not handed to Vulkan
+bool pipeline_cache_matches_device(const void* data, uint32_t size, VkPhysicalDevice physical_device)
+{
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physical_device, &properties);
+	const uint32_t* header = (const uint32_t*)data;
+	if(size < 16 + VK_UUID_SIZE || header[0] < 16 + VK_UUID_SIZE || header[1] != VK_PIPELINE_CACHE_HEADER_VERSION_ONE) return false;
+	if(header[2] != properties.vendorID || header[3] != properties.deviceID) return false;
+	return memcmp(header + 4, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+//Starts from the cache saved by the last run if there is one for this device
+VkResult create_pipeline_cache(vulkan_state* vulkan)
+{
+	VkPipelineCacheCreateInfo cache_info = {};
+	cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	mapped_file file = {};
+	vulkan->pipeline_cache_warm = map_file(&file, PIPELINE_CACHE_PATH) && pipeline_cache_matches_device(file.data, file.size, vulkan->physical_device);
+	if(vulkan->pipeline_cache_warm)
+	{
+		cache_info.initialDataSize = file.size;
+		cache_info.pInitialData = file.data;
+	}
+	VkResult result = vkCreatePipelineCache(vulkan->logical_device, &cache_info, NULL, &vulkan->pipeline_cache);
+	if(file.data) unmap_file(&file);
+	if(result != VK_SUCCESS) print_vulkan_error(result);
+	return result;
+}
+
+void save_pipeline_cache(vulkan_state* vulkan)
+{
+	size_t size = 0;
+	if(vkGetPipelineCacheData(vulkan->logical_device, vulkan->pipeline_cache, &size, NULL) != VK_SUCCESS || size == 0) return;
+	void* data = malloc(size);
+	if(vkGetPipelineCacheData(vulkan->logical_device, vulkan->pipeline_cache, &size, data) == VK_SUCCESS)
+	{
+		//Written beside the old cache and moved over it, so a failed write never leaves a truncated cache for the next run
+		FILE* f = fopen(PIPELINE_CACHE_PATH ".tmp", "wb");
+		bool written = f && fwrite(data, 1, size, f) == size;
+		if(f) written = (fclose(f) == 0) && written;
+		if(!written || !MoveFileExA(PIPELINE_CACHE_PATH ".tmp", PIPELINE_CACHE_PATH, MOVEFILE_REPLACE_EXISTING)) printf("Pipeline cache not saved\n");
+	}
+	free(data);
+}
+
+VkResult create_compute_pipeline(VkPipeline* compute_pipeline, VkDevice logical_device, VkPipelineCache pipeline_cache, VkPipelineLayout pipeline_layout, shader_code compute_shader)
+{
+	VkShaderModule compute_shader_module = create_shader_module(logical_device, compute_shader);
+	VkComputePipelineCreateInfo pipeline_info = {};
+	pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipeline_info.stage.module = compute_shader_module;
+	pipeline_info.stage.pName = "main";
+	pipeline_info.layout = pipeline_layout;
+
+	VkResult result = vkCreateComputePipelines(logical_device, pipeline_cache, 1, &pipeline_info, NULL, compute_pipeline);
+	if(result != VK_SUCCESS) print_vulkan_error(result);
+	vkDestroyShaderModule(logical_device, compute_shader_module, NULL);
+	return result;
+}
+
+//Rects and bins for the compute shader to read, tiles for it to write and the raster tile vertex shader to read
+VkDescriptorSetLayout create_raster_descriptor_set_layout(VkDevice logical_device)
+{
+	VkDescriptorSetLayoutBinding bindings[3] = {};
+	bindings[0].binding = 0;
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[0].descriptorCount = 1;
+	bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	bindings[1].binding = 1;
+	bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[1].descriptorCount = 1;
+	bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_VERTEX_BIT;
+	bindings[2].binding = 2;
+	bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[2].descriptorCount = 1;
+	bindings[2].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkDescriptorSetLayoutCreateInfo descriptor_set_layout_info = {};
+	descriptor_set_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	descriptor_set_layout_info.bindingCount = 3;
+	descriptor_set_layout_info.pBindings = bindings;
+
+	VkDescriptorSetLayout set_layout = {};
+	if(vkCreateDescriptorSetLayout(logical_device, &descriptor_set_layout_info, NULL, &set_layout) != VK_SUCCESS)
+	{
+		printf("Can't create raster descriptor set layout\n");
+	}
+	return set_layout;
+}
+
+//Only made when the graphics queue can dispatch, Vulkan doesn't promise that, though every driver in use does
+uint32_t create_raster_pipelines(vulkan_state* vulkan)
+{
+	uint32_t queue_family_count = 0;
+	VkQueueFamilyProperties queue_families[8] = {};
+	get_device_queue_family_properties(vulkan->physical_device, &queue_family_count, queue_families);
+	vulkan->compute_supported = (queue_families[vulkan->graphics_queue_index].queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
+	if(!vulkan->compute_supported) return 0;
+	vulkan->raster_descriptor_set_layout = create_raster_descriptor_set_layout(vulkan->logical_device);
+
+	//Width and height
+	VkPushConstantRange raster_constants = {VK_SHADER_STAGE_COMPUTE_BIT, 0, 2*sizeof(int32_t)};
+	VkPipelineLayoutCreateInfo pipeline_layout_info = {};
+	pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipeline_layout_info.setLayoutCount = 1;
+	pipeline_layout_info.pSetLayouts = &vulkan->raster_descriptor_set_layout;
+	pipeline_layout_info.pushConstantRangeCount = 1;
+	pipeline_layout_info.pPushConstantRanges = &raster_constants;
+	if(vkCreatePipelineLayout(vulkan->logical_device, &pipeline_layout_info, NULL, &vulkan->raster_pipeline_layout) != VK_SUCCESS) return 30;
+
+	//Model matrix and the area drawn
+	VkDescriptorSetLayout tile_set_layouts[] = {vulkan->uniform_descriptor_set_layout, vulkan->raster_descriptor_set_layout};
+	VkPushConstantRange tile_constants = {VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(mat4) + 4*sizeof(int32_t)};
+	pipeline_layout_info.setLayoutCount = 2;
+	pipeline_layout_info.pSetLayouts = tile_set_layouts;
+	pipeline_layout_info.pPushConstantRanges = &tile_constants;
+	if(vkCreatePipelineLayout(vulkan->logical_device, &pipeline_layout_info, NULL, &vulkan->raster_tile_pipeline_layout) != VK_SUCCESS) return 30;
+
+	VkResult vulkan_procedure_result = create_compute_pipeline(&vulkan->raster_pipeline, vulkan->logical_device, vulkan->pipeline_cache, vulkan->raster_pipeline_layout, SHADER_CODE(tile_raster_comp_spv));
+	if(vulkan_procedure_result != VK_SUCCESS) return 31;
+
+	//Only the mesh's positions, the colour comes from the tile
+	VkVertexInputBindingDescription vertex_binding_description = vertex_input_binding_description(0, sizeof(vertex));
+	VkVertexInputAttributeDescription position_attribute = vertex_attribute(0, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(vertex, position));
+	vulkan_procedure_result = create_graphics_pipeline(&vulkan->raster_tile_graphics_pipeline, vulkan->logical_device, vulkan->pipeline_cache, vulkan->render_pass, vulkan->raster_tile_pipeline_layout, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, &vertex_binding_description, 1, &position_attribute, 1, SHADER_CODE(raster_tile_vert_spv), SHADER_CODE(frag_spv));
+	if(vulkan_procedure_result != VK_SUCCESS) return 32;
+	return 0;
+}
+
+void destroy_raster_pipelines(vulkan_state* vulkan)
+{
+	if(!vulkan->compute_supported) return;
+	vkDestroyPipeline(vulkan->logical_device, vulkan->raster_tile_graphics_pipeline, NULL);
+	vkDestroyPipeline(vulkan->logical_device, vulkan->raster_pipeline, NULL);
+	vkDestroyPipelineLayout(vulkan->logical_device, vulkan->raster_tile_pipeline_layout, NULL);
+	vkDestroyPipelineLayout(vulkan->logical_device, vulkan->raster_pipeline_layout, NULL);
+	vkDestroyDescriptorSetLayout(vulkan->logical_device, vulkan->raster_descriptor_set_layout, NULL);
+}
+
+uint32_t create_pipelines(vulkan_state* vulkan)
+{
+	timer t;
+	start_timer(&t);
 	VkVertexInputBindingDescription vertex_binding_description = vertex_input_binding_description(0, sizeof(vertex));
 
 	VkVertexInputAttributeDescription vertex_attributes[] = 
@@ -882,28 +1060,42 @@ uint32_t create_swapchain_dependent_components(vulkan_state* vulkan)
 		vertex_attribute(0, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(vertex, position)),
 		vertex_attribute(0, 1, VK_FORMAT_R32G32B32_SFLOAT, offsetof(vertex, colour))
 	};
-	vulkan_procedure_result = create_graphics_pipeline(&vulkan->graphics_pipeline, vulkan->logical_device, surface_capabilities.currentExtent, vulkan->render_pass, vulkan->uniform_descriptor_set_layout, vulkan->pipeline_layout, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, &vertex_binding_description, 1, vertex_attributes, 2, "..\\src\\vert.spv", "..\\src\\frag.spv");
+	VkResult vulkan_procedure_result = create_graphics_pipeline(&vulkan->graphics_pipeline, vulkan->logical_device, vulkan->pipeline_cache, vulkan->render_pass, vulkan->pipeline_layout, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, &vertex_binding_description, 1, vertex_attributes, 2, SHADER_CODE(vert_spv), SHADER_CODE(frag_spv));
 	if(vulkan_procedure_result != VK_SUCCESS) return 9;
 
-	vulkan_procedure_result = create_graphics_pipeline(&vulkan->line_graphics_pipeline, vulkan->logical_device, surface_capabilities.currentExtent, vulkan->render_pass, vulkan->uniform_descriptor_set_layout, vulkan->pipeline_layout, VK_PRIMITIVE_TOPOLOGY_LINE_LIST, &vertex_binding_description, 1, vertex_attributes, 2, "..\\src\\line_vert.spv", "..\\src\\line_frag.spv");
+	vulkan_procedure_result = create_graphics_pipeline(&vulkan->line_graphics_pipeline, vulkan->logical_device, vulkan->pipeline_cache, vulkan->render_pass, vulkan->pipeline_layout, VK_PRIMITIVE_TOPOLOGY_LINE_LIST, &vertex_binding_description, 1, vertex_attributes, 2, SHADER_CODE(line_vert_spv), SHADER_CODE(line_frag_spv));
 	if(vulkan_procedure_result != VK_SUCCESS) return 10;
+
+	VkVertexInputBindingDescription tile_binding_descriptions[] =
+	{
+		vertex_binding_description,
+		vertex_input_binding_description(1, sizeof(vec2d), VK_VERTEX_INPUT_RATE_INSTANCE)
+	};
+	VkVertexInputAttributeDescription tile_attributes[] =
+	{
+		vertex_attributes[0],
+		vertex_attributes[1],
+		vertex_attribute(1, 2, VK_FORMAT_R32G32_SFLOAT, 0)
+	};
+	vulkan_procedure_result = create_graphics_pipeline(&vulkan->tile_graphics_pipeline, vulkan->logical_device, vulkan->pipeline_cache, vulkan->render_pass, vulkan->pipeline_layout, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, tile_binding_descriptions, 2, tile_attributes, 3, SHADER_CODE(tile_vert_spv), SHADER_CODE(frag_spv));
+	if(vulkan_procedure_result != VK_SUCCESS) return 27;
+	uint32_t raster_creation_result = create_raster_pipelines(vulkan);
+	if(raster_creation_result) return raster_creation_result;
+	end_timer(&t);
+	printf("Pipelines created in %lld us from a %s pipeline cache\n", (long long)time_elapsed_microsec(&t), vulkan->pipeline_cache_warm ? "warm" : "cold");
+	return 0;
 }
 
-void resize_window(vulkan_state* vulkan)
+void destroy_swapchain_dependent_components(vulkan_state* vulkan)
 {
 	for(int i = 0; i < vulkan->swapchain_image_count; i++) vkDestroyFramebuffer(vulkan->logical_device, vulkan->swapchain_framebuffers[i], NULL); //*
-	vkDestroyPipeline(vulkan->logical_device, vulkan->line_graphics_pipeline, NULL); //*
-	vkDestroyPipeline(vulkan->logical_device, vulkan->graphics_pipeline, NULL); //*
 	for(int i = 0; i < vulkan->swapchain_image_count; i++) vkDestroyImageView(vulkan->logical_device, vulkan->swapchain_image_views[i], NULL); //*
 	vkDestroySwapchainKHR(vulkan->logical_device, vulkan->swapchain, NULL); //*
+}
 
-	VkSurfaceCapabilitiesKHR surface_capabilities;
-	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(vulkan->physical_device, vulkan->surface, &surface_capabilities);
-
-	VkFormat swapchain_image_format = VK_FORMAT_R8G8B8A8_UNORM;
-	vulkan->swapchain_image_count = 3;
-	vulkan->swapchain_extent = surface_capabilities.currentExtent;
-
+void resize_window(vulkan_state* vulkan)
+{
+	destroy_swapchain_dependent_components(vulkan);
 	create_swapchain_dependent_components(vulkan);
 }
 
@@ -912,7 +1104,144 @@ void resize_window(vulkan_state* vulkan)
 //	- If it didn't, why not
 //	- So that the program can be fixed/made to handle problem
 //	- Consistency in function calls/returns/structures
-uint8_t startup_vulkan(vulkan_state* vulkan, HWND window, HINSTANCE hinstance)
+//Timestamps are left off rather than failing startup on a graphics queue that can't write them
+VkResult create_timestamp_pools(vulkan_state* vulkan)
+{
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(vulkan->physical_device, &properties);
+	uint32_t queue_family_count = 0;
+	VkQueueFamilyProperties queue_families[8] = {};
+	get_device_queue_family_properties(vulkan->physical_device, &queue_family_count, queue_families);
+	uint32_t valid_bits = queue_families[vulkan->graphics_queue_index].timestampValidBits;
+	vulkan->timestamp_mask = valid_bits >= 64 ? ~(uint64_t)0 : ((uint64_t)1 << valid_bits) - 1;
+	vulkan->timestamp_period = properties.limits.timestampPeriod;
+
+	VkQueryPoolCreateInfo pool_info = {};
+	pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	pool_info.queryCount = GPU_TIMESTAMP_MAX;
+	for(int i = 0; i < vulkan->frames_in_flight; i++)
+	{
+		vulkan->timestamp_pools[i] = VK_NULL_HANDLE;
+		vulkan->timestamp_counts[i] = 0;
+		vulkan->recording_timings[i] = {};
+		if(!vulkan->timestamp_mask) continue;
+		VkResult result = vkCreateQueryPool(vulkan->logical_device, &pool_info, NULL, &vulkan->timestamp_pools[i]);
+		if(result != VK_SUCCESS) return result;
+	}
+	vulkan->timings = {};
+	return VK_SUCCESS;
+}
+
+//Maps GPU timestamps onto the performance counter, so when the GPU finished a frame can be compared with when it began
+//A timestamp is written by a submission of its own and the counter read once the queue is idle
+//Waking from the wait makes the counter late, so the least offset of a few tries is kept
+void calibrate_timestamps(vulkan_state* vulkan)
+{
+	vulkan->timestamps_calibrated = false;
+	VkCommandBuffer command_buffer;
+	if(!vulkan->timestamp_mask || create_command_buffers(&command_buffer, &vulkan->logical_device, &vulkan->command_pool, 1) != VK_SUCCESS) return;
+	VkCommandBufferBeginInfo begin_info = {};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	vkBeginCommandBuffer(command_buffer, &begin_info);
+	vkCmdResetQueryPool(command_buffer, vulkan->timestamp_pools[0], 0, 1);
+	vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, vulkan->timestamp_pools[0], 0);
+	vkEndCommandBuffer(command_buffer);
+
+	VkSubmitInfo submit_info = {};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &command_buffer;
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	for(int i = 0; i < TIMESTAMP_CALIBRATIONS; i++)
+	{
+		if(vkQueueSubmit(vulkan->graphics_queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) break;
+		vkQueueWaitIdle(vulkan->graphics_queue);
+		LARGE_INTEGER now;
+		QueryPerformanceCounter(&now);
+		uint64_t tick;
+		if(vkGetQueryPoolResults(vulkan->logical_device, vulkan->timestamp_pools[0], 0, 1, sizeof(tick), &tick, sizeof(tick), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) continue;
+		double offset = now.QuadPart*1000000.0/frequency.QuadPart - (tick & vulkan->timestamp_mask)*vulkan->timestamp_period/1000.0;
+		if(!vulkan->timestamps_calibrated || offset < vulkan->timestamp_offset_microsec) vulkan->timestamp_offset_microsec = offset;
+		vulkan->timestamps_calibrated = true;
+	}
+	vkFreeCommandBuffers(vulkan->logical_device, vulkan->command_pool, 1, &command_buffer);
+}
+
+//Command buffers, synchronisation and timestamps for each of frames_in_flight frames
+uint8_t create_frame_resources(vulkan_state* vulkan)
+{
+	VkResult vulkan_procedure_result = create_command_buffers(vulkan->command_buffers, &vulkan->logical_device, &vulkan->command_pool, vulkan->frames_in_flight);
+	if(vulkan_procedure_result != VK_SUCCESS) return 15;
+
+	//CREATE SEMAPHORES AND FENCES
+	for(int i = 0; i < vulkan->frames_in_flight; i++)
+	{
+		vulkan_procedure_result = create_semaphore(&vulkan->image_available_semaphores[i], &vulkan->logical_device);
+		if(vulkan_procedure_result != VK_SUCCESS)
+		{
+			printf("Failed to create image available semaphore %d\n", i);
+			return 16;
+		}
+		
+		vulkan_procedure_result = create_semaphore(&vulkan->render_finished_semaphores[i], &vulkan->logical_device);
+		if(vulkan_procedure_result != VK_SUCCESS)
+		{
+			printf("Failed to create render finished semaphore %d\n", i);
+			return 17;
+		}
+
+		vulkan_procedure_result = create_fence(&vulkan->framebuffer_in_use_fences[i], &vulkan->logical_device);
+		if(vulkan_procedure_result != VK_SUCCESS)
+		{
+			printf("Failed to create framebuffer in use fence %d\n", i);
+			return 18;
+		}
+	}
+	vulkan_procedure_result = create_timestamp_pools(vulkan);
+	if(vulkan_procedure_result != VK_SUCCESS) return 29;
+	calibrate_timestamps(vulkan);
+
+	vulkan->current_frame = 0;
+	vulkan->stale_world_matrix_buffers = (1 << MAX_FRAMES_COMPUTED_AT_ONCE) - 1;
+	return 0;
+}
+
+void destroy_frame_resources(vulkan_state* vulkan)
+{
+	vkFreeCommandBuffers(vulkan->logical_device, vulkan->command_pool, vulkan->frames_in_flight, vulkan->command_buffers);
+	for(int i = 0; i < vulkan->frames_in_flight; i++)
+	{
+		vkDestroySemaphore(vulkan->logical_device, vulkan->render_finished_semaphores[i], NULL);
+		vkDestroySemaphore(vulkan->logical_device, vulkan->image_available_semaphores[i], NULL);
+		vkDestroyFence(vulkan->logical_device, vulkan->framebuffer_in_use_fences[i], NULL);
+		vkDestroyQueryPool(vulkan->logical_device, vulkan->timestamp_pools[i], NULL);
+	}
+}
+
+void select_presentation(vulkan_state* vulkan, VkPresentModeKHR present_mode, int frames_in_flight)
+{
+	if(!present_mode_supported(vulkan, present_mode))
+	{
+		printf("Present mode %s not supported, using fifo\n", present_mode_name(present_mode));
+		present_mode = VK_PRESENT_MODE_FIFO_KHR;
+	}
+	vulkan->present_mode = present_mode;
+	vulkan->frames_in_flight = max(1, min(frames_in_flight, MAX_FRAMES_COMPUTED_AT_ONCE));
+}
+
+uint8_t configure_presentation(vulkan_state* vulkan, VkPresentModeKHR present_mode, int frames_in_flight)
+{
+	complete_graphical_tasks(vulkan);
+	destroy_frame_resources(vulkan);
+	destroy_swapchain_dependent_components(vulkan);
+	select_presentation(vulkan, present_mode, frames_in_flight);
+	if(create_swapchain_dependent_components(vulkan)) return 101;
+	return create_frame_resources(vulkan);
+}
+
+uint8_t startup_vulkan(vulkan_state* vulkan, HWND window, HINSTANCE hinstance, VkPresentModeKHR present_mode, int frames_in_flight)
 {
 	//Vulkan stuff
 	print_available_vulkan_extensions();
@@ -937,8 +1266,8 @@ uint8_t startup_vulkan(vulkan_state* vulkan, HWND window, HINSTANCE hinstance)
 	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(vulkan->physical_device, vulkan->surface, &surface_capabilities);
 
 	VkFormat swapchain_image_format = VK_FORMAT_R8G8B8A8_UNORM;
-	vulkan->swapchain_image_count = 3;
 	vulkan->swapchain_extent = surface_capabilities.currentExtent;
+	select_presentation(vulkan, present_mode, frames_in_flight);
 
 	//CREATE RENDER PASS
 	vulkan_procedure_result = create_render_pass(&vulkan->render_pass, vulkan->logical_device, swapchain_image_format);
@@ -971,7 +1300,8 @@ uint8_t startup_vulkan(vulkan_state* vulkan, HWND window, HINSTANCE hinstance)
 	//CREATE UNIFORM BUFFERS
 	VkDeviceSize uniform_buffer_size = sizeof(world_matrices);
 	
-	for(int i = 0; i < vulkan->swapchain_image_count; i++)
+	//Made for the most frames in flight, memory from gpu_memory is never given back
+	for(int i = 0; i < MAX_FRAMES_COMPUTED_AT_ONCE; i++)
 	{
 		uint32_t queue_families[] = {vulkan->graphics_queue_index, vulkan->transfer_queue_index};
 		vulkan_procedure_result = create_buffer(&vulkan->world_matrix_buffers[i], &vulkan->gpu_memory, &vulkan->logical_device, uniform_buffer_size, vulkan->device_local_mem_in_use, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, queue_families, 2);
@@ -980,18 +1310,24 @@ uint8_t startup_vulkan(vulkan_state* vulkan, HWND window, HINSTANCE hinstance)
 	}
 
 	//CREATE UNIFORM DESCRIPTOR POOL
-	vulkan_procedure_result = create_uniform_descriptor_pool(&vulkan->descriptor_pool, &vulkan->logical_device, vulkan->swapchain_image_count);
+	vulkan_procedure_result = create_uniform_descriptor_pool(&vulkan->descriptor_pool, &vulkan->logical_device, MAX_FRAMES_COMPUTED_AT_ONCE);
 	if(vulkan_procedure_result != VK_SUCCESS) return 12;
 
 
 	//CREATE UNIFORM DESCRIPTOR SETS
-	vulkan_procedure_result = create_descriptor_sets(vulkan->descriptor_sets, &vulkan->logical_device, &vulkan->descriptor_pool, vulkan->world_matrix_buffers, vulkan->uniform_descriptor_set_layout, vulkan->swapchain_image_count, sizeof(world_matrices));
+	vulkan_procedure_result = create_descriptor_sets(vulkan->descriptor_sets, &vulkan->logical_device, &vulkan->descriptor_pool, vulkan->world_matrix_buffers, vulkan->uniform_descriptor_set_layout, MAX_FRAMES_COMPUTED_AT_ONCE, sizeof(world_matrices));
 	if(vulkan_procedure_result != VK_SUCCESS) return 13;
 	
 	//CREATE GRAPHICS PIPELINE LAYOUT
 	vulkan_procedure_result = create_graphics_pipeline_layout(&vulkan->pipeline_layout, vulkan->logical_device, vulkan->uniform_descriptor_set_layout);
 	if(vulkan_procedure_result != VK_SUCCESS) return 8;
 
+	//CREATE PIPELINES
+	vulkan_procedure_result = create_pipeline_cache(vulkan);
+	if(vulkan_procedure_result != VK_SUCCESS) return 28;
+	uint32_t pipeline_creation_result = create_pipelines(vulkan);
+	if(pipeline_creation_result) return pipeline_creation_result;
+
 	//CREATE SWAPCHAIN DEPENDENT COMPONENTS
 	uint32_t swapchain_creation_result = create_swapchain_dependent_components(vulkan);
 	if(swapchain_creation_result) return 101;
@@ -1003,39 +1339,17 @@ uint8_t startup_vulkan(vulkan_state* vulkan, HWND window, HINSTANCE hinstance)
 	vulkan_procedure_result = create_command_pool(&vulkan->transfer_command_pool, &vulkan->logical_device, vulkan->transfer_queue_index);
 	if(vulkan_procedure_result != VK_SUCCESS) return 19;
 
-	vulkan_procedure_result = create_command_buffers(vulkan->command_buffers, &vulkan->logical_device, &vulkan->command_pool, vulkan->swapchain_image_count);
-	if(vulkan_procedure_result != VK_SUCCESS) return 15;
-
 	vulkan_procedure_result = create_command_buffers(&vulkan->transfer_command_buffer, &vulkan->logical_device, &vulkan->transfer_command_pool, 1);
 	if(vulkan_procedure_result != VK_SUCCESS) return 20;
 
-	//CREATE SEMAPHORES AND FENCES
-	for(int i = 0; i < MAX_FRAMES_COMPUTED_AT_ONCE; i++)
-	{
-		vulkan_procedure_result = create_semaphore(&vulkan->image_available_semaphores[i], &vulkan->logical_device);
-		if(vulkan_procedure_result != VK_SUCCESS)
-		{
-			printf("Failed to create image available semaphore %d\n", i);
-			return 16;
-		}
-		
-		vulkan_procedure_result = create_semaphore(&vulkan->render_finished_semaphores[i], &vulkan->logical_device);
-		if(vulkan_procedure_result != VK_SUCCESS)
-		{
-			printf("Failed to create render finished semaphore %d\n", i);
-			return 17;
-		}
+	create_command_recorder(&vulkan->recorder);
 
-		vulkan_procedure_result = create_fence(&vulkan->framebuffer_in_use_fences[i], &vulkan->logical_device);
-		if(vulkan_procedure_result != VK_SUCCESS)
-		{
-			printf("Failed to create framebuffer in use fence %d\n", i);
-			return 18;
-		}
-	}
-	vulkan->current_frame = 0;
+	//CREATE PER FRAME RESOURCES
+	uint8_t frame_creation_result = create_frame_resources(vulkan);
+	if(frame_creation_result) return frame_creation_result;
 
 	vulkan->swapchain_image_index = 0;
+	update_world_matrix(vulkan, identity(), identity());
 	return 0;
 }
 
@@ -1044,50 +1358,221 @@ void shutdown_vulkan(vulkan_state* vulkan)
 	vkDestroyBuffer(vulkan->logical_device, vulkan->staging_buffer, NULL);
 	vkFreeMemory(vulkan->logical_device, vulkan->staging_buffer_memory, NULL);
 	vkFreeMemory(vulkan->logical_device, vulkan->gpu_memory, NULL);
-	for(int i = 0; i < vulkan->swapchain_image_count; i++)
+	for(int i = 0; i < MAX_FRAMES_COMPUTED_AT_ONCE; i++)
 	{
 		vkDestroyBuffer(vulkan->logical_device, vulkan->world_matrix_buffers[i], NULL);
 	}
 	vkDestroyDescriptorPool(vulkan->logical_device, vulkan->descriptor_pool, NULL);
-	for(int i = 0; i < MAX_FRAMES_COMPUTED_AT_ONCE; i++)
-	{
-		vkDestroySemaphore(vulkan->logical_device, vulkan->render_finished_semaphores[i], NULL);
-		vkDestroySemaphore(vulkan->logical_device, vulkan->image_available_semaphores[i], NULL);
-		vkDestroyFence(vulkan->logical_device, vulkan->framebuffer_in_use_fences[i], NULL);
-	}
+	destroy_frame_resources(vulkan);
+	destroy_command_recorder(&vulkan->recorder);
 	vkDestroyCommandPool(vulkan->logical_device, vulkan->transfer_command_pool, NULL);
 	vkDestroyCommandPool(vulkan->logical_device, vulkan->command_pool, NULL);
 	vkDestroyDescriptorSetLayout(vulkan->logical_device, vulkan->uniform_descriptor_set_layout, NULL);
+	destroy_raster_pipelines(vulkan);
+	vkDestroyPipeline(vulkan->logical_device, vulkan->tile_graphics_pipeline, NULL);
+	vkDestroyPipeline(vulkan->logical_device, vulkan->line_graphics_pipeline, NULL);
+	vkDestroyPipeline(vulkan->logical_device, vulkan->graphics_pipeline, NULL);
+	save_pipeline_cache(vulkan);
+	vkDestroyPipelineCache(vulkan->logical_device, vulkan->pipeline_cache, NULL);
 	vkDestroyPipelineLayout(vulkan->logical_device, vulkan->pipeline_layout, NULL);
-	for(int i = 0; i < vulkan->swapchain_image_count; i++) vkDestroyFramebuffer(vulkan->logical_device, vulkan->swapchain_framebuffers[i], NULL); //*
-	vkDestroyPipeline(vulkan->logical_device, vulkan->line_graphics_pipeline, NULL); //*
-	vkDestroyPipeline(vulkan->logical_device, vulkan->graphics_pipeline, NULL); //*
-	for(int i = 0; i < vulkan->swapchain_image_count; i++) vkDestroyImageView(vulkan->logical_device, vulkan->swapchain_image_views[i], NULL); //*
-	vkDestroySwapchainKHR(vulkan->logical_device, vulkan->swapchain, NULL); //*
+	destroy_swapchain_dependent_components(vulkan);
 	vkDestroyRenderPass(vulkan->logical_device, vulkan->render_pass, NULL);
 	vkDestroyDevice(vulkan->logical_device, NULL);
 	destroy_debug_messenger(vulkan->instance, vulkan->debug_messenger);
 	vkDestroyInstance(vulkan->instance, NULL);
 }
 
-void push_model_matrix(vulkan_state* vulkan, mat4 model)
+void create_command_recorder(command_recorder* recorder)
 {
-	vkCmdPushConstants(vulkan->command_buffers[vulkan->swapchain_image_index], vulkan->pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(mat4), &model);
+	*recorder = {};
+	recorder->queue = (queued_draw*)malloc(DRAW_QUEUE_CAPACITY*sizeof(queued_draw));
+	recorder->sorted = (queued_draw**)malloc(DRAW_QUEUE_CAPACITY*sizeof(queued_draw*));
 }
 
-void update_world_matrix(vulkan_state* vulkan, mat4 view, mat4 projection)
+void destroy_command_recorder(command_recorder* recorder)
 {
-	world_matrices wm;
-	wm.view = view;
-	wm.projection = projection;
+	free(recorder->sorted);
+	free(recorder->queue);
+	recorder->sorted = NULL;
+	recorder->queue = NULL;
+}
 
-	for(int i = 0; i < vulkan->swapchain_image_count; i++)
+void begin_recording(command_recorder* recorder, VkCommandBuffer command_buffer)
+{
+	recorder->command_buffer = command_buffer;
+	recorder->model = identity();
+	recorder->queue_count = 0;
+	recorder->pipeline = VK_NULL_HANDLE;
+	recorder->set_layout = VK_NULL_HANDLE;
+	recorder->descriptor_set_count = 0;
+	recorder->vertex_buffers[0] = VK_NULL_HANDLE;
+	recorder->vertex_buffers[1] = VK_NULL_HANDLE;
+	recorder->index_buffer = VK_NULL_HANDLE;
+	recorder->constant_layout = VK_NULL_HANDLE;
+	recorder->constant_size = 0;
+}
+
+//Handles are pointers on 64 bit builds and uint64_t on 32 bit ones, both order the same as uint64_t
+int compare_handles(uint64_t a, uint64_t b)
+{
+	return a == b ? 0 : a < b ? -1 : 1;
+}
+
+//Everything but the instance range, equal state sorts together so it's bound once
+int compare_draw_state(const queued_draw* a, const queued_draw* b)
+{
+	int order = compare_handles((uint64_t)a->pipeline, (uint64_t)b->pipeline);
+	if(!order) order = compare_handles((uint64_t)a->layout, (uint64_t)b->layout);
+	for(int i = 0; i < 2 && !order; i++) order = compare_handles((uint64_t)a->descriptor_sets[i], (uint64_t)b->descriptor_sets[i]);
+	for(int i = 0; i < 2 && !order; i++) order = compare_handles((uint64_t)a->vertex_buffers[i], (uint64_t)b->vertex_buffers[i]);
+	if(!order) order = compare_handles((uint64_t)a->index_buffer, (uint64_t)b->index_buffer);
+	if(!order) order = compare_handles(a->descriptor_set_count, b->descriptor_set_count);
+	if(!order) order = compare_handles(a->vertex_buffer_count, b->vertex_buffer_count);
+	if(!order) order = compare_handles(a->element_count, b->element_count);
+	if(!order) order = compare_handles(a->constant_size, b->constant_size);
+	if(!order) order = memcmp(a->constants, b->constants, a->constant_size);
+	return order;
+}
+
+int compare_queued_draws(const void* a, const void* b)
+{
+	const queued_draw* x = *(queued_draw* const*)a;
+	const queued_draw* y = *(queued_draw* const*)b;
+	int order = compare_draw_state(x, y);
+	if(!order) order = compare_handles(x->first_instance, y->first_instance);
+	return order ? order : x->order - y->order;
+}
+
+//Binds and pushes only what differs from the recorder's bound state
+void record_queued_draw(command_recorder* recorder, const queued_draw* draw, uint32_t instance_count)
+{
+	VkCommandBuffer command_buffer = recorder->command_buffer;
+	if(draw->pipeline != recorder->pipeline)
+	{
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, draw->pipeline);
+		recorder->pipeline = draw->pipeline;
+		recorder->stats.bind_count++;
+	}
+
+	//Sets and push constants stay bound across pipelines with the same layout
+	if(draw->layout != recorder->set_layout || draw->descriptor_set_count != recorder->descriptor_set_count || memcmp(draw->descriptor_sets, recorder->descriptor_sets, draw->descriptor_set_count*sizeof(VkDescriptorSet)))
+	{
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, draw->layout, 0, draw->descriptor_set_count, draw->descriptor_sets, 0, NULL);
+		recorder->set_layout = draw->layout;
+		recorder->descriptor_set_count = draw->descriptor_set_count;
+		memcpy(recorder->descriptor_sets, draw->descriptor_sets, sizeof(draw->descriptor_sets));
+		recorder->stats.bind_count++;
+	}
+	if(draw->constant_size && (draw->layout != recorder->constant_layout || draw->constant_size != recorder->constant_size || memcmp(draw->constants, recorder->constants, draw->constant_size)))
 	{
-		size_t s = sizeof(world_matrices);
-		world_matrices* p_wm = &wm;
-		copy_data_to_buffer(vulkan->logical_device, vulkan->staging_buffer_memory, s, p_wm);
-		copy_data_between_buffers(&vulkan->staging_buffer, &vulkan->world_matrix_buffers[i], s, &vulkan->transfer_command_buffer, &vulkan->transfer_queue);
+		vkCmdPushConstants(command_buffer, draw->layout, VK_SHADER_STAGE_VERTEX_BIT, 0, draw->constant_size, draw->constants);
+		recorder->constant_layout = draw->layout;
+		recorder->constant_size = draw->constant_size;
+		memcpy(recorder->constants, draw->constants, draw->constant_size);
+		recorder->stats.push_count++;
 	}
+
+	//Bindings from the first that changed are bound in one call
+	uint32_t first_binding = 0;
+	while(first_binding < draw->vertex_buffer_count && draw->vertex_buffers[first_binding] == recorder->vertex_buffers[first_binding]) first_binding++;
+	if(first_binding < draw->vertex_buffer_count)
+	{
+		VkDeviceSize offsets[2] = {0, 0};
+		vkCmdBindVertexBuffers(command_buffer, first_binding, draw->vertex_buffer_count - first_binding, draw->vertex_buffers + first_binding, offsets);
+		for(uint32_t i = first_binding; i < draw->vertex_buffer_count; i++) recorder->vertex_buffers[i] = draw->vertex_buffers[i];
+		recorder->stats.bind_count++;
+	}
+	if(draw->index_buffer && draw->index_buffer != recorder->index_buffer)
+	{
+		vkCmdBindIndexBuffer(command_buffer, draw->index_buffer, 0, VK_INDEX_TYPE_UINT16);
+		recorder->index_buffer = draw->index_buffer;
+		recorder->stats.bind_count++;
+	}
+
+	if(draw->index_buffer) vkCmdDrawIndexed(command_buffer, draw->element_count, instance_count, 0, 0, draw->first_instance);
+	else vkCmdDraw(command_buffer, draw->element_count, instance_count, 0, draw->first_instance);
+	recorder->stats.draw_count++;
+}
+
+void flush_draws(command_recorder* recorder)
+{
+	int count = recorder->queue_count;
+	if(!count) return;
+	for(int i = 0; i < count; i++) recorder->sorted[i] = &recorder->queue[i];
+	qsort(recorder->sorted, count, sizeof(queued_draw*), compare_queued_draws);
+
+	//Draws of the same state whose instances follow on are drawn as one
+	for(int i = 0; i < count;)
+	{
+		const queued_draw* draw = recorder->sorted[i++];
+		uint32_t instance_count = draw->instance_count;
+		while(i < count && draw->first_instance + instance_count == recorder->sorted[i]->first_instance && !compare_draw_state(draw, recorder->sorted[i])) instance_count += recorder->sorted[i++]->instance_count;
+		record_queued_draw(recorder, draw, instance_count);
+	}
+	recorder->queue_count = 0;
+}
+
+void flush_draws(vulkan_state* vulkan)
+{
+	flush_draws(&vulkan->recorder);
+}
+
+//A draw of one instance of the pipeline with the recorder's model matrix, its mesh left for the caller
+queued_draw* queue_draw(command_recorder* recorder, VkPipeline pipeline, VkPipelineLayout layout, VkDescriptorSet descriptor_set)
+{
+	if(recorder->queue_count == DRAW_QUEUE_CAPACITY) flush_draws(recorder);
+	queued_draw* draw = &recorder->queue[recorder->queue_count];
+	*draw = {};
+	draw->order = recorder->queue_count++;
+	draw->pipeline = pipeline;
+	draw->layout = layout;
+	draw->descriptor_sets[0] = descriptor_set;
+	draw->descriptor_set_count = 1;
+	draw->instance_count = 1;
+	draw->constant_size = sizeof(mat4);
+	memcpy(draw->constants, &recorder->model, sizeof(mat4));
+	recorder->stats.queued_count++;
+	return draw;
+}
+
+void record_model_matrix(vulkan_state* vulkan, command_recorder* recorder, mat4 model)
+{
+	recorder->model = model;
+}
+
+void push_model_matrix(vulkan_state* vulkan, mat4 model)
+{
+	record_model_matrix(vulkan, &vulkan->recorder, model);
+}
+
+void update_world_matrix(vulkan_state* vulkan, mat4 view, mat4 projection)
+{
+	vulkan->world.view = view;
+	vulkan->world.projection = projection;
+	vulkan->stale_world_matrix_buffers = (1 << MAX_FRAMES_COMPUTED_AT_ONCE) - 1;
+}
+
+//Recorded before the render pass, the barriers keep the write after earlier frames' reads of the buffer and before this frame's
+void record_world_matrix_update(vulkan_state* vulkan)
+{
+	VkCommandBuffer command_buffer = vulkan->command_buffers[vulkan->current_frame];
+	VkBufferMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_UNIFORM_READ_BIT;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = vulkan->world_matrix_buffers[vulkan->current_frame];
+	barrier.offset = 0;
+	barrier.size = VK_WHOLE_SIZE;
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 1, &barrier, 0, NULL);
+
+	vkCmdUpdateBuffer(command_buffer, barrier.buffer, 0, sizeof(world_matrices), &vulkan->world);
+
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_UNIFORM_READ_BIT;
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 0, NULL, 1, &barrier, 0, NULL);
+	vulkan->stale_world_matrix_buffers &= ~(1 << vulkan->current_frame);
 }
 
 void complete_graphical_tasks(vulkan_state* vulkan)
@@ -1095,25 +1580,116 @@ void complete_graphical_tasks(vulkan_state* vulkan)
 	vkDeviceWaitIdle(vulkan->logical_device);
 }
 
-void begin_frame(vulkan_state* vulkan)
+//Flipped so y goes up the screen
+void record_viewport(vulkan_state* vulkan, VkCommandBuffer command_buffer)
+{
+	VkViewport viewport = {};
+	viewport.x = 0.0f;
+	viewport.y = (float)vulkan->swapchain_extent.height;
+	viewport.width = (float)vulkan->swapchain_extent.width;
+	viewport.height = -(float)vulkan->swapchain_extent.height;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+
+	VkRect2D scissor = {};
+	scissor.offset = {0, 0};
+	scissor.extent = vulkan->swapchain_extent;
+	vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+}
+
+void record_timestamp(vulkan_state* vulkan, VkPipelineStageFlagBits stage, const char* name)
+{
+	int frame = vulkan->current_frame;
+	uint32_t index = vulkan->timestamp_counts[frame];
+	if(!vulkan->timestamp_mask || index == GPU_TIMESTAMP_MAX) return;
+	vkCmdWriteTimestamp(vulkan->command_buffers[vulkan->current_frame], stage, vulkan->timestamp_pools[frame], index);
+	vulkan->timestamp_names[frame][index] = name;
+	vulkan->timestamp_counts[frame] = index + 1;
+}
+
+void gpu_timestamp(vulkan_state* vulkan, const char* name)
+{
+	flush_draws(vulkan);
+	record_timestamp(vulkan, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, name);
+}
+
+//Called once the frame's fence has signalled, so its timestamps are all available and no flag to wait for them is needed
+void complete_frame_timings(vulkan_state* vulkan)
+{
+	int frame = vulkan->current_frame;
+	frame_timings* timings = &vulkan->recording_timings[frame];
+	uint32_t count = vulkan->timestamp_counts[frame];
+	uint64_t ticks[GPU_TIMESTAMP_MAX];
+	timings->gpu_valid = count > 1 && vkGetQueryPoolResults(vulkan->logical_device, vulkan->timestamp_pools[frame], 0, count, sizeof(ticks), ticks, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS;
+	timings->gpu_pass_count = 0;
+	if(timings->gpu_valid)
+	{
+		//Differences are taken modulo the valid bits, so a counter wrapping mid frame still gives the right time
+		float millisec_per_tick = vulkan->timestamp_period/1000000.0f;
+		for(uint32_t i = 1; i < count; i++)
+		{
+			timings->gpu_pass_names[i - 1] = vulkan->timestamp_names[frame][i];
+			timings->gpu_pass_millisec[i - 1] = ((ticks[i] - ticks[i - 1]) & vulkan->timestamp_mask)*millisec_per_tick;
+		}
+		timings->gpu_pass_count = count - 1;
+		timings->gpu_frame_millisec = ((ticks[count - 1] - ticks[0]) & vulkan->timestamp_mask)*millisec_per_tick;
+		timings->latency_valid = vulkan->timestamps_calibrated;
+		if(timings->latency_valid)
+		{
+			double end = (ticks[count - 1] & vulkan->timestamp_mask)*vulkan->timestamp_period/1000.0 + vulkan->timestamp_offset_microsec;
+			double begin = vulkan->frame_begin_counts[frame].QuadPart*1000000.0/vulkan->frame_timer.frequency.QuadPart;
+			timings->latency_microsec = (int64_t)(end - begin);
+		}
+	}
+	vulkan->timings = *timings;
+	*timings = {};
+	vulkan->timestamp_counts[frame] = 0;
+}
+
+int format_frame_timings(frame_timings* timings, char* text, int capacity)
+{
+	int length = snprintf(text, capacity, "CPU wait %.2f record %.2f present %.2f ms", timings->wait_microsec/1000.0f, timings->record_microsec/1000.0f, timings->present_microsec/1000.0f);
+	draw_stats* draws = &timings->draws;
+	if(length < capacity) length += snprintf(text + length, capacity - length, " | %d of %d draws %d binds %d pushes", draws->draw_count, draws->queued_count, draws->bind_count, draws->push_count);
+	if(timings->latency_valid && length < capacity) length += snprintf(text + length, capacity - length, " | latency %.2f ms", timings->latency_microsec/1000.0f);
+	if(timings->gpu_valid && length < capacity) length += snprintf(text + length, capacity - length, " | GPU %.2f ms", timings->gpu_frame_millisec);
+	for(int i = 0; i < timings->gpu_pass_count && length < capacity; i++) length += snprintf(text + length, capacity - length, " %s %.2f", timings->gpu_pass_names[i], timings->gpu_pass_millisec[i]);
+	return min(length, capacity - 1);
+}
+
+void begin_frame(vulkan_state* vulkan, VkSubpassContents contents)
 {
 	//Make sure previous commands to swapchain image are completed
+	start_timer(&vulkan->frame_timer);
 	vkWaitForFences(vulkan->logical_device, 1, &vulkan->framebuffer_in_use_fences[vulkan->current_frame], VK_TRUE, (uint64_t)(-1));
 	vkResetFences(vulkan->logical_device, 1, &vulkan->framebuffer_in_use_fences[vulkan->current_frame]);
+	complete_frame_timings(vulkan);
+	vulkan->frame_begin_counts[vulkan->current_frame] = vulkan->frame_timer.start;
 
 	//DRAW FRAME
 	//GET IMAGE FROM SWAPCHAIN
 	vkAcquireNextImageKHR(vulkan->logical_device, vulkan->swapchain, (uint64_t)(-1), vulkan->image_available_semaphores[vulkan->current_frame], VK_NULL_HANDLE, &vulkan->swapchain_image_index);
+	end_timer(&vulkan->frame_timer);
+	vulkan->recording_timings[vulkan->current_frame].wait_microsec = time_elapsed_microsec(&vulkan->frame_timer);
 
 	//BEGIN RECORDING TO COMMAND BUFFERS
 	VkCommandBufferBeginInfo command_begin_info = {};
 	command_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 	command_begin_info.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
 	
-	if(vkBeginCommandBuffer(vulkan->command_buffers[vulkan->swapchain_image_index], &command_begin_info) != VK_SUCCESS)
+	if(vkBeginCommandBuffer(vulkan->command_buffers[vulkan->current_frame], &command_begin_info) != VK_SUCCESS)
 	{
 		printf("Can't record commands\n");
 	}
+	begin_recording(&vulkan->recorder, vulkan->command_buffers[vulkan->current_frame]);
+	vulkan->recorder.stats = {};
+	if(vulkan->timestamp_mask)
+	{
+		vkCmdResetQueryPool(vulkan->command_buffers[vulkan->current_frame], vulkan->timestamp_pools[vulkan->current_frame], 0, GPU_TIMESTAMP_MAX);
+		record_timestamp(vulkan, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, "start");
+	}
+	if(vulkan->stale_world_matrix_buffers & (1 << vulkan->current_frame)) record_world_matrix_update(vulkan);
 
 	VkRenderPassBeginInfo render_pass_begin_info = {};
 	render_pass_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -1126,39 +1702,319 @@ void begin_frame(vulkan_state* vulkan)
 	render_pass_begin_info.clearValueCount = 1;
 	render_pass_begin_info.pClearValues = &clear_colour;
 
-	vkCmdBeginRenderPass(vulkan->command_buffers[vulkan->swapchain_image_index], &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+	vkCmdBeginRenderPass(vulkan->command_buffers[vulkan->current_frame], &render_pass_begin_info, contents);
+	if(contents == VK_SUBPASS_CONTENTS_INLINE) record_viewport(vulkan, vulkan->command_buffers[vulkan->current_frame]);
+	start_timer(&vulkan->frame_timer);
+}
+
+void record_draw(vulkan_state* vulkan, command_recorder* recorder, graphical_data_buffer* data)
+{
+	queued_draw* draw = queue_draw(recorder, vulkan->graphics_pipeline, vulkan->pipeline_layout, vulkan->descriptor_sets[vulkan->current_frame]);
+	draw->vertex_buffers[0] = data->vertex_buffer;
+	draw->vertex_buffer_count = 1;
+	draw->index_buffer = data->index_buffer;
+	draw->element_count = data->index_count;
 }
 
 void draw(vulkan_state* vulkan, graphical_data_buffer* data)
 {
-	vkCmdBindPipeline(vulkan->command_buffers[vulkan->swapchain_image_index], VK_PIPELINE_BIND_POINT_GRAPHICS, vulkan->graphics_pipeline);
-	VkBuffer vertex_buffers[] = {data->vertex_buffer};
-	VkDeviceSize offsets[] = {0};
-	
-	vkCmdBindVertexBuffers(vulkan->command_buffers[vulkan->swapchain_image_index], 0, 1, vertex_buffers, offsets);
-	vkCmdBindIndexBuffer(vulkan->command_buffers[vulkan->swapchain_image_index], data->index_buffer, 0, VK_INDEX_TYPE_UINT16);
-	vkCmdBindDescriptorSets(vulkan->command_buffers[vulkan->swapchain_image_index], VK_PIPELINE_BIND_POINT_GRAPHICS, vulkan->pipeline_layout, 0, 1, &vulkan->descriptor_sets[vulkan->swapchain_image_index], 0, NULL);
+	record_draw(vulkan, &vulkan->recorder, data);
+}
 
-	vkCmdDrawIndexed(vulkan->command_buffers[vulkan->swapchain_image_index], data->index_count, 1, 0, 0, 0);
+void record_draw_line(vulkan_state* vulkan, command_recorder* recorder, graphical_data_buffer* data)
+{
+	queued_draw* draw = queue_draw(recorder, vulkan->line_graphics_pipeline, vulkan->pipeline_layout, vulkan->descriptor_sets[vulkan->current_frame]);
+	draw->vertex_buffers[0] = data->vertex_buffer;
+	draw->vertex_buffer_count = 1;
+	draw->element_count = data->vertex_count;
 }
 
 void draw_line(vulkan_state* vulkan, graphical_data_buffer* data)
 {
-	vkCmdBindPipeline(vulkan->command_buffers[vulkan->swapchain_image_index], VK_PIPELINE_BIND_POINT_GRAPHICS, vulkan->line_graphics_pipeline);
+	record_draw_line(vulkan, &vulkan->recorder, data);
+}
 
-	VkBuffer vertex_buffers[] = {data->vertex_buffer};
-	VkDeviceSize offsets[] = {0};
+VkResult create_tile_instance_buffer(vulkan_state* vulkan, tile_instance_buffer* instances, int capacity)
+{
+	//Each frame's buffer starts on a 256 byte boundary, enough for any device's vertex buffer alignment
+	uint32_t frame_size = (capacity*sizeof(vec2d) + 255) & ~255;
+	instances->capacity = capacity;
+	VkResult result = allocate_buffer_memory(&instances->memory, &vulkan->physical_device, &vulkan->logical_device, frame_size*MAX_FRAMES_COMPUTED_AT_ONCE, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	if(result != VK_SUCCESS) return result;
+
+	void* mapped;
+	result = vkMapMemory(vulkan->logical_device, instances->memory, 0, VK_WHOLE_SIZE, 0, &mapped);
+	if(result != VK_SUCCESS)
+	{
+		print_vulkan_error(result);
+		vkFreeMemory(vulkan->logical_device, instances->memory, NULL);
+		return result;
+	}
+	for(int i = 0; i < MAX_FRAMES_COMPUTED_AT_ONCE; i++)
+	{
+		result = create_buffer(&instances->buffers[i], &instances->memory, &vulkan->logical_device, frame_size, i*frame_size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, &vulkan->graphics_queue_index, 1);
+		if(result != VK_SUCCESS)
+		{
+			for(int j = 0; j < i; j++) vkDestroyBuffer(vulkan->logical_device, instances->buffers[j], NULL);
+			vkFreeMemory(vulkan->logical_device, instances->memory, NULL);
+			return result;
+		}
+		instances->offsets[i] = (vec2d*)((uint8_t*)mapped + i*frame_size);
+	}
+	return VK_SUCCESS;
+}
+
+void destroy_tile_instance_buffer(vulkan_state* vulkan, tile_instance_buffer* instances)
+{
+	for(int i = 0; i < MAX_FRAMES_COMPUTED_AT_ONCE; i++) vkDestroyBuffer(vulkan->logical_device, instances->buffers[i], NULL);
+	vkUnmapMemory(vulkan->logical_device, instances->memory);
+	vkFreeMemory(vulkan->logical_device, instances->memory, NULL);
+}
+
+vec2d* current_tile_offsets(vulkan_state* vulkan, tile_instance_buffer* instances)
+{
+	return instances->offsets[vulkan->current_frame];
+}
+
+void draw_tiles(vulkan_state* vulkan, graphical_data_buffer* data, tile_instance_buffer* instances, int first_instance, int instance_count)
+{
+	if(instance_count <= 0) return;
+	queued_draw* draw = queue_draw(&vulkan->recorder, vulkan->tile_graphics_pipeline, vulkan->pipeline_layout, vulkan->descriptor_sets[vulkan->current_frame]);
+	draw->vertex_buffers[0] = data->vertex_buffer;
+	draw->vertex_buffers[1] = instances->buffers[vulkan->current_frame];
+	draw->vertex_buffer_count = 2;
+	draw->index_buffer = data->index_buffer;
+	draw->element_count = data->index_count;
+	draw->first_instance = first_instance;
+	draw->instance_count = instance_count;
+}
+
+//One off work on the graphics queue, waited for like copy_data_between_buffers()
+VkResult submit_and_wait(vulkan_state* vulkan, VkCommandBuffer command_buffer)
+{
+	VkSubmitInfo submit_info = {};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &command_buffer;
+	VkResult result = vkQueueSubmit(vulkan->graphics_queue, 1, &submit_info, VK_NULL_HANDLE);
+	if(result != VK_SUCCESS)
+	{
+		print_vulkan_error(result);
+		return result;
+	}
+	return vkQueueWaitIdle(vulkan->graphics_queue);
+}
+
+void begin_one_time_commands(VkCommandBuffer command_buffer)
+{
+	VkCommandBufferBeginInfo begin_info = {};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(command_buffer, &begin_info);
+}
+
+VkResult create_tile_raster(vulkan_state* vulkan, tile_raster* raster, int width, int height, int rect_capacity)
+{
+	*raster = {};
+	if(!vulkan->compute_supported) return VK_ERROR_FEATURE_NOT_PRESENT;
+	raster->width = width;
+	raster->height = height;
+	raster->rect_capacity = rect_capacity;
+	raster->group_count = (width*height + TILE_RASTER_GROUP_TILES - 1)/TILE_RASTER_GROUP_TILES;
+	raster->bin_cursors = (uint32_t*)malloc(raster->group_count*sizeof(uint32_t));
+
+	//Binned rects, bins then read back tiles share the host memory, each starting on a 256 byte boundary
+	//A rect goes in a bin at most once, so every bin having room for all of them is enough however they lie
+	uint32_t rect_size = ((uint32_t)rect_capacity*raster->group_count*sizeof(tile_rect) + 255) & ~255;
+	uint32_t bin_size = ((raster->group_count + 1)*sizeof(uint32_t) + 255) & ~255;
+	uint32_t tile_size = (width*height + 3) & ~3;
+	void* mapped = NULL;
+	VkResult result = raster->bin_cursors ? VK_SUCCESS : VK_ERROR_OUT_OF_HOST_MEMORY;
+	if(result == VK_SUCCESS) result = allocate_buffer_memory(&raster->host_memory, &vulkan->physical_device, &vulkan->logical_device, rect_size + bin_size + tile_size, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	if(result == VK_SUCCESS) result = allocate_buffer_memory(&raster->device_memory, &vulkan->physical_device, &vulkan->logical_device, tile_size, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	if(result == VK_SUCCESS) result = vkMapMemory(vulkan->logical_device, raster->host_memory, 0, VK_WHOLE_SIZE, 0, &mapped);
+	if(result == VK_SUCCESS) result = create_buffer(&raster->rect_buffer, &raster->host_memory, &vulkan->logical_device, rect_size, 0, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &vulkan->graphics_queue_index, 1);
+	if(result == VK_SUCCESS) result = create_buffer(&raster->bin_buffer, &raster->host_memory, &vulkan->logical_device, bin_size, rect_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &vulkan->graphics_queue_index, 1);
+	if(result == VK_SUCCESS) result = create_buffer(&raster->readback_buffer, &raster->host_memory, &vulkan->logical_device, tile_size, rect_size + bin_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, &vulkan->graphics_queue_index, 1);
+	if(result == VK_SUCCESS) result = create_buffer(&raster->tile_buffer, &raster->device_memory, &vulkan->logical_device, tile_size, 0, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, &vulkan->graphics_queue_index, 1);
+	if(result == VK_SUCCESS) result = create_command_buffers(&raster->command_buffer, &vulkan->logical_device, &vulkan->command_pool, 1);
+
+	VkDescriptorPoolSize pool_size = {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3};
+	VkDescriptorPoolCreateInfo pool_info = {};
+	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.poolSizeCount = 1;
+	pool_info.pPoolSizes = &pool_size;
+	pool_info.maxSets = 1;
+	if(result == VK_SUCCESS) result = vkCreateDescriptorPool(vulkan->logical_device, &pool_info, NULL, &raster->descriptor_pool);
+
+	VkDescriptorSetAllocateInfo set_info = {};
+	set_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	set_info.descriptorPool = raster->descriptor_pool;
+	set_info.descriptorSetCount = 1;
+	set_info.pSetLayouts = &vulkan->raster_descriptor_set_layout;
+	if(result == VK_SUCCESS) result = vkAllocateDescriptorSets(vulkan->logical_device, &set_info, &raster->descriptor_set);
+	if(result != VK_SUCCESS)
+	{
+		print_vulkan_error(result);
+		destroy_tile_raster(vulkan, raster);
+		return result;
+	}
+
+	VkDescriptorBufferInfo buffer_infos[3] = {{raster->rect_buffer, 0, VK_WHOLE_SIZE}, {raster->tile_buffer, 0, VK_WHOLE_SIZE}, {raster->bin_buffer, 0, VK_WHOLE_SIZE}};
+	VkWriteDescriptorSet writes[3] = {};
+	for(int i = 0; i < 3; i++)
+	{
+		writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[i].dstSet = raster->descriptor_set;
+		writes[i].dstBinding = i;
+		writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writes[i].descriptorCount = 1;
+		writes[i].pBufferInfo = &buffer_infos[i];
+	}
+	vkUpdateDescriptorSets(vulkan->logical_device, 3, writes, 0, NULL);
+	raster->rects = (tile_rect*)mapped;
+	raster->bins = (uint32_t*)((char*)mapped + rect_size);
+	raster->readback = (char*)mapped + rect_size + bin_size;
+	return VK_SUCCESS;
+}
+
+//Also cleans up after a create_tile_raster() that failed part way, every handle it didn't make is null
+void destroy_tile_raster(vulkan_state* vulkan, tile_raster* raster)
+{
+	if(raster->command_buffer) vkFreeCommandBuffers(vulkan->logical_device, vulkan->command_pool, 1, &raster->command_buffer);
+	vkDestroyDescriptorPool(vulkan->logical_device, raster->descriptor_pool, NULL);
+	vkDestroyBuffer(vulkan->logical_device, raster->tile_buffer, NULL);
+	vkDestroyBuffer(vulkan->logical_device, raster->readback_buffer, NULL);
+	vkDestroyBuffer(vulkan->logical_device, raster->bin_buffer, NULL);
+	vkDestroyBuffer(vulkan->logical_device, raster->rect_buffer, NULL);
+	vkFreeMemory(vulkan->logical_device, raster->device_memory, NULL);
+	vkFreeMemory(vulkan->logical_device, raster->host_memory, NULL);
+	free(raster->bin_cursors);
+	*raster = {};
+}
+
+//Counts the rect into, or with binned places it in, the bin of every workgroup whose tiles it covers any of
+//Rows go top to bottom so the groups a rect covers only increase, and no bin gets it twice
+static void bin_rect(tile_rect rect, int width, uint32_t* cursors, tile_rect* binned)
+{
+	int last_binned = -1;
+	for(int y = rect.min_y; y < rect.max_y && rect.min_x < rect.max_x; y++)
+	{
+		int first_group = max(last_binned + 1, (y*width + rect.min_x)/TILE_RASTER_GROUP_TILES);
+		int last_group = (y*width + rect.max_x - 1)/TILE_RASTER_GROUP_TILES;
+		for(int group = first_group; group <= last_group; group++)
+		{
+			if(binned) binned[cursors[group]] = rect;
+			cursors[group]++;
+		}
+		last_binned = max(last_binned, last_group);
+	}
+}
 
-	vkCmdBindVertexBuffers(vulkan->command_buffers[vulkan->swapchain_image_index], 0, 1, vertex_buffers, offsets);
-	vkCmdBindDescriptorSets(vulkan->command_buffers[vulkan->swapchain_image_index], VK_PIPELINE_BIND_POINT_GRAPHICS, vulkan->pipeline_layout, 0, 1, &vulkan->descriptor_sets[vulkan->swapchain_image_index], 0, NULL);
-	vkCmdDraw(vulkan->command_buffers[vulkan->swapchain_image_index], data->vertex_count, 1, 0, 0);
+VkResult rasterize_tiles(vulkan_state* vulkan, tile_raster* raster, const tile_rect* rects, int rect_count)
+{
+	if(rect_count > raster->rect_capacity) return VK_ERROR_TOO_MANY_OBJECTS;
+
+	//Counting the bins doesn't touch the raster's buffers, so it happens before waiting on the device
+	uint32_t* cursors = raster->bin_cursors;
+	memset(cursors, 0, raster->group_count*sizeof(uint32_t));
+	for(int i = 0; i < rect_count; i++) bin_rect(rects[i], raster->width, cursors, NULL);
+
+	//Frames in flight may still be drawing the tiles, and the last rasterisation reading the rects
+	vkQueueWaitIdle(vulkan->graphics_queue);
+	uint32_t bin_start = 0;
+	for(int group = 0; group < raster->group_count; group++)
+	{
+		uint32_t count = cursors[group];
+		raster->bins[group] = bin_start;
+		cursors[group] = bin_start;
+		bin_start += count;
+	}
+	raster->bins[raster->group_count] = bin_start;
+	for(int i = 0; i < rect_count; i++) bin_rect(rects[i], raster->width, cursors, raster->rects);
+
+	VkCommandBuffer command_buffer = raster->command_buffer;
+	begin_one_time_commands(command_buffer);
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, vulkan->raster_pipeline);
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, vulkan->raster_pipeline_layout, 0, 1, &raster->descriptor_set, 0, NULL);
+	int32_t constants[2] = {raster->width, raster->height};
+	vkCmdPushConstants(command_buffer, vulkan->raster_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), constants);
+	vkCmdDispatch(command_buffer, raster->group_count, 1, 1);
+
+	//The barrier holds for everything submitted after it, so later frames and read backs see the tiles
+	VkBufferMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = raster->tile_buffer;
+	barrier.offset = 0;
+	barrier.size = VK_WHOLE_SIZE;
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 1, &barrier, 0, NULL);
+	vkEndCommandBuffer(command_buffer);
+	return submit_and_wait(vulkan, command_buffer);
+}
+
+VkResult read_raster_tiles(vulkan_state* vulkan, tile_raster* raster, char* tiles)
+{
+	VkCommandBuffer command_buffer = raster->command_buffer;
+	begin_one_time_commands(command_buffer);
+	VkBufferCopy copy_region = {0, 0, (VkDeviceSize)((raster->width*raster->height + 3) & ~3)};
+	vkCmdCopyBuffer(command_buffer, raster->tile_buffer, raster->readback_buffer, 1, &copy_region);
+
+	VkBufferMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = raster->readback_buffer;
+	barrier.offset = 0;
+	barrier.size = VK_WHOLE_SIZE;
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, NULL, 1, &barrier, 0, NULL);
+	vkEndCommandBuffer(command_buffer);
+
+	VkResult result = submit_and_wait(vulkan, command_buffer);
+	if(result == VK_SUCCESS) memcpy(tiles, raster->readback, raster->width*raster->height);
+	return result;
+}
+
+void draw_raster_tiles(vulkan_state* vulkan, graphical_data_buffer* mesh, tile_raster* raster, tile_rect area)
+{
+	int columns = area.max_x - area.min_x;
+	int rows = area.max_y - area.min_y;
+	if(columns <= 0 || rows <= 0) return;
+	queued_draw* draw = queue_draw(&vulkan->recorder, vulkan->raster_tile_graphics_pipeline, vulkan->raster_tile_pipeline_layout, vulkan->descriptor_sets[vulkan->current_frame]);
+	draw->descriptor_sets[1] = raster->descriptor_set;
+	draw->descriptor_set_count = 2;
+	draw->vertex_buffers[0] = mesh->vertex_buffer;
+	draw->vertex_buffer_count = 1;
+	draw->index_buffer = mesh->index_buffer;
+	draw->element_count = mesh->index_count;
+	draw->instance_count = columns*rows;
+
+	//The model matrix, then the area
+	mat4 model = identity();
+	int32_t area_constants[4] = {area.min_x, area.min_y, columns, raster->width};
+	memcpy(draw->constants, &model, sizeof(mat4));
+	memcpy(draw->constants + sizeof(mat4), area_constants, sizeof(area_constants));
+	draw->constant_size = DRAW_CONSTANTS_MAX;
 }
 
 void render_frame(vulkan_state* vulkan)
 {
-	vkCmdEndRenderPass(vulkan->command_buffers[vulkan->swapchain_image_index]);
+	frame_timings* timings = &vulkan->recording_timings[vulkan->current_frame];
+	flush_draws(vulkan);
+	timings->draws = vulkan->recorder.stats;
+	end_timer(&vulkan->frame_timer);
+	timings->record_microsec = time_elapsed_microsec(&vulkan->frame_timer);
+	start_timer(&vulkan->frame_timer);
+
+	vkCmdEndRenderPass(vulkan->command_buffers[vulkan->current_frame]);
+	gpu_timestamp(vulkan, "end of pass");
 
-	if(vkEndCommandBuffer(vulkan->command_buffers[vulkan->swapchain_image_index]) != VK_SUCCESS)
+	if(vkEndCommandBuffer(vulkan->command_buffers[vulkan->current_frame]) != VK_SUCCESS)
 	{
 		printf("Command buffer failed\n");
 	}
@@ -1172,7 +2028,7 @@ void render_frame(vulkan_state* vulkan)
 	submit_info.pWaitSemaphores = wait_semaphores;
 	submit_info.pWaitDstStageMask = wait_stages;
 	submit_info.commandBufferCount = 1;
-	submit_info.pCommandBuffers = &vulkan->command_buffers[vulkan->swapchain_image_index];
+	submit_info.pCommandBuffers = &vulkan->command_buffers[vulkan->current_frame];
 	
 	VkSemaphore signal_semaphores[] = {vulkan->render_finished_semaphores[vulkan->current_frame]};
 	submit_info.signalSemaphoreCount = 1;
@@ -1196,7 +2052,116 @@ void render_frame(vulkan_state* vulkan)
 	present_info.pImageIndices = &vulkan->swapchain_image_index;
 	
 	vkQueuePresentKHR(vulkan->graphics_queue, &present_info);
+	end_timer(&vulkan->frame_timer);
+	timings->present_microsec = time_elapsed_microsec(&vulkan->frame_timer);
 	
-	vulkan->current_frame = (vulkan->current_frame + 1) % MAX_FRAMES_COMPUTED_AT_ONCE;
+	vulkan->current_frame = (vulkan->current_frame + 1) % vulkan->frames_in_flight;
 }
 
+
+VkResult create_region_recorder(vulkan_state* vulkan, region_recorder* recorder, int thread_count)
+{
+	if(thread_count <= 0) thread_count = processor_count();
+	if(thread_count > RECORD_MAX_THREADS) thread_count = RECORD_MAX_THREADS;
+	recorder->slot_count = thread_count;
+	create_job_pool(&recorder->jobs, thread_count);
+	for(int slot = 0; slot < recorder->slot_count; slot++) create_command_recorder(&recorder->slot_recorders[slot]);
+	for(int frame = 0; frame < MAX_FRAMES_COMPUTED_AT_ONCE; frame++)
+	{
+		for(int slot = 0; slot < recorder->slot_count; slot++)
+		{
+			VkResult result = create_command_pool(&recorder->command_pools[frame][slot], &vulkan->logical_device, vulkan->graphics_queue_index);
+			if(result != VK_SUCCESS) return result;
+
+			//Region r is always recorded in slot r % slot_count, so each pool owns every slot_count'th buffer
+			VkCommandBuffer buffers[RECORD_MAX_REGIONS];
+			VkCommandBufferAllocateInfo command_alloc_info = {};
+			command_alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			command_alloc_info.commandPool = recorder->command_pools[frame][slot];
+			command_alloc_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+			command_alloc_info.commandBufferCount = (RECORD_MAX_REGIONS - slot + recorder->slot_count - 1)/recorder->slot_count;
+			result = vkAllocateCommandBuffers(vulkan->logical_device, &command_alloc_info, buffers);
+			if(result != VK_SUCCESS)
+			{
+				print_vulkan_error(result);
+				return result;
+			}
+			for(uint32_t i = 0; i < command_alloc_info.commandBufferCount; i++) recorder->command_buffers[frame][slot + i*recorder->slot_count] = buffers[i];
+		}
+	}
+	return VK_SUCCESS;
+}
+
+void destroy_region_recorder(vulkan_state* vulkan, region_recorder* recorder)
+{
+	for(int frame = 0; frame < MAX_FRAMES_COMPUTED_AT_ONCE; frame++)
+	{
+		for(int slot = 0; slot < recorder->slot_count; slot++) vkDestroyCommandPool(vulkan->logical_device, recorder->command_pools[frame][slot], NULL);
+	}
+	for(int slot = 0; slot < recorder->slot_count; slot++) destroy_command_recorder(&recorder->slot_recorders[slot]);
+	destroy_job_pool(&recorder->jobs);
+}
+
+struct region_recording
+{
+	vulkan_state* vulkan;
+	region_recorder* recorder;
+	int region_count;
+	region_record_function record;
+	void* data;
+};
+
+//One slot's regions, only ever touching its own pool
+void record_region_slot(void* data, int slot)
+{
+	region_recording* recording = (region_recording*)data;
+	vulkan_state* vulkan = recording->vulkan;
+	region_recorder* recorder = recording->recorder;
+	command_recorder* draws = &recorder->slot_recorders[slot];
+	draws->stats = {};
+	vkResetCommandPool(vulkan->logical_device, recorder->command_pools[vulkan->current_frame][slot], 0);
+
+	VkCommandBufferInheritanceInfo inheritance_info = {};
+	inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritance_info.renderPass = vulkan->render_pass;
+	inheritance_info.subpass = 0;
+	inheritance_info.framebuffer = vulkan->swapchain_framebuffers[vulkan->swapchain_image_index];
+
+	VkCommandBufferBeginInfo command_begin_info = {};
+	command_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	command_begin_info.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	command_begin_info.pInheritanceInfo = &inheritance_info;
+
+	for(int region = slot; region < recording->region_count; region += recorder->slot_count)
+	{
+		VkCommandBuffer command_buffer = recorder->command_buffers[vulkan->current_frame][region];
+		vkBeginCommandBuffer(command_buffer, &command_begin_info);
+		//Dynamic state isn't inherited from the primary buffer
+		record_viewport(vulkan, command_buffer);
+		begin_recording(draws, command_buffer);
+		recording->record(recording->data, vulkan, draws, region);
+		flush_draws(draws);
+		if(vkEndCommandBuffer(command_buffer) != VK_SUCCESS) printf("Region %d failed to record\n", region);
+	}
+}
+
+void record_regions(vulkan_state* vulkan, region_recorder* recorder, int region_count, region_record_function record, void* data)
+{
+	if(region_count > RECORD_MAX_REGIONS) region_count = RECORD_MAX_REGIONS;
+	if(region_count <= 0) return;
+	region_recording recording = {vulkan, recorder, region_count, record, data};
+	int slot_count = min(recorder->slot_count, region_count);
+	run_jobs(&recorder->jobs, slot_count, record_region_slot, &recording);
+	for(int slot = 0; slot < slot_count; slot++)
+	{
+		draw_stats* slot_stats = &recorder->slot_recorders[slot].stats;
+		draw_stats* frame_stats = &vulkan->recorder.stats;
+		frame_stats->queued_count += slot_stats->queued_count;
+		frame_stats->draw_count += slot_stats->draw_count;
+		frame_stats->bind_count += slot_stats->bind_count;
+		frame_stats->push_count += slot_stats->push_count;
+	}
+	vkCmdExecuteCommands(vulkan->command_buffers[vulkan->current_frame], region_count, recorder->command_buffers[vulkan->current_frame]);
+	//Secondary command buffers leave the primary's bound state undefined
+	begin_recording(&vulkan->recorder, vulkan->command_buffers[vulkan->current_frame]);
+}
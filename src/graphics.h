@@ -4,8 +4,22 @@
 #include <windows.h>
 #include <stdio.h>
 #include "maths.h"
+#include "mapped_file.h"
+#include "jobs.h"
+#include "timer.h"
+#include "dungeon.h"
 
-#define MAX_FRAMES_COMPUTED_AT_ONCE 2
+#define MAX_FRAMES_COMPUTED_AT_ONCE 4 //Most frames in flight, vulkan_state.frames_in_flight picks how many are used
+#define MAX_SWAPCHAIN_IMAGES 8
+#define RECORD_MAX_THREADS 16
+#define RECORD_MAX_REGIONS 256
+#define GPU_TIMESTAMP_MAX 16 //Timestamps per frame, the frame start included
+#define TIMESTAMP_CALIBRATIONS 8 //Tries at lining GPU timestamps up with the performance counter
+#define TILE_RASTER_GROUP_SIZE 64 //local_size_x of tile_raster.comp, each invocation writes 4 tiles
+#define TILE_RASTER_GROUP_TILES (4*TILE_RASTER_GROUP_SIZE) //Tiles a workgroup writes, a row major run of the tile grid
+#define DRAW_QUEUE_CAPACITY 1024 //Draws a command_recorder sorts together, a full queue is recorded early
+#define DRAW_CONSTANTS_MAX (sizeof(mat4) + 4*sizeof(int32_t)) //Largest push constant block of any pipeline, the raster tiles'
+#define PIPELINE_CACHE_PATH "pipeline_cache.bin" //Saved by shutdown_vulkan(), relative to the working directory
 
 #define KILOBYTES(n) 1024*n
 #define MEGABYTES(n) KILOBYTES(1024*n)
@@ -17,6 +31,82 @@ struct world_matrices
 };
 
 
+//Commands recorded for a frame, summed over every command buffer it executes
+struct draw_stats
+{
+	int queued_count; //Draws asked for
+	int draw_count; //Draws recorded, fewer than queued when instance ranges were merged
+	int bind_count; //Pipelines, vertex buffers, index buffers and descriptor sets
+	int push_count;
+};
+
+//Where a frame's time went, complete once the frame's fence has signalled
+//GPU passes run from the timestamp before them to their own, the first is written as the frame's commands start
+struct frame_timings
+{
+	//CPU
+	int64_t wait_microsec; //begin_frame() waiting on the frame's fence and acquiring a swapchain image
+	int64_t record_microsec; //From begin_frame() returning to render_frame()
+	int64_t present_microsec; //render_frame() submitting and presenting
+	draw_stats draws;
+	//From begin_frame() being called, when input for the frame has been taken, to the GPU finishing the frame's render pass
+	//Time the image then spends queued for display isn't seen, that needs a present timing extension
+	int64_t latency_microsec;
+	bool latency_valid; //Needs timestamps
+
+	//GPU
+	bool gpu_valid; //False if the graphics queue has no timestamps or the frame wrote fewer than two
+	float gpu_frame_millisec;
+	int gpu_pass_count;
+	const char* gpu_pass_names[GPU_TIMESTAMP_MAX];
+	float gpu_pass_millisec[GPU_TIMESTAMP_MAX];
+};
+
+//Everything a queued draw binds and pushes
+struct queued_draw
+{
+	VkPipeline pipeline;
+	VkPipelineLayout layout;
+	VkDescriptorSet descriptor_sets[2];
+	uint32_t descriptor_set_count;
+	VkBuffer vertex_buffers[2];
+	uint32_t vertex_buffer_count;
+	VkBuffer index_buffer; //VK_NULL_HANDLE draws vertices without indices
+	uint32_t element_count; //Indices, or vertices without an index buffer
+	uint32_t first_instance;
+	uint32_t instance_count;
+	uint32_t constant_size;
+	uint8_t constants[DRAW_CONSTANTS_MAX];
+	int order; //Place in the queue, keeps the sort stable
+};
+
+//Records draws into one command buffer, binding and pushing only what differs from the draw before
+//Draws are queued until flush_draws(), then sorted by pipeline, descriptor sets, buffers and push constants so equal state is bound once
+//Queued draws differing only in consecutive instance ranges become one draw
+//Sorting reorders draws, so draws that must go over earlier ones are queued after a flush
+//Used by one thread at a time, the region recorder has one per thread
+struct command_recorder
+{
+	VkCommandBuffer command_buffer;
+	mat4 model; //From record_model_matrix(), pushed with the draws queued after it
+	queued_draw* queue;
+	queued_draw** sorted;
+	int queue_count;
+
+	//Bound state, unknown after begin_recording()
+	VkPipeline pipeline;
+	VkPipelineLayout set_layout;
+	VkDescriptorSet descriptor_sets[2];
+	uint32_t descriptor_set_count;
+	VkBuffer vertex_buffers[2];
+	VkBuffer index_buffer;
+	VkPipelineLayout constant_layout;
+	uint32_t constant_size;
+	uint8_t constants[DRAW_CONSTANTS_MAX];
+
+	draw_stats stats;
+};
+
 struct vertex
 {
 	vec2d position;
@@ -46,32 +136,47 @@ struct vulkan_state
 	//Swapchain
 	VkExtent2D swapchain_extent; //Dimensions (in fragments) of swapchain images
 	VkSwapchainKHR swapchain;
+	VkPresentModeKHR present_mode;
 	
 	uint32_t swapchain_image_count;
-	VkImageView swapchain_image_views[4];
-	VkFramebuffer swapchain_framebuffers[4];
+	VkImageView swapchain_image_views[MAX_SWAPCHAIN_IMAGES];
+	VkFramebuffer swapchain_framebuffers[MAX_SWAPCHAIN_IMAGES];
 
-	//Command buffer (coupled to swapchain)
+	//Command buffers, one per frame in flight
 	VkCommandPool command_pool;
-	VkCommandBuffer command_buffers[4];
+	VkCommandBuffer command_buffers[MAX_FRAMES_COMPUTED_AT_ONCE];
+	command_recorder recorder; //The current frame's primary command buffer
 	VkCommandPool transfer_command_pool;
 	VkCommandBuffer transfer_command_buffer;
 
 	//Uniform buffer
-	VkBuffer world_matrix_buffers[4];
+	//Uniform buffers, one per frame in flight
+	VkBuffer world_matrix_buffers[MAX_FRAMES_COMPUTED_AT_ONCE];
+	world_matrices world; //Latest from update_world_matrix()
+	uint32_t stale_world_matrix_buffers; //Bit per frame whose buffer doesn't hold world yet
 
 	//Uniform descriptors
 	VkDescriptorSetLayout uniform_descriptor_set_layout;
 	VkDescriptorPool descriptor_pool;
-	VkDescriptorSet descriptor_sets[4];
+	VkDescriptorSet descriptor_sets[MAX_FRAMES_COMPUTED_AT_ONCE];
 
 	//Pipeline
 	VkRenderPass render_pass;
 	VkPipelineLayout pipeline_layout;
 	VkPipeline graphics_pipeline;
 	VkPipeline line_graphics_pipeline;
+	VkPipeline tile_graphics_pipeline; //Instanced, a tile mesh offset by a per instance vec2d
+	VkDescriptorSetLayout raster_descriptor_set_layout; //A tile_raster's rects, tiles and bins
+	VkPipelineLayout raster_pipeline_layout;
+	VkPipeline raster_pipeline; //Compute, rects to tiles
+	VkPipelineLayout raster_tile_pipeline_layout; //World matrices and a tile_raster's tiles
+	VkPipeline raster_tile_graphics_pipeline; //Instanced, a tile mesh for each tile of a tile_raster
+	bool compute_supported; //The graphics queue can dispatch, the raster pipelines are only made if it can
+	VkPipelineCache pipeline_cache;
+	bool pipeline_cache_warm; //Started from a saved cache
 
 	//Swapchain target
+	int frames_in_flight; //Frames recorded before waiting on the oldest, more keeps the GPU busier at the cost of latency
 	int current_frame;
 	uint32_t swapchain_image_index;
 
@@ -80,6 +185,19 @@ struct vulkan_state
 	VkSemaphore render_finished_semaphores[MAX_FRAMES_COMPUTED_AT_ONCE];
 	VkFence framebuffer_in_use_fences[MAX_FRAMES_COMPUTED_AT_ONCE];
 
+	//Timing, a query pool per frame in flight is read once its fence has signalled, so reading never waits on the GPU
+	VkQueryPool timestamp_pools[MAX_FRAMES_COMPUTED_AT_ONCE];
+	uint32_t timestamp_counts[MAX_FRAMES_COMPUTED_AT_ONCE];
+	const char* timestamp_names[MAX_FRAMES_COMPUTED_AT_ONCE][GPU_TIMESTAMP_MAX];
+	uint64_t timestamp_mask; //Valid bits of the graphics queue's timestamps, 0 if it has none
+	float timestamp_period; //Nanoseconds per tick
+	double timestamp_offset_microsec; //Performance counter time of GPU tick 0
+	bool timestamps_calibrated;
+	LARGE_INTEGER frame_begin_counts[MAX_FRAMES_COMPUTED_AT_ONCE]; //Performance counter as each frame began
+	timer frame_timer;
+	frame_timings recording_timings[MAX_FRAMES_COMPUTED_AT_ONCE];
+	frame_timings timings; //Latest complete frame, frames_in_flight frames behind the one being recorded
+
 	//Memory
 	VkDeviceMemory staging_buffer_memory;
 	VkBuffer staging_buffer;
@@ -96,18 +214,116 @@ struct graphical_data_buffer
 	int index_count;
 };
 
-uint8_t startup_vulkan(vulkan_state*, HWND, HINSTANCE);
+//Per instance tile offsets, one buffer for each of the most frames in flight
+//The memory stays mapped for the buffer's lifetime and is host coherent, so offsets written there need no copy or flush
+//The current frame's buffer is only written between begin_frame() and render_frame(), once its fence says the GPU is done with it
+struct tile_instance_buffer
+{
+	VkDeviceMemory memory;
+	VkBuffer buffers[MAX_FRAMES_COMPUTED_AT_ONCE];
+	vec2d* offsets[MAX_FRAMES_COMPUTED_AT_ONCE];
+	int capacity; //Instances per frame
+};
+
+//Tiles rasterised on the device from floor rects by the compute shader in tile_raster.comp, drawn from there without tile_map
+//Tiles are bytes in tile_map's row major layout, packed 4 to a uint in device local memory
+//Rects go up and tiles come back through persistently mapped, host coherent buffers
+//Rects are binned on the host by the workgroup whose tiles they cover, so a workgroup only tests its own bin
+struct tile_raster
+{
+	int width;
+	int height;
+	int rect_capacity;
+	int group_count;
+	VkDeviceMemory host_memory;
+	VkBuffer rect_buffer;
+	VkBuffer bin_buffer;
+	VkBuffer readback_buffer;
+	tile_rect* rects; //Binned, with room for each of rect_capacity rects in every bin
+	uint32_t* bins; //group_count + 1 bin starts in rects
+	uint32_t* bin_cursors; //Host memory, counts then next free slot of each bin while binning
+	char* readback;
+	VkDeviceMemory device_memory;
+	VkBuffer tile_buffer;
+	VkDescriptorPool descriptor_pool;
+	VkDescriptorSet descriptor_set;
+	VkCommandBuffer command_buffer;
+};
+
+//Records a frame's draws in regions on a pool of threads
+//Each region is recorded into its own secondary command buffer, which the frame's primary buffer then executes in region order
+//Threads record into buffers from their own command pools, one set per frame in flight, reset once that frame's fence has signalled
+struct region_recorder
+{
+	job_pool jobs;
+	int slot_count; //Command pools per frame, one per thread
+	VkCommandPool command_pools[MAX_FRAMES_COMPUTED_AT_ONCE][RECORD_MAX_THREADS];
+	VkCommandBuffer command_buffers[MAX_FRAMES_COMPUTED_AT_ONCE][RECORD_MAX_REGIONS];
+	command_recorder slot_recorders[RECORD_MAX_THREADS];
+};
+
+//Records one region's draws through the record_ functions, called on any of the recorder's threads
+//The recorder's draws are flushed into the region's command buffer once the function returns
+typedef void (*region_record_function)(void* data, vulkan_state*, command_recorder*, int region);
+
+uint8_t startup_vulkan(vulkan_state*, HWND, HINSTANCE, VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR, int frames_in_flight = 2);
 void shutdown_vulkan(vulkan_state*);
+//Waits for the GPU, then recreates the swapchain and per frame resources, an unsupported present mode falls back to FIFO
+uint8_t configure_presentation(vulkan_state*, VkPresentModeKHR present_mode, int frames_in_flight);
+bool present_mode_supported(vulkan_state*, VkPresentModeKHR);
+const char* present_mode_name(VkPresentModeKHR);
 
 graphical_data_buffer buffer_graphical_data(vulkan_state*, vertex*, int, uint16_t*, int);
 graphical_data_buffer buffer_graphical_data(vulkan_state*, vertex*, int);
 
-void begin_frame(vulkan_state*);
+//Frames whose draws are recorded by record_regions() begin with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS and draw nothing inline
+void begin_frame(vulkan_state*, VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
 void draw(vulkan_state*, graphical_data_buffer*);
 void draw_line(vulkan_state*, graphical_data_buffer*);
+//Records the frame's queued draws, later draws are drawn over them
+void flush_draws(vulkan_state*);
 void render_frame(vulkan_state*);
+//Marks the end of a pass named name on the GPU after flushing the draws before it, name must outlive the frame
+//Only between draws of frames begun with VK_SUBPASS_CONTENTS_INLINE, the render pass of other frames only takes secondary command buffers
+void gpu_timestamp(vulkan_state*, const char* name);
+//One line summary of timings, returns the length written
+int format_frame_timings(frame_timings*, char* text, int capacity);
 void complete_graphical_tasks(vulkan_state*);
 void destroy_graphical_data(vulkan_state*, graphical_data_buffer*);
+//Cheap enough to call every frame, each swapchain image's buffer is updated by its own command buffer the next time it is drawn
 void update_world_matrix(vulkan_state*, mat4, mat4);
 void push_model_matrix(vulkan_state*, mat4);
 void resize_window(vulkan_state*);
+
+VkResult create_tile_instance_buffer(vulkan_state*, tile_instance_buffer*, int capacity);
+void destroy_tile_instance_buffer(vulkan_state*, tile_instance_buffer*);
+//Offsets for the frame being recorded
+vec2d* current_tile_offsets(vulkan_state*, tile_instance_buffer*);
+//Draws the mesh once for each of instance_count offsets from first_instance in the current frame's buffer
+void draw_tiles(vulkan_state*, graphical_data_buffer*, tile_instance_buffer*, int first_instance, int instance_count);
+
+void create_command_recorder(command_recorder*);
+void destroy_command_recorder(command_recorder*);
+//Draws after this go into command_buffer, with nothing assumed bound
+void begin_recording(command_recorder*, VkCommandBuffer);
+void flush_draws(command_recorder*);
+//The draws above through a given recorder
+void record_draw(vulkan_state*, command_recorder*, graphical_data_buffer*);
+void record_draw_line(vulkan_state*, command_recorder*, graphical_data_buffer*);
+void record_model_matrix(vulkan_state*, command_recorder*, mat4);
+
+//Fails with VK_ERROR_FEATURE_NOT_PRESENT if the graphics queue can't dispatch compute work
+VkResult create_tile_raster(vulkan_state*, tile_raster*, int width, int height, int rect_capacity);
+void destroy_tile_raster(vulkan_state*, tile_raster*);
+//Waits for the GPU to finish with the tiles, then writes FLOOR in every rect and WALL elsewhere
+VkResult rasterize_tiles(vulkan_state*, tile_raster*, const tile_rect* rects, int rect_count);
+//Copies the tiles into width*height bytes, to check them against rasterize_rects()
+VkResult read_raster_tiles(vulkan_state*, tile_raster*, char* tiles);
+//Draws the mesh once for each tile of area, coloured by the tile's type
+void draw_raster_tiles(vulkan_state*, graphical_data_buffer* mesh, tile_raster*, tile_rect area);
+
+//thread_count of 0 uses every processor, up to RECORD_MAX_THREADS
+VkResult create_region_recorder(vulkan_state*, region_recorder*, int thread_count = 0);
+void destroy_region_recorder(vulkan_state*, region_recorder*);
+//Records regions [0, region_count) across the recorder's threads and executes them from the current frame's primary buffer
+void record_regions(vulkan_state*, region_recorder*, int region_count, region_record_function, void* data);
@@ -0,0 +1,116 @@
+#include "jobs.h"
+
+struct job_batch
+{
+	job_function job;
+	void* data;
+	LONG count;
+	volatile LONG next_index;
+};
+
+DWORD WINAPI job_worker(LPVOID parameter)
+{
+	job_batch* batch = (job_batch*)parameter;
+	for(LONG i = InterlockedIncrement(&batch->next_index) - 1; i < batch->count; i = InterlockedIncrement(&batch->next_index) - 1)
+	{
+		batch->job(batch->data, i);
+	}
+	return 0;
+}
+
+int processor_count()
+{
+	SYSTEM_INFO system_info;
+	GetSystemInfo(&system_info);
+	return system_info.dwNumberOfProcessors;
+}
+
+void parallel_for(int count, job_function job, void* data, int thread_count)
+{
+	if(thread_count <= 0) thread_count = processor_count();
+	if(thread_count > count) thread_count = count;
+	if(thread_count > MAX_JOB_THREADS) thread_count = MAX_JOB_THREADS;
+
+	job_batch batch = {job, data, count, 0};
+	HANDLE threads[MAX_JOB_THREADS];
+	int thread_handle_count = 0;
+	for(int i = 1; i < thread_count; i++)
+	{
+		HANDLE thread = CreateThread(NULL, 0, job_worker, &batch, 0, NULL);
+		if(thread) threads[thread_handle_count++] = thread;
+	}
+	job_worker(&batch);
+
+	if(thread_handle_count > 0) WaitForMultipleObjects(thread_handle_count, threads, TRUE, INFINITE);
+	for(int i = 0; i < thread_handle_count; i++) CloseHandle(threads[i]);
+}
+
+void take_pool_jobs(job_pool* pool)
+{
+	for(LONG i = InterlockedIncrement(&pool->next_index) - 1; i < pool->count; i = InterlockedIncrement(&pool->next_index) - 1)
+	{
+		pool->job(pool->data, i);
+	}
+}
+
+DWORD WINAPI pool_worker(LPVOID parameter)
+{
+	job_pool* pool = (job_pool*)parameter;
+	for(;;)
+	{
+		WaitForSingleObject(pool->start, INFINITE);
+		if(pool->stopping) return 0;
+		take_pool_jobs(pool);
+		if(InterlockedDecrement(&pool->running_workers) == 0) SetEvent(pool->done);
+	}
+}
+
+void create_job_pool(job_pool* pool, int thread_count)
+{
+	if(thread_count <= 0) thread_count = processor_count();
+	if(thread_count > MAX_JOB_THREADS) thread_count = MAX_JOB_THREADS;
+	pool->start = CreateSemaphoreA(NULL, 0, MAX_JOB_THREADS, NULL);
+	pool->done = CreateEventA(NULL, FALSE, FALSE, NULL);
+	pool->running_workers = 0;
+	pool->stopping = 0;
+	pool->count = 0;
+	pool->next_index = 0;
+	pool->thread_count = 1;
+	for(int i = 1; i < thread_count; i++)
+	{
+		HANDLE thread = CreateThread(NULL, 0, pool_worker, pool, 0, NULL);
+		if(thread) pool->threads[pool->thread_count++ - 1] = thread;
+	}
+}
+
+void destroy_job_pool(job_pool* pool)
+{
+	int worker_count = pool->thread_count - 1;
+	InterlockedExchange(&pool->stopping, 1);
+	if(worker_count > 0)
+	{
+		ReleaseSemaphore(pool->start, worker_count, NULL);
+		WaitForMultipleObjects(worker_count, pool->threads, TRUE, INFINITE);
+	}
+	for(int i = 0; i < worker_count; i++) CloseHandle(pool->threads[i]);
+	CloseHandle(pool->start);
+	CloseHandle(pool->done);
+}
+
+//Every worker is woken even when there are fewer jobs than threads, so the last one out always sets done
+void run_jobs(job_pool* pool, int count, job_function job, void* data)
+{
+	int worker_count = pool->thread_count - 1;
+	pool->job = job;
+	pool->data = data;
+	pool->count = count;
+	pool->next_index = 0;
+	if(worker_count > 0 && count > 1)
+	{
+		pool->running_workers = worker_count;
+		ReleaseSemaphore(pool->start, worker_count, NULL);
+		take_pool_jobs(pool);
+		WaitForSingleObject(pool->done, INFINITE);
+	}
+	else take_pool_jobs(pool);
+}
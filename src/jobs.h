@@ -0,0 +1,35 @@
+#pragma once
+#include <windows.h>
+
+#define MAX_JOB_THREADS 64
+
+typedef void (*job_function)(void* data, int index);
+
+int processor_count();
+
+//Calls job once for every index in [0, count), spread across thread_count threads (0 uses every processor)
+//The calling thread takes jobs too and parallel_for returns once all of them have completed
+void parallel_for(int count, job_function job, void* data, int thread_count = 0);
+
+//Threads kept between runs, for work that is split every frame and too short to pay for starting threads each time
+struct job_pool
+{
+	int thread_count; //Including the thread calling run_jobs()
+	HANDLE threads[MAX_JOB_THREADS];
+	HANDLE start; //Semaphore, released once for each worker when a run starts
+	HANDLE done; //Set by the last worker out of a run
+	volatile LONG running_workers;
+	volatile LONG stopping;
+
+	//Current run
+	job_function job;
+	void* data;
+	LONG count;
+	volatile LONG next_index;
+};
+
+//thread_count of 0 uses every processor
+void create_job_pool(job_pool*, int thread_count = 0);
+void destroy_job_pool(job_pool*);
+//parallel_for() on the pool's threads, one run at a time and only from the thread that created the pool
+void run_jobs(job_pool*, int count, job_function job, void* data);
@@ -19,6 +19,6 @@ layout(location = 1) out vec3 colour;
 
 void main()
 {
-	gl_Position = vec4(in_position, 0.0, 1.0);
+	gl_Position = wm.projection * wm.view * pc.model * vec4(in_position, 0.0, 1.0);
 	colour = in_colour;
 }
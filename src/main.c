@@ -1,11 +1,29 @@
 #include <stdio.h>
 #include <windows.h>
 #include <stdlib.h>
+#include <string.h>
 #include "graphics.h"
 #include "rng.h"
+#include "dungeon.h"
+#include "validate.h"
+#include "timer.h"
+#include "benchmark.h"
+#include "service.h"
+#include "camera.h"
+#include "tile_pyramid.h"
 
 #define WINDOW_WIDTH 640
 #define WINDOW_HEIGHT 640
+#define CAMERA_PAN 0.1f //Fraction of the view moved per key press
+#define CAMERA_ZOOM 0.8f //Height scale per wheel notch towards the screen
+#define REGION_ROWS 8 //Least tile rows per recorded region with -regions
+#define TIMINGS_INTERVAL 500 //Milliseconds between frame timings in the window title
+#define LATENCY_WARMUP_FRAMES 60
+#define LATENCY_FRAMES 600 //Timed frames per configuration with -latency
+#define RASTER_CHECK_DUNGEONS 256 //Seeds rasterised on the GPU and compared with -raster-check
+//A room per leaf, and a leaf only needs MIN_ROOM + 1 tiles on a side, the bound create_dungeon_batch() sizes its tables with
+#define MAX_ROOMS ((MAP_SIZE/(MIN_ROOM + 1) + 1)*(MAP_SIZE/(MIN_ROOM + 1) + 1))
+#define MAX_FLOOR_RECTS (MAX_ROOMS + 2*(MAX_ROOMS - 1)) //Rooms, and at most two corridors for each of the room_count - 1 hallways
 
 typedef graphical_data_buffer tile_graphical_data;
 
@@ -28,99 +46,16 @@ typedef graphical_data_buffer tile_graphical_data;
 //TODO: Remove uint64_t, make own macros
 //TODO: Proper error handling in graphics code
 
-int max(int n, int m)
-{
-	return (n >= m) ? n : m;
-}
-
-int min(int n, int m)
-{
-	return (n <= m) ? n : m;
-}
-
-struct bsp_node
-{
-	vec2d top_right;
-	vec2d bottom_left;
-	vec2d room_top_right;
-	vec2d room_bottom_left;
-	int partition_direction;
-	int partition_position;
-	bsp_node* left_child;
-	bsp_node* right_child;
-};
-
-#define MIN_PARTITION 16
-#define MIN_ROOM 4
-
-#define HORIZONTAL 0
-#define VERTICAL 1
-
-//bsp tree:
-//	- At least 2 levels deep
-
-bsp_node* generate_bsp_tree(vec2d bottom_left, vec2d top_right, int level = 0)
-{
-	bsp_node* tree = (bsp_node*)malloc(sizeof(bsp_node));
-	tree->bottom_left = bottom_left;
-	tree->top_right = top_right;
-	tree->left_child = NULL;
-	tree->right_child = NULL;
-	tree->partition_direction = -1;
-
-	vec2d dimensions = top_right - bottom_left;
-
-	if(dimensions[HORIZONTAL] > MIN_PARTITION || dimensions[VERTICAL] > MIN_PARTITION)
-	{
-		int should_partition = rng() % 5;
-		if(should_partition || level < 2)
-		{
-			//Choose direction of partition
-			int direction = rng() % 2;
-			if(dimensions[direction] < MIN_PARTITION) direction = (direction+1)%2;
-
-			//Choose position of partition along direction
-			int min = bottom_left[direction] + MIN_ROOM + 2;
-			int max = top_right[direction] - MIN_ROOM - 2;
-			int partition_position = rng_range(min, max);
-			
-			//Find bottom_left and top_right for left and right child nodes
-			//If direction is x (partition line is drawn parallel to y axis)
-			//	Left child bottom_left is same as current_bottom_left
-			//	Right child bottom_left is {partition_position, bottom_left.y}
-			//	Left child top_right is {partition_position - 1, top_right.y}
-			//	Right child top_right is same as current top_right
-			//If direction is y (partition line is drawn parallel to x axis)
-			//	Left child bottom left is {bottom_left.x, partition_position}
-			//	Right child bottom_left is same as current_bottom_left
-			//	Left child top_right is same as current top_right
-			//	Right child top_right is {top_right.x, partition_position - 1}
-			vec2d l_child_bottom_left = (direction == HORIZONTAL) ? bottom_left : vec2d{bottom_left.x, partition_position};
-			vec2d l_child_top_right = (direction == HORIZONTAL) ? vec2d{partition_position - 1, top_right.y} : top_right;
-			vec2d r_child_bottom_left = (direction == HORIZONTAL) ? vec2d{partition_position, bottom_left.y} : bottom_left;
-			vec2d r_child_top_right = (direction == HORIZONTAL) ? top_right : vec2d{top_right.x, partition_position - 1};
-
-			tree->partition_position = partition_position;
-
-			//Create child nodes
-			tree->partition_direction = direction;
-			tree->left_child = generate_bsp_tree(l_child_bottom_left, l_child_top_right, level+1);
-			tree->right_child = generate_bsp_tree(r_child_bottom_left, r_child_top_right, level+1);
-		}
-	}
-	return tree;
-}
-
-void destroy_bsp_tree(bsp_node* tree)
-{
-	if(tree->left_child) destroy_bsp_tree(tree->left_child);
-	if(tree->right_child) destroy_bsp_tree(tree->right_child);
-	free(tree);
-}
-
 bool running = false;
 bool resizing = false;
 bool resized = false;
+camera view_camera;
+bool camera_moved = false;
+//P cycles the present mode and F the frames in flight
+VkPresentModeKHR present_modes[] = {VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR};
+int present_mode_index = 0;
+int frames_in_flight = 2;
+bool presentation_changed = false;
 
 LRESULT CALLBACK WindowEventHandler(HWND window, UINT message, WPARAM wParam, LPARAM lParam)
 {
@@ -142,6 +77,43 @@ LRESULT CALLBACK WindowEventHandler(HWND window, UINT message, WPARAM wParam, LP
 				resized = true;
 			}
 			break;
+		case WM_KEYDOWN:
+		{
+			//The viewport is flipped, so tile y grows up the screen
+			float step = CAMERA_PAN*view_camera.height;
+			if(wParam == VK_LEFT) pan_camera(&view_camera, vec2d{-step, 0.0f});
+			else if(wParam == VK_RIGHT) pan_camera(&view_camera, vec2d{step, 0.0f});
+			else if(wParam == VK_UP) pan_camera(&view_camera, vec2d{0.0f, step});
+			else if(wParam == VK_DOWN) pan_camera(&view_camera, vec2d{0.0f, -step});
+			else if(wParam == 'P')
+			{
+				present_mode_index = (present_mode_index + 1) % (sizeof(present_modes)/sizeof(present_modes[0]));
+				presentation_changed = true;
+			}
+			else if(wParam == 'F')
+			{
+				frames_in_flight = frames_in_flight % 3 + 1;
+				presentation_changed = true;
+			}
+			camera_moved = true;
+			break;
+		}
+		case WM_MOUSEWHEEL:
+		{
+			//Zoom about the tile under the cursor, the window's top row is the view's max_y
+			POINT cursor = {(short)LOWORD(lParam), (short)HIWORD(lParam)};
+			ScreenToClient(window, &cursor);
+			RECT client;
+			GetClientRect(window, &client);
+			if(client.right > 0 && client.bottom > 0)
+			{
+				view_bounds bounds = camera_bounds(&view_camera);
+				vec2d anchor = {bounds.min_x + (bounds.max_x - bounds.min_x)*cursor.x/client.right, bounds.max_y - (bounds.max_y - bounds.min_y)*cursor.y/client.bottom};
+				zoom_camera(&view_camera, (short)HIWORD(wParam) > 0 ? CAMERA_ZOOM : 1.0f/CAMERA_ZOOM, anchor);
+				camera_moved = true;
+			}
+			break;
+		}
 		case WM_DESTROY:
 			printf("DESTROY WINDOW MESSAGE CALLED\n");
 			break;
@@ -197,171 +169,192 @@ graphical_data_buffer buffer_line(vulkan_state* vulkan, vec2d p_0, vec2d p_1, ve
 	return line;
 }
 
-struct timer
-{
-	LARGE_INTEGER frequency;
-	LARGE_INTEGER start;
-	LARGE_INTEGER end;
-};
-
-void start_timer(timer* t)
-{
-	QueryPerformanceFrequency(&t->frequency);
-	QueryPerformanceCounter(&t->start);
-}
-
-void end_timer(timer* t)
-{
-	QueryPerformanceCounter(&t->end);
-}
+tile_graphical_data tgd_table[8] = {};
 
-long int time_elapsed_millisec(timer* t)
+int buffer_partition_lines(vulkan_state* vulkan, bsp_node* node, graphical_data_buffer** line_buffer)
 {
-	LARGE_INTEGER elapsed;
-	elapsed.QuadPart = t->end.QuadPart - t->start.QuadPart;
-	elapsed.QuadPart *= 1000;
-	elapsed.QuadPart /= t->frequency.QuadPart;
+	int partition_count = 0;
+	if(node->left_child && node->right_child)
+	{
+		++partition_count;
+		vec2d p_0 = (node->partition_direction == 0) ? node->right_child->bottom_left : node->left_child->bottom_left;
+		vec2d p_1 = (node->partition_direction == 0) ? node->left_child->top_right + vec2d{1.0f, 1.0f} : node->right_child->top_right + vec2d{1.0f, 1.0f};
+		**line_buffer = buffer_line(vulkan, p_0, p_1, vec3d{1.0f, 0.0f, 0.0f});
+		*line_buffer += 1;
+		partition_count += buffer_partition_lines(vulkan, node->left_child, line_buffer);
+		partition_count += buffer_partition_lines(vulkan, node->right_child, line_buffer);
+	}
+	return partition_count;
 }
 
-long int current_time()
+//Per tile drawing for tooling, the visible rows are split into regions recorded in parallel and the partition lines are one more region
+struct tile_regions
 {
-	timer t;
-	start_timer(&t);
-	return t.start.QuadPart;
-}
-
-#define WALL 0
-#define FLOOR 1
-#define PARTITION 2
-
-char tile_map[128][128] = {};
-tile_graphical_data tgd_table[8] = {};
+	tile_rect visible;
+	int rows_per_region;
+	int tile_region_count;
+	graphical_data_buffer* partition_lines;
+	int partition_count;
+};
 
-//Recursively generates hallways connecting the given node's child nodes
-void generate_hallways(bsp_node* node)
+void record_tile_region(void* data, vulkan_state* vulkan, command_recorder* recorder, int region)
 {
-	//Each hallway is 1 wide and n long
-	//Need to connect from one of the first child's outer floor tile to one of the second's outer floor tile
-	//Take bounding boxes containing all floor tiles of each child, rectangle (minx,miny) (maxx, maxy)
-	//Hallways generated should be single straight lines of floor tiles
-	//The partitions always have matching bounds and are adjacent, but within the bounds of each the rooms may not be aligned along the partition direction
-	
-	//If bounds of both children can be connected by a single line across the partition direction
-	//Generate hallway at random position between overlapping bounds
-	//Else
-	//Either generate hallway connecting random position along bound of first partition in direction perpendicular to the partition direction, to random position along
-	//bound of second partition in the partition direction
-	//or generate hallway along fist partition bound in partition direction, connecting to random position along second bound in direction perpendicular to partition direction
-
-	//If node's children are not leaf nodes
-	//Generate hallways between child nodes
-	if(node->left_child && node->left_child->left_child) generate_hallways(node->left_child);
-	if(node->right_child && node->right_child->right_child) generate_hallways(node->right_child);
-
-	//Get bounds of both children's floor tiles
-	vec2d left_child_room_bounds[2] = {node->left_child->room_bottom_left, node->left_child->room_top_right};
-	vec2d right_child_room_bounds[2] = {node->right_child->room_bottom_left, node->right_child->room_top_right};
-
-	int overlap;
-	int bound_direction = 1 - node->partition_direction;
-	int bound_max = min(left_child_room_bounds[1][bound_direction], right_child_room_bounds[1][bound_direction]);
-	int bound_min = max(left_child_room_bounds[0][bound_direction], right_child_room_bounds[0][bound_direction]);
-	int hallway_position = rng_range(bound_min, bound_max);
-	overlap = max(0, bound_max - bound_min);
-
-	vec2d hallway_center = {}; //Not literal center, just at hallway position along partition line
-	hallway_center[bound_direction] = (float)hallway_position;
-	hallway_center[1-bound_direction] = node->partition_position;
-	if(overlap > 0)
+	tile_regions* regions = (tile_regions*)data;
+	if(region == regions->tile_region_count)
 	{
-
-		if(node->partition_direction == HORIZONTAL)
-		{
-			for(int x = (int)hallway_center.x; tile_map[(int)hallway_center.y][x] == WALL; ++x) tile_map[(int)hallway_center.y][x] = FLOOR;
-			for(int x = (int)hallway_center.x - 1; tile_map[(int)hallway_center.y][x] == WALL; --x) tile_map[(int)hallway_center.y][x] = FLOOR;
-		}
-		else
-		{
-			for(int y = (int)hallway_center.y; tile_map[y][(int)hallway_center.x] == WALL; ++y) tile_map[y][(int)hallway_center.x] = FLOOR;
-			for(int y = (int)hallway_center.y - 1; tile_map[y][(int)hallway_center.x] == WALL; --y) tile_map[y][(int)hallway_center.x] = FLOOR;
-		}
+		record_model_matrix(vulkan, recorder, identity());
+		for(int i = 0; i < regions->partition_count; i++) record_draw_line(vulkan, recorder, &regions->partition_lines[i]);
+		return;
 	}
-	else
+	int first_row = regions->visible.min_y + region*regions->rows_per_region;
+	int last_row = min(first_row + regions->rows_per_region, regions->visible.max_y);
+	for(int i = first_row; i < last_row; i++)
 	{
-		int hallway_position_1_max = (int)right_child_room_bounds[1][node->partition_direction]; //Oriented to different axis to position_0
-		int hallway_position_1_min = (int)right_child_room_bounds[0][node->partition_direction];
-
-		int hallway_position_1 = rng_range(hallway_position_1_min, hallway_position_1_max);
-		
-		vec2d hallway_center_1 = {};
-		hallway_center_1[1-bound_direction] = hallway_position_1;
-		hallway_center_1[bound_direction] = hallway_center[bound_direction];
-		if(node->partition_direction == HORIZONTAL)
+		for(int j = regions->visible.min_x; j < regions->visible.max_x; j++)
 		{
-			for(int x = (int)hallway_center.x-1; tile_map[(int)hallway_center.y][x] == WALL; --x) tile_map[(int)hallway_center.y][x] = FLOOR;
-			for(int x = (int)hallway_center.x; x <= hallway_center_1.x; ++x) tile_map[(int)hallway_center.y][x] = FLOOR;
-			for(int y = (int)hallway_center_1.y; tile_map[y][(int)hallway_center_1.x] == WALL; --y) tile_map[y][(int)hallway_center_1.x] = FLOOR;
-		}
-		else
-		{
-			for(int y = (int)hallway_center.y-1; tile_map[y][(int)hallway_center.x] == WALL; --y) tile_map[y][(int)hallway_center.x] = FLOOR;
-			for(int y = (int)hallway_center.y; y <= hallway_center_1.y; ++y) tile_map[y][(int)hallway_center.x] = FLOOR;
-			for(int x = (int)hallway_center_1.x; tile_map[(int)hallway_center_1.y][x] == WALL; --x) tile_map[(int)hallway_center_1.y][x] = FLOOR;
+			record_model_matrix(vulkan, recorder, translate(vec3d{(float)j, (float)i, 0.0f}));
+			record_draw(vulkan, recorder, &tgd_table[tile_map[i][j]]);
 		}
 	}
-	node->room_bottom_left = {min(node->left_child->room_bottom_left.x, node->right_child->room_bottom_left.x), min(node->left_child->room_bottom_left.y, node->right_child->room_bottom_left.y)};
-	node->room_top_right = {max(node->left_child->room_top_right.x, node->right_child->room_top_right.x), max(node->left_child->room_top_right.y, node->right_child->room_top_right.y)};
 }
 
-void generate_rooms(bsp_node* node)
+//What the instanced path draws each frame
+struct tile_scene
 {
-	//If node is a leaf
-	if(!node->left_child && !node->right_child)
+	tile_pyramid* pyramid;
+	tile_instance_buffer* instances;
+	graphical_data_buffer* partition_lines;
+	int partition_count;
+	tile_raster* raster; //With -gpu-raster, floor tiles drawn from the rasterised dungeon instead of the pyramid
+};
+
+void draw_tile_frame(vulkan_state* vulkan, tile_scene* scene)
+{
+	begin_frame(vulkan);
+	
+	if(scene->raster)
 	{
-		vec2d dimensions = node->top_right - node->bottom_left + vec2d{1.0f, 1.0f};
-
-		int left_side = rng_range(node->bottom_left.x+1, node->top_right.x-MIN_ROOM+1);
-		int right_side = rng_range(left_side+MIN_ROOM, node->top_right.x+1);
-		int bottom_side = rng_range(node->bottom_left.y+1, node->top_right.y-MIN_ROOM+1);
-		int top_side = rng_range(bottom_side+MIN_ROOM, node->top_right.y+1);
-		node->room_bottom_left = vec2d{left_side, bottom_side};
-		node->room_top_right = vec2d{right_side, top_side};
-		for(int i = bottom_side; i < top_side; i++) for(int j = left_side; j < right_side; j++) tile_map[i][j] = FLOOR;
+		//The raster's tiles pick each instance's colour, so one draw covers walls and floor
+		draw_raster_tiles(vulkan, &tgd_table[FLOOR], scene->raster, visible_tiles(&view_camera, MAP_SIZE, MAP_SIZE));
+		flush_draws(vulkan);
+		gpu_timestamp(vulkan, "tiles");
+		push_model_matrix(vulkan, identity());
+		for(int i = 0; i < scene->partition_count; i++) draw_line(vulkan, &scene->partition_lines[i]);
+		gpu_timestamp(vulkan, "lines");
+		render_frame(vulkan);
+		return;
 	}
-	else
+	//Offsets of the tiles on screen in one pass, then one instanced draw per tile type
+	//Zoomed out, tiles come from the pyramid level whose tiles are about a pixel, so no more are drawn than there are pixels
+	tile_pyramid* pyramid = scene->pyramid;
+	int level = pyramid_level_for(pyramid, view_camera.height/vulkan->swapchain_extent.height);
+	tile_rect visible = pyramid_level_rect(visible_tiles(&view_camera, MAP_SIZE, MAP_SIZE), level);
+	tile_batch batch;
+	batch_tile_rect_offsets(pyramid->levels[level], pyramid->widths[level], visible.min_x, visible.min_y, visible.max_x, visible.max_y, current_tile_offsets(vulkan, scene->instances), &batch);
+	push_model_matrix(vulkan, scale((float)(1 << level)));
+	for(int t = 0; t < TILE_BATCH_MAX_TYPES; t++) draw_tiles(vulkan, &tgd_table[t], scene->instances, batch.first[t], batch.count[t]);
+	//Lines go over the tiles, so the tiles are recorded before any line is queued
+	flush_draws(vulkan);
+	gpu_timestamp(vulkan, "tiles");
+	push_model_matrix(vulkan, identity());
+	for(int i = 0; i < scene->partition_count; i++)
 	{
-		generate_rooms(node->left_child);
-		generate_rooms(node->right_child);
+		draw_line(vulkan, &scene->partition_lines[i]);
 	}
+	gpu_timestamp(vulkan, "lines");
+
+	render_frame(vulkan);
 }
 
-bsp_node* generate_dungeon()
+//Each present mode the surface supports with 1 to 3 frames in flight, drawing as fast as each presents
+//Latency is from a frame beginning, when its input would be taken, to the GPU finishing it
+void benchmark_presentation(vulkan_state* vulkan, tile_scene* scene)
 {
-	for(int i = 0; i < 128; i++) for(int j = 0; j < 128; j++) tile_map[i][j] = WALL;
-	bsp_node* tree = generate_bsp_tree(vec2d{0.0f, 0.0f}, vec2d{127.0f, 127.0f});
-	generate_rooms(tree);
-	generate_hallways(tree);
-	return tree;
+	printf("%-10s %6s %10s %14s %14s\n", "Present", "Frames", "FPS", "Latency ms", "Worst ms");
+	for(int m = 0; m < sizeof(present_modes)/sizeof(present_modes[0]); m++)
+	{
+		if(!present_mode_supported(vulkan, present_modes[m]))
+		{
+			printf("%-10s not supported\n", present_mode_name(present_modes[m]));
+			continue;
+		}
+		for(int frames = 1; frames <= 3; frames++)
+		{
+			if(configure_presentation(vulkan, present_modes[m], frames))
+			{
+				printf("%-10s %6d failed\n", present_mode_name(present_modes[m]), frames);
+				continue;
+			}
+			timer t;
+			int64_t latency_total = 0;
+			int64_t latency_worst = 0;
+			int latency_count = 0;
+			for(int i = 0; i < LATENCY_WARMUP_FRAMES + LATENCY_FRAMES; i++)
+			{
+				if(i == LATENCY_WARMUP_FRAMES) start_timer(&t);
+				MSG message;
+				while(PeekMessage(&message, 0, 0, 0, PM_REMOVE))
+				{
+					TranslateMessage(&message);
+					DispatchMessage(&message);
+				}
+				draw_tile_frame(vulkan, scene);
+				if(i >= LATENCY_WARMUP_FRAMES && vulkan->timings.latency_valid)
+				{
+					latency_total += vulkan->timings.latency_microsec;
+					if(vulkan->timings.latency_microsec > latency_worst) latency_worst = vulkan->timings.latency_microsec;
+					latency_count++;
+				}
+			}
+			end_timer(&t);
+			int64_t elapsed = time_elapsed_microsec(&t);
+			float fps = LATENCY_FRAMES*1000000.0f/(elapsed > 0 ? elapsed : 1);
+			if(latency_count) printf("%-10s %6d %10.1f %14.2f %14.2f\n", present_mode_name(present_modes[m]), frames, fps, latency_total/1000.0/latency_count, latency_worst/1000.0);
+			else printf("%-10s %6d %10.1f %14s %14s\n", present_mode_name(present_modes[m]), frames, fps, "n/a", "n/a");
+		}
+	}
 }
 
-int buffer_partition_lines(vulkan_state* vulkan, bsp_node* node, graphical_data_buffer** line_buffer)
+//Rasterises many seeds' floor rects on the GPU and compares the tiles with rasterize_rects() and the generator's own tile_map
+//Returns the number of dungeons that differ
+int check_gpu_raster(vulkan_state* vulkan, tile_raster* raster)
 {
-	int partition_count = 0;
-	if(node->left_child && node->right_child)
+	dungeon* d = (dungeon*)malloc(sizeof(dungeon));
+	tile_rect* rects = (tile_rect*)malloc(MAX_FLOOR_RECTS*sizeof(tile_rect));
+	char* reference = (char*)malloc(MAP_SIZE*MAP_SIZE);
+	char* tiles = (char*)malloc(MAP_SIZE*MAP_SIZE);
+	int mismatches = 0;
+	int64_t cpu_microsec = 0;
+	int64_t gpu_microsec = 0;
+	for(int i = 0; i < RASTER_CHECK_DUNGEONS; i++)
 	{
-		++partition_count;
-		vec2d p_0 = (node->partition_direction == 0) ? node->right_child->bottom_left : node->left_child->bottom_left;
-		vec2d p_1 = (node->partition_direction == 0) ? node->left_child->top_right + vec2d{1.0f, 1.0f} : node->right_child->top_right + vec2d{1.0f, 1.0f};
-		p_0.x = (p_0.x / 64.0f) - 1.0f;
-		p_0.y = (p_0.y / 64.0f) - 1.0f;
-		p_1.x = (p_1.x / 64.0f) - 1.0f;
-		p_1.y = (p_1.y / 64.0f) - 1.0f;
-		**line_buffer = buffer_line(vulkan, p_0, p_1, vec3d{1.0f, 0.0f, 0.0f});
-		*line_buffer += 1;
-		partition_count += buffer_partition_lines(vulkan, node->left_child, line_buffer);
-		partition_count += buffer_partition_lines(vulkan, node->right_child, line_buffer);
+		seed_rng(i);
+		generate_dungeon(d);
+		int rect_count = gather_floor_rects(d, rects);
+		timer t;
+		start_timer(&t);
+		rasterize_rects(rects, rect_count, MAP_SIZE, MAP_SIZE, reference);
+		end_timer(&t);
+		cpu_microsec += time_elapsed_microsec(&t);
+		start_timer(&t);
+		VkResult result = rasterize_tiles(vulkan, raster, rects, rect_count);
+		end_timer(&t);
+		gpu_microsec += time_elapsed_microsec(&t);
+		if(result == VK_SUCCESS) result = read_raster_tiles(vulkan, raster, tiles);
+		if(result != VK_SUCCESS || memcmp(tiles, reference, MAP_SIZE*MAP_SIZE) || memcmp(reference, &tile_map[0][0], MAP_SIZE*MAP_SIZE))
+		{
+			printf("Seed %d rasterised differently\n", i);
+			mismatches++;
+		}
+		destroy_dungeon(d);
 	}
-	return partition_count;
+	printf("%d of %d dungeons differ, rasterize_rects %.1f us, rasterize_tiles %.1f us per dungeon\n", mismatches, RASTER_CHECK_DUNGEONS,
+		(double)cpu_microsec/RASTER_CHECK_DUNGEONS, (double)gpu_microsec/RASTER_CHECK_DUNGEONS);
+	free(tiles);
+	free(reference);
+	free(rects);
+	free(d);
+	return mismatches;
 }
 
 int APIENTRY WinMain(HINSTANCE hinstance, HINSTANCE prevInstance, LPSTR lpCmdLine, int nCmdShow)
@@ -372,9 +365,27 @@ int APIENTRY WinMain(HINSTANCE hinstance, HINSTANCE prevInstance, LPSTR lpCmdLin
 	window_class.lpfnWndProc = WindowEventHandler;
 	window_class.lpszClassName = "DungeonGeneratorClass";
 
-	timer t;
-
 	seed_rng(current_time());
+	if(strstr(lpCmdLine, "-bench"))
+	{
+		run_benchmarks();
+		return 0;
+	}
+	if(strstr(lpCmdLine, "-serve"))
+	{
+		//Runs until the process is killed, printing the service's stats every few seconds
+		dungeon_service* service = (dungeon_service*)malloc(sizeof(dungeon_service));
+		create_dungeon_service(service, make_runtime_config(default_dungeon_config()));
+		if(!start_service_pipe(service)) return -1;
+		printf("Serving on %s with %d workers\n", SERVICE_PIPE_NAME, service->worker_count);
+		for(;;)
+		{
+			Sleep(5000);
+			service_stats stats;
+			get_service_stats(service, &stats);
+			print_service_stats(&stats);
+		}
+	}
 	if(RegisterClass(&window_class))
 	{
 		//Set window attributes
@@ -383,21 +394,73 @@ int APIENTRY WinMain(HINSTANCE hinstance, HINSTANCE prevInstance, LPSTR lpCmdLin
 				WINDOW_WIDTH, WINDOW_HEIGHT, 0, 0, prevInstance, 0);
 		if(window)
 		{
+			//-present fifo|mailbox|immediate and -frames 1 to MAX_FRAMES_COMPUTED_AT_ONCE
+			const char* present_option = strstr(lpCmdLine, "-present ");
+			if(present_option)
+			{
+				for(int m = 0; m < sizeof(present_modes)/sizeof(present_modes[0]); m++)
+				{
+					const char* name = present_mode_name(present_modes[m]);
+					if(strncmp(present_option + 9, name, strlen(name)) == 0) present_mode_index = m;
+				}
+			}
+			const char* frames_option = strstr(lpCmdLine, "-frames ");
+			if(frames_option) frames_in_flight = atoi(frames_option + 8);
+
 			vulkan_state vulkan;
-			uint8_t vulkan_startup_result = startup_vulkan(&vulkan, window, hinstance);
+			timer startup;
+			start_timer(&startup);
+			uint8_t vulkan_startup_result = startup_vulkan(&vulkan, window, hinstance, present_modes[present_mode_index], frames_in_flight);
+			end_timer(&startup);
 			if(vulkan_startup_result != 0)
 			{
 				printf("Vulkan startup failed\n");
 				return -1;
 			}
+			printf("Vulkan started in %ld ms, presenting %s with %d frames in flight\n", time_elapsed_millisec(&startup), present_mode_name(vulkan.present_mode), vulkan.frames_in_flight);
 
 			//Load tile graphical data
 			tgd_table[PARTITION] = buffer_rect(&vulkan, vec3d{0.5f, 0.5f, 0.5f});
 			tgd_table[WALL] = buffer_rect(&vulkan, vec3d{0.0f, 0.0f, 0.0f});
 			tgd_table[FLOOR] = buffer_rect(&vulkan, vec3d{1.0f, 1.0f, 1.0f});
 
-			mat4 ortho = orthographic_projection(0.0f, 128.0f, 0.0f, 128.0f, -1.0f, 1.0f);
-			update_world_matrix(&vulkan, identity(), ortho);
+			//-regions draws tile by tile through the region recorder instead of the instanced batch
+			bool draw_regions = strstr(lpCmdLine, "-regions") != NULL;
+			region_recorder recorder;
+			if(draw_regions && create_region_recorder(&vulkan, &recorder) != VK_SUCCESS)
+			{
+				printf("Region recorder not created\n");
+				return -1;
+			}
+
+			//-gpu-raster draws the dungeon from tiles rasterised by a compute shader, -raster-check compares those tiles with the CPU's and exits
+			bool gpu_raster = strstr(lpCmdLine, "-gpu-raster") || strstr(lpCmdLine, "-raster-check");
+			tile_raster raster = {};
+			if(gpu_raster && create_tile_raster(&vulkan, &raster, MAP_SIZE, MAP_SIZE, MAX_FLOOR_RECTS) != VK_SUCCESS)
+			{
+				printf("Tile raster not created\n");
+				return -1;
+			}
+			if(strstr(lpCmdLine, "-raster-check"))
+			{
+				int mismatches = check_gpu_raster(&vulkan, &raster);
+				destroy_tile_raster(&vulkan, &raster);
+				destroy_graphical_data(&vulkan, &tgd_table[PARTITION]);
+				destroy_graphical_data(&vulkan, &tgd_table[FLOOR]);
+				destroy_graphical_data(&vulkan, &tgd_table[WALL]);
+				shutdown_vulkan(&vulkan);
+				return mismatches ? -1 : 0;
+			}
+
+			tile_instance_buffer tile_instances;
+			if(create_tile_instance_buffer(&vulkan, &tile_instances, MAP_SIZE*MAP_SIZE) != VK_SUCCESS)
+			{
+				printf("Tile instance buffer not created\n");
+				return -1;
+			}
+
+			view_camera = make_camera(vec2d{0.5f*MAP_SIZE, 0.5f*MAP_SIZE}, (float)MAP_SIZE, (float)vulkan.swapchain_extent.width/vulkan.swapchain_extent.height);
+			camera_moved = true;
 			for(int i = 0; i < 128; i++)
 			{
 				for(int j = 0; j < 128; j++)
@@ -407,14 +470,36 @@ int APIENTRY WinMain(HINSTANCE hinstance, HINSTANCE prevInstance, LPSTR lpCmdLin
 			}
 
 			//Set partition lines in grid
-			bsp_node* tree = generate_dungeon();
+			dungeon* generated_dungeon = (dungeon*)malloc(sizeof(dungeon));
+			generate_dungeon(generated_dungeon);
+			connectivity_validator validator;
+			connectivity_stats stats;
+			create_connectivity_validator(&validator, MAP_SIZE, MAP_SIZE);
+			if(!validate_dungeon(&validator, generated_dungeon, &tile_map[0][0], &stats)) printf("Dungeon has unreachable rooms\n");
+			print_connectivity_stats(&stats);
+			destroy_connectivity_validator(&validator);
+			tile_pyramid pyramid;
+			create_tile_pyramid(&pyramid, &tile_map[0][0], MAP_SIZE, MAP_SIZE);
+			bsp_node* tree = generated_dungeon->tree;
 			graphical_data_buffer partition_lines[2048] = {};
 			graphical_data_buffer* partition_lines_buffer = &partition_lines[0];
 			int partition_count = 0;
 
 			partition_count = buffer_partition_lines(&vulkan, tree, &partition_lines_buffer);
+			tile_scene scene = {&pyramid, &tile_instances, partition_lines, partition_count, NULL};
+			if(gpu_raster)
+			{
+				tile_rect* rects = (tile_rect*)malloc(MAX_FLOOR_RECTS*sizeof(tile_rect));
+				int rect_count = gather_floor_rects(generated_dungeon, rects);
+				if(rasterize_tiles(&vulkan, &raster, rects, rect_count) == VK_SUCCESS) scene.raster = &raster;
+				else printf("Dungeon not rasterised, drawing the tile pyramid\n");
+				free(rects);
+			}
 
-			running = true;
+			running = !strstr(lpCmdLine, "-latency");
+			if(!running) benchmark_presentation(&vulkan, &scene);
+			timer timings_timer;
+			start_timer(&timings_timer);
 
 			//Window event handle loop
 			while(running)
@@ -429,43 +514,64 @@ int APIENTRY WinMain(HINSTANCE hinstance, HINSTANCE prevInstance, LPSTR lpCmdLin
 					DispatchMessage(&message);
 				}
 
-				start_timer(&t);
-				if(resized)
+				//Frame timings in the title, the GPU's are from a frame or two back
+				end_timer(&timings_timer);
+				if(time_elapsed_millisec(&timings_timer) >= TIMINGS_INTERVAL)
 				{
-					complete_graphical_tasks(&vulkan);
-					resize_window(&vulkan);
-					resized = false;
+					char title[256];
+					format_frame_timings(&vulkan.timings, title, sizeof(title));
+					SetWindowTextA(window, title);
+					start_timer(&timings_timer);
 				}
 
-				begin_frame(&vulkan);
-				
-				for(int i = 0; i < 128; i++)
+				if(presentation_changed)
 				{
-					for(int j = 0; j < 128; j++)
+					if(configure_presentation(&vulkan, present_modes[present_mode_index], frames_in_flight))
 					{
-						vec3d position = {(float)j, (float)i, 0.0f};
-						mat4 translation = translate(position);
-						push_model_matrix(&vulkan, translation);
-						draw(&vulkan, &tgd_table[tile_map[i][j]]);
+						printf("Presentation not configured\n");
+						break;
 					}
+					printf("Presenting %s with %d frames in flight\n", present_mode_name(vulkan.present_mode), vulkan.frames_in_flight);
+					presentation_changed = false;
 				}
-				push_model_matrix(&vulkan, identity());
-				for(int i = 0; i < partition_count; i++)
+				if(resized)
 				{
-					draw_line(&vulkan, &partition_lines[i]);
+					complete_graphical_tasks(&vulkan);
+					resize_window(&vulkan);
+					resized = false;
+					view_camera.aspect = (float)vulkan.swapchain_extent.width/vulkan.swapchain_extent.height;
+					camera_moved = true;
+				}
+				if(camera_moved)
+				{
+					update_world_matrix(&vulkan, camera_view(&view_camera), camera_projection(&view_camera));
+					camera_moved = false;
 				}
 
-				end_timer(&t);
-				long int elapsed = time_elapsed_millisec(&t);
-				//printf("Time elapsed = %ld\n", elapsed);
-				render_frame(&vulkan);
+				if(draw_regions)
+				{
+					tile_regions regions = {visible_tiles(&view_camera, MAP_SIZE, MAP_SIZE), REGION_ROWS, 0, partition_lines, partition_count};
+					int rows = regions.visible.max_y - regions.visible.min_y;
+					regions.rows_per_region = max(REGION_ROWS, (rows + RECORD_MAX_REGIONS - 2)/(RECORD_MAX_REGIONS - 1));
+					regions.tile_region_count = (rows + regions.rows_per_region - 1)/regions.rows_per_region;
+					begin_frame(&vulkan, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+					record_regions(&vulkan, &recorder, regions.tile_region_count + 1, record_tile_region, &regions);
+					render_frame(&vulkan);
+					continue;
+				}
 
+				draw_tile_frame(&vulkan, &scene);
 			}
 			complete_graphical_tasks(&vulkan);
 
-			destroy_bsp_tree(tree);
+			destroy_tile_pyramid(&pyramid);
+			destroy_dungeon(generated_dungeon);
+			free(generated_dungeon);
 			for(int i = 0; i < partition_count; i++) destroy_graphical_data(&vulkan, &partition_lines[i]);
 
+			destroy_tile_instance_buffer(&vulkan, &tile_instances);
+			if(gpu_raster) destroy_tile_raster(&vulkan, &raster);
+			if(draw_regions) destroy_region_recorder(&vulkan, &recorder);
 			destroy_graphical_data(&vulkan, &tgd_table[PARTITION]);
 			destroy_graphical_data(&vulkan, &tgd_table[FLOOR]);
 			destroy_graphical_data(&vulkan, &tgd_table[WALL]);
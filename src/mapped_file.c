@@ -0,0 +1,36 @@
+#include "mapped_file.h"
+
+bool map_file(mapped_file* mapped, const char* path)
+{
+	*mapped = {};
+	mapped->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(mapped->file == INVALID_HANDLE_VALUE) return false;
+
+	//Empty files can't be mapped
+	LARGE_INTEGER size;
+	if(!GetFileSizeEx(mapped->file, &size) || size.QuadPart == 0 || size.QuadPart > 0xFFFFFFFF)
+	{
+		CloseHandle(mapped->file);
+		return false;
+	}
+	mapped->size = (uint32_t)size.QuadPart;
+
+	mapped->mapping = CreateFileMappingA(mapped->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if(mapped->mapping) mapped->data = MapViewOfFile(mapped->mapping, FILE_MAP_READ, 0, 0, 0);
+	if(!mapped->data)
+	{
+		if(mapped->mapping) CloseHandle(mapped->mapping);
+		CloseHandle(mapped->file);
+		*mapped = {};
+		return false;
+	}
+	return true;
+}
+
+void unmap_file(mapped_file* mapped)
+{
+	if(mapped->data) UnmapViewOfFile(mapped->data);
+	if(mapped->mapping) CloseHandle(mapped->mapping);
+	if(mapped->file && mapped->file != INVALID_HANDLE_VALUE) CloseHandle(mapped->file);
+	*mapped = {};
+}
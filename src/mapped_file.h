@@ -0,0 +1,15 @@
+#pragma once
+#include <windows.h>
+#include <stdint.h>
+
+//Read only view of a whole file
+struct mapped_file
+{
+	HANDLE file;
+	HANDLE mapping;
+	const void* data;
+	uint32_t size;
+};
+
+bool map_file(mapped_file*, const char* path);
+void unmap_file(mapped_file*);
@@ -1,42 +1,199 @@
 #include "maths.h"
+#include "simd.h"
+#include "jobs.h"
+#include <stdlib.h>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
 
+//Each column of the product is m_0's columns weighted by the matching column of m_1
 mat4 operator*(mat4 m_0, mat4 m_1)
 {
-	mat4 m_2 = {};
+	mat4 m_2;
+	float4 c_0 = load_float4(m_0[0].xyzw);
+	float4 c_1 = load_float4(m_0[1].xyzw);
+	float4 c_2 = load_float4(m_0[2].xyzw);
+	float4 c_3 = load_float4(m_0[3].xyzw);
 	for(int col = 0; col < 4; col++)
 	{
-		for(int row = 0; row < 4; row++)
+		float4 weights = load_float4(m_1[col].xyzw);
+		float4 column = multiply_float4(c_0, splat_lane<0>(weights));
+		column = multiply_add_float4(c_1, splat_lane<1>(weights), column);
+		column = multiply_add_float4(c_2, splat_lane<2>(weights), column);
+		column = multiply_add_float4(c_3, splat_lane<3>(weights), column);
+		store_float4(m_2[col].xyzw, column);
+	}
+	return m_2;
+}
+
+vec4d operator*(mat4 m, vec4d v)
+{
+	vec4d transformed;
+	float4 weights = load_float4(v.xyzw);
+	float4 result = multiply_float4(load_float4(m[0].xyzw), splat_lane<0>(weights));
+	result = multiply_add_float4(load_float4(m[1].xyzw), splat_lane<1>(weights), result);
+	result = multiply_add_float4(load_float4(m[2].xyzw), splat_lane<2>(weights), result);
+	result = multiply_add_float4(load_float4(m[3].xyzw), splat_lane<3>(weights), result);
+	store_float4(transformed.xyzw, result);
+	return transformed;
+}
+
+//The matrix's columns stay in registers for the whole batch
+void transform_vectors(mat4* m, const vec4d* in, vec4d* out, int count)
+{
+	int i = 0;
+#ifdef __AVX__
+	//Two vectors at a time, one in each 128 bit half, with every column repeated in both halves
+	__m256 columns[4];
+	for(int col = 0; col < 4; col++) columns[col] = _mm256_broadcast_ps((const __m128*)(*m)[col].xyzw);
+	for(; i + 2 <= count; i += 2)
+	{
+		__m256 vectors = _mm256_loadu_ps(in[i].xyzw);
+		__m256 result = _mm256_mul_ps(columns[0], _mm256_permute_ps(vectors, 0x00));
+		result = _mm256_add_ps(result, _mm256_mul_ps(columns[1], _mm256_permute_ps(vectors, 0x55)));
+		result = _mm256_add_ps(result, _mm256_mul_ps(columns[2], _mm256_permute_ps(vectors, 0xAA)));
+		result = _mm256_add_ps(result, _mm256_mul_ps(columns[3], _mm256_permute_ps(vectors, 0xFF)));
+		_mm256_storeu_ps(out[i].xyzw, result);
+	}
+#endif
+	float4 c_0 = load_float4((*m)[0].xyzw);
+	float4 c_1 = load_float4((*m)[1].xyzw);
+	float4 c_2 = load_float4((*m)[2].xyzw);
+	float4 c_3 = load_float4((*m)[3].xyzw);
+	for(; i < count; i++)
+	{
+		float4 weights = load_float4(in[i].xyzw);
+		float4 result = multiply_float4(c_0, splat_lane<0>(weights));
+		result = multiply_add_float4(c_1, splat_lane<1>(weights), result);
+		result = multiply_add_float4(c_2, splat_lane<2>(weights), result);
+		result = multiply_add_float4(c_3, splat_lane<3>(weights), result);
+		store_float4(out[i].xyzw, result);
+	}
+}
+
+//vec3d is 12 bytes, so each component is broadcast from memory rather than loaded as a vector and shuffled
+void transform_positions(mat4* m, const vec3d* in, vec4d* out, int count)
+{
+	float4 c_0 = load_float4((*m)[0].xyzw);
+	float4 c_1 = load_float4((*m)[1].xyzw);
+	float4 c_2 = load_float4((*m)[2].xyzw);
+	float4 c_3 = load_float4((*m)[3].xyzw);
+	for(int i = 0; i < count; i++)
+	{
+		float4 result = multiply_add_float4(c_0, splat_float4(in[i].x), c_3);
+		result = multiply_add_float4(c_1, splat_float4(in[i].y), result);
+		result = multiply_add_float4(c_2, splat_float4(in[i].z), result);
+		store_float4(out[i].xyzw, result);
+	}
+}
+
+//Two offsets per store, the offsets are counted up rather than converted from ints one at a time
+void write_row_offsets(float x, float y, int count, vec2d* out)
+{
+	float first_pair[4] = {x, y, x + 1.0f, y};
+	float step[4] = {2.0f, 0.0f, 2.0f, 0.0f};
+	float4 pair = load_float4(first_pair);
+	float4 pair_step = load_float4(step);
+	int i = 0;
+	for(; i + 2 <= count; i += 2)
+	{
+		store_float4(out[i].xy, pair);
+		pair = add_float4(pair, pair_step);
+	}
+	if(i < count) out[i] = vec2d{x + (float)i, y};
+}
+
+struct tile_batch_job
+{
+	const char* tiles;
+	int map_width;
+	int min_x;
+	int min_y;
+	int max_x;
+	int max_y;
+	vec2d* out;
+	int* band_counts; //TILE_BATCH_MAX_TYPES per band, then the band's first instance of each type
+};
+
+void count_tile_band(void* data, int band)
+{
+	tile_batch_job* job = (tile_batch_job*)data;
+	int* counts = job->band_counts + band*TILE_BATCH_MAX_TYPES;
+	for(int t = 0; t < TILE_BATCH_MAX_TYPES; t++) counts[t] = 0;
+	int first_row = job->min_y + band*TILE_BATCH_BAND_ROWS;
+	int last_row = min(first_row + TILE_BATCH_BAND_ROWS, job->max_y);
+	for(int y = first_row; y < last_row; y++)
+	{
+		const unsigned char* row = (const unsigned char*)job->tiles + y*job->map_width;
+		for(int x = job->min_x; x < job->max_x; x++)
 		{
-			for(int i = 0; i < 4; i++)
-			{
-				m_2[col][row] += m_0[i][row]*m_1[col][i];
-			}
+			if(row[x] < TILE_BATCH_MAX_TYPES) counts[row[x]]++;
 		}
 	}
-	return m_2;
 }
 
-mat4 identity()
+//Runs of one type along a row land next to each other in that type's range, so each run is one write_row_offsets()
+void write_tile_band(void* data, int band)
 {
-	mat4 m;
-	for(int i = 0; i < 4; i++)
+	tile_batch_job* job = (tile_batch_job*)data;
+	int* cursors = job->band_counts + band*TILE_BATCH_MAX_TYPES;
+	int first_row = job->min_y + band*TILE_BATCH_BAND_ROWS;
+	int last_row = min(first_row + TILE_BATCH_BAND_ROWS, job->max_y);
+	for(int y = first_row; y < last_row; y++)
 	{
-		for(int j = 0; j < 4; j++)
+		const unsigned char* row = (const unsigned char*)job->tiles + y*job->map_width;
+		int x = job->min_x;
+		while(x < job->max_x)
 		{
-			if(i == j) 
-			{
-				m[i][j] = 1.0f;
-			}
-			else m[i][j] = 0.0f;
+			int run_start = x;
+			unsigned char type = row[x];
+			while(x < job->max_x && row[x] == type) x++;
+			if(type >= TILE_BATCH_MAX_TYPES) continue;
+			write_row_offsets((float)run_start, (float)y, x - run_start, job->out + cursors[type]);
+			cursors[type] += x - run_start;
 		}
 	}
+}
+
+//Bands are counted, each band's counts become its first instance of each type, then bands write their runs in place
+//Both passes split across threads the same way, no band writes where another does
+void batch_tile_rect_offsets(const char* tiles, int map_width, int min_x, int min_y, int max_x, int max_y, vec2d* out, tile_batch* batch, int thread_count)
+{
+	int band_count = (max_x > min_x && max_y > min_y) ? (max_y - min_y + TILE_BATCH_BAND_ROWS - 1)/TILE_BATCH_BAND_ROWS : 0;
+	tile_batch_job job = {tiles, map_width, min_x, min_y, max_x, max_y, out, (int*)malloc(band_count*TILE_BATCH_MAX_TYPES*sizeof(int))};
+	if((max_x - min_x)*(max_y - min_y) < TILE_BATCH_PARALLEL_TILES) thread_count = 1;
+	parallel_for(band_count, count_tile_band, &job, thread_count);
+
+	int next = 0;
+	for(int t = 0; t < TILE_BATCH_MAX_TYPES; t++)
+	{
+		batch->first[t] = next;
+		for(int band = 0; band < band_count; band++)
+		{
+			int count = job.band_counts[band*TILE_BATCH_MAX_TYPES + t];
+			job.band_counts[band*TILE_BATCH_MAX_TYPES + t] = next;
+			next += count;
+		}
+		batch->count[t] = next - batch->first[t];
+	}
+	parallel_for(band_count, write_tile_band, &job, thread_count);
+	free(job.band_counts);
+}
+
+void batch_tile_offsets(const char* tiles, int width, int height, vec2d* out, tile_batch* batch, int thread_count)
+{
+	batch_tile_rect_offsets(tiles, width, 0, 0, width, height, out, batch, thread_count);
+}
+
+mat4 identity()
+{
+	mat4 m = {{{1.0f, 0.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 0.0f, 1.0f}}};
 	return m;
 }
 
 mat4 translate(vec3d v)
 {
-	mat4 m = identity();
-	m[3].xyz = v;
+	mat4 m = {{{1.0f, 0.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f, 0.0f}, {v.x, v.y, v.z, 1.0f}}};
 	return m;
 }
 
@@ -105,6 +262,16 @@ vec3d cross(vec3d v_0, vec3d v_1)
 	return c;
 }
 
+int max(int n, int m)
+{
+	return (n >= m) ? n : m;
+}
+
+int min(int n, int m)
+{
+	return (n <= m) ? n : m;
+}
+
 vec2d operator-(vec2d v_0, vec2d v_1)
 {
 	vec2d v;
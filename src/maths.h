@@ -52,7 +52,9 @@ struct vec3d
 	}
 };
 
-struct vec4d
+//16 byte aligned so vectors and matrix columns load as one SIMD register
+//malloc only promises 8 bytes on 32 bit builds, arrays of these and of mat4 come from _aligned_malloc()
+struct alignas(16) vec4d
 {
 	union
 	{
@@ -85,18 +87,11 @@ struct vec4d
 	}
 };
 
-struct mat4
+//Column major
+struct alignas(16) mat4
 {
 	vec4d _m[4];
 
-	mat4& operator=(mat4 m)
-	{
-		float* p_this = (float*)this;
-		float* p_m = (float*)&m;
-		for(int i = 0; i < 16; i++) p_this[i] = p_m[i];
-		return *this;
-	}
-
 	vec4d& operator[](int column)
 	{
 		return _m[column];
@@ -107,14 +102,6 @@ struct mat3
 {
 	vec3d _m[3];
 
-	mat3& operator=(mat3 m)
-	{
-		float* p_this = (float*)this;
-		float* p_m = (float*)&m;
-		for(int i = 0; i < 3; i++) p_this[i] = p_m[i];
-		return *this;
-	}
-
 	vec3d& operator[](int column)
 	{
 		return _m[column];
@@ -122,6 +109,32 @@ struct mat3
 };
 
 mat4 operator*(mat4,mat4);
+vec4d operator*(mat4,vec4d);
+
+//Batch transforms, count vectors from in to out, which may be the same array
+void transform_vectors(mat4*, const vec4d* in, vec4d* out, int count);
+//Positions are transformed with w = 1
+void transform_positions(mat4*, const vec3d* in, vec4d* out, int count);
+
+#define TILE_BATCH_MAX_TYPES 8
+#define TILE_BATCH_BAND_ROWS 32 //Rows counted and written together by one job
+#define TILE_BATCH_PARALLEL_TILES (512*512) //Smaller grids are batched on the calling thread, starting threads costs more than they save
+
+//Where each tile type's instances are in a batch, type t is count[t] offsets from first[t]
+struct tile_batch
+{
+	int first[TILE_BATCH_MAX_TYPES];
+	int count[TILE_BATCH_MAX_TYPES];
+};
+
+//Writes {x, x + 1, ..., x + count - 1} at height y as count offsets
+void write_row_offsets(float x, float y, int count, vec2d* out);
+//Writes the offset {x, y} of every tile of a width*height grid into out, grouped by tile type and row major within each type
+//This is the translation of every tile's model matrix, so a whole grid is drawn as one instanced draw per type
+//Tiles of TILE_BATCH_MAX_TYPES and above are left out
+void batch_tile_offsets(const char* tiles, int width, int height, vec2d* out, tile_batch*, int thread_count = 0);
+//The same for only the tiles in [min_x, max_x) by [min_y, max_y) of a map map_width tiles wide, offsets are still map positions
+void batch_tile_rect_offsets(const char* tiles, int map_width, int min_x, int min_y, int max_x, int max_y, vec2d* out, tile_batch*, int thread_count = 0);
 
 mat4 identity();
 mat4 translate(vec3d);
@@ -134,6 +147,9 @@ mat4 look_at(vec3d position, vec3d target, vec3d up);
 float dot(vec3d, vec3d);
 vec3d cross(vec3d, vec3d);
 
+int max(int, int);
+int min(int, int);
+
 vec2d operator-(vec2d,vec2d);
 vec2d operator+(vec2d,vec2d);
 
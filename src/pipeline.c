@@ -0,0 +1,285 @@
+#include "pipeline.h"
+#include "jobs.h"
+
+int take_free_buffer(dungeon_pipeline* pipeline)
+{
+	WaitForSingleObject(pipeline->free_count, INFINITE);
+	EnterCriticalSection(&pipeline->free_lock);
+	int buffer = pipeline->free_buffers[--pipeline->free_top];
+	LeaveCriticalSection(&pipeline->free_lock);
+	return buffer;
+}
+
+void return_free_buffer(dungeon_pipeline* pipeline, int buffer)
+{
+	EnterCriticalSection(&pipeline->free_lock);
+	pipeline->free_buffers[pipeline->free_top++] = buffer;
+	LeaveCriticalSection(&pipeline->free_lock);
+	ReleaseSemaphore(pipeline->free_count, 1, NULL);
+}
+
+void queue_filled_buffer(dungeon_pipeline* pipeline, int buffer)
+{
+	EnterCriticalSection(&pipeline->filled_lock);
+	pipeline->filled_buffers[(pipeline->filled_start + pipeline->filled_size++) % PIPELINE_BUFFERS] = buffer;
+	LeaveCriticalSection(&pipeline->filled_lock);
+	ReleaseSemaphore(pipeline->filled_count, 1, NULL);
+}
+
+//Called once a count has been taken from filled_count
+int take_filled_buffer(dungeon_pipeline* pipeline)
+{
+	EnterCriticalSection(&pipeline->filled_lock);
+	int buffer = pipeline->filled_buffers[pipeline->filled_start];
+	pipeline->filled_start = (pipeline->filled_start + 1) % PIPELINE_BUFFERS;
+	pipeline->filled_size--;
+	LeaveCriticalSection(&pipeline->filled_lock);
+	return buffer;
+}
+
+DWORD WINAPI pipeline_generator(LPVOID parameter)
+{
+	dungeon_pipeline* pipeline = (dungeon_pipeline*)parameter;
+	dungeon_batch batch;
+	create_dungeon_batch(&batch, pipeline->config);
+	uint32_t seeds[BATCH_LANES];
+	int64_t generating = 0;
+	int64_t stalls = 0;
+	timer t;
+	while(!pipeline->stopping)
+	{
+		uint32_t first = (uint32_t)InterlockedExchangeAdd(&pipeline->next_index, BATCH_LANES);
+		if(first >= pipeline->count) break;
+		int lanes = pipeline->count - first < BATCH_LANES ? pipeline->count - first : BATCH_LANES;
+
+		//Lanes past the end repeat the first seed and are not written
+		start_timer(&t);
+		for(int lane = 0; lane < BATCH_LANES; lane++) seeds[lane] = pipeline->first_seed + first + (lane < lanes ? lane : 0);
+		generate_dungeon_batch(&batch, seeds);
+		end_timer(&t);
+		generating += time_elapsed_microsec(&t);
+
+		for(int lane = 0; lane < lanes; lane++)
+		{
+			start_timer(&t);
+			pipeline_buffer* buffer = &pipeline->buffers[take_free_buffer(pipeline)];
+			end_timer(&t);
+			stalls += time_elapsed_microsec(&t);
+
+			start_timer(&t);
+			uint32_t size = batch_lane_file_size(&batch, lane);
+			if(size > buffer->capacity)
+			{
+				buffer->data = (char*)realloc(buffer->data, size);
+				buffer->capacity = size;
+			}
+			buffer->size = serialize_batch_lane(&batch, lane, seeds[lane], buffer->data, buffer->capacity);
+			queue_filled_buffer(pipeline, (int)(buffer - pipeline->buffers));
+			end_timer(&t);
+			generating += time_elapsed_microsec(&t);
+		}
+	}
+	destroy_dungeon_batch(&batch);
+
+	EnterCriticalSection(&pipeline->stats_lock);
+	pipeline->stats.generating += generating;
+	pipeline->stats.generator_stalls += stalls;
+	LeaveCriticalSection(&pipeline->stats_lock);
+	return 0;
+}
+
+//Returns false if the write failed, a synchronous handle writes at the offset before WriteFile returns
+bool issue_pipeline_write(dungeon_pipeline* pipeline, pipeline_buffer* buffer, uint64_t offset)
+{
+	memset(&buffer->overlapped, 0, sizeof(OVERLAPPED));
+	buffer->overlapped.Offset = (DWORD)offset;
+	buffer->overlapped.OffsetHigh = (DWORD)(offset >> 32);
+	buffer->overlapped.hEvent = buffer->written;
+	DWORD written = 0;
+	if(WriteFile(pipeline->file, buffer->data, buffer->size, &written, &buffer->overlapped)) return true;
+	return pipeline->stats.overlapped && GetLastError() == ERROR_IO_PENDING;
+}
+
+bool complete_pipeline_write(dungeon_pipeline* pipeline, pipeline_buffer* buffer)
+{
+	DWORD written = 0;
+	return GetOverlappedResult(pipeline->file, &buffer->overlapped, &written, TRUE) && written == buffer->size;
+}
+
+//Once a write has failed the remaining dungeons are dropped as they arrive, until every generator has stopped
+void drain_pipeline(dungeon_pipeline* pipeline, HANDLE* generators, int generator_count)
+{
+	for(int i = 0; i < generator_count;)
+	{
+		if(WaitForSingleObject(pipeline->filled_count, 1) == WAIT_OBJECT_0) return_free_buffer(pipeline, take_filled_buffer(pipeline));
+		else if(WaitForSingleObject(generators[i], 0) == WAIT_OBJECT_0) i++;
+	}
+	while(WaitForSingleObject(pipeline->filled_count, 0) == WAIT_OBJECT_0) return_free_buffer(pipeline, take_filled_buffer(pipeline));
+}
+
+//The calling thread is the writer, issuing up to PIPELINE_MAX_WRITES writes before waiting on the oldest
+void run_pipeline_writer(dungeon_pipeline* pipeline)
+{
+	pipeline_stats* stats = &pipeline->stats;
+	int in_flight[PIPELINE_MAX_WRITES];
+	int in_flight_start = 0;
+	int in_flight_count = 0;
+	uint32_t issued = 0;
+	uint64_t offset = 0;
+	timer t;
+	while(!stats->failed && (issued < pipeline->count || in_flight_count))
+	{
+		int next = -1;
+		if(in_flight_count < PIPELINE_MAX_WRITES && issued < pipeline->count)
+		{
+			if(WaitForSingleObject(pipeline->filled_count, 0) == WAIT_OBJECT_0) next = take_filled_buffer(pipeline);
+			else if(!in_flight_count)
+			{
+				start_timer(&t);
+				WaitForSingleObject(pipeline->filled_count, INFINITE);
+				end_timer(&t);
+				stats->writer_idle += time_elapsed_microsec(&t);
+				next = take_filled_buffer(pipeline);
+			}
+		}
+
+		start_timer(&t);
+		if(next >= 0)
+		{
+			pipeline_buffer* buffer = &pipeline->buffers[next];
+			if(issue_pipeline_write(pipeline, buffer, offset))
+			{
+				in_flight[(in_flight_start + in_flight_count++) % PIPELINE_MAX_WRITES] = next;
+				offset += buffer->size;
+			}
+			else
+			{
+				stats->failed = true;
+				return_free_buffer(pipeline, next);
+			}
+			issued++;
+		}
+		else
+		{
+			//Writes land in the order they were issued, so the oldest is always the next to wait for
+			int oldest = in_flight[in_flight_start];
+			in_flight_start = (in_flight_start + 1) % PIPELINE_MAX_WRITES;
+			in_flight_count--;
+			if(complete_pipeline_write(pipeline, &pipeline->buffers[oldest]))
+			{
+				stats->dungeons++;
+				stats->bytes += pipeline->buffers[oldest].size;
+			}
+			else stats->failed = true;
+			return_free_buffer(pipeline, oldest);
+		}
+		end_timer(&t);
+		stats->writing += time_elapsed_microsec(&t);
+	}
+
+	//A failed run still waits for the writes it issued, their buffers are owned by the system until then
+	for(int i = 0; i < in_flight_count; i++)
+	{
+		int buffer = in_flight[(in_flight_start + i) % PIPELINE_MAX_WRITES];
+		complete_pipeline_write(pipeline, &pipeline->buffers[buffer]);
+		return_free_buffer(pipeline, buffer);
+	}
+}
+
+bool run_dungeon_pipeline(const char* path, runtime_dungeon_config config, uint32_t first_seed, uint32_t count, int generator_count, pipeline_stats* stats)
+{
+	dungeon_pipeline* pipeline = (dungeon_pipeline*)malloc(sizeof(dungeon_pipeline));
+	memset(pipeline, 0, sizeof(dungeon_pipeline));
+	pipeline->config = config;
+	pipeline->first_seed = first_seed;
+	pipeline->count = count;
+
+	//Files that refuse overlapped I/O are written synchronously at the same offsets
+	pipeline->stats.overlapped = true;
+	pipeline->file = CreateFileA(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED, NULL);
+	if(pipeline->file == INVALID_HANDLE_VALUE)
+	{
+		pipeline->stats.overlapped = false;
+		pipeline->file = CreateFileA(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	}
+	if(pipeline->file == INVALID_HANDLE_VALUE)
+	{
+		free(pipeline);
+		return false;
+	}
+
+	InitializeCriticalSection(&pipeline->free_lock);
+	InitializeCriticalSection(&pipeline->filled_lock);
+	InitializeCriticalSection(&pipeline->stats_lock);
+	pipeline->free_count = CreateSemaphoreA(NULL, PIPELINE_BUFFERS, PIPELINE_BUFFERS, NULL);
+	pipeline->filled_count = CreateSemaphoreA(NULL, 0, PIPELINE_BUFFERS, NULL);
+	for(int i = 0; i < PIPELINE_BUFFERS; i++)
+	{
+		pipeline->buffers[i].written = CreateEventA(NULL, TRUE, FALSE, NULL);
+		pipeline->free_buffers[pipeline->free_top++] = i;
+	}
+
+	timer elapsed;
+	start_timer(&elapsed);
+	if(generator_count <= 0) generator_count = max(processor_count() - 1, 1);
+	generator_count = min(generator_count, PIPELINE_MAX_GENERATORS);
+	HANDLE generators[PIPELINE_MAX_GENERATORS];
+	int started = 0;
+	for(int i = 0; i < generator_count; i++)
+	{
+		HANDLE generator = CreateThread(NULL, 0, pipeline_generator, pipeline, 0, NULL);
+		if(generator) generators[started++] = generator;
+	}
+	pipeline->stats.generator_count = started;
+
+	if(started) run_pipeline_writer(pipeline);
+	else pipeline->stats.failed = true;
+	if(pipeline->stats.failed)
+	{
+		InterlockedExchange(&pipeline->stopping, 1);
+		drain_pipeline(pipeline, generators, started);
+	}
+	for(int i = 0; i < started; i++)
+	{
+		WaitForSingleObject(generators[i], INFINITE);
+		CloseHandle(generators[i]);
+	}
+	if(!CloseHandle(pipeline->file)) pipeline->stats.failed = true;
+	end_timer(&elapsed);
+	pipeline->stats.elapsed = time_elapsed_microsec(&elapsed);
+
+	for(int i = 0; i < PIPELINE_BUFFERS; i++)
+	{
+		free(pipeline->buffers[i].data);
+		CloseHandle(pipeline->buffers[i].written);
+	}
+	CloseHandle(pipeline->free_count);
+	CloseHandle(pipeline->filled_count);
+	DeleteCriticalSection(&pipeline->free_lock);
+	DeleteCriticalSection(&pipeline->filled_lock);
+	DeleteCriticalSection(&pipeline->stats_lock);
+
+	bool succeeded = !pipeline->stats.failed;
+	if(stats) *stats = pipeline->stats;
+	free(pipeline);
+	return succeeded;
+}
+
+void print_pipeline_stats(pipeline_stats* stats)
+{
+	double elapsed = stats->elapsed > 0 ? stats->elapsed : 1;
+	double seconds = elapsed/1000000.0;
+	double generator_time = elapsed*max(stats->generator_count, 1);
+	double stalled = stats->generator_stalls/generator_time;
+	double idle = stats->writer_idle/elapsed;
+	printf("Pipeline\n");
+	printf("Dungeons = %u, %.1f MB in %.3fs (%.0f dungeons/s, %.1f MB/s, %s writes)\n", stats->dungeons, stats->bytes/(1024.0*1024.0), seconds,
+		stats->dungeons/seconds, stats->bytes/(1024.0*1024.0)/seconds, stats->overlapped ? "overlapped" : "synchronous");
+	printf("Generators = %d, %.1f%% generating, %.1f%% waiting for buffers\n", stats->generator_count, 100.0*stats->generating/generator_time, 100.0*stalled);
+	printf("Writer = %.1f%% writing, %.1f%% waiting for dungeons\n", 100.0*stats->writing/elapsed, 100.0*idle);
+
+	//Whichever side spends more of its time waiting on the other is the faster one
+	if(stats->failed) printf("Failed\n\n");
+	else if(stalled > idle) printf("I/O bound, generators waited for the writer\n\n");
+	else printf("Generation bound, the writer waited for generators\n\n");
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <windows.h>
+#include <stdint.h>
+#include "batch.h"
+#include "dungeon_file.h"
+#include "timer.h"
+
+#define PIPELINE_BUFFERS 32 //Dungeons generated but not yet written, generators wait for a buffer past this
+#define PIPELINE_MAX_WRITES 8 //Overlapped writes in flight at once
+#define PIPELINE_MAX_GENERATORS (PIPELINE_BUFFERS - PIPELINE_MAX_WRITES)
+
+//Generation to disk pipeline
+//Generator threads each take BATCH_LANES seeds at a time, serialize every lane into a free buffer and queue it
+//The calling thread writes queued buffers with overlapped WriteFile and returns each buffer to the free list when its write completes
+//Buffers are allocated once and only grow if a dungeon does not fit, so a steady run does no allocation per dungeon
+//The output is dungeon file images back to back in the order they were written, each starting with its header
+
+struct pipeline_buffer
+{
+	char* data;
+	uint32_t capacity;
+	uint32_t size;
+	OVERLAPPED overlapped;
+	HANDLE written; //Event for the buffer's write, so writes complete independently of each other
+};
+
+//Stage times are in microseconds, generator times summed over every generator thread
+struct pipeline_stats
+{
+	uint32_t dungeons;
+	uint64_t bytes;
+	int generator_count;
+	bool overlapped; //False if the file could not be opened for overlapped I/O and writes were synchronous
+	bool failed;
+	int64_t elapsed;
+	int64_t generating; //Generating and serializing
+	int64_t generator_stalls; //Waiting for a free buffer, which only happens when writing falls behind
+	int64_t writing; //Issuing writes and waiting for them to complete
+	int64_t writer_idle; //Waiting for a generated dungeon, which only happens when generation falls behind
+};
+
+struct dungeon_pipeline
+{
+	runtime_dungeon_config config;
+	HANDLE file;
+	pipeline_buffer buffers[PIPELINE_BUFFERS];
+
+	CRITICAL_SECTION free_lock;
+	HANDLE free_count;
+	int free_buffers[PIPELINE_BUFFERS];
+	int free_top;
+
+	CRITICAL_SECTION filled_lock;
+	HANDLE filled_count;
+	int filled_buffers[PIPELINE_BUFFERS];
+	int filled_start;
+	int filled_size;
+
+	//Generators claim seeds first_seed + next_index onwards BATCH_LANES at a time
+	uint32_t first_seed;
+	uint32_t count;
+	volatile LONG next_index;
+	volatile LONG stopping; //Set when a write fails, generators stop claiming seeds
+
+	CRITICAL_SECTION stats_lock;
+	pipeline_stats stats;
+};
+
+//Generates count dungeons from first_seed on into the file at path, generator_count 0 uses every processor but one
+bool run_dungeon_pipeline(const char* path, runtime_dungeon_config, uint32_t first_seed, uint32_t count, int generator_count, pipeline_stats*);
+void print_pipeline_stats(pipeline_stats*);
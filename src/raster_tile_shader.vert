@@ -0,0 +1,37 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(set = 0, binding = 0) uniform world_matrix
+{
+	mat4 view;
+	mat4 projection;
+} wm;
+
+//Written by tile_raster.comp, 4 tiles to a uint
+layout(set = 1, binding = 1) readonly buffer tile_buffer
+{
+	uint tiles[];
+};
+
+layout(location = 0) in vec2 in_position;
+
+layout(push_constant) uniform push_constants
+{
+	mat4 model;
+	ivec4 area; //First tile x and y, tiles per row of the area and of the map
+} pc;
+
+layout(location = 1) out vec3 frag_colour;
+
+//WALL, FLOOR and PARTITION, the colours main.c gives their meshes
+const vec3 tile_colours[3] = vec3[](vec3(0.0), vec3(1.0), vec3(0.5));
+
+void main()
+{
+	int x = pc.area.x + gl_InstanceIndex % pc.area.z;
+	int y = pc.area.y + gl_InstanceIndex / pc.area.z;
+	int tile = y*pc.area.w + x;
+	uint type = (tiles[tile >> 2] >> (8*(tile & 3))) & 0xFFu;
+	gl_Position = wm.projection * wm.view * pc.model * vec4(in_position + vec2(x, y), 0.0, 1.0);
+	frag_colour = tile_colours[min(type, 2u)];
+}
@@ -21,6 +21,7 @@ uint64_t rng()
 
 uint64_t rng_range(uint64_t min, uint64_t max)
 {
+	if(max <= min) return min;
 	uint64_t diff = max - min;
 	uint64_t n = rng() % diff;
 	return min + n;
@@ -33,6 +34,7 @@ uint64_t rng()
 
 uint64_t rng_range(uint64_t min, uint64_t max)
 {
+	if(max <= min) return min;
 	uint64_t diff = max-min;
 	uint64_t n = rand() % diff;
 	return min+n;
@@ -0,0 +1,53 @@
+#include "seed_file.h"
+
+void make_seed_record(dungeon_seed_record* record, uint32_t seed, runtime_dungeon_config config)
+{
+	*record = {};
+	record->magic = DUNGEON_SEED_MAGIC;
+	record->version = DUNGEON_SEED_VERSION;
+	record->generator_version = DUNGEON_GENERATOR_VERSION;
+	record->seed = seed;
+	record->config = config;
+}
+
+bool write_dungeon_seed_file(const char* path, uint32_t seed, runtime_dungeon_config config)
+{
+	dungeon_seed_record record;
+	make_seed_record(&record, seed, config);
+	FILE* f = fopen(path, "wb");
+	bool written = f && fwrite(&record, sizeof(record), 1, f) == 1;
+	if(f) written = (fclose(f) == 0) && written;
+	return written;
+}
+
+bool read_dungeon_seed_file(const char* path, dungeon_seed_record* record)
+{
+	FILE* f = fopen(path, "rb");
+	if(!f) return false;
+	bool read = fread(record, sizeof(*record), 1, f) == 1;
+	fclose(f);
+	return read && record->magic == DUNGEON_SEED_MAGIC && record->version == DUNGEON_SEED_VERSION;
+}
+
+template<typename config>
+bool matches_config(const runtime_dungeon_config& runtime, const config& c)
+{
+	return runtime.width == c.width && runtime.height == c.height && runtime.min_partition == c.min_partition &&
+		runtime.min_room == c.min_room && runtime.leaf_odds == c.leaf_odds && runtime.min_depth == c.min_depth;
+}
+
+bool regenerate_dungeon(const dungeon_seed_record* record, dungeon* d, char* tiles)
+{
+	const runtime_dungeon_config& c = record->config;
+	if(record->magic != DUNGEON_SEED_MAGIC || record->version != DUNGEON_SEED_VERSION || record->generator_version != DUNGEON_GENERATOR_VERSION) return false;
+	if(record->seed > UINT32_MAX) return false;
+	if(c.width <= 0 || c.height <= 0 || c.width > 0xFFFF || c.height > 0xFFFF || c.min_room <= 0 || c.min_partition <= 0 || c.leaf_odds <= 0) return false;
+
+	//Records made with one of the fixed configurations go through its instantiation, anything else through the runtime one
+	seed_rng((uint32_t)record->seed);
+	if(matches_config(c, default_dungeon_config())) generate_dungeon(d, tiles, default_dungeon_config());
+	else if(matches_config(c, small_dungeon_config())) generate_dungeon(d, tiles, small_dungeon_config());
+	else if(matches_config(c, large_dungeon_config())) generate_dungeon(d, tiles, large_dungeon_config());
+	else generate_dungeon(d, tiles, c);
+	return true;
+}
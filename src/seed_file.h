@@ -0,0 +1,28 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include "generator.h"
+
+#define DUNGEON_SEED_MAGIC 0x44455344 //"DSED"
+#define DUNGEON_SEED_VERSION 1
+
+//Seed records store what a dungeon was generated from rather than the dungeon, and it is generated again on load
+//A record is a few dozen bytes against a full dungeon file, at the cost of running the generator on every load
+struct dungeon_seed_record
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t generator_version; //DUNGEON_GENERATOR_VERSION of the build that wrote the record
+	uint32_t reserved;
+	uint64_t seed; //Only 32 bits are used, what srand() takes, records with higher bits set are rejected
+	runtime_dungeon_config config;
+};
+
+void make_seed_record(dungeon_seed_record*, uint32_t seed, runtime_dungeon_config);
+bool write_dungeon_seed_file(const char* path, uint32_t seed, runtime_dungeon_config);
+bool read_dungeon_seed_file(const char* path, dungeon_seed_record*);
+
+//Generates the recorded dungeon into tiles, which must hold config.width*config.height tiles
+//Fails without generating if the record is malformed or from a different generator version
+//Draws come from rand(), whose state the CRT keeps per thread, so nothing else on the calling thread may draw from it while the dungeon is generated
+bool regenerate_dungeon(const dungeon_seed_record*, dungeon*, char* tiles);
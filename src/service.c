@@ -0,0 +1,392 @@
+#include "service.h"
+#include "jobs.h"
+
+struct service_client
+{
+	dungeon_service* service;
+	HANDLE pipe;
+	int slot;
+};
+
+int latency_bucket(uint32_t microseconds)
+{
+	if(microseconds < 32) return microseconds;
+	int exponent = 31 - __builtin_clz(microseconds);
+	return 32 + (exponent - 5)*16 + ((microseconds >> (exponent - 4)) & 15);
+}
+
+//Largest latency that lands in bucket
+uint32_t latency_bucket_limit(int bucket)
+{
+	if(bucket < 32) return bucket;
+	int exponent = (bucket - 32)/16 + 5;
+	return (uint32_t)(((uint64_t)(16 + (bucket - 32)%16 + 1) << (exponent - 4)) - 1);
+}
+
+uint32_t latency_percentile(latency_histogram* histogram, double percentile)
+{
+	uint32_t rank = (uint32_t)(histogram->total*percentile);
+	uint32_t seen = 0;
+	for(int i = 0; i < LATENCY_BUCKETS; i++)
+	{
+		seen += histogram->counts[i];
+		if(seen > rank) return min(latency_bucket_limit(i), histogram->max_latency);
+	}
+	return histogram->max_latency;
+}
+
+//Called with stats_lock held
+void record_latency(dungeon_service* service, service_request* request)
+{
+	uint32_t latency = (uint32_t)time_elapsed_microsec(&request->latency);
+	service->latencies.counts[latency_bucket(latency)]++;
+	service->latencies.total++;
+	service->latencies.max_latency = max(service->latencies.max_latency, latency);
+	service->stats.requests++;
+}
+
+DWORD WINAPI service_worker(LPVOID parameter)
+{
+	dungeon_service* service = (dungeon_service*)parameter;
+	dungeon* d = (dungeon*)malloc(sizeof(dungeon));
+	char* tiles = (char*)malloc(service->config.width*service->config.height);
+	dungeon_seed_record record;
+	for(;;)
+	{
+		//One semaphore count is taken per request, a count with nothing queued is the signal to stop
+		WaitForSingleObject(service->queued, INFINITE);
+		service_request* request = NULL;
+		EnterCriticalSection(&service->queue_lock);
+		if(service->queue_count)
+		{
+			request = service->queue[service->queue_start];
+			service->queue_start = (service->queue_start + 1) % SERVICE_QUEUE_SIZE;
+			service->queue_count--;
+		}
+		LeaveCriticalSection(&service->queue_lock);
+		if(!request) break;
+
+		//Generated the way its seed record regenerates it, so a seed gives the same dungeon from the service as from generate_dungeon()
+		make_seed_record(&record, request->seed, service->config);
+		request->status = SERVICE_FAILED;
+		if(regenerate_dungeon(&record, d, tiles))
+		{
+			request->size = dungeon_file_size(d);
+			request->blob = (char*)malloc(request->size);
+			serialize_dungeon(d, request->seed, service->config, request->blob, request->size);
+			destroy_dungeon(d);
+			request->status = SERVICE_OK;
+			dungeon_cache_key key = make_cache_key(request->seed, service->config);
+			cache_dungeon(&service->cache, &key, request->blob, request->size);
+		}
+
+		end_timer(&request->latency);
+		EnterCriticalSection(&service->stats_lock);
+		record_latency(service, request);
+		LeaveCriticalSection(&service->stats_lock);
+		SetEvent(request->done);
+	}
+	free(tiles);
+	free(d);
+	return 0;
+}
+
+void create_dungeon_service(dungeon_service* service, runtime_dungeon_config config, int worker_count, uint32_t cache_budget)
+{
+	memset(service, 0, sizeof(dungeon_service));
+	service->config = config;
+	service->running = 1;
+	InitializeCriticalSection(&service->queue_lock);
+	InitializeCriticalSection(&service->stats_lock);
+	InitializeCriticalSection(&service->clients_lock);
+	create_dungeon_cache(&service->cache, cache_budget);
+	service->queued = CreateSemaphoreA(NULL, 0, SERVICE_QUEUE_SIZE + SERVICE_MAX_WORKERS, NULL);
+
+	if(worker_count <= 0) worker_count = processor_count();
+	worker_count = min(worker_count, SERVICE_MAX_WORKERS);
+	for(int i = 0; i < worker_count; i++)
+	{
+		HANDLE worker = CreateThread(NULL, 0, service_worker, service, 0, NULL);
+		if(worker) service->workers[service->worker_count++] = worker;
+	}
+}
+
+void stop_service_pipe(dungeon_service* service)
+{
+	//Connecting is the only way to wake a listener blocked in ConnectNamedPipe, retried in case it is between pipe instances
+	while(WaitForSingleObject(service->listener, 10) == WAIT_TIMEOUT)
+	{
+		HANDLE wake = CreateFileA(SERVICE_PIPE_NAME, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+		if(wake != INVALID_HANDLE_VALUE) CloseHandle(wake);
+	}
+	CloseHandle(service->listener);
+	service->listener = NULL;
+
+	//Disconnecting fails any read a client thread is blocked in, and the thread then closes its pipe and exits
+	EnterCriticalSection(&service->clients_lock);
+	for(int i = 0; i < SERVICE_MAX_CLIENTS; i++) if(service->client_pipes[i]) DisconnectNamedPipe(service->client_pipes[i]);
+	LeaveCriticalSection(&service->clients_lock);
+	for(int i = 0; i < service->client_count; i++)
+	{
+		if(!service->client_threads[i]) continue;
+		WaitForSingleObject(service->client_threads[i], INFINITE);
+		CloseHandle(service->client_threads[i]);
+	}
+}
+
+void destroy_dungeon_service(dungeon_service* service)
+{
+	service->running = 0;
+	if(service->listener) stop_service_pipe(service);
+
+	//Workers finish the queue before they see one of these
+	ReleaseSemaphore(service->queued, service->worker_count, NULL);
+	WaitForMultipleObjects(service->worker_count, service->workers, TRUE, INFINITE);
+	for(int i = 0; i < service->worker_count; i++) CloseHandle(service->workers[i]);
+
+	destroy_dungeon_cache(&service->cache);
+	CloseHandle(service->queued);
+	DeleteCriticalSection(&service->queue_lock);
+	DeleteCriticalSection(&service->stats_lock);
+	DeleteCriticalSection(&service->clients_lock);
+}
+
+void create_service_request(service_request* request)
+{
+	*request = {};
+	request->done = CreateEventA(NULL, FALSE, FALSE, NULL);
+}
+
+void destroy_service_request(service_request* request)
+{
+	CloseHandle(request->done);
+	free(request->blob);
+	*request = {};
+}
+
+uint32_t service_generate(dungeon_service* service, service_request* request)
+{
+	start_timer(&request->latency);
+	request->blob = NULL;
+	request->size = 0;
+	request->status = SERVICE_FAILED;
+	if(!service->running) return SERVICE_FAILED;
+	dungeon_cache_key key = make_cache_key(request->seed, service->config);
+	if(find_cached_dungeon(&service->cache, &key, &request->blob, &request->size))
+	{
+		end_timer(&request->latency);
+		EnterCriticalSection(&service->stats_lock);
+		service->stats.cache_hits++;
+		record_latency(service, request);
+		LeaveCriticalSection(&service->stats_lock);
+		request->status = SERVICE_OK;
+		return SERVICE_OK;
+	}
+
+	EnterCriticalSection(&service->queue_lock);
+	bool queued = service->queue_count < SERVICE_QUEUE_SIZE;
+	if(queued)
+	{
+		service->queue[(service->queue_start + service->queue_count) % SERVICE_QUEUE_SIZE] = request;
+		service->queue_count++;
+		ReleaseSemaphore(service->queued, 1, NULL);
+	}
+	uint32_t depth = service->queue_count;
+	LeaveCriticalSection(&service->queue_lock);
+
+	EnterCriticalSection(&service->stats_lock);
+	service->stats.max_queue_depth = max(service->stats.max_queue_depth, depth);
+	service->stats.rejected += !queued;
+	LeaveCriticalSection(&service->stats_lock);
+	if(!queued) return SERVICE_BUSY;
+
+	WaitForSingleObject(request->done, INFINITE);
+	return request->status;
+}
+
+void get_service_stats(dungeon_service* service, service_stats* stats)
+{
+	EnterCriticalSection(&service->stats_lock);
+	*stats = service->stats;
+	stats->p50 = latency_percentile(&service->latencies, 0.5);
+	stats->p90 = latency_percentile(&service->latencies, 0.9);
+	stats->p99 = latency_percentile(&service->latencies, 0.99);
+	stats->p999 = latency_percentile(&service->latencies, 0.999);
+	stats->max_latency = service->latencies.max_latency;
+	LeaveCriticalSection(&service->stats_lock);
+
+	EnterCriticalSection(&service->queue_lock);
+	stats->queue_depth = service->queue_count;
+	LeaveCriticalSection(&service->queue_lock);
+}
+
+void print_service_stats(service_stats* stats)
+{
+	printf("Service\n");
+	printf("Requests = %u (%u cache hits, %u rejected)\n", stats->requests, stats->cache_hits, stats->rejected);
+	printf("Queue depth = %u (max %u)\n", stats->queue_depth, stats->max_queue_depth);
+	printf("Latency p50 = %uus, p90 = %uus, p99 = %uus, p99.9 = %uus, max = %uus\n\n", stats->p50, stats->p90, stats->p99, stats->p999, stats->max_latency);
+}
+
+bool read_pipe(HANDLE pipe, void* data, uint32_t size)
+{
+	for(uint32_t done = 0; done < size;)
+	{
+		DWORD read;
+		if(!ReadFile(pipe, (char*)data + done, size - done, &read, NULL) || !read) return false;
+		done += read;
+	}
+	return true;
+}
+
+bool write_pipe(HANDLE pipe, const void* data, uint32_t size)
+{
+	for(uint32_t done = 0; done < size;)
+	{
+		DWORD written;
+		if(!WriteFile(pipe, (const char*)data + done, size - done, &written, NULL) || !written) return false;
+		done += written;
+	}
+	return true;
+}
+
+DWORD WINAPI service_client_thread(LPVOID parameter)
+{
+	service_client* client = (service_client*)parameter;
+	dungeon_service* service = client->service;
+	service_request request;
+	create_service_request(&request);
+	service_request_message message;
+	while(read_pipe(client->pipe, &message, sizeof(message)))
+	{
+		service_response_header response = {SERVICE_MAGIC, SERVICE_BAD_REQUEST, 0, 0};
+		const void* payload = NULL;
+		service_stats stats;
+		if(message.magic == SERVICE_MAGIC && message.type == SERVICE_GENERATE)
+		{
+			request.seed = message.seed;
+			response.status = service_generate(service, &request);
+			response.size = request.size;
+			payload = request.blob;
+		}
+		else if(message.magic == SERVICE_MAGIC && message.type == SERVICE_STATS)
+		{
+			get_service_stats(service, &stats);
+			response.status = SERVICE_OK;
+			response.size = sizeof(stats);
+			payload = &stats;
+		}
+		bool sent = write_pipe(client->pipe, &response, sizeof(response)) && write_pipe(client->pipe, payload, response.size);
+		free(request.blob);
+		request.blob = NULL;
+		if(!sent || response.status == SERVICE_BAD_REQUEST) break;
+	}
+	destroy_service_request(&request);
+
+	//The slot is freed under the lock so stop_service_pipe() never disconnects a closed handle
+	EnterCriticalSection(&service->clients_lock);
+	service->client_pipes[client->slot] = NULL;
+	FlushFileBuffers(client->pipe);
+	DisconnectNamedPipe(client->pipe);
+	CloseHandle(client->pipe);
+	LeaveCriticalSection(&service->clients_lock);
+	free(client);
+	return 0;
+}
+
+//Finds a free slot for the pipe and starts its thread, a slot's previous thread has already finished with it
+bool add_service_client(dungeon_service* service, HANDLE pipe)
+{
+	EnterCriticalSection(&service->clients_lock);
+	int slot = 0;
+	while(slot < service->client_count && service->client_pipes[slot]) slot++;
+	bool added = slot < SERVICE_MAX_CLIENTS;
+	if(added)
+	{
+		if(service->client_threads[slot])
+		{
+			WaitForSingleObject(service->client_threads[slot], INFINITE);
+			CloseHandle(service->client_threads[slot]);
+		}
+		service_client* client = (service_client*)malloc(sizeof(service_client));
+		*client = service_client{service, pipe, slot};
+		service->client_pipes[slot] = pipe;
+		service->client_threads[slot] = CreateThread(NULL, 0, service_client_thread, client, 0, NULL);
+		service->client_count = max(service->client_count, slot + 1);
+		if(!service->client_threads[slot])
+		{
+			service->client_pipes[slot] = NULL;
+			free(client);
+			added = false;
+		}
+	}
+	LeaveCriticalSection(&service->clients_lock);
+	return added;
+}
+
+DWORD WINAPI service_listener(LPVOID parameter)
+{
+	dungeon_service* service = (dungeon_service*)parameter;
+	while(service->running)
+	{
+		HANDLE pipe = CreateNamedPipeA(SERVICE_PIPE_NAME, PIPE_ACCESS_DUPLEX, PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT,
+				PIPE_UNLIMITED_INSTANCES, SERVICE_PIPE_BUFFER, SERVICE_PIPE_BUFFER, 0, NULL);
+		if(pipe == INVALID_HANDLE_VALUE) break;
+		bool connected = ConnectNamedPipe(pipe, NULL) || GetLastError() == ERROR_PIPE_CONNECTED;
+		if(!connected || !service->running || !add_service_client(service, pipe))
+		{
+			DisconnectNamedPipe(pipe);
+			CloseHandle(pipe);
+		}
+	}
+	return 0;
+}
+
+bool start_service_pipe(dungeon_service* service)
+{
+	service->listener = CreateThread(NULL, 0, service_listener, service, 0, NULL);
+	return service->listener != NULL;
+}
+
+HANDLE connect_to_service()
+{
+	HANDLE pipe = CreateFileA(SERVICE_PIPE_NAME, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+	if(pipe == INVALID_HANDLE_VALUE && GetLastError() == ERROR_PIPE_BUSY && WaitNamedPipeA(SERVICE_PIPE_NAME, 1000))
+	{
+		pipe = CreateFileA(SERVICE_PIPE_NAME, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+	}
+	return pipe;
+}
+
+//Sends a request and reads the response header, the payload is left in the pipe
+bool exchange_service_message(HANDLE pipe, uint32_t type, uint32_t seed, service_response_header* response)
+{
+	service_request_message message = {SERVICE_MAGIC, type, seed, 0};
+	return write_pipe(pipe, &message, sizeof(message)) && read_pipe(pipe, response, sizeof(*response)) && response->magic == SERVICE_MAGIC;
+}
+
+uint32_t request_dungeon(HANDLE pipe, uint32_t seed, char** blob, uint32_t* size)
+{
+	*blob = NULL;
+	*size = 0;
+	service_response_header response;
+	if(!exchange_service_message(pipe, SERVICE_GENERATE, seed, &response)) return SERVICE_FAILED;
+	if(!response.size) return response.status;
+	char* received = (char*)malloc(response.size);
+	if(!read_pipe(pipe, received, response.size))
+	{
+		free(received);
+		return SERVICE_FAILED;
+	}
+	*blob = received;
+	*size = response.size;
+	return response.status;
+}
+
+uint32_t request_service_stats(HANDLE pipe, service_stats* stats)
+{
+	service_response_header response;
+	if(!exchange_service_message(pipe, SERVICE_STATS, 0, &response)) return SERVICE_FAILED;
+	if(response.size != sizeof(service_stats)) return SERVICE_FAILED;
+	return read_pipe(pipe, stats, sizeof(service_stats)) ? response.status : SERVICE_FAILED;
+}
@@ -0,0 +1,138 @@
+#pragma once
+#include <windows.h>
+#include <stdint.h>
+#include "seed_file.h"
+#include "dungeon_file.h"
+#include "cache.h"
+#include "timer.h"
+
+#define SERVICE_PIPE_NAME "\\\\.\\pipe\\dungeon_gen"
+#define SERVICE_MAGIC 0x56524553 //"SERV"
+#define SERVICE_QUEUE_SIZE 1024 //Requests past this are turned away with SERVICE_BUSY rather than queued
+#define SERVICE_CACHE_BUDGET (64u << 20)
+#define SERVICE_MAX_WORKERS 16
+#define SERVICE_MAX_CLIENTS 64
+#define SERVICE_PIPE_BUFFER 65536
+#define LATENCY_BUCKETS 480
+
+//Dungeon generation service
+//Requests from any number of threads or pipe clients go through one queue, each worker takes one queued request at a time and generates it
+//Results are dungeon file images (see dungeon_file.h), recently generated seeds are answered from a cache without queueing
+//Seeds go through regenerate_dungeon(), so they give the same dungeons as generate_dungeon() and seed records
+
+enum service_message_type
+{
+	SERVICE_GENERATE = 1,
+	SERVICE_STATS = 2,
+};
+
+enum service_status
+{
+	SERVICE_OK = 0,
+	SERVICE_BUSY = 1,
+	SERVICE_BAD_REQUEST = 2,
+	SERVICE_FAILED = 3,
+};
+
+//Pipe protocol: the client writes a request message, the service answers with a response header followed by size bytes
+//The payload is a dungeon file image for SERVICE_GENERATE and a service_stats for SERVICE_STATS
+struct service_request_message
+{
+	uint32_t magic;
+	uint32_t type;
+	uint32_t seed;
+	uint32_t reserved;
+};
+
+struct service_response_header
+{
+	uint32_t magic;
+	uint32_t status;
+	uint32_t size;
+	uint32_t reserved;
+};
+
+//Latencies are in microseconds from the request being submitted to its result being ready, cache hits included
+struct service_stats
+{
+	uint32_t queue_depth;
+	uint32_t max_queue_depth;
+	uint32_t requests;
+	uint32_t cache_hits;
+	uint32_t rejected;
+	uint32_t p50;
+	uint32_t p90;
+	uint32_t p99;
+	uint32_t p999;
+	uint32_t max_latency;
+};
+
+//Log linear histogram, exact below 32us and within 1/16th above
+struct latency_histogram
+{
+	uint32_t counts[LATENCY_BUCKETS];
+	uint32_t total;
+	uint32_t max_latency;
+};
+
+//One per in flight request, done is reused so a client thread only creates it once
+struct service_request
+{
+	uint32_t seed;
+	HANDLE done;
+	timer latency;
+	uint32_t status;
+	char* blob; //Owned by the caller once the request completes
+	uint32_t size;
+};
+
+struct dungeon_service
+{
+	runtime_dungeon_config config;
+	volatile LONG running;
+
+	//Ring of waiting requests, queued counts them for the workers
+	CRITICAL_SECTION queue_lock;
+	HANDLE queued;
+	service_request* queue[SERVICE_QUEUE_SIZE];
+	int queue_start;
+	int queue_count;
+
+	int worker_count;
+	HANDLE workers[SERVICE_MAX_WORKERS];
+
+	dungeon_cache cache; //Keyed with DUNGEON_GENERATOR_VERSION
+
+	CRITICAL_SECTION stats_lock;
+	service_stats stats;
+	latency_histogram latencies;
+
+	//Pipe listener and the threads serving each connected client
+	HANDLE listener;
+	CRITICAL_SECTION clients_lock;
+	HANDLE client_pipes[SERVICE_MAX_CLIENTS];
+	HANDLE client_threads[SERVICE_MAX_CLIENTS];
+	int client_count;
+};
+
+//Starts worker_count workers (0 uses every processor) generating with config
+void create_dungeon_service(dungeon_service*, runtime_dungeon_config, int worker_count = 0, uint32_t cache_budget = SERVICE_CACHE_BUDGET);
+//Stops listening if the pipe was opened, disconnects clients and finishes every queued request before returning
+void destroy_dungeon_service(dungeon_service*);
+
+//Accepts pipe clients on SERVICE_PIPE_NAME from a listener thread
+bool start_service_pipe(dungeon_service*);
+
+void create_service_request(service_request*);
+void destroy_service_request(service_request*);
+//Blocks until the request's seed has been generated or fetched from the cache, returns a service_status
+uint32_t service_generate(dungeon_service*, service_request*);
+
+void get_service_stats(dungeon_service*, service_stats*);
+void print_service_stats(service_stats*);
+
+//Client side of the pipe protocol, for processes using a running service
+HANDLE connect_to_service();
+//blob is malloced and owned by the caller
+uint32_t request_dungeon(HANDLE pipe, uint32_t seed, char** blob, uint32_t* size);
+uint32_t request_service_stats(HANDLE pipe, service_stats*);
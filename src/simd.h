@@ -0,0 +1,133 @@
+#pragma once
+
+//Four float vectors for the maths kernels
+//SSE on x86, NEON on ARM and plain floats anywhere else, the kernels are written once against these
+//Loads and stores are unaligned, 32 bit malloc only guarantees 8 bytes, and they cost the same as aligned ones on aligned data
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+
+typedef __m128 float4;
+
+inline float4 load_float4(const float* p)
+{
+	return _mm_loadu_ps(p);
+}
+
+inline void store_float4(float* p, float4 v)
+{
+	_mm_storeu_ps(p, v);
+}
+
+inline float4 splat_float4(float f)
+{
+	return _mm_set1_ps(f);
+}
+
+inline float4 add_float4(float4 a, float4 b)
+{
+	return _mm_add_ps(a, b);
+}
+
+inline float4 multiply_float4(float4 a, float4 b)
+{
+	return _mm_mul_ps(a, b);
+}
+
+//a*b + c, SSE has no fused multiply add without FMA3
+inline float4 multiply_add_float4(float4 a, float4 b, float4 c)
+{
+	return _mm_add_ps(_mm_mul_ps(a, b), c);
+}
+
+template<int lane>
+float4 splat_lane(float4 v)
+{
+	return _mm_shuffle_ps(v, v, _MM_SHUFFLE(lane, lane, lane, lane));
+}
+
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+
+typedef float32x4_t float4;
+
+inline float4 load_float4(const float* p)
+{
+	return vld1q_f32(p);
+}
+
+inline void store_float4(float* p, float4 v)
+{
+	vst1q_f32(p, v);
+}
+
+inline float4 splat_float4(float f)
+{
+	return vdupq_n_f32(f);
+}
+
+inline float4 add_float4(float4 a, float4 b)
+{
+	return vaddq_f32(a, b);
+}
+
+inline float4 multiply_float4(float4 a, float4 b)
+{
+	return vmulq_f32(a, b);
+}
+
+inline float4 multiply_add_float4(float4 a, float4 b, float4 c)
+{
+	return vmlaq_f32(c, a, b);
+}
+
+template<int lane>
+float4 splat_lane(float4 v)
+{
+	return vdupq_n_f32(vgetq_lane_f32(v, lane));
+}
+
+#else
+
+struct float4
+{
+	float f[4];
+};
+
+inline float4 load_float4(const float* p)
+{
+	return float4{{p[0], p[1], p[2], p[3]}};
+}
+
+inline void store_float4(float* p, float4 v)
+{
+	for(int i = 0; i < 4; i++) p[i] = v.f[i];
+}
+
+inline float4 splat_float4(float f)
+{
+	return float4{{f, f, f, f}};
+}
+
+inline float4 add_float4(float4 a, float4 b)
+{
+	return float4{{a.f[0] + b.f[0], a.f[1] + b.f[1], a.f[2] + b.f[2], a.f[3] + b.f[3]}};
+}
+
+inline float4 multiply_float4(float4 a, float4 b)
+{
+	return float4{{a.f[0]*b.f[0], a.f[1]*b.f[1], a.f[2]*b.f[2], a.f[3]*b.f[3]}};
+}
+
+inline float4 multiply_add_float4(float4 a, float4 b, float4 c)
+{
+	return add_float4(multiply_float4(a, b), c);
+}
+
+template<int lane>
+float4 splat_lane(float4 v)
+{
+	return splat_float4(v.f[lane]);
+}
+
+#endif
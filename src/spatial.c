@@ -0,0 +1,310 @@
+#include "spatial.h"
+
+bool rect_contains(tile_rect r, int x, int y)
+{
+	return x >= r.min_x && x < r.max_x && y >= r.min_y && y < r.max_y;
+}
+
+bool rects_intersect(tile_rect a, tile_rect b)
+{
+	return a.min_x < b.max_x && b.min_x < a.max_x && a.min_y < b.max_y && b.min_y < a.max_y;
+}
+
+//Squared distance from the tile (x, y) to the closest tile in the rect
+int distance_squared(tile_rect r, int x, int y)
+{
+	int dx = max(max(r.min_x - x, x - (r.max_x - 1)), 0);
+	int dy = max(max(r.min_y - y, y - (r.max_y - 1)), 0);
+	return dx*dx + dy*dy;
+}
+
+bsp_node* find_leaf(bsp_node* node, int x, int y)
+{
+	if(x < node->bottom_left.x || x > node->top_right.x || y < node->bottom_left.y || y > node->top_right.y) return NULL;
+	while(node->left_child)
+	{
+		//Horizontal partitions split along x with the left child below the partition position
+		//Vertical partitions split along y with the left child above the partition position
+		if(node->partition_direction == HORIZONTAL) node = (x < node->partition_position) ? node->left_child : node->right_child;
+		else node = (y >= node->partition_position) ? node->left_child : node->right_child;
+	}
+	return node;
+}
+
+bsp_node* find_room(bsp_node* tree, int x, int y)
+{
+	bsp_node* leaf = find_leaf(tree, x, y);
+	if(leaf && rect_contains(room_rect(leaf), x, y)) return leaf;
+	return NULL;
+}
+
+void find_rooms(bsp_node* tree, const int* xs, const int* ys, int count, bsp_node** rooms)
+{
+	for(int i = 0; i < count; i++) rooms[i] = find_room(tree, xs[i], ys[i]);
+}
+
+//Room bounds of internal nodes are the bounding box of all rooms below them, so whole subtrees can be skipped
+void find_rooms_in_rect(bsp_node* node, tile_rect rect, bsp_node** rooms, int max_rooms, int* room_count)
+{
+	if(!rects_intersect(room_rect(node), rect)) return;
+	if(!node->left_child)
+	{
+		if(*room_count < max_rooms) rooms[*room_count] = node;
+		++*room_count;
+		return;
+	}
+	find_rooms_in_rect(node->left_child, rect, rooms, max_rooms, room_count);
+	find_rooms_in_rect(node->right_child, rect, rooms, max_rooms, room_count);
+}
+
+//Returns the total number of rooms intersecting rect, at most max_rooms are written
+int find_rooms_in_rect(bsp_node* tree, tile_rect rect, bsp_node** rooms, int max_rooms)
+{
+	int room_count = 0;
+	find_rooms_in_rect(tree, rect, rooms, max_rooms, &room_count);
+	return room_count;
+}
+
+//Keeps rooms sorted by distance, nearest first
+void insert_nearest(bsp_node** rooms, int* distances, int* found, int k, bsp_node* room, int distance)
+{
+	if(*found == k && distance >= distances[k-1]) return;
+	int i = (*found < k) ? (*found)++ : k - 1;
+	for(; i > 0 && distances[i-1] > distance; i--)
+	{
+		rooms[i] = rooms[i-1];
+		distances[i] = distances[i-1];
+	}
+	rooms[i] = room;
+	distances[i] = distance;
+}
+
+//Branch and bound descent, visiting the nearer child first so the far child can usually be pruned
+void find_nearest_rooms(bsp_node* node, int x, int y, int k, bsp_node** rooms, int* distances, int* found)
+{
+	int node_distance = distance_squared(room_rect(node), x, y);
+	if(*found == k && node_distance >= distances[k-1]) return;
+	if(!node->left_child)
+	{
+		insert_nearest(rooms, distances, found, k, node, node_distance);
+		return;
+	}
+	bsp_node* near_child = node->left_child;
+	bsp_node* far_child = node->right_child;
+	if(distance_squared(room_rect(far_child), x, y) < distance_squared(room_rect(near_child), x, y))
+	{
+		near_child = node->right_child;
+		far_child = node->left_child;
+	}
+	find_nearest_rooms(near_child, x, y, k, rooms, distances, found);
+	find_nearest_rooms(far_child, x, y, k, rooms, distances, found);
+}
+
+//Writes up to k rooms ordered by distance to (x, y) and their squared distances, returns the number written
+int find_nearest_rooms(bsp_node* tree, int x, int y, int k, bsp_node** rooms, int* distances)
+{
+	if(k <= 0) return 0;
+	int found = 0;
+	for(int i = 0; i < k; i++) rooms[i] = NULL;
+	find_nearest_rooms(tree, x, y, k, rooms, distances, &found);
+	return found;
+}
+
+void build_spatial_index(spatial_index* index, dungeon* d)
+{
+	index->room_count = d->room_count;
+	index->rect_count = d->room_count + d->corridor_count;
+	index->rects = (tile_rect*)malloc(index->rect_count*sizeof(tile_rect));
+	gather_room_rects(d->tree, index->rects);
+	for(int i = 0; i < d->corridor_count; i++) index->rects[d->room_count + i] = d->corridors[i];
+
+	int map_width = (int)d->tree->top_right.x + 1;
+	int map_height = (int)d->tree->top_right.y + 1;
+	index->grid_width = (map_width + SPATIAL_CELL_SIZE - 1) >> SPATIAL_CELL_SHIFT;
+	index->grid_height = (map_height + SPATIAL_CELL_SIZE - 1) >> SPATIAL_CELL_SHIFT;
+	int cell_count = index->grid_width*index->grid_height;
+	index->cell_starts = (int*)calloc(cell_count + 1, sizeof(int));
+
+	//Count the rects overlapping each cell, then prefix sum into offsets and fill
+	for(int pass = 0; pass < 2; pass++)
+	{
+		for(int i = 0; i < index->rect_count; i++)
+		{
+			tile_rect r = index->rects[i];
+			int min_cx = max(r.min_x >> SPATIAL_CELL_SHIFT, 0);
+			int min_cy = max(r.min_y >> SPATIAL_CELL_SHIFT, 0);
+			int max_cx = min((r.max_x - 1) >> SPATIAL_CELL_SHIFT, index->grid_width - 1);
+			int max_cy = min((r.max_y - 1) >> SPATIAL_CELL_SHIFT, index->grid_height - 1);
+			for(int cy = min_cy; cy <= max_cy; cy++)
+			{
+				for(int cx = min_cx; cx <= max_cx; cx++)
+				{
+					int cell = cy*index->grid_width + cx;
+					if(pass == 0) index->cell_starts[cell + 1]++;
+					else index->cell_rects[index->cell_starts[cell]++] = i;
+				}
+			}
+		}
+		if(pass == 0)
+		{
+			for(int c = 0; c < cell_count; c++) index->cell_starts[c + 1] += index->cell_starts[c];
+			index->cell_rects = (int*)malloc(index->cell_starts[cell_count]*sizeof(int));
+		}
+		else
+		{
+			//Filling advanced each start to the next cell's start, shift them back
+			for(int c = cell_count; c > 0; c--) index->cell_starts[c] = index->cell_starts[c - 1];
+			index->cell_starts[0] = 0;
+		}
+	}
+}
+
+void destroy_spatial_index(spatial_index* index)
+{
+	free(index->rects);
+	free(index->cell_starts);
+	free(index->cell_rects);
+	*index = {};
+}
+
+//Rooms are stored before corridors in each cell, so a room wins where a corridor was carved over it
+int query_point(spatial_index* index, int x, int y)
+{
+	int cx = x >> SPATIAL_CELL_SHIFT;
+	int cy = y >> SPATIAL_CELL_SHIFT;
+	if(x < 0 || y < 0 || cx >= index->grid_width || cy >= index->grid_height) return -1;
+	int cell = cy*index->grid_width + cx;
+	for(int i = index->cell_starts[cell]; i < index->cell_starts[cell + 1]; i++)
+	{
+		int id = index->cell_rects[i];
+		if(rect_contains(index->rects[id], x, y)) return id;
+	}
+	return -1;
+}
+
+void query_points(spatial_index* index, const int* xs, const int* ys, int count, int* rect_ids)
+{
+	for(int i = 0; i < count; i++) rect_ids[i] = query_point(index, xs[i], ys[i]);
+}
+
+//Rects intersecting rect, and with max_distance_squared of 0 or more only those within it of (x, y)
+int query_cells(spatial_index* index, tile_rect rect, int x, int y, int max_distance_squared, int* rect_ids, int max_rect_ids)
+{
+	int found = 0;
+	int min_cx = max(rect.min_x, 0) >> SPATIAL_CELL_SHIFT;
+	int min_cy = max(rect.min_y, 0) >> SPATIAL_CELL_SHIFT;
+	int max_cx = min((rect.max_x - 1) >> SPATIAL_CELL_SHIFT, index->grid_width - 1);
+	int max_cy = min((rect.max_y - 1) >> SPATIAL_CELL_SHIFT, index->grid_height - 1);
+	for(int cy = min_cy; cy <= max_cy; cy++)
+	{
+		for(int cx = min_cx; cx <= max_cx; cx++)
+		{
+			int cell = cy*index->grid_width + cx;
+			for(int i = index->cell_starts[cell]; i < index->cell_starts[cell + 1]; i++)
+			{
+				int id = index->cell_rects[i];
+				tile_rect r = index->rects[id];
+				if(!rects_intersect(r, rect)) continue;
+
+				//A rect spanning several cells is only reported from the cell holding the corner of its intersection with the query
+				if((max(r.min_x, rect.min_x) >> SPATIAL_CELL_SHIFT) != cx || (max(r.min_y, rect.min_y) >> SPATIAL_CELL_SHIFT) != cy) continue;
+				if(max_distance_squared >= 0 && distance_squared(r, x, y) > max_distance_squared) continue;
+				if(found < max_rect_ids) rect_ids[found] = id;
+				++found;
+			}
+		}
+	}
+	return found;
+}
+
+//Returns the total number of rects intersecting rect, at most max_rect_ids are written
+int query_rect(spatial_index* index, tile_rect rect, int* rect_ids, int max_rect_ids)
+{
+	return query_cells(index, rect, 0, 0, -1, rect_ids, max_rect_ids);
+}
+
+//Returns the total number of rects within radius of (x, y), at most max_rect_ids are written
+int query_radius(spatial_index* index, int x, int y, int radius, int* rect_ids, int max_rect_ids)
+{
+	tile_rect bounds = {x - radius, y - radius, x + radius + 1, y + radius + 1};
+	return query_cells(index, bounds, x, y, radius*radius, rect_ids, max_rect_ids);
+}
+
+//Searches rings of cells outward from (x, y) until no unvisited cell can hold anything nearer than the k found so far
+//Writes up to k rects ordered by distance and their squared distances, returns the number written, at most rect_count
+int query_nearest(spatial_index* index, int x, int y, int k, int* rect_ids, int* distances)
+{
+	k = min(k, index->rect_count);
+	if(k <= 0) return 0;
+	int found = 0;
+
+	int cx = min(max(x >> SPATIAL_CELL_SHIFT, 0), index->grid_width - 1);
+	int cy = min(max(y >> SPATIAL_CELL_SHIFT, 0), index->grid_height - 1);
+	int outside_x = max(max(-x, x - (index->grid_width*SPATIAL_CELL_SIZE - 1)), 0);
+	int outside_y = max(max(-y, y - (index->grid_height*SPATIAL_CELL_SIZE - 1)), 0);
+	int max_ring = max(index->grid_width, index->grid_height);
+
+	for(int ring = 0; ring <= max_ring; ring++)
+	{
+		for(int ry = cy - ring; ry <= cy + ring; ry++)
+		{
+			if(ry < 0 || ry >= index->grid_height) continue;
+			bool edge_row = (ry == cy - ring || ry == cy + ring);
+			for(int rx = cx - ring; rx <= cx + ring; rx += (edge_row) ? 1 : 2*ring)
+			{
+				if(rx >= 0 && rx < index->grid_width)
+				{
+					int cell = ry*index->grid_width + rx;
+					for(int i = index->cell_starts[cell]; i < index->cell_starts[cell + 1]; i++)
+					{
+						int id = index->cell_rects[i];
+						int distance = distance_squared(index->rects[id], x, y);
+						if(found == k && distance >= distances[k-1]) continue;
+
+						bool seen = false;
+						for(int j = 0; j < found && !seen; j++) seen = rect_ids[j] == id;
+						if(seen) continue;
+
+						int slot = (found < k) ? found++ : k - 1;
+						for(; slot > 0 && distances[slot-1] > distance; slot--)
+						{
+							rect_ids[slot] = rect_ids[slot-1];
+							distances[slot] = distances[slot-1];
+						}
+						rect_ids[slot] = id;
+						distances[slot] = distance;
+					}
+				}
+				if(ring == 0) break;
+			}
+		}
+
+		//Anything not yet visited is at least ring cells away along one axis
+		int lower_bound = ring*SPATIAL_CELL_SIZE + 1 - outside_x - outside_y;
+		if(found == k && lower_bound > 0 && lower_bound*lower_bound > distances[k-1]) break;
+	}
+	return found;
+}
+
+bool nearest_floor_tile(spatial_index* index, int x, int y, int* floor_x, int* floor_y)
+{
+	int nearest;
+	int distance;
+	if(query_nearest(index, x, y, 1, &nearest, &distance) == 0) return false;
+	tile_rect r = index->rects[nearest];
+	*floor_x = min(max(x, r.min_x), r.max_x - 1);
+	*floor_y = min(max(y, r.min_y), r.max_y - 1);
+	return true;
+}
+
+void nearest_floor_tiles(spatial_index* index, const int* xs, const int* ys, int count, int* floor_xs, int* floor_ys)
+{
+	for(int i = 0; i < count; i++)
+	{
+		if(!nearest_floor_tile(index, xs[i], ys[i], &floor_xs[i], &floor_ys[i]))
+		{
+			floor_xs[i] = -1;
+			floor_ys[i] = -1;
+		}
+	}
+}
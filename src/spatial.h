@@ -0,0 +1,45 @@
+#pragma once
+#include "dungeon.h"
+
+#define SPATIAL_CELL_SHIFT 3 //Grid cells are 8x8 tiles
+#define SPATIAL_CELL_SIZE (1 << SPATIAL_CELL_SHIFT)
+
+//Packed uniform grid over a dungeon's room and corridor rectangles
+//Rect ids below room_count are rooms (matching bsp_node::room_index), the rest are corridors
+struct spatial_index
+{
+	tile_rect* rects;
+	int room_count;
+	int rect_count;
+
+	int grid_width;
+	int grid_height;
+	int* cell_starts; //grid_width*grid_height+1 offsets into cell_rects
+	int* cell_rects;
+};
+
+//Queries against the bsp tree, rooms only
+bsp_node* find_leaf(bsp_node*, int x, int y);
+bsp_node* find_room(bsp_node*, int x, int y);
+int find_rooms_in_rect(bsp_node*, tile_rect, bsp_node** rooms, int max_rooms);
+//rooms and distances must hold k, distances gets each room's squared distance to (x, y)
+int find_nearest_rooms(bsp_node*, int x, int y, int k, bsp_node** rooms, int* distances);
+void find_rooms(bsp_node*, const int* xs, const int* ys, int count, bsp_node** rooms);
+
+//Queries against the spatial index, rooms and corridors
+void build_spatial_index(spatial_index*, dungeon*);
+void destroy_spatial_index(spatial_index*);
+
+int query_point(spatial_index*, int x, int y);
+int query_rect(spatial_index*, tile_rect, int* rect_ids, int max_rect_ids);
+int query_radius(spatial_index*, int x, int y, int radius, int* rect_ids, int max_rect_ids);
+//rect_ids and distances must hold k, distances gets each rect's squared distance to (x, y)
+int query_nearest(spatial_index*, int x, int y, int k, int* rect_ids, int* distances);
+bool nearest_floor_tile(spatial_index*, int x, int y, int* floor_x, int* floor_y);
+
+void query_points(spatial_index*, const int* xs, const int* ys, int count, int* rect_ids);
+void nearest_floor_tiles(spatial_index*, const int* xs, const int* ys, int count, int* floor_xs, int* floor_ys);
+
+bool rect_contains(tile_rect, int x, int y);
+bool rects_intersect(tile_rect, tile_rect);
+int distance_squared(tile_rect, int x, int y);
@@ -0,0 +1,121 @@
+#include "tile_pyramid.h"
+#include "jobs.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+struct reduce_job
+{
+	const char* tiles;
+	int width;
+	int height;
+	char* out;
+};
+
+inline char reduce_four(unsigned char a, unsigned char b, unsigned char c, unsigned char d)
+{
+	if(a == FLOOR || b == FLOOR || c == FLOOR || d == FLOOR) return FLOOR;
+	unsigned char highest = a > b ? a : b;
+	highest = highest > c ? highest : c;
+	return highest > d ? highest : d;
+}
+
+#ifdef __SSE2__
+//16 tiles of two rows to 8 reduced tiles, one in the low byte of each 16 bit lane
+__m128i reduce_pairs(__m128i top, __m128i bottom)
+{
+	__m128i floor_tiles = _mm_set1_epi8(FLOOR);
+	__m128i low_bytes = _mm_set1_epi16(0x00FF);
+	__m128i highest = _mm_max_epu8(top, bottom);
+	__m128i floors = _mm_or_si128(_mm_cmpeq_epi8(top, floor_tiles), _mm_cmpeq_epi8(bottom, floor_tiles));
+	highest = _mm_max_epi16(_mm_and_si128(highest, low_bytes), _mm_srli_epi16(highest, 8));
+	floors = _mm_and_si128(_mm_or_si128(floors, _mm_srli_epi16(floors, 8)), low_bytes);
+	return _mm_or_si128(_mm_and_si128(floors, _mm_set1_epi16(FLOOR)), _mm_andnot_si128(floors, highest));
+}
+#endif
+
+void reduce_band(void* data, int band)
+{
+	reduce_job* job = (reduce_job*)data;
+	int out_width = (job->width + 1)/2;
+	int out_height = (job->height + 1)/2;
+	int last_row = min((band + 1)*TILE_PYRAMID_BAND_ROWS, out_height);
+	for(int y = band*TILE_PYRAMID_BAND_ROWS; y < last_row; y++)
+	{
+		const unsigned char* top = (const unsigned char*)job->tiles + 2*y*job->width;
+		const unsigned char* bottom = (2*y + 1 < job->height) ? top + job->width : top;
+		char* out = job->out + y*out_width;
+		int x = 0;
+#ifdef __SSE2__
+		for(; 2*x + 32 <= job->width; x += 16)
+		{
+			__m128i left = reduce_pairs(_mm_loadu_si128((__m128i*)(top + 2*x)), _mm_loadu_si128((__m128i*)(bottom + 2*x)));
+			__m128i right = reduce_pairs(_mm_loadu_si128((__m128i*)(top + 2*x + 16)), _mm_loadu_si128((__m128i*)(bottom + 2*x + 16)));
+			_mm_storeu_si128((__m128i*)(out + x), _mm_packus_epi16(left, right));
+		}
+#endif
+		for(; x < out_width; x++)
+		{
+			int right = (2*x + 1 < job->width) ? 2*x + 1 : 2*x;
+			out[x] = reduce_four(top[2*x], top[right], bottom[2*x], bottom[right]);
+		}
+	}
+}
+
+void reduce_tiles(const char* tiles, int width, int height, char* out, int thread_count)
+{
+	reduce_job job = {tiles, width, height, out};
+	int band_count = ((height + 1)/2 + TILE_PYRAMID_BAND_ROWS - 1)/TILE_PYRAMID_BAND_ROWS;
+	if(width*height < TILE_PYRAMID_PARALLEL_TILES) thread_count = 1;
+	parallel_for(band_count, reduce_band, &job, thread_count);
+}
+
+void create_tile_pyramid(tile_pyramid* pyramid, char* tiles, int width, int height, int thread_count)
+{
+	pyramid->levels[0] = tiles;
+	pyramid->widths[0] = width;
+	pyramid->heights[0] = height;
+	pyramid->level_count = 1;
+	//Every level above the map shares one allocation, together they are under a third of the map
+	size_t size = 0;
+	while(pyramid->level_count < TILE_PYRAMID_MAX_LEVELS && (width > 1 || height > 1))
+	{
+		width = (width + 1)/2;
+		height = (height + 1)/2;
+		pyramid->widths[pyramid->level_count] = width;
+		pyramid->heights[pyramid->level_count] = height;
+		pyramid->level_count++;
+		size += width*height;
+	}
+	char* levels = (char*)malloc(size);
+	for(int i = 1; i < pyramid->level_count; i++)
+	{
+		pyramid->levels[i] = levels;
+		levels += pyramid->widths[i]*pyramid->heights[i];
+	}
+	build_tile_pyramid(pyramid, thread_count);
+}
+
+void build_tile_pyramid(tile_pyramid* pyramid, int thread_count)
+{
+	for(int i = 1; i < pyramid->level_count; i++) reduce_tiles(pyramid->levels[i - 1], pyramid->widths[i - 1], pyramid->heights[i - 1], pyramid->levels[i], thread_count);
+}
+
+void destroy_tile_pyramid(tile_pyramid* pyramid)
+{
+	if(pyramid->level_count > 1) free(pyramid->levels[1]);
+	pyramid->level_count = 0;
+}
+
+int pyramid_level_for(tile_pyramid* pyramid, float tiles_per_pixel)
+{
+	int level = 0;
+	while(level + 1 < pyramid->level_count && (float)(2 << level) <= tiles_per_pixel) level++;
+	return level;
+}
+
+tile_rect pyramid_level_rect(tile_rect rect, int level)
+{
+	int size = 1 << level;
+	return tile_rect{rect.min_x >> level, rect.min_y >> level, (rect.max_x + size - 1) >> level, (rect.max_y + size - 1) >> level};
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <stdint.h>
+#include "dungeon.h"
+
+#define TILE_PYRAMID_MAX_LEVELS 16
+#define TILE_PYRAMID_BAND_ROWS 64 //Output rows reduced together by one job
+#define TILE_PYRAMID_PARALLEL_TILES (1024*1024) //Smaller levels are reduced on the calling thread
+
+//Level of detail pyramid over a tile map
+//Level 0 is the map itself, each level above is the one below reduced 2x2 to 1 until a level is a single tile
+//A reduced tile is FLOOR if any of its four is, otherwise the highest of them, so corridors one tile wide stay visible from far out
+//Odd sized levels reduce their last column or row on its own
+struct tile_pyramid
+{
+	int level_count;
+	int widths[TILE_PYRAMID_MAX_LEVELS];
+	int heights[TILE_PYRAMID_MAX_LEVELS];
+	char* levels[TILE_PYRAMID_MAX_LEVELS]; //levels[0] is the map, not owned by the pyramid
+};
+
+//Allocates every level above the map and builds them
+void create_tile_pyramid(tile_pyramid*, char* tiles, int width, int height, int thread_count = 0);
+//Rebuilds every level from the map after its tiles have changed
+void build_tile_pyramid(tile_pyramid*, int thread_count = 0);
+void destroy_tile_pyramid(tile_pyramid*);
+
+//One level's reduction, out is (width + 1)/2 by (height + 1)/2
+void reduce_tiles(const char* tiles, int width, int height, char* out, int thread_count = 0);
+
+//The coarsest level whose tiles are no bigger than a pixel, for a view showing tiles_per_pixel map tiles across each pixel
+int pyramid_level_for(tile_pyramid*, float tiles_per_pixel);
+//Tiles of a level covering a rect of map tiles
+tile_rect pyramid_level_rect(tile_rect, int level);
@@ -0,0 +1,36 @@
+#include "timer.h"
+
+void start_timer(timer* t)
+{
+	QueryPerformanceFrequency(&t->frequency);
+	QueryPerformanceCounter(&t->start);
+}
+
+void end_timer(timer* t)
+{
+	QueryPerformanceCounter(&t->end);
+}
+
+long int time_elapsed_millisec(timer* t)
+{
+	LARGE_INTEGER elapsed;
+	elapsed.QuadPart = t->end.QuadPart - t->start.QuadPart;
+	elapsed.QuadPart *= 1000;
+	elapsed.QuadPart /= t->frequency.QuadPart;
+	return elapsed.QuadPart;
+}
+
+//Whole seconds and the remainder are scaled apart so the multiply can't overflow however long the timer ran
+int64_t time_elapsed_microsec(timer* t)
+{
+	int64_t ticks = t->end.QuadPart - t->start.QuadPart;
+	int64_t frequency = t->frequency.QuadPart;
+	return ticks/frequency*1000000 + ticks%frequency*1000000/frequency;
+}
+
+long int current_time()
+{
+	timer t;
+	start_timer(&t);
+	return t.start.QuadPart;
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <windows.h>
+#include <stdint.h>
+
+struct timer
+{
+	LARGE_INTEGER frequency;
+	LARGE_INTEGER start;
+	LARGE_INTEGER end;
+};
+
+void start_timer(timer*);
+void end_timer(timer*);
+long int time_elapsed_millisec(timer*);
+int64_t time_elapsed_microsec(timer*);
+long int current_time();
@@ -0,0 +1,192 @@
+#include "validate.h"
+
+void create_connectivity_validator(connectivity_validator* validator, int width, int height)
+{
+	//A row holds at most one span for every two tiles
+	int max_row_spans = (width + 1)/2;
+	validator->width = width;
+	validator->height = height;
+	create_bitgrid(&validator->floor, width, height);
+	create_bitgrid(&validator->span_starts, width, height);
+	validator->word_spans = (int*)malloc(validator->floor.words_per_row*height*sizeof(int));
+	validator->span_parents = (int*)malloc(max_row_spans*height*sizeof(int));
+	validator->row_starts = (int*)malloc(max_row_spans*sizeof(int));
+	validator->row_ends = (int*)malloc(max_row_spans*sizeof(int));
+	validator->rooms = NULL;
+	validator->room_capacity = 0;
+	validator->rect_parents = NULL;
+	validator->rect_capacity = 0;
+}
+
+void destroy_connectivity_validator(connectivity_validator* validator)
+{
+	destroy_bitgrid(&validator->floor);
+	destroy_bitgrid(&validator->span_starts);
+	free(validator->word_spans);
+	free(validator->span_parents);
+	free(validator->row_starts);
+	free(validator->row_ends);
+	free(validator->rooms);
+	free(validator->rect_parents);
+	*validator = {};
+}
+
+int find_span_root(int* parents, int span)
+{
+	while(parents[span] >= 0)
+	{
+		if(parents[parents[span]] >= 0) parents[span] = parents[parents[span]];
+		span = parents[span];
+	}
+	return span;
+}
+
+void join_spans(int* parents, int span_0, int span_1)
+{
+	int root_0 = find_span_root(parents, span_0);
+	int root_1 = find_span_root(parents, span_1);
+	if(root_0 < root_1) parents[root_1] = root_0;
+	else if(root_1 < root_0) parents[root_0] = root_1;
+}
+
+//Number of the span covering (x, y), which must be a floor tile
+int find_span(connectivity_validator* validator, int x, int y)
+{
+	int word = y*validator->floor.words_per_row + x/64;
+	uint64_t starts_up_to_x = validator->span_starts.words[word] & (~(uint64_t)0 >> (63 - x%64));
+	return validator->word_spans[word] + __builtin_popcountll(starts_up_to_x) - 1;
+}
+
+//Every place floor of one rect touches another's was recorded as a contact when the later one was carved, so joining them gives the floor's components
+bool validate_contacts(connectivity_validator* validator, dungeon* d)
+{
+	int rect_count = d->room_count + d->corridor_count;
+	if(rect_count > validator->rect_capacity)
+	{
+		validator->rect_capacity = rect_count;
+		validator->rect_parents = (int*)realloc(validator->rect_parents, validator->rect_capacity*sizeof(int));
+	}
+	int* parents = validator->rect_parents;
+	memset(parents, -1, rect_count*sizeof(int));
+	for(int i = 0; i < d->contact_count; i++) join_spans(parents, d->contacts[i].corridor, d->contacts[i].rect);
+
+	//Joins keep the smaller index as the root, so a connected dungeon has every room under room 0
+	for(int r = 1; r < d->room_count; r++)
+	{
+		if(find_span_root(parents, r) != 0) return false;
+	}
+	return true;
+}
+
+//Union-find over horizontal runs of floor, worked out a word at a time rather than run by run
+//Runs are never listed explicitly: each run of overlap between a row and the row below joins the span above to the span below, both found by counting start bits
+bool validate_dungeon(connectivity_validator* validator, dungeon* d, const char* tiles, connectivity_stats* stats)
+{
+	if(!stats && d->contacts && tiles == d->tiles) return validate_contacts(validator, d);
+
+	int words_per_row = validator->floor.words_per_row;
+	uint64_t* floor = validator->floor.words;
+	uint64_t* starts = validator->span_starts.words;
+	int* parents = validator->span_parents;
+	bitgrid_from_tiles(&validator->floor, tiles, FLOOR);
+
+	//Number the spans
+	int span_count = 0;
+	for(int y = 0; y < validator->height; y++)
+	{
+		uint64_t* row = floor + y*words_per_row;
+		bool repeated = y > 0;
+		for(int w = 0; w < words_per_row && repeated; w++) repeated = row[w] == row[w - words_per_row];
+		if(repeated)
+		{
+			memcpy(starts + y*words_per_row, starts + (y - 1)*words_per_row, words_per_row*sizeof(uint64_t));
+			memcpy(validator->word_spans + y*words_per_row, validator->word_spans + (y - 1)*words_per_row, words_per_row*sizeof(int));
+			continue;
+		}
+		uint64_t carry = 0;
+		for(int w = 0; w < words_per_row; w++)
+		{
+			starts[y*words_per_row + w] = row[w] & ~((row[w] << 1) | carry);
+			carry = row[w] >> 63;
+			validator->word_spans[y*words_per_row + w] = span_count;
+			span_count += __builtin_popcountll(starts[y*words_per_row + w]);
+		}
+	}
+	memset(parents, -1, span_count*sizeof(int));
+
+	//Join spans that overlap the row below, repeated rows have nothing new to join
+	for(int y = 1; y < validator->height; y++)
+	{
+		uint64_t* row = floor + y*words_per_row;
+		if(validator->word_spans[y*words_per_row] == validator->word_spans[(y - 1)*words_per_row]) continue;
+		uint64_t carry = 0;
+		for(int w = 0; w < words_per_row; w++)
+		{
+			uint64_t overlap = row[w] & row[w - words_per_row];
+			uint64_t overlap_starts = overlap & ~((overlap << 1) | carry);
+			carry = overlap >> 63;
+			for(; overlap_starts; overlap_starts &= overlap_starts - 1)
+			{
+				int x = w*64 + __builtin_ctzll(overlap_starts);
+				join_spans(parents, find_span(validator, x, y - 1), find_span(validator, x, y));
+			}
+		}
+	}
+
+	if(d->room_count > validator->room_capacity)
+	{
+		validator->room_capacity = d->room_count;
+		validator->rooms = (tile_rect*)realloc(validator->rooms, validator->room_capacity*sizeof(tile_rect));
+	}
+	tile_rect* rooms = validator->rooms;
+	gather_room_rects(d->tree, rooms);
+
+	int reachable_rooms = 0;
+	int first_root = (d->room_count > 0) ? find_span_root(parents, find_span(validator, rooms[0].min_x, rooms[0].min_y)) : -1;
+	for(int r = 0; r < d->room_count; r++)
+	{
+		reachable_rooms += find_span_root(parents, find_span(validator, rooms[r].min_x, rooms[r].min_y)) == first_root;
+	}
+
+	if(stats)
+	{
+		stats->room_count = d->room_count;
+		stats->reachable_room_count = reachable_rooms;
+		stats->floor_tile_count = count_bits(&validator->floor);
+		stats->reachable_floor_tile_count = 0;
+		stats->component_count = 0;
+		stats->span_count = span_count;
+		for(int s = 0; s < span_count; s++) stats->component_count += parents[s] < 0;
+		for(int y = 0; y < validator->height; y++)
+		{
+			//Run lengths aren't kept, so pull them out of the row again
+			uint64_t* row = floor + y*words_per_row;
+			uint64_t carry = 0;
+			int start_count = 0;
+			int end_count = 0;
+			for(int w = 0; w < words_per_row; w++)
+			{
+				uint64_t shifted = (row[w] << 1) | carry;
+				uint64_t run_ends = ~row[w] & shifted;
+				carry = row[w] >> 63;
+				for(uint64_t run_starts = starts[y*words_per_row + w]; run_starts; run_starts &= run_starts - 1) validator->row_starts[start_count++] = w*64 + __builtin_ctzll(run_starts);
+				for(; run_ends; run_ends &= run_ends - 1) validator->row_ends[end_count++] = w*64 + __builtin_ctzll(run_ends);
+			}
+			if(end_count < start_count) validator->row_ends[end_count] = validator->width;
+			for(int i = 0; i < start_count; i++)
+			{
+				if(find_span_root(parents, validator->word_spans[y*words_per_row] + i) == first_root) stats->reachable_floor_tile_count += validator->row_ends[i] - validator->row_starts[i];
+			}
+		}
+	}
+	return reachable_rooms == d->room_count;
+}
+
+void print_connectivity_stats(connectivity_stats* stats)
+{
+	printf("Connectivity\n");
+	printf("Rooms reachable = %d/%d\n", stats->reachable_room_count, stats->room_count);
+	printf("Floor tiles reachable = %d/%d\n", stats->reachable_floor_tile_count, stats->floor_tile_count);
+	printf("Floor components = %d\n", stats->component_count);
+	printf("Floor spans = %d\n\n", stats->span_count);
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "dungeon.h"
+#include "bitgrid.h"
+
+struct connectivity_stats
+{
+	int room_count;
+	int reachable_room_count; //Rooms reachable from the first room
+	int floor_tile_count;
+	int reachable_floor_tile_count;
+	int component_count; //Separate groups of 4-connected floor tiles
+	int span_count; //Horizontal runs of floor tiles, not counting rows repeated from the row below
+};
+
+//Scratch space for validating dungeons of one size, keep one per thread so batches don't allocate per dungeon
+struct connectivity_validator
+{
+	int width;
+	int height;
+	bitgrid floor;
+	bitgrid span_starts; //Set on the first tile of each horizontal run of floor
+
+	//Spans are numbered row by row, a span's number is the word's first number plus the start bits before it in the word
+	//A row identical to the one below it reuses that row's spans
+	int* word_spans;
+	int* span_parents; //Union-find forest, negative for roots
+	int* row_starts; //Scratch for gathering span lengths
+	int* row_ends;
+
+	tile_rect* rooms;
+	int room_capacity;
+
+	//Union-find over rooms then corridors for dungeons that recorded their contacts
+	int* rect_parents;
+	int rect_capacity;
+};
+
+void create_connectivity_validator(connectivity_validator*, int width, int height);
+void destroy_connectivity_validator(connectivity_validator*);
+
+//Returns whether every room can be reached from every other, stats are only gathered when asked for
+//Without stats a dungeon that recorded its contacts while generating into tiles is checked from those alone, much cheaper than scanning the tiles
+bool validate_dungeon(connectivity_validator*, dungeon*, const char* tiles, connectivity_stats* stats = NULL);
+void print_connectivity_stats(connectivity_stats*);